@@ -0,0 +1,177 @@
+/*
+
+bench_codec.cpp
+---------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <random>
+#include <string>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <mailio/base64.hpp>
+#include <mailio/quoted_printable.hpp>
+#include <mailio/q_codec.hpp>
+
+
+using std::string;
+using std::vector;
+using std::mt19937;
+using mailio::codec;
+using mailio::base64;
+using mailio::quoted_printable;
+using mailio::q_codec;
+
+
+/**
+Making a text of about the given size out of lines of the given sample.
+
+@param sample Line to repeat, without the line ending.
+@param size   Size of the text.
+@return       Text with the lines separated by CRLF.
+**/
+static string make_text(const string& sample, string::size_type size)
+{
+    string text;
+    text.reserve(size + sample.length() + 2);
+    while (text.length() < size)
+        text += sample + "\r\n";
+    return text;
+}
+
+
+/**
+Mostly ASCII text, like a HTML newsletter, where the quoted printable encoder copies long runs as they are.
+**/
+static const string HTML_TEXT = make_text("<p style=\"margin:0;font-family:Arial\">Welcome to our weekly newsletter, here are the news of this week "
+    "and the offers for our subscribers.</p>", 1 << 20);
+
+
+/**
+Eight bit text, where the quoted printable encoder escapes most of the characters.
+**/
+static const string UTF8_TEXT = make_text("Ово је текст на ћирилици који се кодира скоро у потпуности, јер су сви карактери осмобитни.", 1 << 20);
+
+
+/**
+Making random binary data of the given size, the same on each run.
+
+@param size Size of the data.
+@return     Binary data.
+**/
+static string make_binary(string::size_type size)
+{
+    mt19937 generator(size);
+    string data(size, '\0');
+    for (auto& ch : data)
+        ch = static_cast<char>(generator());
+    return data;
+}
+
+
+/**
+Binary data, like an attachment.
+**/
+static const string BINARY_DATA = make_binary(1 << 20);
+
+
+/**
+Header value encoded into several encoded words.
+**/
+static const string SUBJECT = "Ово је наслов поруке који је довољно дугачак да се кодира у више речи, Ђорђе Ћирић";
+
+
+static void base64_encode(benchmark::State& state)
+{
+    base64 b64(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    for (auto _ : state)
+    {
+        string enc_text;
+        b64.encode(BINARY_DATA, enc_text);
+        benchmark::DoNotOptimize(enc_text);
+    }
+    state.SetBytesProcessed(state.iterations() * BINARY_DATA.length());
+}
+
+
+static void base64_decode(benchmark::State& state)
+{
+    base64 b64(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    const vector<string> enc_text = b64.encode(BINARY_DATA);
+    for (auto _ : state)
+    {
+        string dec_text = b64.decode(enc_text);
+        benchmark::DoNotOptimize(dec_text);
+    }
+    state.SetBytesProcessed(state.iterations() * BINARY_DATA.length());
+}
+
+
+static void qp_encode(benchmark::State& state, const string& text)
+{
+    quoted_printable qp(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    for (auto _ : state)
+    {
+        string enc_text;
+        qp.encode(text, enc_text);
+        benchmark::DoNotOptimize(enc_text);
+    }
+    state.SetBytesProcessed(state.iterations() * text.length());
+}
+
+
+static void qp_decode(benchmark::State& state, const string& text)
+{
+    // the soft break after an escaped character might exceed the recommended policy, so the decoder uses the mandatory one
+    quoted_printable qp(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::MANDATORY);
+    const vector<string> enc_text = qp.encode(text);
+    for (auto _ : state)
+    {
+        string dec_text = qp.decode(enc_text);
+        benchmark::DoNotOptimize(dec_text);
+    }
+    state.SetBytesProcessed(state.iterations() * text.length());
+}
+
+
+static void q_codec_encode(benchmark::State& state, codec::header_codec_t method)
+{
+    q_codec qc(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    for (auto _ : state)
+    {
+        vector<string> enc_text = qc.encode(SUBJECT, codec::CHARSET_UTF8, method);
+        benchmark::DoNotOptimize(enc_text);
+    }
+    state.SetBytesProcessed(state.iterations() * SUBJECT.length());
+}
+
+
+static void q_codec_decode(benchmark::State& state, codec::header_codec_t method)
+{
+    q_codec qc(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    // the encoded words are decoded together, as the header parser does
+    string enc_text;
+    for (const auto& word : qc.encode(SUBJECT, codec::CHARSET_UTF8, method))
+        enc_text += word;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(qc.check_decode(enc_text));
+    state.SetBytesProcessed(state.iterations() * SUBJECT.length());
+}
+
+
+BENCHMARK(base64_encode);
+BENCHMARK(base64_decode);
+BENCHMARK_CAPTURE(qp_encode, html, HTML_TEXT);
+BENCHMARK_CAPTURE(qp_encode, utf8, UTF8_TEXT);
+BENCHMARK_CAPTURE(qp_decode, html, HTML_TEXT);
+BENCHMARK_CAPTURE(qp_decode, utf8, UTF8_TEXT);
+BENCHMARK_CAPTURE(q_codec_encode, base64, codec::header_codec_t::BASE64);
+BENCHMARK_CAPTURE(q_codec_encode, quoted_printable, codec::header_codec_t::QUOTED_PRINTABLE);
+BENCHMARK_CAPTURE(q_codec_decode, base64, codec::header_codec_t::BASE64);
+BENCHMARK_CAPTURE(q_codec_decode, quoted_printable, codec::header_codec_t::QUOTED_PRINTABLE);
@@ -0,0 +1,297 @@
+/*
+
+bench_message.cpp
+-----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <list>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <benchmark/benchmark.h>
+#include <mailio/mime.hpp>
+#include <mailio/message.hpp>
+#include <mailio/batch_parser.hpp>
+
+
+using std::string;
+using std::list;
+using std::tuple;
+using std::istream;
+using std::istringstream;
+using std::ofstream;
+using std::size_t;
+using std::exception_ptr;
+using std::mt19937;
+using mailio::codec;
+using mailio::mime;
+using mailio::message;
+using mailio::mail_address;
+using mailio::batch_parser;
+
+
+/**
+Creating a message with the headers set, but without the content.
+
+@return Message with the headers.
+**/
+static message make_headers()
+{
+    message msg;
+    msg.from(mail_address("mailio", "adresa@mailio.dev"));
+    msg.add_recipient(mail_address("Tomislav Karastojkovic", "qwerty@gmail.com"));
+    msg.add_cc_recipient(mail_address("Tomislav Karastojkovic", "asdfg@zoho.com"));
+    msg.subject("Ово је наслов поруке");
+    msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+    return msg;
+}
+
+
+/**
+Creating a short plain text message.
+
+@return Small message.
+**/
+static message make_small()
+{
+    message msg = make_headers();
+    msg.content_transfer_encoding(mime::content_transfer_encoding_t::QUOTED_PRINTABLE);
+    msg.content("Hello, World!\r\nThis is a short message, as most of the messages are.\r\n");
+    return msg;
+}
+
+
+/**
+Creating a message with a HTML text and two binary attachments of a few megabytes.
+
+@return Large message.
+**/
+static message make_large()
+{
+    message msg = make_headers();
+    msg.content_type(message::media_type_t::TEXT, "html", "utf-8");
+    msg.content_transfer_encoding(mime::content_transfer_encoding_t::QUOTED_PRINTABLE);
+    string html;
+    while (html.length() < (1 << 16))
+        html += "<p>Welcome to our weekly newsletter, here are the news of this week and the offers for our subscribers.</p>\r\n";
+    msg.content(html);
+
+    mt19937 generator(1);
+    string data(3 << 20, '\0');
+    for (auto& ch : data)
+        ch = static_cast<char>(generator());
+    istringstream pdf_strm(data), png_strm(data.substr(0, 1 << 20));
+    list<tuple<istream&, string, message::content_type_t>> atts;
+    atts.push_back(tuple<istream&, string, message::content_type_t>(pdf_strm, "report.pdf",
+        message::content_type_t(message::media_type_t::APPLICATION, "pdf")));
+    atts.push_back(tuple<istream&, string, message::content_type_t>(png_strm, "chart.png",
+        message::content_type_t(message::media_type_t::IMAGE, "png")));
+    msg.attach(atts);
+    return msg;
+}
+
+
+/**
+Creating a message whose multipart parts are nested into each other.
+
+@return Deeply nested message.
+**/
+static message make_nested()
+{
+    const int NESTING_DEPTH = 32;
+
+    mime part;
+    part.content_type(mime::media_type_t::TEXT, "plain", "utf-8");
+    part.content("The innermost part.");
+    for (int level = NESTING_DEPTH; level > 0; level--)
+    {
+        mime text;
+        text.content_type(mime::media_type_t::TEXT, "plain", "utf-8");
+        text.content("Part of the level " + std::to_string(level) + ".");
+        mime multipart;
+        multipart.content_type(mime::media_type_t::MULTIPART, "mixed");
+        multipart.boundary("level" + std::to_string(level));
+        multipart.add_part(text);
+        multipart.add_part(part);
+        part = multipart;
+    }
+
+    message msg = make_headers();
+    msg.content_type(message::media_type_t::MULTIPART, "mixed");
+    msg.boundary("level0");
+    msg.add_part(part);
+    return msg;
+}
+
+
+/**
+Formatting the given message, so it can be parsed.
+
+@param msg Message to format.
+@return    Formatted message.
+**/
+static string format_message(const message& msg)
+{
+    string msg_str;
+    msg.format(msg_str);
+    return msg_str;
+}
+
+
+static void message_format(benchmark::State& state, message (*make)())
+{
+    const message msg = make();
+    string::size_type msg_len = 0;
+    for (auto _ : state)
+    {
+        string msg_str;
+        msg.format(msg_str);
+        msg_len = msg_str.length();
+        benchmark::DoNotOptimize(msg_str);
+    }
+    state.SetBytesProcessed(state.iterations() * msg_len);
+}
+
+
+static void message_parse(benchmark::State& state, message (*make)())
+{
+    const string msg_str = format_message(make());
+    for (auto _ : state)
+    {
+        message msg;
+        msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+        msg.parse(msg_str);
+        benchmark::DoNotOptimize(msg);
+    }
+    state.SetBytesProcessed(state.iterations() * msg_str.length());
+}
+
+
+static void message_parse_lazy(benchmark::State& state, message (*make)())
+{
+    const string msg_str = format_message(make());
+    for (auto _ : state)
+    {
+        message msg;
+        msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+        msg.lazy_decoding(true);
+        msg.parse(msg_str);
+        benchmark::DoNotOptimize(msg);
+    }
+    state.SetBytesProcessed(state.iterations() * msg_str.length());
+}
+
+
+/**
+Parsing the typical headers of an indexed message, the address lists, IDs and dates, and reporting the parsed headers per second.
+**/
+static void message_parse_headers(benchmark::State& state)
+{
+    const string headers_str = "From: \"Tomislav Karastojkovic\" <adresa@mailio.dev>\r\n"
+        "Sender: mailio <adresa@mailio.dev>\r\n"
+        "Reply-To: mailio <adresa@mailio.dev>\r\n"
+        "To: mailio <adresa@mailio.dev>, Tomislav Karastojkovic <qwerty@gmail.com>,\r\n"
+        "  undisclosed: qwerty@gmail.com, asdfg@zoho.com;\r\n"
+        "Cc: Tomislav Karastojkovic <asdfg@zoho.com>, zxcvb@yahoo.com\r\n"
+        "Message-ID: <1234567890@mailio.dev>\r\n"
+        "In-Reply-To: <1234567889@mailio.dev>\r\n"
+        "References: <1234567888@mailio.dev> <1234567889@mailio.dev>\r\n"
+        "Date: Fri, 17 Jan 2014 05:39:22 -0730\r\n"
+        "Subject: Hello, World!\r\n"
+        "X-Mailer: mailio\r\n"
+        "\r\n";
+    const int HEADERS_NO = 12;
+    for (auto _ : state)
+    {
+        message msg;
+        msg.strict_mode(true);
+        msg.parse(headers_str);
+        benchmark::DoNotOptimize(msg);
+    }
+    state.SetItemsProcessed(state.iterations() * HEADERS_NO);
+}
+
+
+/**
+Parsing the custom headers of a message sent through a few mail servers and filters, and the attributes of its content headers, and reporting
+the parsed headers per second.
+**/
+static void message_parse_custom_headers(benchmark::State& state)
+{
+    string headers_str = "From: mailio <adresa@mailio.dev>\r\n"
+        "To: mailio <adresa@mailio.dev>\r\n"
+        "Subject: Hello, World!\r\n"
+        "MIME-Version: 1.0\r\n"
+        "Content-Type: text/plain; charset=UTF-8; format=flowed; delsp=yes; name=\"report.txt\"\r\n"
+        "Content-Transfer-Encoding: 7bit\r\n"
+        "Content-Disposition: attachment; filename=\"report.txt\"; size=1024\r\n";
+    int headers_no = 7;
+    for (int hop = 0; hop < 8; hop++)
+    {
+        headers_str += "Received: from mx" + std::to_string(hop) + ".mailio.dev (mx" + std::to_string(hop) + ".mailio.dev [192.168.0." +
+            std::to_string(hop) + "]) by mailio.dev\r\n";
+        headers_str += "X-Spam-Score: " + std::to_string(hop) + "\r\n";
+        headers_str += "ARC-Seal: i=" + std::to_string(hop) + "; a=rsa-sha256; t=1389937162; cv=none\r\n";
+        headers_no += 3;
+    }
+    headers_str += "\r\n";
+
+    for (auto _ : state)
+    {
+        message msg;
+        msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+        msg.parse(headers_str);
+        benchmark::DoNotOptimize(msg);
+    }
+    state.SetItemsProcessed(state.iterations() * headers_no);
+}
+
+
+/**
+Parsing an mbox archive of small messages by the given number of workers, the throughput per worker is reported as a counter.
+**/
+static void batch_parse_mbox(benchmark::State& state)
+{
+    const string msg_str = format_message(make_small());
+    const string archive_path = "bench_batch.mbox";
+    {
+        ofstream ofs(archive_path, std::ios::binary);
+        for (int i = 0; i < 4096; i++)
+            ofs << "From adresa@mailio.dev Fri Jan 17 05:39:22 2014\r\n" << msg_str << "\r\n";
+    }
+
+    batch_parser parser(static_cast<unsigned>(state.range(0)));
+    batch_parser::batch_stat_t stat;
+    for (auto _ : state)
+    {
+        stat = parser.parse_mbox(archive_path, [](size_t, message& msg, exception_ptr) { benchmark::DoNotOptimize(msg); },
+            batch_parser::delivery_t::UNORDERED);
+    }
+    state.SetBytesProcessed(state.iterations() * stat.bytes);
+    state.counters["bytes_per_second_per_worker"] = stat.bytes_per_second_per_worker();
+}
+
+
+BENCHMARK_CAPTURE(message_format, small, make_small);
+BENCHMARK_CAPTURE(message_format, large, make_large);
+BENCHMARK_CAPTURE(message_format, nested, make_nested);
+BENCHMARK_CAPTURE(message_parse, small, make_small);
+BENCHMARK_CAPTURE(message_parse, large, make_large);
+BENCHMARK_CAPTURE(message_parse, nested, make_nested);
+BENCHMARK_CAPTURE(message_parse_lazy, small, make_small);
+BENCHMARK_CAPTURE(message_parse_lazy, large, make_large);
+BENCHMARK_CAPTURE(message_parse_lazy, nested, make_nested);
+BENCHMARK(message_parse_headers);
+BENCHMARK(message_parse_custom_headers);
+BENCHMARK(batch_parse_mbox)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
@@ -0,0 +1,159 @@
+/*
+
+bench_protocol.cpp
+------------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/io_context.hpp>
+#include <benchmark/benchmark.h>
+#include <mailio/imap.hpp>
+#include <mailio/smtp.hpp>
+
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::unique_ptr;
+using std::make_unique;
+using boost::asio::io_context;
+using boost::asio::ip::tcp;
+using boost::asio::ip::address_v4;
+using mailio::imap;
+using mailio::smtp;
+
+
+/**
+SMTP client exposing the reply parser.
+**/
+class smtp_parser : public smtp
+{
+public:
+
+    using smtp::parse_line;
+};
+
+
+/**
+IMAP client exposing the response parser.
+
+Since the client connects when created, the connection is accepted by the loopback listener, and no data is exchanged.
+**/
+class imap_parser : public imap
+{
+public:
+
+    imap_parser(unsigned port) : imap("127.0.0.1", port)
+    {
+    }
+
+    using imap::parse_response;
+    using imap::complete_literal;
+    using imap::reset_response_parser;
+};
+
+
+/**
+Listener on the loopback interface, so the IMAP client can connect.
+**/
+class loopback_listener
+{
+public:
+
+    loopback_listener() : acceptor_(ios_, tcp::endpoint(address_v4::loopback(), 0))
+    {
+    }
+
+    unsigned port() const
+    {
+        return acceptor_.local_endpoint().port();
+    }
+
+private:
+
+    io_context ios_;
+
+    tcp::acceptor acceptor_;
+};
+
+
+/**
+Making the untagged responses of a large FETCH of flags, sizes, dates and envelopes.
+
+@param messages_no Number of the fetched messages.
+@return            Responses without the untagged mark.
+**/
+static vector<string> make_fetch_responses(unsigned long messages_no)
+{
+    vector<string> responses;
+    for (unsigned long msg_no = 1; msg_no <= messages_no; msg_no++)
+        responses.push_back(to_string(msg_no) + " FETCH (UID " + to_string(msg_no + 1000) + " FLAGS (\\Seen \\Answered) RFC822.SIZE 4286 "
+            "INTERNALDATE \"17-Jul-1996 02:44:25 -0700\" ENVELOPE (\"Wed, 17 Jul 1996 02:23:25 -0700 (PDT)\" \"IMAP4rev1 WG mtg summary and "
+            "minutes\" ((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) ((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) "
+            "((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) ((NIL NIL \"imap\" \"cac.washington.edu\")) ((NIL NIL \"minutes\" "
+            "\"CNRI.Reston.VA.US\") (\"John Klensin\" NIL \"KLENSIN\" \"MIT.EDU\")) NIL NIL \"<B27397-0100000@cac.washington.edu>\"))");
+    return responses;
+}
+
+
+static void imap_parse_response_envelopes(benchmark::State& state)
+{
+    loopback_listener listener;
+    imap_parser parser(listener.port());
+    const vector<string> responses = make_fetch_responses(1000);
+    string::size_type responses_len = 0;
+    for (const auto& response : responses)
+        responses_len += response.length();
+
+    for (auto _ : state)
+        for (const auto& response : responses)
+        {
+            parser.reset_response_parser();
+            parser.parse_response(response);
+        }
+    state.SetBytesProcessed(state.iterations() * responses_len);
+}
+
+
+static void imap_parse_response_literal(benchmark::State& state)
+{
+    loopback_listener listener;
+    imap_parser parser(listener.port());
+    const string literal(4 << 20, 'x');
+    const string response = "1 FETCH (UID 1001 RFC822 {" + to_string(literal.length()) + "}";
+
+    for (auto _ : state)
+    {
+        parser.reset_response_parser();
+        parser.parse_response(response);
+        parser.complete_literal(literal);
+        parser.parse_response(")");
+    }
+    state.SetBytesProcessed(state.iterations() * literal.length());
+}
+
+
+static void smtp_parse_line(benchmark::State& state)
+{
+    const vector<string> replies = {"250-mailio.dev Hello", "250-PIPELINING", "250-SIZE 35882577", "250-8BITMIME", "250-AUTH LOGIN PLAIN XOAUTH2",
+        "250-ENHANCEDSTATUSCODES", "250 SMTPUTF8", "354 Go ahead", "250 2.0.0 OK 1531144380 queued"};
+    for (auto _ : state)
+        for (const auto& reply : replies)
+            benchmark::DoNotOptimize(smtp_parser::parse_line(reply));
+    state.SetItemsProcessed(state.iterations() * replies.size());
+}
+
+
+BENCHMARK(imap_parse_response_envelopes);
+BENCHMARK(imap_parse_response_literal);
+BENCHMARK(smtp_parse_line);
@@ -0,0 +1,279 @@
+/*
+
+bench_session.cpp
+-----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <mailio/message.hpp>
+#include <mailio/smtp.hpp>
+#include <mailio/imap.hpp>
+#include <mailio/pop3.hpp>
+#include "mock_server.hpp"
+
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::list;
+using std::unique_ptr;
+using std::make_unique;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using std::micro;
+using mailio::codec;
+using mailio::message;
+using mailio::mail_address;
+using mailio::smtp;
+using mailio::smtps;
+using mailio::imap;
+using mailio::imaps;
+using mailio::pop3;
+using mailio::pop3s;
+using mailio::mock_smtp;
+using mailio::mock_imap;
+using mailio::mock_pop3;
+
+
+/**
+Number of the messages in the mailbox of the mock servers.
+**/
+static const unsigned long MAILBOX_SIZE = 100;
+
+
+/**
+Flag if the client connects over TLS, so the mock server has to use it as well.
+**/
+template<typename Client>
+static constexpr bool USES_TLS = std::is_same<Client, smtps>::value || std::is_same<Client, imaps>::value || std::is_same<Client, pop3s>::value;
+
+
+/**
+Collecting the latencies of the operations, so their percentiles are reported besides the throughput.
+**/
+class latency_recorder
+{
+public:
+
+    /**
+    Marking the beginning of an operation.
+    **/
+    void start()
+    {
+        start_ = steady_clock::now();
+    }
+
+    /**
+    Marking the end of the operation started last.
+    **/
+    void stop()
+    {
+        samples_.push_back(duration<double, micro>(steady_clock::now() - start_).count());
+    }
+
+    /**
+    Reporting the number of operations per second and the latency percentiles in microseconds.
+
+    @param state Benchmark state to report to.
+    **/
+    void report(benchmark::State& state)
+    {
+        state.SetItemsProcessed(samples_.size());
+        if (samples_.empty())
+            return;
+        std::sort(samples_.begin(), samples_.end());
+        auto percentile = [this](double p) { return samples_[static_cast<vector<double>::size_type>(p * (samples_.size() - 1))]; };
+        state.counters["p50_us"] = percentile(0.50);
+        state.counters["p90_us"] = percentile(0.90);
+        state.counters["p99_us"] = percentile(0.99);
+    }
+
+private:
+
+    steady_clock::time_point start_;
+
+    vector<double> samples_;
+};
+
+
+/**
+Creating a message of a typical size, with a few kilobytes of text.
+
+@return Message to send.
+**/
+static message make_message()
+{
+    message msg;
+    msg.from(mail_address("mailio", "adresa@mailio.dev"));
+    msg.add_recipient(mail_address("Tomislav Karastojkovic", "qwerty@gmail.com"));
+    msg.subject("Weekly report");
+    msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+    string text;
+    while (text.length() < (4 << 10))
+        text += "This is the line of the weekly report which is repeated to get a message of a typical size.\r\n";
+    msg.content(text);
+    return msg;
+}
+
+
+/**
+Creating the mailbox of the mock servers.
+
+@return Formatted messages.
+**/
+static vector<string> make_mailbox()
+{
+    string msg_str;
+    make_message().format(msg_str);
+    return vector<string>(MAILBOX_SIZE, msg_str);
+}
+
+
+/**
+Connecting to the mock server and logging in.
+
+@param port Port of the mock server.
+@return     Authenticated client.
+**/
+template<typename Client>
+static unique_ptr<Client> login(unsigned port)
+{
+    auto client = make_unique<Client>("127.0.0.1", port);
+    client->authenticate("mailio", "qwerty", Client::auth_method_t::LOGIN);
+    return client;
+}
+
+
+template<typename Client>
+static void session_smtp_login(benchmark::State& state)
+{
+    mock_smtp server(USES_TLS<Client>);
+    latency_recorder latency;
+    for (auto _ : state)
+    {
+        latency.start();
+        login<Client>(server.port());
+        latency.stop();
+    }
+    latency.report(state);
+}
+
+
+template<typename Client>
+static void session_smtp_submit(benchmark::State& state)
+{
+    mock_smtp server(USES_TLS<Client>);
+    auto client = login<Client>(server.port());
+    const message msg = make_message();
+    latency_recorder latency;
+    for (auto _ : state)
+    {
+        latency.start();
+        client->submit(msg);
+        latency.stop();
+    }
+    latency.report(state);
+}
+
+
+template<typename Client>
+static void session_imap_fetch(benchmark::State& state)
+{
+    mock_imap server(USES_TLS<Client>, make_mailbox());
+    auto client = login<Client>(server.port());
+    client->select("INBOX");
+    latency_recorder latency;
+    unsigned long msg_no = 0;
+    for (auto _ : state)
+    {
+        message msg;
+        msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+        latency.start();
+        client->fetch(msg_no++ % MAILBOX_SIZE + 1, msg);
+        latency.stop();
+    }
+    latency.report(state);
+}
+
+
+template<typename Client>
+static void session_imap_search(benchmark::State& state)
+{
+    mock_imap server(USES_TLS<Client>, make_mailbox());
+    auto client = login<Client>(server.port());
+    client->select("INBOX");
+    const list<imap::search_condition_t> conditions = {imap::search_condition_t(imap::search_condition_t::ALL)};
+    latency_recorder latency;
+    for (auto _ : state)
+    {
+        list<unsigned long> results;
+        latency.start();
+        client->search(conditions, results);
+        latency.stop();
+    }
+    latency.report(state);
+}
+
+
+template<typename Client>
+static void session_imap_append(benchmark::State& state)
+{
+    mock_imap server(USES_TLS<Client>, make_mailbox());
+    auto client = login<Client>(server.port());
+    const message msg = make_message();
+    latency_recorder latency;
+    for (auto _ : state)
+    {
+        latency.start();
+        client->append("INBOX", msg);
+        latency.stop();
+    }
+    latency.report(state);
+}
+
+
+template<typename Client>
+static void session_pop3_fetch(benchmark::State& state)
+{
+    mock_pop3 server(USES_TLS<Client>, make_mailbox());
+    auto client = login<Client>(server.port());
+    latency_recorder latency;
+    unsigned long msg_no = 0;
+    for (auto _ : state)
+    {
+        message msg;
+        msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+        latency.start();
+        client->fetch(msg_no++ % MAILBOX_SIZE + 1, msg);
+        latency.stop();
+    }
+    latency.report(state);
+}
+
+
+BENCHMARK_TEMPLATE(session_smtp_login, smtp)->UseRealTime();
+BENCHMARK_TEMPLATE(session_smtp_login, smtps)->UseRealTime();
+BENCHMARK_TEMPLATE(session_smtp_submit, smtp)->UseRealTime();
+BENCHMARK_TEMPLATE(session_smtp_submit, smtps)->UseRealTime();
+BENCHMARK_TEMPLATE(session_imap_fetch, imap)->UseRealTime();
+BENCHMARK_TEMPLATE(session_imap_fetch, imaps)->UseRealTime();
+BENCHMARK_TEMPLATE(session_imap_search, imap)->UseRealTime();
+BENCHMARK_TEMPLATE(session_imap_search, imaps)->UseRealTime();
+BENCHMARK_TEMPLATE(session_imap_append, imap)->UseRealTime();
+BENCHMARK_TEMPLATE(session_imap_append, imaps)->UseRealTime();
+BENCHMARK_TEMPLATE(session_pop3_fetch, pop3)->UseRealTime();
+BENCHMARK_TEMPLATE(session_pop3_fetch, pop3s)->UseRealTime();
@@ -0,0 +1,78 @@
+/*
+
+imaps_async_fetch.cpp
+---------------------
+
+Connects to IMAP server, then selects a mailbox and fetches the message headers without blocking, by running the connection context.
+
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <exception>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include <mailio/imap.hpp>
+
+
+using mailio::message;
+using mailio::codec;
+using mailio::imaps;
+using mailio::imap_error;
+using mailio::dialog_error;
+using std::cout;
+using std::endl;
+using std::exception_ptr;
+using std::list;
+using std::make_shared;
+using std::map;
+using std::rethrow_exception;
+using std::string;
+
+
+int main()
+{
+    try
+    {
+        auto ios = make_shared<boost::asio::io_context>();
+        imaps conn("imap.zoho.com", 993, std::chrono::milliseconds(10000), ios);
+        // modify username/password to use real credentials
+        conn.authenticate("mailio@zoho.com", "mailiopass", imaps::auth_method_t::LOGIN);
+        conn.async_select("inbox", true, [&conn](exception_ptr exc, imaps::mailbox_stat_t stat)
+        {
+            if (exc)
+                rethrow_exception(exc);
+            cout << "Number of messages: " << stat.messages_no << endl;
+
+            list<imaps::messages_range_t> range{imaps::messages_range_t(1, std::nullopt)};
+            conn.async_fetch(range, false, true, codec::line_len_policy_t::RECOMMENDED, [](exception_ptr exc, map<unsigned long, message> msgs)
+            {
+                if (exc)
+                    rethrow_exception(exc);
+                for (const auto& msg : msgs)
+                    cout << msg.first << ": " << msg.second.subject() << endl;
+            });
+        });
+        // all the completion handlers are called from here
+        ios->run();
+    }
+    catch (imap_error& exc)
+    {
+        cout << exc.what() << endl;
+    }
+    catch (dialog_error& exc)
+    {
+        cout << exc.what() << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
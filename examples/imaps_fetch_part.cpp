@@ -0,0 +1,78 @@
+/*
+
+imaps_fetch_part.cpp
+--------------------
+
+Connects to IMAP server, fetches the structure of the first message, and downloads only the beginning of its first plain text part, without
+marking the message as seen.
+
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <mailio/imap.hpp>
+
+
+using mailio::mime;
+using mailio::imaps;
+using mailio::imap_error;
+using mailio::dialog_error;
+using std::cout;
+using std::endl;
+using std::function;
+using std::list;
+using std::map;
+using std::string;
+
+
+int main()
+{
+    try
+    {
+        imaps conn("imap.zoho.com", 993);
+        // modify username/password to use real credentials
+        conn.authenticate("mailio@zoho.com", "mailiopass", imaps::auth_method_t::LOGIN);
+        conn.select("inbox");
+
+        map<unsigned long, imaps::message_info_t> infos;
+        conn.fetch_info({imaps::messages_range_t(1, 1)}, imaps::message_info_t::BODY_STRUCTURE, infos);
+        if (infos.empty())
+            return EXIT_SUCCESS;
+
+        const imaps::body_structure_t* text_part = nullptr;
+        function<void (const imaps::body_structure_t&)> find_text = [&text_part, &find_text](const imaps::body_structure_t& body)
+        {
+            if (text_part == nullptr && body.media_type == "text" && body.media_subtype == "plain")
+                text_part = &body;
+            for (const auto& part : body.parts)
+                find_text(part);
+        };
+        find_text(infos.begin()->second.body_structure);
+        if (text_part == nullptr)
+            return EXIT_SUCCESS;
+
+        mime part;
+        conn.fetch_part(1, *text_part, part, false, 0, 4096);
+        cout << "Section " << text_part->section << " of " << text_part->size << " octets begins with:" << endl << part.content() << endl;
+    }
+    catch (imap_error& exc)
+    {
+        cout << exc.what() << endl;
+    }
+    catch (dialog_error& exc)
+    {
+        cout << exc.what() << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
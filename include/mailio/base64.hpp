@@ -18,7 +18,9 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #pragma warning(disable:4251)
 #endif
 
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "codec.hpp"
 #include "export.hpp"
@@ -41,7 +43,112 @@ public:
     Base64 character set.
     **/
     static const std::string CHARSET;
-    
+
+    /**
+    Encoder which takes the text in chunks of any size and passes each encoded line to the sink as soon as it is complete.
+    **/
+    class MAILIO_EXPORT encoder_t
+    {
+    public:
+
+        /**
+        Starting the encoding.
+
+        @param codec    Codec whose line policy is applied.
+        @param sink     Receiver of the encoded lines.
+        @param reserved Number of characters to subtract from the line policy.
+        **/
+        encoder_t(const base64& codec, sink_t sink, std::string::size_type reserved = 0);
+
+        /**
+        Encoding the next chunk of the text.
+
+        @param chunk Chunk to encode.
+        **/
+        void feed(const std::string& chunk);
+
+        /**
+        Encoding the rest of the text together with the padding.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Encoding the full group of three characters, and passing the line to the sink if it reached the line policy.
+
+        @param chars Characters of the group.
+        **/
+        void encode_group(const unsigned char* chars);
+
+        /**
+        Receiver of the encoded lines.
+        **/
+        sink_t sink_;
+
+        /**
+        Maximum length of a line.
+        **/
+        const std::string::size_type line_len_max_;
+
+        /**
+        Line being encoded.
+        **/
+        std::string line_;
+
+        /**
+        Characters of the last incomplete three character group.
+        **/
+        std::string group_;
+    };
+
+    /**
+    Decoder which takes the text line by line and passes the decoded text to the sink by blocks.
+    **/
+    class MAILIO_EXPORT decoder_t
+    {
+    public:
+
+        /**
+        Starting the decoding.
+
+        @param codec Codec whose line policy is applied, it must outlive the decoder.
+        @param sink  Receiver of the decoded text.
+        **/
+        decoder_t(const base64& codec, sink_t sink);
+
+        /**
+        Decoding the next line.
+
+        @param line        Base64 encoded line.
+        @throw codec_error Bad line policy.
+        @throw codec_error Bad character.
+        **/
+        void feed(std::string_view line);
+
+        /**
+        Finishing the decoding by passing the rest of the decoded text to the sink.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Codec whose line policy is applied.
+        **/
+        const base64& codec_;
+
+        /**
+        Receiver of the decoded text.
+        **/
+        sink_t sink_;
+
+        /**
+        Decoded text not yet passed to the sink.
+        **/
+        std::string dec_text_;
+    };
+
     /**
     Setting the encoder and decoder line policy.
 
@@ -73,6 +180,17 @@ public:
     **/
     std::vector<std::string> encode(const std::string& text, std::string::size_type reserved = 0) const;
 
+    /**
+    Encoding a string by applying the line policy, and appending the encoded lines together with their line endings to the given string.
+
+    The capacity of the given string is reserved beforehand, so the encoding allocates at most once.
+
+    @param text     String to encode.
+    @param enc_text String to append the encoded lines to.
+    @param reserved Number of characters to subtract from the line policy.
+    **/
+    void encode(const std::string& text, std::string& enc_text, std::string::size_type reserved = 0) const;
+
     /**
     Decoding a vector of Base64 encoded strings to string by applying the line policy.
 
@@ -94,6 +212,11 @@ public:
 
 private:
 
+    /**
+    Values of the characters from the character set, indexed by the character code. Other characters have the value -1.
+    **/
+    static const std::array<int, 256> DECODE_TABLE;
+
     /**
     Checking if the given character is in the base64 character set.
 
@@ -0,0 +1,275 @@
+/*
+
+batch_parser.hpp
+----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapped_text.hpp"
+#include "mbox.hpp"
+#include "message.hpp"
+#include "export.hpp"
+
+
+namespace mailio
+{
+
+
+/**
+Parsing the messages of an mbox archive or a Maildir directory in parallel.
+
+The messages are distributed among the queues of the worker threads, and a worker which runs out of messages steals them from the others.
+Each message is parsed into its own copy of the prototype message, so the parsing settings are taken from it. The parsing keeps no state
+shared among the messages, except the constant regular expressions which are safe to use concurrently.
+**/
+class MAILIO_EXPORT batch_parser
+{
+public:
+
+    /**
+    Order of delivering the parsed messages.
+    **/
+    enum class delivery_t {ORDERED, UNORDERED};
+
+    /**
+    Handler of a parsed message, called with the index of the message in the batch, the message, and the parsing error if any.
+
+    In case of the error, the message is parsed only partially.
+    **/
+    typedef std::function<void(std::size_t, message&, std::exception_ptr)> message_handler_t;
+
+    /**
+    Statistics of a worker thread.
+    **/
+    struct worker_stat_t
+    {
+        /**
+        Number of parsed messages.
+        **/
+        std::size_t messages;
+
+        /**
+        Number of messages stolen from the other workers.
+        **/
+        std::size_t stolen;
+
+        /**
+        Size of the parsed messages in bytes.
+        **/
+        std::size_t bytes;
+
+        /**
+        Time spent in parsing and delivering the messages.
+        **/
+        std::chrono::steady_clock::duration busy;
+
+        /**
+        Setting all the counters to zero.
+        **/
+        worker_stat_t() : messages(0), stolen(0), bytes(0), busy(0)
+        {
+        }
+    };
+
+    /**
+    Statistics of a batch.
+    **/
+    struct batch_stat_t
+    {
+        /**
+        Number of messages in the batch.
+        **/
+        std::size_t messages;
+
+        /**
+        Number of messages which failed to parse.
+        **/
+        std::size_t failures;
+
+        /**
+        Size of the messages in bytes.
+        **/
+        std::size_t bytes;
+
+        /**
+        Time of the whole batch.
+        **/
+        std::chrono::steady_clock::duration elapsed;
+
+        /**
+        Statistics of each worker.
+        **/
+        std::vector<worker_stat_t> workers;
+
+        /**
+        Setting all the counters to zero.
+        **/
+        batch_stat_t() : messages(0), failures(0), bytes(0), elapsed(0)
+        {
+        }
+
+        /**
+        Calculating the throughput of the batch divided among the workers.
+
+        @return Bytes per second per worker, zero if nothing is parsed.
+        **/
+        double bytes_per_second_per_worker() const;
+    };
+
+    /**
+    Setting the number of workers.
+
+    @param workers Number of worker threads, if zero then the number of hardware threads is used.
+    **/
+    explicit batch_parser(unsigned workers = 0);
+
+    batch_parser(const batch_parser&) = delete;
+
+    batch_parser(batch_parser&&) = delete;
+
+    ~batch_parser() = default;
+
+    void operator=(const batch_parser&) = delete;
+
+    void operator=(batch_parser&&) = delete;
+
+    /**
+    Setting the message whose copies are parsed, so the settings like line policy or lazy decoding apply to all the messages.
+
+    @param msg Prototype message.
+    **/
+    void prototype(const message& msg);
+
+    /**
+    Getting the number of workers.
+
+    @return Number of worker threads.
+    **/
+    unsigned workers() const;
+
+    /**
+    Parsing the messages of an mbox archive.
+
+    @param file_path Path of the archive.
+    @param handler   Handler of the parsed messages.
+    @param delivery  Order of delivering the messages.
+    @return          Statistics of the batch.
+    @throw *         `mbox::mbox(const std::string&)`, `parse(std::vector<task_t>&, const message_handler_t&, delivery_t)`.
+    **/
+    batch_stat_t parse_mbox(const std::string& file_path, const message_handler_t& handler, delivery_t delivery = delivery_t::ORDERED);
+
+    /**
+    Parsing the messages of a Maildir directory, found in its `cur` and `new` subdirectories.
+
+    The messages are indexed in the order of their file names, so the `new` ones go after the `cur` ones.
+
+    @param dir_path           Path of the Maildir directory.
+    @param handler            Handler of the parsed messages.
+    @param delivery           Order of delivering the messages.
+    @return                   Statistics of the batch.
+    @throw batch_parser_error Not a Maildir directory.
+    @throw *                  `parse(std::vector<task_t>&, const message_handler_t&, delivery_t)`.
+    **/
+    batch_stat_t parse_maildir(const std::string& dir_path, const message_handler_t& handler, delivery_t delivery = delivery_t::ORDERED);
+
+private:
+
+    /**
+    Message to parse.
+    **/
+    struct task_t
+    {
+        /**
+        Index of the message in the batch.
+        **/
+        std::size_t index;
+
+        /**
+        Text of the message, if it's already mapped.
+        **/
+        mapped_text text;
+
+        /**
+        Path of the message file to map by the worker, if the text is not mapped.
+        **/
+        std::string file_path;
+    };
+
+    /**
+    Parsing the given messages by the workers, and delivering them to the handler.
+
+    The first exception thrown by the handler stops the workers.
+
+    @param tasks    Messages to parse.
+    @param handler  Handler of the parsed messages.
+    @param delivery Order of delivering the messages.
+    @return         Statistics of the batch.
+    @throw *        Exception thrown by the handler.
+    **/
+    batch_stat_t parse(std::vector<task_t>& tasks, const message_handler_t& handler, delivery_t delivery) const;
+
+    /**
+    Number of worker threads.
+    **/
+    unsigned workers_;
+
+    /**
+    Message whose copies are parsed.
+    **/
+    message prototype_;
+};
+
+
+/**
+Exception reported by `batch_parser` class.
+**/
+class batch_parser_error : public std::runtime_error
+{
+public:
+
+    /**
+    Calling parent constructor.
+
+    @param msg Error message.
+    **/
+    explicit batch_parser_error(const std::string& msg) : std::runtime_error(msg)
+    {
+    }
+
+    /**
+    Calling parent constructor.
+
+    @param msg Error message.
+    **/
+    explicit batch_parser_error(const char* msg) : std::runtime_error(msg)
+    {
+    }
+};
+
+
+} // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
@@ -13,7 +13,13 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 #pragma once
 
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
 #include <string>
+#include <string_view>
 #include <vector>
 #include "codec.hpp"
 #include "export.hpp"
@@ -52,6 +58,76 @@ public:
 
     void operator=(binary&&) = delete;
 
+    /**
+    Encoder which passes each chunk of the text to the sink unchanged, since binary data is not split into lines.
+    **/
+    class MAILIO_EXPORT encoder_t
+    {
+    public:
+
+        /**
+        Starting the encoding.
+
+        @param codec Codec to apply.
+        @param sink  Receiver of the chunks.
+        **/
+        encoder_t(const binary& codec, sink_t sink);
+
+        /**
+        Passing the next chunk of the text.
+
+        @param chunk Chunk to encode.
+        **/
+        void feed(const std::string& chunk);
+
+        /**
+        Finishing the encoding, nothing is left to encode.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Receiver of the chunks.
+        **/
+        sink_t sink_;
+    };
+
+    /**
+    Decoder which takes the text line by line and passes each line to the sink together with the line ending.
+    **/
+    class MAILIO_EXPORT decoder_t
+    {
+    public:
+
+        /**
+        Starting the decoding.
+
+        @param codec Codec to apply.
+        @param sink  Receiver of the decoded text.
+        **/
+        decoder_t(const binary& codec, sink_t sink);
+
+        /**
+        Decoding the next line.
+
+        @param line Encoded line.
+        **/
+        void feed(std::string_view line);
+
+        /**
+        Finishing the decoding, nothing is left to decode.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Receiver of the decoded text.
+        **/
+        sink_t sink_;
+    };
+
     /**
     Encoding a string into vector of binary encoded strings.
 
@@ -74,3 +150,8 @@ private:
 
 
 } // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
@@ -13,8 +13,13 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 #pragma once
 
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include "codec.hpp"
 #include "export.hpp"
@@ -53,6 +58,111 @@ public:
 
     void operator=(bit8&&) = delete;
 
+    /**
+    Encoder which takes the text in chunks of any size and passes each encoded line to the sink as soon as it is complete.
+    **/
+    class MAILIO_EXPORT encoder_t
+    {
+    public:
+
+        /**
+        Starting the encoding.
+
+        @param codec Codec whose line policy and character set are applied, it must outlive the encoder.
+        @param sink  Receiver of the encoded lines.
+        **/
+        encoder_t(const bit8& codec, sink_t sink);
+
+        /**
+        Encoding the next chunk of the text.
+
+        @param chunk       Chunk to encode.
+        @throw codec_error Bad character.
+        **/
+        void feed(const std::string& chunk);
+
+        /**
+        Passing the last line to the sink.
+
+        @throw codec_error Bad character.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Codec whose line policy and character set are applied.
+        **/
+        const bit8& codec_;
+
+        /**
+        Receiver of the encoded lines.
+        **/
+        sink_t sink_;
+
+        /**
+        Line being encoded.
+        **/
+        std::string line_;
+
+        /**
+        Flag if the previous chunk ended with the carriage return.
+        **/
+        bool pending_cr_;
+
+        /**
+        Number of the empty lines held back.
+        **/
+        std::string::size_type empty_lines_;
+    };
+
+    /**
+    Decoder which takes the text line by line and passes the decoded text to the sink.
+    **/
+    class MAILIO_EXPORT decoder_t
+    {
+    public:
+
+        /**
+        Starting the decoding.
+
+        @param codec Codec whose line policy and character set are applied, it must outlive the decoder.
+        @param sink  Receiver of the decoded text.
+        **/
+        decoder_t(const bit8& codec, sink_t sink);
+
+        /**
+        Decoding the next line.
+
+        @param line        Encoded line.
+        @throw codec_error Line policy overflow.
+        @throw codec_error Bad character.
+        **/
+        void feed(std::string_view line);
+
+        /**
+        Finishing the decoding, the trailing whitespace is dropped.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Codec whose line policy and character set are applied.
+        **/
+        const bit8& codec_;
+
+        /**
+        Receiver of the decoded text.
+        **/
+        sink_t sink_;
+
+        /**
+        Decoded text not yet passed to the sink.
+        **/
+        std::string dec_text_;
+    };
+
     /**
     Encoding a string into vector of 8bit encoded strings by applying the line policy.
 
@@ -87,3 +197,6 @@ private:
 } // namespace mailio
 
 
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
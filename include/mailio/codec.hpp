@@ -18,6 +18,7 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #pragma warning(disable:4251)
 #endif
 
+#include <functional>
 #include <string>
 #include <stdexcept>
 #include <boost/algorithm/string.hpp>
@@ -475,6 +476,11 @@ public:
     **/
     enum class header_codec_t {BASE64, QUOTED_PRINTABLE, UTF8};
 
+    /**
+    Receiver of the streamed codec output, called with each encoded line or with each decoded part of the text.
+    **/
+    typedef std::function<void(const std::string&)> sink_t;
+
     /**
     Setting the encoder and decoder line policy of the codec.
 
@@ -512,6 +518,30 @@ public:
 
 protected:
 
+    /**
+    Passing an encoded line to the sink, but holding back the empty lines until a non empty one arrives, so the empty lines at the end of
+    the encoded text are dropped.
+
+    @param line        Encoded line to pass.
+    @param empty_lines Number of the empty lines held back so far.
+    @param sink        Receiver of the encoded lines.
+    **/
+    static void pass_line(const std::string& line, std::string::size_type& empty_lines, const sink_t& sink);
+
+    /**
+    Passing the collected decoded text to the sink, but keeping its trailing whitespace until more text arrives, so the whitespace at the
+    end of the decoded text is trimmed.
+
+    @param dec_text Decoded text collected so far, left with its trailing whitespace only.
+    @param sink     Receiver of the decoded text.
+    **/
+    static void pass_trimmed(std::string& dec_text, const sink_t& sink);
+
+    /**
+    Length of the decoded text collected by a decoder before it is passed to the sink.
+    **/
+    static const std::string::size_type DECODER_BUFFER_SIZE = 65536;
+
     /**
     Encoder line length policy.
     **/
@@ -17,6 +17,11 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <stdexcept>
 #include <chrono>
 #include <memory>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/streambuf.hpp>
@@ -42,10 +47,18 @@ public:
     @param hostname     Server hostname.
     @param port         Server port.
     @param timeout      Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios          Asio context to run the I/O on. If null, then the connection creates its own context. A shared context lets many
+                        dialogs run their non-blocking operations on a single thread which calls `io_context::run()`, so a context per core
+                        serves many connections. A blocking operation with a timeout drives the context by itself: it runs the pending
+                        handlers of the other dialogs, and restarts the context if it is stopped. Thus the blocking operations must not be
+                        mixed with `io_context::run()` on a shared context, nor called from its handlers, nor called while another thread
+                        runs it. The non-blocking operations of a dialog share its timeout timer without a strand, so the context must be
+                        run by a single thread.
     @throw dialog_error Server connecting failed.
     @throw *             `connect_async()`.
     **/
-    dialog(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout);
+    dialog(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout,
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Copy constructor.
@@ -67,13 +80,30 @@ public:
 
     virtual void connect();
 
+    /**
+    Closing the connection, so the dialog cannot be used anymore.
+    **/
+    void close();
+
     /**
     Sending a line to network synchronously or asynchronously, depending of the timeout value.
 
+    The line and CRLF are sent by a single gathered write, so the line is not copied.
+
     @param line Line to send.
-    @throw *    `send_sync<Socket>(Socket&, const std::string&)`, `send_async<Socket>(Socket&, const std::string&)`.
+    @param raw  Flag if the line is sent as it is (no CRLF is appended) or not.
+    @throw *    `send(const std::vector<boost::asio::const_buffer>&)`.
     **/
-    virtual void send(const std::string& line);
+    void send(const std::string& line, bool raw = false);
+
+    /**
+    Sending the buffers to network by a single gathered write, synchronously or asynchronously depending of the timeout value.
+
+    @param buffers Buffers to send in the given order.
+    @throw *       `send_sync<Socket>(Socket&, const std::vector<boost::asio::const_buffer>&)`,
+                   `send_async<Socket>(Socket&, const std::vector<boost::asio::const_buffer>&)`.
+    **/
+    virtual void send(const std::vector<boost::asio::const_buffer>& buffers);
 
     /**
     Receiving a line from network.
@@ -84,17 +114,72 @@ public:
     **/
     virtual std::string receive(bool raw = false);
 
+    /**
+    Receiving exactly the given number of octets, regardless of the line endings.
+
+    The octets already buffered by the line receiving are used first, the rest is read in large chunks.
+
+    @param bytes Number of octets to receive.
+    @return      Octets received.
+    @throw *     `receive_bytes_sync<Socket>(Socket&, std::size_t)`, `receive_bytes_async<Socket>(Socket&, std::size_t)`.
+    **/
+    virtual std::string receive_bytes(std::size_t bytes);
+
+    /**
+    Getting the Asio context the connection runs on.
+
+    @return Asio context of the connection.
+    **/
+    std::shared_ptr<boost::asio::io_context> io_context() const;
+
+    /**
+    Sending a line to network without blocking.
+
+    The handler is called from the connection context, so the context has to be run by the caller from a single thread. The dialog must not
+    be used by another operation until the handler is called. The line and CRLF are sent by a single gathered write.
+
+    @param line    Line to send.
+    @param handler Called with the `dialog_error` exception if sending failed or timed out, null pointer otherwise.
+    **/
+    void async_send(const std::string& line, std::function<void (std::exception_ptr)> handler);
+
+    /**
+    Sending the buffers to network by a single gathered write, without blocking.
+
+    The buffers must stay valid until the handler is called.
+
+    @param buffers Buffers to send in the given order.
+    @param handler Completion handler as described by `async_send(const std::string&, std::function<void (std::exception_ptr)>)`.
+    **/
+    virtual void async_send(const std::vector<boost::asio::const_buffer>& buffers, std::function<void (std::exception_ptr)> handler);
+
+    /**
+    Receiving a line from network without blocking.
+
+    @param raw     Flag if the receiving is raw (no CRLF is truncated) or not.
+    @param handler Called with the `dialog_error` exception if receiving failed or timed out, null pointer and the line otherwise.
+    **/
+    virtual void async_receive(bool raw, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Receiving exactly the given number of octets without blocking.
+
+    @param bytes   Number of octets to receive.
+    @param handler Called with the `dialog_error` exception if receiving failed or timed out, null pointer and the octets otherwise.
+    **/
+    virtual void async_receive_bytes(std::size_t bytes, std::function<void (std::exception_ptr, std::string)> handler);
+
 protected:
 
     /**
-    Sending a line to network in synchronous manner.
+    Sending buffers to network in synchronous manner.
 
     @param socket       Socket to use for I/O.
-    @param line         Line to send.
+    @param buffers      Buffers to send.
     @throw dialog_error Network sending error.
     **/
     template<typename Socket>
-    void send_sync(Socket& socket, const std::string& line);
+    void send_sync(Socket& socket, const std::vector<boost::asio::const_buffer>& buffers);
 
     /**
     Receiving a line from network in synchronous manner.
@@ -107,6 +192,17 @@ protected:
     template<typename Socket>
     std::string receive_sync(Socket& socket, bool raw);
 
+    /**
+    Receiving the given number of octets from network in synchronous manner.
+
+    @param socket       Socket to use for I/O.
+    @param bytes        Number of octets to receive.
+    @return             Octets received.
+    @throw dialog_error Network receiving error.
+    **/
+    template<typename Socket>
+    std::string receive_bytes_sync(Socket& socket, std::size_t bytes);
+
     /**
     Connecting to the host within the given timeout period.
 
@@ -116,15 +212,15 @@ protected:
     void connect_async();
 
     /**
-    Sending a line over network within the given timeout period.
+    Sending buffers over network within the given timeout period.
 
     @param socket       Socket to use for I/O.
-    @param line         Line to send.
+    @param buffers      Buffers to send.
     @throw dialog_error Network sending failed.
     @throw dialog_error Network sending timed out.
     **/
     template<typename Socket>
-    void send_async(Socket& socket, std::string line);
+    void send_async(Socket& socket, const std::vector<boost::asio::const_buffer>& buffers);
 
     /**
     Receiving a line over network within the given timeout period.
@@ -139,9 +235,79 @@ protected:
     std::string receive_async(Socket& socket, bool raw);
 
     /**
-    Checking if the timeout is reached.
+    Receiving the given number of octets over network within the given timeout period.
+
+    @param socket       Socket to use for I/O.
+    @param bytes        Number of octets to receive.
+    @return             Octets received.
+    @throw dialog_error Network receiving failed.
+    @throw dialog_error Network receiving timed out.
+    **/
+    template<typename Socket>
+    std::string receive_bytes_async(Socket& socket, std::size_t bytes);
+
+    /**
+    Running the given asynchronous operation on the connection context until it completes or the timeout expires.
+
+    When the timeout expires, the socket is closed, so the pending operation completes with an error. The method does not return before
+    both the operation and the timer handlers are executed, so the operation may safely refer to the caller's local variables.
+
+    The context is run one handler at a time, including the handlers of the other dialogs sharing it, and it is restarted if stopped. See
+    the `ios` parameter of the constructor for the restrictions which follow.
+
+    @param operation Callable which starts an asynchronous operation and passes the given completion callback to it.
+    @return          Error code of the operation.
+    **/
+    template<typename Operation>
+    boost::system::error_code run_with_timeout(Operation&& operation);
+
+    /**
+    Sending buffers over network without blocking.
+
+    @param socket  Socket to use for I/O.
+    @param buffers Buffers to send, valid until the handler is called.
+    @param handler Completion handler as described by `async_send(const std::string&, std::function<void (std::exception_ptr)>)`.
+    **/
+    template<typename Socket>
+    void async_write_buffers(Socket& socket, const std::vector<boost::asio::const_buffer>& buffers,
+        std::function<void (std::exception_ptr)> handler);
+
+    /**
+    Receiving a line over network without blocking.
+
+    @param socket  Socket to use for I/O.
+    @param raw     Flag if the receiving is raw (no CRLF is truncated) or not.
+    @param handler Completion handler as described by `async_receive(bool, std::function<void (std::exception_ptr, std::string)>)`.
+    **/
+    template<typename Socket>
+    void async_read_line(Socket& socket, bool raw, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Receiving the given number of octets over network without blocking.
+
+    @param socket  Socket to use for I/O.
+    @param bytes   Number of octets to receive.
+    @param handler Completion handler as described by `async_receive_bytes(std::size_t, std::function<void (std::exception_ptr, std::string)>)`.
     **/
-    void check_timeout();
+    template<typename Socket>
+    void async_read_bytes(Socket& socket, std::size_t bytes, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Taking the given number of octets out of the receiving buffer.
+
+    @param bytes Number of octets to take, not more than buffered.
+    @return      Octets taken.
+    **/
+    std::string take_bytes(std::size_t bytes);
+
+    /**
+    Arming the timer for a non-blocking operation, if the timeout is set.
+
+    Once expired before the operation is completed, the socket is closed so the operation fails.
+
+    @param completed Flag set by the operation when completed.
+    **/
+    void arm_timer(std::shared_ptr<bool> completed);
 
     /**
     Server hostname.
@@ -154,9 +320,9 @@ protected:
     const unsigned int port_;
 
     /**
-    Asio input/output service.
+    Asio input/output context, owned by the connection or supplied by the caller.
     **/
-    static boost::asio::io_context ios_;
+    std::shared_ptr<boost::asio::io_context> ios_;
 
     /**
     Socket connection.
@@ -174,7 +340,7 @@ protected:
     std::chrono::milliseconds timeout_;
 
     /**
-    Flag to show whether the timeout has expired.
+    Flag to show whether the timeout has expired, set by the timer handler on the thread running the context.
     **/
     bool timer_expired_;
 
@@ -190,6 +356,98 @@ protected:
 };
 
 
+/**
+Client side cache of TLS sessions per server, so the reconnects to a server resume the previous session by an abbreviated handshake.
+
+The cache is thread safe, and can be shared by any number of connections through `dialog_ssl::ssl_options_t`.
+**/
+class MAILIO_EXPORT ssl_session_cache : public std::enable_shared_from_this<ssl_session_cache>
+{
+public:
+
+    /**
+    Creating an empty cache.
+    **/
+    ssl_session_cache() = default;
+
+    /**
+    Default destructor.
+    **/
+    ~ssl_session_cache() = default;
+
+    ssl_session_cache(const ssl_session_cache&) = delete;
+
+    ssl_session_cache(ssl_session_cache&&) = delete;
+
+    void operator=(const ssl_session_cache&) = delete;
+
+    void operator=(ssl_session_cache&&) = delete;
+
+    /**
+    Configuring a context to pass the sessions issued by the servers to the caches of their connections.
+
+    The context is configured only once, the later calls leave it as it is. Since a context shared by connections in several threads must not
+    be changed while they make their handshakes, it should be configured when it's created; otherwise the first connection with a cache
+    configures it.
+
+    @param ctx Context to configure.
+    **/
+    static void configure(boost::asio::ssl::context& ctx);
+
+    /**
+    Preparing a connection before its handshake: setting the cached session of the server to resume, and binding the connection to the cache
+    so the sessions issued by the server are stored to it.
+
+    The cache must be managed by a shared pointer, and the context of the connection must be configured by `configure()`.
+
+    @param ssl      Connection to prepare.
+    @param hostname Server hostname.
+    @param port     Server port.
+    **/
+    void attach(SSL* ssl, const std::string& hostname, unsigned port);
+
+    /**
+    Getting the number of cached sessions.
+
+    @return Number of servers with a cached session.
+    **/
+    std::size_t size() const;
+
+    /**
+    Removing all the cached sessions.
+    **/
+    void clear();
+
+private:
+
+    /**
+    Storing a session issued by the server, as the OpenSSL new session callback.
+
+    @param ssl     Connection which received the session.
+    @param session Received session.
+    @return        Always zero, since the cache keeps its own copy of the session.
+    **/
+    static int store(SSL* ssl, SSL_SESSION* session);
+
+    /**
+    Getting the index of the connection data which binds a connection to the cache and the server.
+
+    @return Index of the connection data.
+    **/
+    static int binding_index();
+
+    /**
+    Mutex guarding the sessions.
+    **/
+    mutable std::mutex mutex_;
+
+    /**
+    The latest session per server.
+    **/
+    std::map<std::string, std::shared_ptr<SSL_SESSION>> sessions_;
+};
+
+
 /**
 Secure version of `dialog` class.
 **/
@@ -211,6 +469,18 @@ public:
         Peer verification bitmask supported by Asio.
         **/
         boost::asio::ssl::verify_mode verify_mode;
+
+        /**
+        Context shared by connections, for instance to load the certificate store only once. If null, then each connection creates its own
+        context by using the method.
+        **/
+        std::shared_ptr<boost::asio::ssl::context> context = nullptr;
+
+        /**
+        Cache of sessions to resume. If null, then each connection makes the full handshake. A shared context should be configured for the
+        cache by `ssl_session_cache::configure()` when it's created.
+        **/
+        std::shared_ptr<ssl_session_cache> session_cache = nullptr;
     };
 
     /**
@@ -220,9 +490,12 @@ public:
     @param port     Server port.
     @param timeout  Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
     @param options  SSL options to set.
-    @throw *        `dialog::dialog(const std::string&, unsigned)`.
+    @param ios      Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                    be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
+    @throw *        `dialog::dialog(const std::string&, unsigned, std::chrono::milliseconds, std::shared_ptr<boost::asio::io_context>)`.
     **/
-    dialog_ssl(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout, const ssl_options_t& options);
+    dialog_ssl(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout, const ssl_options_t& options,
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Calling the parent constructor, initializing the SSL socket.
@@ -248,13 +521,19 @@ public:
 
     void operator=(dialog_ssl&&) = delete;
 
+    using dialog::send;
+
+    using dialog::async_send;
+
     /**
-    Sending an encrypted or unecrypted line, depending of SSL flag.
+    Sending encrypted or unecrypted buffers, depending of SSL flag.
 
-    @param line Line to send.
-    @throw *    `dialog::send(const std::string&)`, `send_sync<Socket>(Socket&, const std::string&)`, `send_async<Socket>(Socket&, const std::string&)`.
+    @param buffers Buffers to send in the given order.
+    @throw *       `dialog::send(const std::vector<boost::asio::const_buffer>&)`,
+                   `send_sync<Socket>(Socket&, const std::vector<boost::asio::const_buffer>&)`,
+                   `send_async<Socket>(Socket&, const std::vector<boost::asio::const_buffer>&)`.
     **/
-    void send(const std::string& line);
+    void send(const std::vector<boost::asio::const_buffer>& buffers);
 
     /**
     Receiving an encrypted or unecrypted line, depending of SSL state.
@@ -265,6 +544,47 @@ public:
     **/
     std::string receive(bool raw = false);
 
+    /**
+    Receiving encrypted or unencrypted octets, depending of SSL state.
+
+    @param bytes Number of octets to receive.
+    @return      Octets received.
+    @throw *     `dialog::receive_bytes(std::size_t)`, `receive_bytes_sync<Socket>(Socket&, std::size_t)`,
+                 `receive_bytes_async<Socket>(Socket&, std::size_t)`.
+    **/
+    std::string receive_bytes(std::size_t bytes);
+
+    /**
+    Sending encrypted or unencrypted buffers without blocking, depending of SSL state.
+
+    @param buffers Buffers to send in the given order, valid until the handler is called.
+    @param handler Completion handler as described by `dialog::async_send(const std::string&, std::function<void (std::exception_ptr)>)`.
+    **/
+    void async_send(const std::vector<boost::asio::const_buffer>& buffers, std::function<void (std::exception_ptr)> handler);
+
+    /**
+    Receiving an encrypted or unencrypted line without blocking, depending of SSL state.
+
+    @param raw     Flag if the receiving is raw (no CRLF is truncated) or not.
+    @param handler Completion handler as described by `dialog::async_receive(bool, std::function<void (std::exception_ptr, std::string)>)`.
+    **/
+    void async_receive(bool raw, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Receiving encrypted or unencrypted octets without blocking, depending of SSL state.
+
+    @param bytes   Number of octets to receive.
+    @param handler Completion handler as described by `dialog::async_receive_bytes(std::size_t, std::function<void (std::exception_ptr, std::string)>)`.
+    **/
+    void async_receive_bytes(std::size_t bytes, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Checking whether the handshake resumed a cached session.
+
+    @return True if the session is resumed, false if not.
+    **/
+    bool session_resumed() const;
+
 protected:
 
     /**
@@ -284,6 +604,34 @@ protected:
 };
 
 
+/**
+Adapting an Asio completion handler to the callback taken by the non-blocking operations of the protocol clients.
+
+The handler is invoked by using its associated executor, or the given one if none is associated, so any completion token supported by
+`boost::asio::async_initiate` can be used.
+
+@param handler  Completion handler with the signature `void (std::exception_ptr, Result)`.
+@param executor Executor to use if the handler has none associated.
+@return         Callback to pass to the operation.
+**/
+template<typename Result, typename Handler, typename Executor>
+std::function<void (std::exception_ptr, Result)> make_async_callback(Handler&& handler, const Executor& executor)
+{
+    auto handler_ex = boost::asio::get_associated_executor(handler, executor);
+    auto state = std::make_shared<std::pair<std::decay_t<Handler>, boost::asio::executor_work_guard<decltype(handler_ex)>>>(
+        std::forward<Handler>(handler), boost::asio::make_work_guard(handler_ex));
+    return [state, handler_ex](std::exception_ptr exc, Result result)
+    {
+        boost::asio::dispatch(handler_ex, [state, exc, result = std::move(result)]() mutable
+            {
+                auto handler = std::move(state->first);
+                state->second.reset();
+                handler(exc, std::move(result));
+            });
+    };
+}
+
+
 /**
 Error thrown by `dialog` client.
 **/
@@ -0,0 +1,198 @@
+/*
+
+header_map.hpp
+--------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "export.hpp"
+
+
+namespace mailio
+{
+
+
+/**
+Header names and values, or attribute names and values of a header, kept in the order of insertion.
+
+Names are compared case insensitively. The hash of a case folded name is calculated once when the entry is inserted, so a lookup compares the
+names only if their hashes match, and allocates nothing. Since a message has a few dozen headers at most, the entries are searched linearly.
+**/
+class MAILIO_EXPORT header_map
+{
+public:
+
+    /**
+    Name and value of an entry.
+    **/
+    typedef std::pair<std::string, std::string> value_type;
+
+    /**
+    Iterator over the entries, which cannot change them so the names and their hashes stay consistent.
+    **/
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    /**
+    Same as `const_iterator`.
+    **/
+    typedef const_iterator iterator;
+
+    header_map() = default;
+
+    header_map(const header_map&) = default;
+
+    header_map(header_map&&) = default;
+
+    ~header_map() = default;
+
+    header_map& operator=(const header_map&) = default;
+
+    header_map& operator=(header_map&&) = default;
+
+    /**
+    Getting the first entry.
+
+    @return Iterator to the first entry.
+    **/
+    const_iterator begin() const;
+
+    /**
+    Getting the end of the entries.
+
+    @return Iterator past the last entry.
+    **/
+    const_iterator end() const;
+
+    /**
+    Getting the number of entries.
+
+    @return Number of entries.
+    **/
+    std::size_t size() const;
+
+    /**
+    Checking if there are no entries.
+
+    @return True if empty, false if not.
+    **/
+    bool empty() const;
+
+    /**
+    Appending an entry, even if an entry of the same name already exists.
+
+    @param name  Name of the entry.
+    @param value Value of the entry.
+    @return      Iterator to the new entry.
+    **/
+    const_iterator insert(const std::string& name, const std::string& value);
+
+    /**
+    Getting the value of the first entry of the given name, the entry is appended if it does not exist.
+
+    @param name Name of the entry.
+    @return     Value of the entry.
+    **/
+    std::string& operator[](const std::string& name);
+
+    /**
+    Finding the first entry of the given name.
+
+    @param name Name of the entry.
+    @return     Iterator to the found entry, or `end()` if not found.
+    **/
+    const_iterator find(std::string_view name) const;
+
+    /**
+    Counting the entries of the given name.
+
+    @param name Name of the entries.
+    @return     Number of the found entries.
+    **/
+    std::size_t count(std::string_view name) const;
+
+    /**
+    Removing all entries of the given name.
+
+    @param name Name of the entries.
+    @return     Number of the removed entries.
+    **/
+    std::size_t erase(std::string_view name);
+
+    /**
+    Removing the given entry.
+
+    @param pos Iterator to the entry.
+    @return    Iterator to the entry after the removed one.
+    **/
+    const_iterator erase(const_iterator pos);
+
+    /**
+    Removing all entries.
+    **/
+    void clear();
+
+    /**
+    Calculating the hash of a case folded name.
+
+    @param name Name to hash.
+    @return     Hash of the name.
+    **/
+    static std::size_t hash_name(std::string_view name);
+
+    /**
+    Comparing two names case insensitively, without a locale since the names are ASCII.
+
+    @param lhs First name to compare.
+    @param rhs Second name to compare.
+    @return    True if the names are equal, false if not.
+    **/
+    static bool equal_names(std::string_view lhs, std::string_view rhs);
+
+private:
+
+    /**
+    Finding the first entry of the given name, starting with the given position.
+
+    @param name      Name of the entry.
+    @param name_hash Hash of the name.
+    @param pos       Position to start with.
+    @return          Position of the found entry, or the number of entries if not found.
+    **/
+    std::size_t find(std::string_view name, std::size_t name_hash, std::size_t pos) const;
+
+    /**
+    Entries in the order of insertion.
+    **/
+    std::vector<value_type> entries_;
+
+    /**
+    Hashes of the entry names, at the same positions as the entries.
+    **/
+    std::vector<std::size_t> hashes_;
+};
+
+
+} // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
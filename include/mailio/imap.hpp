@@ -19,19 +19,27 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #endif
 
 #include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <variant>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/streambuf.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <cstdint>
 #include "dialog.hpp"
+#include "header_map.hpp"
+#include "mailboxes.hpp"
 #include "message.hpp"
 #include "export.hpp"
 
@@ -191,15 +199,196 @@ public:
         search_condition_t(key_type condition_key, value_type condition_value = value_type());
     };
 
+    /**
+    Envelope of a message, as parsed by the server.
+    **/
+    struct MAILIO_EXPORT envelope_t
+    {
+        /**
+        Date header as it is written in the message.
+        **/
+        std::string date;
+
+        /**
+        Decoded subject.
+        **/
+        string_t subject;
+
+        /**
+        Authors of the message.
+        **/
+        mailboxes from;
+
+        /**
+        Sender of the message.
+        **/
+        mailboxes sender;
+
+        /**
+        Addresses to reply to.
+        **/
+        mailboxes reply_to;
+
+        /**
+        Recipients of the message.
+        **/
+        mailboxes to;
+
+        /**
+        CC recipients of the message.
+        **/
+        mailboxes cc;
+
+        /**
+        BCC recipients of the message.
+        **/
+        mailboxes bcc;
+
+        /**
+        `In-Reply-To` header as it is written in the message.
+        **/
+        std::string in_reply_to;
+
+        /**
+        `Message-ID` header as it is written in the message.
+        **/
+        std::string message_id;
+    };
+
+    /**
+    Structure of a message body or of its part, as parsed by the server.
+    **/
+    struct MAILIO_EXPORT body_structure_t
+    {
+        /**
+        Section specifier of the part like `1.2`, to fetch the part by. The multipart body of the message or of an attached message is
+        specified by `TEXT`, like `TEXT` or `3.TEXT`.
+        **/
+        std::string section;
+
+        /**
+        Media type in lower case.
+        **/
+        std::string media_type;
+
+        /**
+        Media subtype in lower case.
+        **/
+        std::string media_subtype;
+
+        /**
+        Content type parameters like the charset or the boundary.
+        **/
+        header_map parameters;
+
+        /**
+        Content ID.
+        **/
+        std::string id;
+
+        /**
+        Content description.
+        **/
+        std::string description;
+
+        /**
+        Content transfer encoding in lower case.
+        **/
+        std::string encoding;
+
+        /**
+        Size of the encoded body in octets, zero for a multipart body.
+        **/
+        unsigned long size;
+
+        /**
+        Number of lines of a text or a message body, zero for the others.
+        **/
+        unsigned long lines;
+
+        /**
+        Content disposition in lower case, if the server reports it.
+        **/
+        std::string disposition;
+
+        /**
+        Content disposition parameters like the file name.
+        **/
+        header_map disposition_parameters;
+
+        /**
+        Parts of a multipart body, or the body of an attached message.
+        **/
+        std::vector<body_structure_t> parts;
+
+        /**
+        Setting the sizes to zero.
+        **/
+        body_structure_t() : size(0), lines(0)
+        {
+        }
+    };
+
+    /**
+    Information about a message fetched instead of the message itself.
+    **/
+    struct MAILIO_EXPORT message_info_t
+    {
+        /**
+        Items to be fetched, the UID is always fetched.
+        **/
+        enum info_item_t {DEFAULT = 0, FLAGS = 1, ENVELOPE = 2, BODY_STRUCTURE = 4, SIZE = 8, INTERNAL_DATE = 16};
+
+        /**
+        Unique identifier of the message.
+        **/
+        unsigned long uid;
+
+        /**
+        Flags of the message like `\Seen`.
+        **/
+        std::list<std::string> flags;
+
+        /**
+        Envelope of the message.
+        **/
+        envelope_t envelope;
+
+        /**
+        Structure of the message body.
+        **/
+        body_structure_t body_structure;
+
+        /**
+        Size of the message in octets.
+        **/
+        unsigned long size;
+
+        /**
+        Date and time when the message is received by the server.
+        **/
+        boost::local_time::local_date_time internal_date;
+
+        /**
+        Setting the numbers to zero and the date to none.
+        **/
+        message_info_t() : uid(0), size(0), internal_date(boost::local_time::not_a_date_time)
+        {
+        }
+    };
+
     /**
     Creating a connection to a server.
 
     @param hostname Hostname of the server.
     @param port     Port of the server.
     @param timeout  Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios      Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                    be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
     @throw *        `dialog::dialog(const string&, unsigned)`.
     **/
-    imap(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    imap(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Sending the logout command and closing the connection.
@@ -311,6 +500,73 @@ public:
     void fetch(const std::list<messages_range_t>& messages_range, std::map<unsigned long, message>& found_messages, bool is_uids = false,
         bool header_only = false, codec::line_len_policy_t line_policy = codec::line_len_policy_t::RECOMMENDED);
 
+    /**
+    Fetching messages from an already selected mailbox, handing over each message as soon as it is received.
+
+    Only one message is kept in memory at once, so it is suitable for large ranges. The handler must not use the connection, and throwing from
+    it leaves the rest of the response unread.
+
+    @param messages_range  Range of message numbers or UIDs to fetch.
+    @param message_handler Called for each message with its number or uid, and the parsed message.
+    @param is_uids         Using message UID numbers instead of a message sequence numbers.
+    @param header_only     Flag if only the message headers should be fetched.
+    @param line_policy     Decoder line policy to use while parsing each message.
+    @throw *               See `fetch(const std::list<messages_range_t>&, std::map<unsigned long, message>&, bool, bool, codec::line_len_policy_t)`.
+    **/
+    void fetch(const std::list<messages_range_t>& messages_range, std::function<void (unsigned long, message)> message_handler,
+        bool is_uids = false, bool header_only = false, codec::line_len_policy_t line_policy = codec::line_len_policy_t::RECOMMENDED);
+
+    /**
+    Fetching the information about messages from an already selected mailbox, instead of the messages themselves.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param items          Items to fetch as a combination of `message_info_t::info_item_t` values.
+    @param infos          Map of the information to store the results, indexed by message number or uid.
+                          It does not clear the map first, so that results can be accumulated.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @throw imap_error     Fetching message failure.
+    @throw imap_error     Parsing failure.
+    @throw *              `parse_tag_result(const string&)`, `parse_response(std::string_view)`, `dialog::send(const string&)`, `dialog::receive()`.
+    **/
+    void fetch_info(const std::list<messages_range_t>& messages_range, unsigned int items, std::map<unsigned long, message_info_t>& infos,
+        bool is_uids = false);
+
+    /**
+    Fetching a section of a message from an already selected mailbox, without setting the `\Seen` flag.
+
+    If the server does not send the section, the content is left empty.
+
+    @param message_no Number of the message to fetch.
+    @param section    Section specifier like `1.2`, `1.2.MIME`, `HEADER` or `TEXT`, the empty one for the whole message.
+    @param content    Content of the section as sent by the server, so it is not decoded.
+    @param is_uid     Using a message uid number instead of a message sequence number.
+    @param offset     Octet of the section where the partial content begins.
+    @param length     Number of octets of the partial content, zero for the whole section.
+    @throw imap_error Fetching message failure.
+    @throw imap_error Parsing failure.
+    @throw *          `parse_tag_result(const string&)`, `parse_response(std::string_view)`, `dialog::send(const string&)`, `dialog::receive()`.
+    **/
+    void fetch_section(unsigned long message_no, const std::string& section, std::string& content, bool is_uid = false,
+        unsigned long offset = 0, unsigned long length = 0);
+
+    /**
+    Fetching a part of a message from an already selected mailbox and decoding it, without setting the `\Seen` flag.
+
+    Only the content of the part is transferred, its header is formatted from the part structure. A partial content is cut to its last
+    complete line, so it can be decoded if the offset is at the beginning of a line.
+
+    @param message_no Number of the message to fetch.
+    @param part       Structure of the part, as fetched by `fetch_info()`.
+    @param part_mime  Mime part to store the result, its line policies and strict modes are kept.
+    @param is_uid     Using a message uid number instead of a message sequence number.
+    @param offset     Octet of the part content where the partial content begins.
+    @param length     Number of octets of the partial content, zero for the whole part.
+    @throw *          `fetch_section(unsigned long, const std::string&, std::string&, bool, unsigned long, unsigned long)`,
+                      `mime::parse(const string&, bool)`.
+    **/
+    void fetch_part(unsigned long message_no, const body_structure_t& part, mime& part_mime, bool is_uid = false, unsigned long offset = 0,
+        unsigned long length = 0);
+
     /**
     Appending a message to the given folder.
 
@@ -510,6 +766,121 @@ public:
     **/
     std::string folder_delimiter();
 
+    /**
+    Checking if the session is alive by the `NOOP` command.
+
+    @return True if the server replies positively, false if it does not or the connection is broken.
+    **/
+    bool noop();
+
+    /**
+    Selecting a mailbox without blocking.
+
+    The operation runs on the connection context, which has to be run by the caller from a single thread. The object must outlive the
+    operation and must not be used by another operation until this one completes.
+
+    @param mailbox   Mailbox to select.
+    @param read_only Flag if the selected mailbox is only readable of also writable.
+    @param token     Completion token with the signature `void (std::exception_ptr, mailbox_stat_t)`.
+    @return          Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_select(const std::string& mailbox, bool read_only, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, mailbox_stat_t)>(
+            [this, mailbox, read_only](auto handler)
+            {
+                initiate_select(mailbox, read_only, make_async_callback<mailbox_stat_t>(std::move(handler), dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
+    /**
+    Fetching messages from an already selected mailbox without blocking.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @param header_only    Flag if only the message headers should be fetched.
+    @param line_policy    Decoder line policy to use while parsing each message.
+    @param token          Completion token with the signature `void (std::exception_ptr, std::map<unsigned long, message>)`, the messages
+                          being indexed by message number or uid.
+    @return               Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_fetch(const std::list<messages_range_t>& messages_range, bool is_uids, bool header_only, codec::line_len_policy_t line_policy,
+        CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, std::map<unsigned long, message>)>(
+            [this, messages_range, is_uids, header_only, line_policy](auto handler)
+            {
+                initiate_fetch(messages_range, is_uids, header_only, line_policy,
+                    make_async_callback<std::map<unsigned long, message>>(std::move(handler), dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
+    /**
+    Fetching the information about messages from an already selected mailbox without blocking.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param items          Items to fetch as a combination of `message_info_t::info_item_t` values.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @param token          Completion token with the signature `void (std::exception_ptr, std::map<unsigned long, message_info_t>)`, the
+                          information being indexed by message number or uid.
+    @return               Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_fetch_info(const std::list<messages_range_t>& messages_range, unsigned int items, bool is_uids, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, std::map<unsigned long, message_info_t>)>(
+            [this, messages_range, items, is_uids](auto handler)
+            {
+                initiate_fetch_info(messages_range, items, is_uids,
+                    make_async_callback<std::map<unsigned long, message_info_t>>(std::move(handler), dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
+    /**
+    Fetching a part of a message from an already selected mailbox and decoding it without blocking, and without setting the `\Seen` flag.
+
+    @param message_no  Number of the message to fetch.
+    @param part        Structure of the part, as fetched by `fetch_info()`.
+    @param is_uid      Using a message uid number instead of a message sequence number.
+    @param offset      Octet of the part content where the partial content begins.
+    @param length      Number of octets of the partial content, zero for the whole part.
+    @param line_policy Decoder line policy to use while parsing the part.
+    @param token       Completion token with the signature `void (std::exception_ptr, mime)`.
+    @return            Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_fetch_part(unsigned long message_no, const body_structure_t& part, bool is_uid, unsigned long offset, unsigned long length,
+        codec::line_len_policy_t line_policy, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, mime)>(
+            [this, message_no, part, is_uid, offset, length, line_policy](auto handler)
+            {
+                initiate_fetch_part(message_no, part, is_uid, offset, length, line_policy,
+                    make_async_callback<mime>(std::move(handler), dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
+    /**
+    Searching a mailbox without blocking.
+
+    @param conditions List of conditions taken in conjuction way.
+    @param want_uids  Return a list of message UIDs instead of message sequence numbers.
+    @param token      Completion token with the signature `void (std::exception_ptr, std::list<unsigned long>)`.
+    @return           Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_search(const std::list<search_condition_t>& conditions, bool want_uids, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, std::list<unsigned long>)>(
+            [this, conditions = search_conditions_to_string(conditions), want_uids](auto handler)
+            {
+                initiate_search(conditions, want_uids, make_async_callback<std::list<unsigned long>>(std::move(handler),
+                    dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
 protected:
 
     /**
@@ -652,6 +1023,285 @@ protected:
     **/
     void search(const std::string& conditions, std::list<unsigned long>& results, bool want_uids = false);
 
+    /**
+    Processor of the response lines to a command.
+
+    It is fed with each line received, with the LF removed, until it returns true which means that the tagged response completing the command
+    is processed. Errors are reported by throwing exceptions.
+    **/
+    typedef std::function<bool (std::string&)> response_processor_t;
+
+    /**
+    Formatting the select or examine command.
+
+    @param mailbox   Mailbox to select.
+    @param read_only Flag if the examine command is used.
+    @return          Tagged command.
+    **/
+    std::string select_command(const std::string& mailbox, bool read_only);
+
+    /**
+    Creating the processor of the select response.
+
+    @param stat Mailbox statistics to store the results.
+    @return     Response processor.
+    @throw *    See `select(const std::string&, bool)`.
+    **/
+    response_processor_t select_processor(std::shared_ptr<mailbox_stat_t> stat);
+
+    /**
+    Formatting the fetch command.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @param header_only    Flag if only the message headers should be fetched.
+    @return               Tagged command.
+    @throw imap_error     Empty messages range.
+    **/
+    std::string fetch_command(const std::list<messages_range_t>& messages_range, bool is_uids, bool header_only);
+
+    /**
+    Creating the processor of the fetch response.
+
+    @param is_uids         Flag if message UIDs are fetched.
+    @param header_only     Flag if only the message headers are fetched.
+    @param line_policy     Decoder line policy to use while parsing each message.
+    @param message_handler Called for each message as soon as its literal is received.
+    @return                Response processor.
+    @throw *               See `fetch(const std::list<messages_range_t>&, std::map<unsigned long, message>&, bool, bool, codec::line_len_policy_t)`.
+    **/
+    response_processor_t fetch_processor(bool is_uids, bool header_only, codec::line_len_policy_t line_policy,
+        std::function<void (unsigned long, message)> message_handler);
+
+    /**
+    Formatting the fetch command of the message information.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param items          Items to fetch as a combination of `message_info_t::info_item_t` values.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @return               Tagged command.
+    @throw imap_error     Empty messages range.
+    **/
+    std::string fetch_info_command(const std::list<messages_range_t>& messages_range, unsigned int items, bool is_uids);
+
+    /**
+    Creating the processor of the fetch response with the message information.
+
+    The untagged responses without UID, like the unsolicited flag updates, are ignored.
+
+    @param is_uids      Flag if message UIDs are fetched.
+    @param info_handler Called for each message as soon as its response is received.
+    @return             Response processor.
+    @throw *            See `fetch_info(const std::list<messages_range_t>&, unsigned int, std::map<unsigned long, message_info_t>&, bool)`.
+    **/
+    response_processor_t fetch_info_processor(bool is_uids, std::function<void (unsigned long, message_info_t)> info_handler);
+
+    /**
+    Formatting the fetch command of a message section, which does not set the `\Seen` flag.
+
+    @param message_no Number of the message to fetch.
+    @param section    Section specifier.
+    @param is_uid     Using a message uid number instead of a message sequence number.
+    @param offset     Octet of the section where the partial content begins.
+    @param length     Number of octets of the partial content, zero for the whole section.
+    @return           Tagged command.
+    **/
+    std::string fetch_section_command(unsigned long message_no, const std::string& section, bool is_uid, unsigned long offset,
+        unsigned long length);
+
+    /**
+    Creating the processor of the fetch response with a message section.
+
+    The untagged responses without the section, like the flag updates, are ignored.
+
+    @param content Content of the section to store the result.
+    @return        Response processor.
+    @throw *       See `fetch_section(unsigned long, const std::string&, std::string&, bool, unsigned long, unsigned long)`.
+    **/
+    response_processor_t fetch_section_processor(std::shared_ptr<std::string> content);
+
+    /**
+    Decoding the fetched content of a part.
+
+    @param part      Structure of the part.
+    @param content   Content of the part, the header is prepended to it.
+    @param partial   Flag if the content is partial, so its last incomplete line is cut.
+    @param part_mime Mime part to store the result.
+    @throw *         `mime::parse(const string&, bool)`.
+    **/
+    static void decode_part(const body_structure_t& part, std::string& content, bool partial, mime& part_mime);
+
+    /**
+    Formatting the header of a part from its structure.
+
+    @param part Structure of the part.
+    @return     Content type, transfer encoding and disposition headers, followed by the empty line.
+    **/
+    static std::string format_part_header(const body_structure_t& part);
+
+    /**
+    Parsing an envelope.
+
+    @param token      Index of the envelope list.
+    @param envelope   Envelope to store the result.
+    @throw imap_error Parsing failure.
+    @throw *          `parse_address_list(std::size_t)`, `q_codec::check_decode(const std::string&)`.
+    **/
+    void parse_envelope(std::size_t token, envelope_t& envelope);
+
+    /**
+    Parsing a list of addresses of an envelope, where a group begins with an address without host and ends with an empty address.
+
+    @param token Index of the address list, or of `NIL`.
+    @return      Addresses and groups.
+    @throw *     `q_codec::check_decode(const std::string&)`.
+    **/
+    mailboxes parse_address_list(std::size_t token);
+
+    /**
+    Parsing a body structure, and the structures of its parts recursively.
+
+    @param token      Index of the body structure list.
+    @param body       Body structure to store the result.
+    @param section    Section number of the body, empty for the top body.
+    @throw imap_error Parsing failure.
+    **/
+    void parse_body_structure(std::size_t token, body_structure_t& body, const std::string& section);
+
+    /**
+    Parsing the list of parameter names and values.
+
+    @param token      Index of the parameter list, or of `NIL`.
+    @param parameters Parameters to store the result.
+    **/
+    void parse_body_parameters(std::size_t token, header_map& parameters);
+
+    /**
+    Parsing an internal date like `17-Jul-1996 02:44:25 -0700`.
+
+    @param date_str   Date to parse.
+    @return           Local date and time.
+    @throw imap_error Parsing failure.
+    **/
+    static boost::local_time::local_date_time parse_internal_date(std::string_view date_str);
+
+    /**
+    Formatting the search command.
+
+    @param conditions String of search keys.
+    @param want_uids  Flag if message uids are searched for.
+    @return           Tagged command.
+    **/
+    std::string search_command(const std::string& conditions, bool want_uids);
+
+    /**
+    Formatting the search conditions.
+
+    @param conditions List of conditions taken in conjuction way.
+    @return           String of search keys.
+    **/
+    static std::string search_conditions_to_string(const std::list<search_condition_t>& conditions);
+
+    /**
+    Creating the processor of the search response.
+
+    @param results List to store the found message sequence numbers or uids.
+    @return        Response processor.
+    @throw *       See `search(const std::string&, std::list<unsigned long>&, bool)`.
+    **/
+    response_processor_t search_processor(std::shared_ptr<std::list<unsigned long>> results);
+
+    /**
+    Receiving the response lines and passing them to the processor until it completes.
+
+    @param processor Processor of the response.
+    @throw *         `process_line(response_processor_t&, std::string&)`, `dialog::receive(bool)`.
+    **/
+    void receive_response(response_processor_t processor);
+
+    /**
+    Passing a line to the processor, reporting the conversion errors as parsing failures.
+
+    @param processor  Processor of the response.
+    @param line       Line to process.
+    @return           True if the response is completed, false if not.
+    @throw imap_error Parsing failure.
+    @throw *          Errors of the processor.
+    **/
+    bool process_line(response_processor_t& processor, std::string& line);
+
+    /**
+    Sending a command and processing its response without blocking.
+
+    @param command   Tagged command to send.
+    @param processor Processor of the response.
+    @param handler   Called with the error, or null pointer once the response is completed.
+    **/
+    void initiate_command(const std::string& command, response_processor_t processor, std::function<void (std::exception_ptr)> handler);
+
+    /**
+    Receiving the response lines without blocking and passing them to the processor until it completes.
+
+    @param processor Processor of the response.
+    @param handler   Called with the error, or null pointer once the response is completed.
+    **/
+    void async_receive_response(std::shared_ptr<response_processor_t> processor, std::function<void (std::exception_ptr)> handler);
+
+    /**
+    Starting the non-blocking select.
+
+    @param mailbox   Mailbox to select.
+    @param read_only Flag if the selected mailbox is only readable of also writable.
+    @param handler   Called with the error or the mailbox statistics.
+    **/
+    void initiate_select(const std::string& mailbox, bool read_only, std::function<void (std::exception_ptr, mailbox_stat_t)> handler);
+
+    /**
+    Starting the non-blocking fetch.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @param header_only    Flag if only the message headers should be fetched.
+    @param line_policy    Decoder line policy to use while parsing each message.
+    @param handler        Called with the error or the fetched messages.
+    **/
+    void initiate_fetch(const std::list<messages_range_t>& messages_range, bool is_uids, bool header_only, codec::line_len_policy_t line_policy,
+        std::function<void (std::exception_ptr, std::map<unsigned long, message>)> handler);
+
+    /**
+    Starting the non-blocking fetch of the message information.
+
+    @param messages_range Range of message numbers or UIDs to fetch.
+    @param items          Items to fetch as a combination of `message_info_t::info_item_t` values.
+    @param is_uids        Using message UID numbers instead of a message sequence numbers.
+    @param handler        Called with the error or the fetched information.
+    **/
+    void initiate_fetch_info(const std::list<messages_range_t>& messages_range, unsigned int items, bool is_uids,
+        std::function<void (std::exception_ptr, std::map<unsigned long, message_info_t>)> handler);
+
+    /**
+    Starting the non-blocking fetch of a message part.
+
+    @param message_no  Number of the message to fetch.
+    @param part        Structure of the part.
+    @param is_uid      Using a message uid number instead of a message sequence number.
+    @param offset      Octet of the part content where the partial content begins.
+    @param length      Number of octets of the partial content, zero for the whole part.
+    @param line_policy Decoder line policy to use while parsing the part.
+    @param handler     Called with the error or the decoded part.
+    **/
+    void initiate_fetch_part(unsigned long message_no, const body_structure_t& part, bool is_uid, unsigned long offset, unsigned long length,
+        codec::line_len_policy_t line_policy, std::function<void (std::exception_ptr, mime)> handler);
+
+    /**
+    Starting the non-blocking search.
+
+    @param conditions String of search keys.
+    @param want_uids  Flag if message uids are searched for.
+    @param handler    Called with the error or the found message sequence numbers or uids.
+    **/
+    void initiate_search(const std::string& conditions, bool want_uids, std::function<void (std::exception_ptr, std::list<unsigned long>)> handler);
+
     /**
     Folder delimiter string determined by the IMAP server.
     **/
@@ -726,16 +1376,62 @@ protected:
 
     @param response   Response to parse without tag and result.
     @throw imap_error Parser failure.
-    @throw *          `std::stoul`.
     @todo             Perhaps the error should point to a part of the string where the parsing fails.
     **/
-    void parse_response(const std::string& response);
+    void parse_response(std::string_view response);
+
+    /**
+    Getting the number of octets left to complete the string literal being read.
+
+    @return Number of octets not read yet.
+    **/
+    std::size_t literal_remaining();
+
+    /**
+    Completing the string literal being read by the rest of its octets, received at once instead of line by line.
+
+    @param octets Rest of the literal.
+    **/
+    void complete_literal(const std::string& octets);
 
     /**
     Resetting the parser state to the initial one.
     **/
     void reset_response_parser();
 
+    /**
+    Getting the content of an atom.
+
+    @param token Index of the token.
+    @return      Atom as a part of the response text, empty if the token is not an atom.
+    **/
+    std::string_view token_atom(std::size_t token) const;
+
+    /**
+    Getting the number stored in an atom.
+
+    @param token      Index of the token.
+    @return           Number of the atom.
+    @throw imap_error Parsing failure.
+    **/
+    unsigned long token_number(std::size_t token) const;
+
+    /**
+    Getting the content of a string literal.
+
+    @param token Index of the literal token.
+    @return      String literal.
+    **/
+    std::string& token_literal(std::size_t token);
+
+    /**
+    Getting the content of a string which is either an atom or a string literal, where the unquoted `NIL` is the empty string.
+
+    @param token Index of the token.
+    @return      String content, empty if the token is neither an atom nor a string literal.
+    **/
+    std::string token_string(std::size_t token);
+
     /**
     Formatting a tagged command.
 
@@ -779,11 +1475,45 @@ protected:
     **/
     unsigned tag_;
 
+    /**
+    Index of no token, which ends a sequence of tokens.
+    **/
+    static constexpr std::size_t NO_TOKEN = static_cast<std::size_t>(-1);
+
+    /**
+    Sequence of tokens, linked by their indexes in the token arena.
+    **/
+    struct token_list_t
+    {
+        /**
+        First token of the sequence, or `NO_TOKEN` if the sequence is empty.
+        **/
+        std::size_t first;
+
+        /**
+        Last token of the sequence, or `NO_TOKEN` if the sequence is empty.
+        **/
+        std::size_t last;
+
+        /**
+        Number of tokens in the sequence.
+        **/
+        std::size_t size;
+
+        /**
+        Default constructor.
+        **/
+        token_list_t() : first(NO_TOKEN), last(NO_TOKEN), size(0)
+        {
+        }
+    };
+
     /**
     Token of the response defined by the grammar.
 
     Its type is determined by the content, and can be either atom, string literal or parenthesized list. Thus, it can be considered as union of
-    those three types.
+    those three types. The tokens of a response are kept in the arena `tokens_` and refer to each other by indexes, while an atom refers to the
+    response text. Thus, once the arena and the response text grow enough, parsing a response allocates nothing except for the string literals.
     **/
     struct response_token_t
     {
@@ -793,44 +1523,68 @@ protected:
         enum class token_type_t {EMPTY, ATOM, LITERAL, LIST} token_type;
 
         /**
-        Token content in case it is atom.
+        Position of the atom in the response text, or index of the string literal among the literals.
         **/
-        std::string atom;
+        std::string::size_type pos;
 
         /**
-        Token content in case it is string literal.
+        Length of the atom, or size of the string literal as announced before the literal itself.
         **/
-        std::string literal;
+        std::string::size_type length;
 
         /**
-        String literal is first determined by its size, so it's stored here before reading the literal itself.
+        Token content in case it is parenthesized list.
+
+        It can store either of the three types, so the definition is recursive.
         **/
-        std::string literal_size;
+        token_list_t parenthesized_list;
 
         /**
-        Token content in case it is parenthesized list.
+        Next token in the sequence which the token belongs to, or `NO_TOKEN` if the token is the last one.
+        **/
+        std::size_t next;
 
-        It can store either of the three types, so the definition is recursive.
+        /**
+        Flag if the atom is a quoted string.
         **/
-        std::list<std::shared_ptr<response_token_t>> parenthesized_list;
+        bool quoted;
 
         /**
-        Default constructor.
+        Creating an empty token of the given type.
+
+        @param type     Type of the token.
+        @param position Position of the atom or index of the literal.
         **/
-        response_token_t() : token_type(token_type_t::EMPTY)
+        response_token_t(token_type_t type, std::string::size_type position) : token_type(type), pos(position), length(0), next(NO_TOKEN),
+            quoted(false)
         {
         }
     };
 
+    /**
+    Tokens of the response, in the order they are read.
+    **/
+    std::vector<response_token_t> tokens_;
+
+    /**
+    Response lines parsed so far, which the atoms refer to.
+    **/
+    std::string response_text_;
+
+    /**
+    String literals of the response.
+    **/
+    std::vector<std::string> literals_;
+
     /**
     Optional part of the response, determined by the square brackets.
     **/
-    std::list<std::shared_ptr<response_token_t>> optional_part_;
+    token_list_t optional_part_;
 
     /**
     Mandatory part of the response, which is any text outside of the square brackets.
     **/
-    std::list<std::shared_ptr<response_token_t>> mandatory_part_;
+    token_list_t mandatory_part_;
 
     /**
     Parser state if an optional part is reached.
@@ -839,13 +1593,15 @@ protected:
 
     /**
     Parser state if an atom is reached.
+
+    The section of an atom like `BODY[HEADER.FIELDS (DATE)]` is part of the atom, so it's read as is up to the closing square bracket.
     **/
-    enum class atom_state_t {NONE, PLAIN, QUOTED} atom_state_;
+    enum class atom_state_t {NONE, PLAIN, QUOTED, SECTION} atom_state_;
 
     /**
-    Counting open parenthesis of a parenthized list, thus it also keeps parser state if a parenthesized list is reached.
+    Parenthesized lists being read, from the outermost to the innermost one, thus it also keeps parser state if a parenthesized list is reached.
     **/
-    unsigned int parenthesis_list_counter_;
+    std::vector<std::size_t> open_lists_;
 
     /**
     Parser state if a string literal is reached.
@@ -858,14 +1614,18 @@ protected:
     std::string::size_type literal_bytes_read_;
 
     /**
-    Finding last token of the list at the given depth in terms of parenthesis count.
+    String literal being read, or `NO_TOKEN` if no literal is reached.
+    **/
+    std::size_t literal_token_;
 
-    When a new token is found, this method enables to find the last current token and append the new one.
+    /**
+    Appending a new token to the sequence being read, which is either the innermost open list or the current part of the response.
 
-    @param token_list Token sequence to traverse.
-    @return           Last token of the given sequence at the current depth of parenthesis count.
+    @param token_type Type of the token.
+    @param pos        Position of the atom or index of the literal.
+    @return           Index of the token.
     **/
-    std::list<std::shared_ptr<response_token_t>>* find_last_token_list(std::list<std::shared_ptr<response_token_t>>& token_list);
+    std::size_t add_token(response_token_t::token_type_t token_type, std::string::size_type pos);
 
     /**
     Keeping the number of end-of-line characters to be counted as additionals to a formatted line.
@@ -906,9 +1666,12 @@ public:
     @param hostname Hostname of the server.
     @param port     Port of the server.
     @param timeout  Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios      Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                    be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
     @throw *        `imap::imap(const std::string&, unsigned)`.
     **/
-    imaps(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    imaps(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Sending the logout command and closing the connection.
@@ -0,0 +1,137 @@
+/*
+
+mapped_text.hpp
+---------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "export.hpp"
+
+
+namespace mailio
+{
+
+
+/**
+Text of a read only memory mapped file, or a part of it.
+
+The mapping is shared by the copies and the parts of the text, and by the mime parts which keep their bodies for the lazy decoding, so it's
+unmapped when the last of them is destroyed.
+**/
+class MAILIO_EXPORT mapped_text
+{
+    friend class mime;
+
+public:
+
+    /**
+    Creating an empty text, not mapped to any file.
+    **/
+    mapped_text() = default;
+
+    /**
+    Mapping the whole file.
+
+    @param file_path         Path of the file to map.
+    @throw mapped_text_error Mapping failure.
+    **/
+    explicit mapped_text(const std::string& file_path);
+
+    mapped_text(const mapped_text&) = default;
+
+    mapped_text(mapped_text&&) = default;
+
+    ~mapped_text() = default;
+
+    mapped_text& operator=(const mapped_text&) = default;
+
+    mapped_text& operator=(mapped_text&&) = default;
+
+    /**
+    Getting the text as a view into the mapping.
+
+    @return View of the text, valid as long as the text or any part of it exists.
+    **/
+    std::string_view text() const;
+
+    /**
+    Getting a part of the text which shares the mapping.
+
+    @param pos   Position of the part.
+    @param count Length of the part, if it goes beyond the text then the part ends with the text.
+    @return      The part of the text.
+    @throw *     `std::string_view::substr(std::string_view::size_type, std::string_view::size_type)`.
+    **/
+    mapped_text substr(std::string_view::size_type pos, std::string_view::size_type count = std::string_view::npos) const;
+
+    /**
+    Checking if the text is empty.
+
+    @return True if empty, false if not.
+    **/
+    bool empty() const;
+
+private:
+
+    /**
+    Mapped region of the file, null for an empty file.
+    **/
+    std::shared_ptr<const void> region_;
+
+    /**
+    Text as a view into the mapped region.
+    **/
+    std::string_view text_;
+};
+
+
+/**
+Exception reported by `mapped_text` class.
+**/
+class mapped_text_error : public std::runtime_error
+{
+public:
+
+    /**
+    Calling parent constructor.
+
+    @param msg Error message.
+    **/
+    explicit mapped_text_error(const std::string& msg) : std::runtime_error(msg)
+    {
+    }
+
+    /**
+    Calling parent constructor.
+
+    @param msg Error message.
+    **/
+    explicit mapped_text_error(const char* msg) : std::runtime_error(msg)
+    {
+    }
+};
+
+
+} // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
@@ -0,0 +1,110 @@
+/*
+
+mbox.hpp
+--------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
+#include <string>
+#include <string_view>
+#include "mapped_text.hpp"
+#include "message.hpp"
+#include "export.hpp"
+
+
+namespace mailio
+{
+
+
+/**
+Iterating the messages of a memory mapped mbox archive.
+
+The messages are separated by the lines beginning with `From `, which are not part of the messages. The lines of a message may end either by
+CRLF or by LF. The quoted `>From ` lines are left as they are, so the messages can be kept as parts of the mapping.
+**/
+class MAILIO_EXPORT mbox
+{
+public:
+
+    /**
+    Separator line beginning of two messages.
+    **/
+    static const std::string FROM_LINE;
+
+    /**
+    Mapping the archive.
+
+    @param file_path Path of the archive.
+    @throw *         `mapped_text::mapped_text(const std::string&)`.
+    **/
+    explicit mbox(const std::string& file_path);
+
+    /**
+    Iterating the messages of the already mapped archive.
+
+    @param archive_text Text of the archive.
+    **/
+    explicit mbox(const mapped_text& archive_text);
+
+    mbox(const mbox&) = default;
+
+    mbox(mbox&&) = default;
+
+    ~mbox() = default;
+
+    mbox& operator=(const mbox&) = default;
+
+    mbox& operator=(mbox&&) = default;
+
+    /**
+    Getting the text of the next message, without copying it.
+
+    @param message_text Text of the next message, as a part of the mapping.
+    @return             True if there is a next message, false if the end of the archive is reached.
+    **/
+    bool next(mapped_text& message_text);
+
+    /**
+    Parsing the next message.
+
+    The message is parsed with its own settings, so with the lazy decoding its encoded bodies stay in the mapping.
+
+    @param msg Message to parse into.
+    @return    True if there is a next message, false if the end of the archive is reached.
+    @throw *   `message::parse(const mapped_text&, bool)`.
+    **/
+    bool next(message& msg);
+
+private:
+
+    /**
+    Text of the archive.
+    **/
+    mapped_text text_;
+
+    /**
+    Position of the next message separator, or the end of the text.
+    **/
+    std::string_view::size_type pos_;
+};
+
+
+} // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
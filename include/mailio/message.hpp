@@ -26,6 +26,7 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <memory>
 #include <tuple>
 #include <istream>
+#include <ostream>
 #include <boost/date_time.hpp>
 #include "q_codec.hpp"
 #include "mime.hpp"
@@ -113,6 +114,15 @@ public:
     void format(std::u8string& message_str, bool dot_escape = false) const;
 #endif
 
+    /**
+    Formatting the message to a stream, without keeping the whole formatted message in memory.
+
+    @param message_strm Stream to write the message to.
+    @param dot_escape   Flag if the leading dot should be escaped.
+    @throw *            `format_header()`, `format_content(std::ostream&, bool)`, `mime::format(std::ostream&, bool)`.
+    **/
+    void format(std::ostream& message_strm, bool dot_escape = false) const;
+
     /**
     Parsing a message from a string.
 
@@ -134,6 +144,16 @@ public:
     void parse(const std::u8string& mime_string, bool dot_escape = false);
 #endif
 
+    /**
+    Parsing a message from a memory mapped text.
+
+    @param message_text  Mapped text to parse.
+    @param dot_escape    Flag if the leading dot should be escaped.
+    @throw message_error No author address.
+    @throw *             `mime::parse(const mapped_text&, bool)`.
+    **/
+    void parse(const mapped_text& message_text, bool dot_escape = false);
+
     /**
     Checking if the mail is empty.
 
@@ -481,7 +501,7 @@ public:
     void add_header(const std::string& name, const std::string& value);
 
     /**
-    Removing another header.
+    Removing another header, all of its occurrences regardless of the case of the name.
 
     Removing a header defined by other methods leads to the undefined behaviour.
 
@@ -492,22 +512,12 @@ public:
     /**
     Returning the other headers.
 
-    @return Message headers.
+    @return Message headers in the order they are added or parsed.
     **/
-    std::multimap<std::string, std::string> headers() const;
+    header_map headers() const;
 
 protected:
 
-    /**
-    Printable ASCII characters without the alphanumerics, double quote, comma, colon, semicolon, angle and square brackets and monkey.
-    **/
-    static const std::string ATEXT;
-
-    /**
-    Printable ASCII characters without the alphanumerics, brackets and backslash.
-    **/
-    static const std::string DTEXT;
-
     /**
     `From` header name.
     **/
@@ -758,7 +768,7 @@ protected:
     /**
     Other headers not included into the known ones.
     **/
-    std::multimap<std::string, std::string> headers_;
+    header_map headers_;
 };
 
 
@@ -18,14 +18,16 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #pragma warning(disable:4251)
 #endif
 
+#include <memory>
 #include <string>
+#include <string_view>
+#include <ostream>
+#include <streambuf>
 #include <utility>
 #include <vector>
 #include <stdexcept>
-#include <map>
-#include <boost/regex.hpp>
-#include <boost/algorithm/string/case_conv.hpp>
 #include "codec.hpp"
+#include "header_map.hpp"
 #include "export.hpp"
 
 
@@ -33,6 +35,9 @@ namespace mailio
 {
 
 
+class mapped_text;
+
+
 /*
 To parse elements of a mime part the following alphabet is used as described in [rfc 5322]:
 ```
@@ -216,19 +221,42 @@ public:
     void format(std::u8string& mime_str, bool dot_escape = true) const;
 #endif
 
+    /**
+    Formatting the mime part to a stream, without keeping the whole formatted part in memory.
+
+    @param mime_strm  Stream to write the mime part to.
+    @param dot_escape Flag if the leading dot should be escaped.
+    @throw mime_error Formatting failure, non multipart message with boundary.
+    @throw *          `format_header()`, `format_content(std::ostream&, bool)`.
+    **/
+    void format(std::ostream& mime_strm, bool dot_escape = true) const;
+
     /**
     Parsing the mime part from a string.
 
     If a line contains leading dot, then it can be escaped as required by mail protocols.
 
-    Essentially, the method goes line by line and calls the parsing by line.
+    The string is parsed in a single pass. The header and body lines of all the parts are kept as views into the string, so only the decoded
+    contents are copied. With the lazy decoding, the string is copied once and the contents are decoded on access.
 
     @param mime_string String to parse.
     @param dot_escape  Flag if the leading dot should be escaped.
-    @throw *           `parse_by_line(const std::string&, bool)`.
+    @throw *           `parse_text(std::string_view, const std::shared_ptr<const void>&, bool, bool)`.
     **/
     void parse(const std::string& mime_string, bool dot_escape = false);
 
+    /**
+    Parsing the mime part from a memory mapped text.
+
+    The lines may end either by CRLF or by LF, as usual for the files. With the lazy decoding, the encoded bodies are kept as views into the
+    mapping instead of copying the text, so the mapping is released when all the parts are decoded or destroyed.
+
+    @param mime_text  Mapped text to parse.
+    @param dot_escape Flag if the leading dot should be escaped.
+    @throw *          `parse_text(std::string_view, const std::shared_ptr<const void>&, bool, bool)`.
+    **/
+    void parse(const mapped_text& mime_text, bool dot_escape = false);
+
     /**
     Overload of `parse(const string&, bool)`.
 
@@ -252,7 +280,7 @@ public:
     @param line       String to be parsed. If it's CRLF, then message parsing ends; any further parsing is undefined.
     @param dot_escape Flag if the leading dot should be escaped.
     @return           Mime itself.
-    @throw *          `parse_header()`, `parse_content`.
+    @throw *          `parse_header(const std::vector<std::string_view>&)`, `parse_content(const std::vector<std::string_view>&)`.
     @todo             Determine a default charset.
     **/
     mime& parse_by_line(const std::string& line, bool dot_escape = false);
@@ -367,7 +395,11 @@ public:
     /**
     Getting the content as a string.
 
+    If the content is parsed with the lazy decoding, then it's decoded on the first access and kept decoded. Concurrent first accesses decode
+    it only once.
+
     @return Content as string.
+    @throw  * `decoded_content()`.
     **/
     std::string content() const;
 
@@ -435,6 +467,25 @@ public:
     **/
     bool strict_codec_mode() const;
 
+    /**
+    Enabling/disabling the lazy decoding of the content when parsing a string.
+
+    With the lazy decoding, the parsing builds the tree of parts and keeps their encoded bodies, so the codecs run only for the contents
+    accessed later. A decoding failure is then reported by the access instead of the parsing. The parts share a single copy of the parsed
+    string, which is released when all of them are decoded or destroyed. The first access of a lazy content decodes it under a lock, so a
+    parsed message can be read by several threads, as long as none of them changes or copies it meanwhile.
+
+    @param mode True to enable the lazy decoding, false to disable.
+    **/
+    void lazy_decoding(bool mode);
+
+    /**
+    Returning the lazy decoding status.
+
+    @return True if the lazy decoding enabled, false if disabled.
+    **/
+    bool lazy_decoding() const;
+
     using header_codec_t = codec::header_codec_t;
 
     /**
@@ -454,20 +505,9 @@ public:
 protected:
 
     /**
-    Comparator for the attributes map based on case insensitivity.
-    **/
-    struct attr_comp_t : public std::less<std::string>
-    {
-        bool operator()(const std::string& lhs, const std::string& rhs) const
-        {
-            return boost::to_lower_copy(lhs) < boost::to_lower_copy(rhs);
-        }
-    };
-
-    /**
-    Attributes map which used the appropriate comparator.
+    Attributes of a header, with the names compared case insensitively.
     **/
-    typedef std::map<std::string, std::string, attr_comp_t> attributes_t;
+    typedef header_map attributes_t;
 
     /**
     Content type header name.
@@ -580,19 +620,24 @@ protected:
     static const std::string BOUNDARY_DELIMITER;
 
     /**
-    Alphanumerics plus some special character allowed in the quoted text.
+    Size of the buffer collecting the encoded lines before they are written to a stream.
     **/
-    static const std::string QTEXT;
+    static const std::string::size_type CONTENT_BUFFER_SIZE = 65536;
+
+    /**
+    Printable ASCII characters without the alphanumerics, double quote, comma, colon, semicolon, angle and square brackets and monkey.
+    **/
+    static const std::string ATEXT;
 
     /**
-    Allowed characters for the header name. They consist of the printable ASCII characters without the colon.
+    Printable ASCII characters without the alphanumerics, brackets and backslash.
     **/
-    static const boost::regex HEADER_NAME_REGEX;
+    static const std::string DTEXT;
 
     /**
-    Allowed characters for the header value. They consist of the printable ASCII characters with the space.
+    Alphanumerics plus some special character allowed in the quoted text.
     **/
-    static const boost::regex HEADER_VALUE_REGEX;
+    static const std::string QTEXT;
 
     /**
     Content type attribute value allowed characters.
@@ -605,14 +650,48 @@ protected:
     static const std::string CONTENT_HEADER_VALUE_ALPHABET;
 
     /**
-    Regex for the message id in the strict mode.
+    Checking if a character is an ASCII letter or digit, regardless of the locale.
+
+    @param ch Character to check.
+    @return   True if alphanumeric, false if not.
     **/
-    static const std::string MESSAGE_ID_REGEX;
+    static bool is_alnum(char ch);
 
     /**
-    Regex for the message id in the non-strict mode.
+    Checking if a character is an alphanumeric or one of `ATEXT` characters.
+
+    @param ch Character to check.
+    @return   True if atext, false if not.
+    **/
+    static bool is_atext(char ch);
+
+    /**
+    Checking the header name, which consists of the printable ASCII characters without the colon, comma and double quote.
+
+    @param name Header name to check.
+    @return     True if valid, false if not.
+    **/
+    static bool is_header_name(std::string_view name);
+
+    /**
+    Checking the header value, which consists of the printable ASCII characters with the space and tab.
+
+    @param value Header value to check.
+    @return      True if valid, false if not.
+    **/
+    static bool is_header_value(std::string_view value);
+
+    /**
+    Checking the message id without the angle brackets.
+
+    In the strict mode, it consists of the atext characters around the single monkey. Otherwise, the monkey, backslash, angle brackets and
+    spaces are allowed anywhere, and the id may be empty.
+
+    @param id          Message id to check.
+    @param strict_mode Flag if the strict mode is applied.
+    @return            True if valid, false if not.
     **/
-    static const std::string MESSAGE_ID_REGEX_NS;
+    static bool is_message_id(std::string_view id, bool strict_mode);
 
     /**
     Formatting the vector of IDs.
@@ -639,6 +718,55 @@ protected:
     **/
     std::vector<std::string> parse_many_ids(const std::string& ids) const;
 
+    /**
+    Stream buffer appending the characters to a string, so formatting to a string does not copy the formatted text.
+    **/
+    class string_streambuf : public std::streambuf
+    {
+    public:
+
+        /**
+        Setting the string to append to.
+
+        @param text String to append to.
+        **/
+        explicit string_streambuf(std::string& text);
+
+        string_streambuf(const string_streambuf&) = delete;
+
+        string_streambuf(string_streambuf&&) = delete;
+
+        void operator=(const string_streambuf&) = delete;
+
+        void operator=(string_streambuf&&) = delete;
+
+    protected:
+
+        /**
+        Appending a single character.
+
+        @param ch Character to append.
+        @return   The character.
+        **/
+        int_type overflow(int_type ch) override;
+
+        /**
+        Appending the given characters.
+
+        @param chars Characters to append.
+        @param count Number of characters.
+        @return      Number of characters appended.
+        **/
+        std::streamsize xsputn(const char* chars, std::streamsize count) override;
+
+    private:
+
+        /**
+        String to append to.
+        **/
+        std::string& text_;
+    };
+
     /**
     Formatting header.
 
@@ -655,6 +783,18 @@ protected:
     **/
     std::string format_content(bool dot_escape) const;
 
+    /**
+    Formatting content by using the codec, and writing it to a stream line by line.
+
+    The Base64 content is encoded in chunks of whole lines, so only a chunk is kept in memory besides the content.
+
+    @param content_strm Stream to write the content to.
+    @param dot_escape   Flag if leading dots in lines should be escaped.
+    @return             True if any line is written, false if not.
+    @throw *            `bit7::encode(const string&)`, `bit8::encode(const string&)`, `base64::encode(const string&)`, `quoted_printable::encode(const string&)`.
+    **/
+    bool format_content(std::ostream& content_strm, bool dot_escape) const;
+
     /**
     Formatting content type to a string.
 
@@ -693,28 +833,115 @@ protected:
     **/
     std::string format_mime_name(const std::string& name) const;
 
+    /**
+    Lines of a mime part being parsed from a string, as views into the string.
+    **/
+    struct part_lines_t
+    {
+        /**
+        Mime part the lines belong to.
+        **/
+        mime* part;
+
+        /**
+        Header lines.
+        **/
+        std::vector<std::string_view> header;
+
+        /**
+        Body lines, without the nested parts.
+        **/
+        std::vector<std::string_view> body;
+    };
+
+    /**
+    Parsing the text in a single pass, by slicing it into lines and passing them to `parse_line()`.
+
+    @param text       Text to parse.
+    @param raw_text   Owner of the text, kept by the parts for the lazy decoding.
+    @param dot_escape Flag if the leading dot should be escaped.
+    @param bare_lf    Flag if the lines end by LF with optional CR, otherwise by CRLF.
+    @throw *          `parse_line(std::vector<part_lines_t>&, std::vector<part_lines_t>::size_type, std::string_view, bool,
+                      const std::shared_ptr<const void>&)`,
+                      `end_part(std::vector<part_lines_t>&, std::vector<part_lines_t>::size_type, const std::shared_ptr<const void>&)`.
+    **/
+    void parse_text(std::string_view text, const std::shared_ptr<const void>& raw_text, bool dot_escape, bool bare_lf);
+
+    /**
+    Passing a line of the parsed string to the part of the given nesting level, which passes it further to its nested part if the line belongs
+    to it.
+
+    The parts being parsed are kept on a stack, the outermost at the bottom. When a part begins, it's pushed to the stack, and when it ends,
+    it's decoded and popped from the stack.
+
+    @param parts       Stack of the parts being parsed.
+    @param level       Nesting level of the part to parse the line.
+    @param line        Line without the CRLF.
+    @param dot_escape  Flag if the leading dot should be escaped.
+    @param raw_text    Parsed string kept for the lazy decoding, null if the contents are decoded at once.
+    @throw mime_error  Line policy overflow in a header.
+    @throw *           `parse_header(const std::vector<std::string_view>&)`,
+                       `end_part(std::vector<part_lines_t>&, std::vector<part_lines_t>::size_type, const std::shared_ptr<const void>&)`.
+    **/
+    static void parse_line(std::vector<part_lines_t>& parts, std::vector<part_lines_t>::size_type level, std::string_view line, bool dot_escape,
+        const std::shared_ptr<const void>& raw_text);
+
+    /**
+    Ending the part of the given nesting level by decoding its content, and popping it with its nested parts from the stack.
+
+    As with parsing by line, the nested parts which are not ended by a boundary are not decoded.
+
+    @param parts    Stack of the parts being parsed.
+    @param level    Nesting level of the part to end.
+    @param raw_text Parsed string kept for the lazy decoding, in which case the body is kept for decoding on access, null if the content is
+                    decoded at once.
+    @throw *        `parse_content(const std::vector<std::string_view>&)`.
+    **/
+    static void end_part(std::vector<part_lines_t>& parts, std::vector<part_lines_t>::size_type level,
+        const std::shared_ptr<const void>& raw_text);
+
     /**
     Parsing header by going through header lines and calling `parse_header_line()`.
 
-    @throw * `parse_header_line(const string&)`.
+    @param header_lines Header lines, the folded ones are unfolded.
+    @throw *            `parse_header_line(const string&)`.
     **/
-    void parse_header();
+    void parse_header(const std::vector<std::string_view>& header_lines);
 
     /**
     Parsing the content by using the appropriate codec.
 
-    @throw * `bit7::decode(const string&)`, `bit8::decode(const string&)`, `base64::decode(const string&)`, `quoted_printable::decode(const string&)`.
+    @param body_lines Body lines to decode.
+    @throw *          `decode_content(const std::vector<std::string_view>&)`.
+    **/
+    void parse_content(const std::vector<std::string_view>& body_lines);
+
+    /**
+    Decoding the body lines by using the appropriate codec, the trailing empty lines are skipped.
+
+    @param body_lines Body lines to decode.
+    @return           Decoded content.
+    @throw *          `bit7::decoder_t::feed(std::string_view)`, `bit8::decoder_t::feed(std::string_view)`, `base64::decoder_t::feed(std::string_view)`,
+                      `quoted_printable::decoder_t::feed(std::string_view)`.
+    **/
+    std::string decode_content(const std::vector<std::string_view>& body_lines) const;
+
+    /**
+    Getting the content, decoded first if it's kept encoded by the lazy decoding, by a single thread if several access it.
+
+    @return Decoded content.
+    @throw  * `decode_content(const std::vector<std::string_view>&)`.
     **/
-    void parse_content();
+    const std::string& decoded_content() const;
 
     /**
     Parsing a header line for a specific header.
 
     @param header_line Header line to be parsed.
     @throw *           `parse_header_name_value(const string&, string&, string&)`,
-                       `parse_content_type(const string&, media_type_t&, string&, map<string, string>&)`,
-                       `parse_content_transfer_encoding(const string&, content_transfer_encoding_t& encoding, map<string, string>&)`,
-                       `parse_content_disposition(const string&, content_disposition_t& disposition, map<string, string>&)`.
+                       `parse_content_type(const string&, media_type_t&, string&, attributes_t&)`,
+                       `parse_content_transfer_encoding(const string&, content_transfer_encoding_t& encoding, attributes_t&)`,
+                       `parse_content_disposition(const string&, content_disposition_t& disposition, attributes_t&)`.
     **/
     virtual void parse_header_line(const std::string& header_line);
 
@@ -746,7 +973,7 @@ protected:
     @param media_subtype    Media subtype parsed from the header.
     @param attributes       Attributes parsed from the header.
     @throw mime_error       Parsing content type value failure.
-    @throw *                `parse_header_value_attributes(const string&, string&, map<string, string>&)`, `mime_type_as_enum(const string&)`.
+    @throw *                `parse_header_value_attributes(const string&, string&, attributes_t&)`, `mime_type_as_enum(const string&)`.
     **/
     void parse_content_type(const std::string& content_type_hdr, media_type_t& media_type, std::string& media_subtype, attributes_t& attributes) const;
 
@@ -757,7 +984,7 @@ protected:
     @param encoding              Content transfer encoding value parsed.
     @param attributes            Content transfer encoding attributes parsed in the the key/value format.
     @throw mime_error            Parsing content transfer encoding failure.
-    @throw *                     `parse_header_value_attributes(const string&, string&, map<string, string>&)`.
+    @throw *                     `parse_header_value_attributes(const string&, string&, attributes_t&)`.
     **/
     void parse_content_transfer_encoding(const std::string& transfer_encoding_hdr, content_transfer_encoding_t& encoding, attributes_t& attributes) const;
 
@@ -768,7 +995,7 @@ protected:
     @param disposition      Content disposition value parsed.
     @param attributes       Content disposition attributes parsed in the the key/value format.
     @throw mime_error       Parsing content disposition failure.
-    @throw *                `parse_header_value_attributes(const string&, string&, map<string, string>&)`.
+    @throw *                `parse_header_value_attributes(const string&, string&, attributes_t&)`.
     **/
     void parse_content_disposition(const std::string& content_disp_hdr, content_disposition_t& disposition, attributes_t& attributes) const;
 
@@ -809,11 +1036,6 @@ protected:
     **/
     media_type_t mime_type_as_enum(const std::string& media_type_val) const;
 
-    /**
-    Removing trailing empty lines from the body.
-    **/
-    void strip_body();
-
     /**
     Boundary for the mime part.
     **/
@@ -844,6 +1066,11 @@ protected:
     **/
     bool strict_codec_mode_;
 
+    /**
+    Flag if the contents are decoded on access instead of parsing.
+    **/
+    bool lazy_decoding_;
+
     /**
     Codec used for headers.
     **/
@@ -881,8 +1108,20 @@ protected:
 
     The content is in the form as presented to the user, thus no limits such as line policy are applied here. For such purpose, the format method
     is used,
+
+    With the lazy decoding, it's set on the first access, so it's mutable.
+    **/
+    mutable std::string content_;
+
+    /**
+    Owner of the parsed text the encoded body refers to, either a copy of the string or a mapping, null if there is no content left to decode.
+    **/
+    mutable std::shared_ptr<const void> raw_text_;
+
+    /**
+    Encoded body lines as views into the parsed string, left to decode on access.
     **/
-    std::string content_;
+    mutable std::vector<std::string_view> raw_body_;
 
     /**
     Keeps containing mime parts, if any; otherwise, it's empty vector.
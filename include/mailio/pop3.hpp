@@ -24,6 +24,9 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <utility>
 #include <istream>
 #include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/streambuf.hpp>
@@ -90,9 +93,12 @@ public:
     @param hostname Hostname of the server.
     @param port     Port of the server.
     @param timeout  Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios      Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                    be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
     @throw *        `dialog::dialog(const string&, unsigned)`.
     **/
-    pop3(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    pop3(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Sending the quit command and closing the connection.
@@ -169,6 +175,30 @@ public:
     **/
     void fetch(unsigned long message_no, message& msg, bool header_only = false);
 
+    /**
+    Fetching a message without blocking.
+
+    The operation runs on the connection context, which has to be run by the caller from a single thread. The object must outlive the
+    operation and must not be used by another operation until this one completes.
+
+    @param message_no  Message number to fetch.
+    @param header_only Flag if only the message header should be fetched.
+    @param line_policy Decoder line policy to use while parsing the message.
+    @param token       Completion token with the signature `void (std::exception_ptr, message)`. The errors are the same as of
+                       `fetch(unsigned long, message&, bool)`.
+    @return            Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_fetch(unsigned long message_no, bool header_only, codec::line_len_policy_t line_policy, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, message)>(
+            [this, message_no, header_only, line_policy](auto handler)
+            {
+                initiate_fetch(message_no, header_only, line_policy, make_async_callback<message>(std::move(handler),
+                    dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
     /**
     Removing a message in the mailbox.
 
@@ -214,6 +244,60 @@ protected:
     **/
     std::tuple<std::string, std::string> parse_status(const std::string& line);
 
+    /**
+    Formatting the command to fetch a message.
+
+    @param message_no  Message number to fetch.
+    @param header_only Flag if only the message header should be fetched.
+    @return            Command to send.
+    **/
+    static std::string fetch_command(unsigned long message_no, bool header_only);
+
+    /**
+    Checking the status of the fetch command.
+
+    @param line        Response line.
+    @param header_only Flag if only the message header is fetched.
+    @return            True if the message follows, false if the server does not support fetching the header only.
+    @throw pop3_error  Fetching message failure.
+    @throw *           `parse_status(const string&)`.
+    **/
+    bool fetch_status(const std::string& line, bool header_only);
+
+    /**
+    Passing a line of the fetched message to the message parser.
+
+    @param line        Line received.
+    @param msg         Message to parse into.
+    @param header_only Flag if only the message header is fetched.
+    @param empty_line  Flag if the previous line was empty, kept between the calls.
+    @return            True if the end of message is reached, false if not.
+    @throw *           `message::parse_by_line(const string&, bool)`.
+    **/
+    bool parse_message_line(const std::string& line, message& msg, bool header_only, bool& empty_line);
+
+    /**
+    Starting the non-blocking fetch.
+
+    @param message_no  Message number to fetch.
+    @param header_only Flag if only the message header should be fetched.
+    @param line_policy Decoder line policy to use while parsing the message.
+    @param handler     Called with the error or the fetched message.
+    **/
+    void initiate_fetch(unsigned long message_no, bool header_only, codec::line_len_policy_t line_policy,
+        std::function<void (std::exception_ptr, message)> handler);
+
+    /**
+    Receiving the lines of a message without blocking, until the end of message is reached.
+
+    @param msg         Message to parse into.
+    @param header_only Flag if only the message header is fetched.
+    @param empty_line  Flag if the previous line was empty.
+    @param handler     Called with the error or the fetched message.
+    **/
+    void async_receive_message(std::shared_ptr<message> msg, bool header_only, std::shared_ptr<bool> empty_line,
+        std::function<void (std::exception_ptr, message)> handler);
+
     /**
     Dialog to use for send/receive operations.
     **/
@@ -245,9 +329,12 @@ public:
     @param hostname Hostname of the server.
     @param port     Port of the server.
     @param timeout  Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios      Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                    be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
     @throw *        `pop3::pop3(const string&, unsigned)`.
     **/
-    pop3s(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    pop3s(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Sending the quit command and closing the connection.
@@ -13,7 +13,14 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 #pragma once
 
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "codec.hpp"
 #include "export.hpp"
@@ -52,6 +59,136 @@ public:
 
     void operator=(quoted_printable&&) = delete;
 
+    /**
+    Encoder which takes the text in chunks of any size and passes each encoded line to the sink as soon as it is complete.
+    **/
+    class MAILIO_EXPORT encoder_t
+    {
+    public:
+
+        /**
+        Starting the encoding.
+
+        @param codec    Codec whose line policy and mode are applied, it must outlive the encoder.
+        @param sink     Receiver of the encoded lines.
+        @param reserved Number of characters to subtract from the line policy.
+        **/
+        encoder_t(const quoted_printable& codec, sink_t sink, std::string::size_type reserved = 0);
+
+        /**
+        Encoding the next chunk of the text.
+
+        @param chunk       Chunk to encode.
+        @throw codec_error Bad character.
+        @throw codec_error Bad CRLF sequence.
+        **/
+        void feed(const std::string& chunk);
+
+        /**
+        Passing the last line to the sink.
+
+        @throw codec_error Bad CRLF sequence.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Encoding a character other than the carriage return.
+
+        @param ch Character to encode.
+        **/
+        void encode_char(char ch);
+
+        /**
+        Passing the line to the sink and starting a new one.
+        **/
+        void pass_line();
+
+        /**
+        Codec whose line policy and mode are applied.
+        **/
+        const quoted_printable& codec_;
+
+        /**
+        Receiver of the encoded lines.
+        **/
+        sink_t sink_;
+
+        /**
+        Number of characters to subtract from the line policy.
+        **/
+        const std::string::size_type reserved_;
+
+        /**
+        Line being encoded.
+        **/
+        std::string line_;
+
+        /**
+        Length of the line as counted by the line policy.
+        **/
+        std::string::size_type line_len_;
+
+        /**
+        Flag if the previous chunk ended with the carriage return.
+        **/
+        bool pending_cr_;
+
+        /**
+        Number of the empty lines held back.
+        **/
+        std::string::size_type empty_lines_;
+    };
+
+    /**
+    Decoder which takes the text line by line and passes the decoded text to the sink.
+    **/
+    class MAILIO_EXPORT decoder_t
+    {
+    public:
+
+        /**
+        Starting the decoding.
+
+        @param codec Codec whose line policy and mode are applied, it must outlive the decoder.
+        @param sink  Receiver of the decoded text.
+        **/
+        decoder_t(const quoted_printable& codec, sink_t sink);
+
+        /**
+        Decoding the next line.
+
+        @param line        Quoted printable encoded line.
+        @throw codec_error Bad line policy.
+        @throw codec_error Bad character.
+        @throw codec_error Bad hexadecimal digit.
+        **/
+        void feed(std::string_view line);
+
+        /**
+        Finishing the decoding, the trailing whitespace is dropped.
+        **/
+        void finish();
+
+    private:
+
+        /**
+        Codec whose line policy and mode are applied.
+        **/
+        const quoted_printable& codec_;
+
+        /**
+        Receiver of the decoded text.
+        **/
+        sink_t sink_;
+
+        /**
+        Decoded text not yet passed to the sink.
+        **/
+        std::string dec_text_;
+    };
+
     /**
     Encoding a string into vector of quoted printable encoded strings by applying the line policy.
 
@@ -63,6 +200,20 @@ public:
     **/
     std::vector<std::string> encode(const std::string& text, std::string::size_type reserved = 0) const;
 
+    /**
+    Encoding a string by applying the line policy, and appending the encoded lines together with their line endings to the given string.
+
+    The capacity of the given string is reserved beforehand by counting the characters to be escaped, so the encoding allocates at most
+    once.
+
+    @param text        String to encode.
+    @param enc_text    String to append the encoded lines to.
+    @param reserved    Number of characters to subtract from the line policy.
+    @throw codec_error Bad character.
+    @throw codec_error Bad CRLF sequence.
+    **/
+    void encode(const std::string& text, std::string& enc_text, std::string::size_type reserved = 0) const;
+
     /**
     Decoding a vector of quoted printable strings to string by applying the line policy.
 
@@ -83,6 +234,16 @@ public:
 
 private:
 
+    /**
+    Flags of the characters which the encoder copies as they are when not in the Q codec mode, indexed by the character code.
+    **/
+    static const std::array<bool, 256> ENCODER_PLAIN_CHARS;
+
+    /**
+    Flags of the characters which the decoder copies as they are, indexed by the character code.
+    **/
+    static const std::array<bool, 256> DECODER_PLAIN_CHARS;
+
     /**
     Check if a character is in the Quoted Printable character set.
 
@@ -99,3 +260,8 @@ private:
 
 
 } // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
@@ -0,0 +1,406 @@
+/*
+
+session_pool.hpp
+----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#pragma once
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4251)
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "dialog.hpp"
+#include "smtp.hpp"
+#include "imap.hpp"
+#include "export.hpp"
+
+
+namespace mailio
+{
+
+
+/**
+Thread safe pool of authenticated sessions, so they can be reused instead of connecting, negotiating TLS and authenticating again.
+
+Sessions are kept per server, credentials and TLS options. The number of sessions open towards a server (either leased or idle) is limited,
+idle sessions are checked by the `NOOP` command before being leased again, and the ones idle for too long are closed.
+
+The pool is instantiated for `smtps` and `imaps`.
+**/
+template<typename Session>
+class MAILIO_EXPORT session_pool
+{
+public:
+
+    /**
+    Authentication method of the session.
+    **/
+    typedef typename Session::auth_method_t auth_method_t;
+
+    /**
+    Parameters which identify a session, so a session is reused only for the same ones.
+    **/
+    struct session_params_t
+    {
+        /**
+        Hostname of the server.
+        **/
+        std::string hostname;
+
+        /**
+        Port of the server.
+        **/
+        unsigned port;
+
+        /**
+        Username to authenticate.
+        **/
+        std::string username;
+
+        /**
+        Password to authenticate.
+        **/
+        std::string password;
+
+        /**
+        Authentication method to use.
+        **/
+        auth_method_t method;
+
+        /**
+        SSL options to set.
+        **/
+        dialog_ssl::ssl_options_t ssl_options;
+
+        /**
+        Ordering the parameters, so they can be used as a key.
+
+        @param other Parameters to compare with.
+        @return      True if these parameters are less than the other ones.
+        **/
+        bool operator<(const session_params_t& other) const;
+    };
+
+    /**
+    Usage statistics of the pool.
+    **/
+    struct pool_stat_t
+    {
+        /**
+        Number of leases served by an idle session.
+        **/
+        unsigned long hits;
+
+        /**
+        Number of leases which required a new session.
+        **/
+        unsigned long misses;
+
+        /**
+        Number of idle sessions which failed the check before being leased.
+        **/
+        unsigned long failed_checks;
+
+        /**
+        Number of idle sessions closed because of the idle timeout, or to make a room for a session with other parameters.
+        **/
+        unsigned long evictions;
+
+        /**
+        Setting all the counters to zero.
+        **/
+        pool_stat_t() : hits(0), misses(0), failed_checks(0), evictions(0)
+        {
+        }
+    };
+
+    /**
+    Session leased from the pool, returned to the pool when destroyed.
+
+    The pool must outlive its leases.
+    **/
+    class lease_t
+    {
+    public:
+
+        /**
+        Taking over the session of the given lease.
+
+        @param other Lease to move.
+        **/
+        lease_t(lease_t&& other) noexcept;
+
+        /**
+        Returning the session to the pool, unless it is invalidated.
+        **/
+        ~lease_t();
+
+        lease_t(const lease_t&) = delete;
+
+        void operator=(const lease_t&) = delete;
+
+        void operator=(lease_t&&) = delete;
+
+        /**
+        Accessing the leased session.
+
+        @return Leased session.
+        **/
+        Session& operator*() const;
+
+        /**
+        Accessing the leased session.
+
+        @return Leased session.
+        **/
+        Session* operator->() const;
+
+        /**
+        Marking the session as not reusable, for instance after a network error, so it is closed instead of returned to the pool.
+        **/
+        void invalidate();
+
+    private:
+
+        friend class session_pool;
+
+        /**
+        Leasing the given session.
+
+        @param pool    Pool to return the session to.
+        @param params  Parameters of the session.
+        @param session Leased session.
+        **/
+        lease_t(session_pool* pool, const session_params_t& params, std::unique_ptr<Session> session);
+
+        /**
+        Pool to return the session to.
+        **/
+        session_pool* pool_;
+
+        /**
+        Parameters of the session.
+        **/
+        session_params_t params_;
+
+        /**
+        Leased session.
+        **/
+        std::unique_ptr<Session> session_;
+
+        /**
+        Flag if the session is returned to the pool.
+        **/
+        bool valid_;
+    };
+
+    /**
+    Creating an empty pool.
+
+    @param max_sessions Maximum number of sessions open towards the same server and port.
+    @param idle_timeout Time after which an idle session is closed.
+    @param timeout      Network timeout of the sessions, as described by the session constructor.
+    @param wait_timeout Maximum time to wait for a session when the maximum number of sessions is reached. If zero, then it waits indefinitely.
+    @throw pool_error   Zero sessions not allowed.
+    **/
+    session_pool(std::size_t max_sessions, std::chrono::milliseconds idle_timeout, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::chrono::milliseconds wait_timeout = std::chrono::milliseconds(0));
+
+    /**
+    Closing all the idle sessions.
+    **/
+    ~session_pool();
+
+    session_pool(const session_pool&) = delete;
+
+    session_pool(session_pool&&) = delete;
+
+    void operator=(const session_pool&) = delete;
+
+    void operator=(session_pool&&) = delete;
+
+    /**
+    Leasing an authenticated session, either the idle one with the same parameters or a new one.
+
+    @param params     Parameters of the session.
+    @return           Leased session.
+    @throw pool_error Waiting for a session timed out.
+    @throw *          Session constructor, `ssl_options(const dialog_ssl::ssl_options_t&)`, `authenticate(const std::string&, const std::string&,
+                      auth_method_t)`.
+    **/
+    lease_t lease(const session_params_t& params);
+
+    /**
+    Closing the sessions which are idle longer than the idle timeout.
+
+    @return Number of closed sessions.
+    **/
+    std::size_t evict_idle();
+
+    /**
+    Getting the usage statistics.
+
+    @return Statistics since the pool is created.
+    **/
+    pool_stat_t statistics() const;
+
+    /**
+    Getting the number of idle sessions.
+
+    @return Number of idle sessions.
+    **/
+    std::size_t idle_sessions() const;
+
+protected:
+
+    /**
+    Server as the hostname and port.
+    **/
+    typedef std::pair<std::string, unsigned> server_t;
+
+    /**
+    Session not in use, with the time when it was returned to the pool.
+    **/
+    typedef std::pair<std::unique_ptr<Session>, std::chrono::steady_clock::time_point> idle_session_t;
+
+    /**
+    Returning a session to the pool.
+
+    @param params  Parameters of the session.
+    @param session Session to return.
+    @param valid   Flag if the session can be reused.
+    **/
+    void release(const session_params_t& params, std::unique_ptr<Session> session, bool valid);
+
+    /**
+    Creating and authenticating a new session.
+
+    @param params Parameters of the session.
+    @return       New session.
+    @throw *      See `lease(const session_params_t&)`.
+    **/
+    std::unique_ptr<Session> create(const session_params_t& params) const;
+
+    /**
+    Moving the expired idle sessions to the given list, so they are closed once the lock is released.
+
+    Must be called with the lock held.
+
+    @param expired List to store the expired sessions.
+    **/
+    void collect_expired(std::list<std::unique_ptr<Session>>& expired);
+
+    /**
+    Taking an idle session out of the pool, so it is closed once the lock is released.
+
+    Must be called with the lock held.
+
+    @param server  Server of the session.
+    @param closed  List to store the taken session.
+    @param session Session to take.
+    **/
+    void forget(const server_t& server, std::list<std::unique_ptr<Session>>& closed, std::unique_ptr<Session> session);
+
+    /**
+    Maximum number of sessions towards a server.
+    **/
+    const std::size_t max_sessions_;
+
+    /**
+    Time after which an idle session is closed.
+    **/
+    const std::chrono::milliseconds idle_timeout_;
+
+    /**
+    Network timeout of the sessions.
+    **/
+    const std::chrono::milliseconds timeout_;
+
+    /**
+    Maximum time to wait for a session.
+    **/
+    const std::chrono::milliseconds wait_timeout_;
+
+    /**
+    Mutex guarding the pool state.
+    **/
+    mutable std::mutex mutex_;
+
+    /**
+    Notified when a session is returned or closed.
+    **/
+    std::condition_variable released_;
+
+    /**
+    Idle sessions per parameters, the most recently used at the back.
+    **/
+    std::map<session_params_t, std::list<idle_session_t>> idle_;
+
+    /**
+    Number of open sessions per server, either leased or idle.
+    **/
+    std::map<server_t, std::size_t> open_;
+
+    /**
+    Usage statistics.
+    **/
+    pool_stat_t stat_;
+};
+
+
+extern template class session_pool<smtps>;
+extern template class session_pool<imaps>;
+
+
+/**
+Error thrown by the session pool.
+**/
+class pool_error : public std::runtime_error
+{
+public:
+
+    /**
+    Calling the parent constructor.
+
+    @param msg Error message.
+    **/
+    explicit pool_error(const std::string& msg) : std::runtime_error(msg)
+    {
+    }
+
+    /**
+    Calling the parent constructor.
+
+    @param msg Error message.
+    **/
+    explicit pool_error(const char* msg) : std::runtime_error(msg)
+    {
+    }
+};
+
+
+} // namespace mailio
+
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
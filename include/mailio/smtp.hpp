@@ -21,8 +21,12 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <string>
 #include <memory>
 #include <tuple>
+#include <vector>
+#include <exception>
+#include <functional>
 #include <stdexcept>
 #include <chrono>
+#include <streambuf>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/streambuf.hpp>
@@ -58,10 +62,13 @@ public:
     @param hostname   Hostname of the server.
     @param port       Port of the server.
     @param timeout    Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios        Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                      be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
     @throw smtp_error Empty source hostname not allowed.
     @throw *          `dialog::dialog`, `read_hostname`.
     **/
-    smtp(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    smtp(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Sending the quit command and closing the connection.
@@ -89,9 +96,40 @@ public:
     **/
     std::string authenticate(const std::string& username, const std::string& password, auth_method_t method);
 
+    /**
+    Recipient rejected by the server.
+    **/
+    struct rejected_recipient_t
+    {
+        /**
+        Recipient address or group name.
+        **/
+        std::string address;
+
+        /**
+        Status of the server reply.
+        **/
+        int status;
+
+        /**
+        Text of the server reply.
+        **/
+        std::string reply;
+    };
+
     /**
     Submitting a message.
 
+    Many messages can be submitted over the same session. If a message is rejected, the session is reset so it is ready for the next one.
+
+    If the server supports the command pipelining (RFC 2920), then the envelope is sent in a single batch, otherwise command by command.
+    Either way, the rejected recipients do not abort the submission as long as at least one recipient is accepted, but they are stored so
+    they can be retrieved by `rejected_recipients()`. The submission is aborted if the sender is rejected, or if all the recipients are
+    rejected in which case the rejection of the first one is reported.
+
+    The message is formatted directly to the connection once the server accepts the data. If the formatting fails at that point, the
+    connection is closed, since the session cannot be reset in the middle of the data.
+
     @param msg        Mail message to send.
     @return           The SMTP server's reply on accepting the message.
     @throw smtp_error Mail sender rejection.
@@ -102,10 +140,65 @@ public:
     @throw smtp_error Mail bcc recipient rejection.
     @throw smtp_error Mail group bcc recipient rejection.
     @throw smtp_error Mail message rejection.
-    @throw *          `parse_line(const string&)`, `dialog::send(const string&)`, `dialog::receive()`.
+    @throw *          `parse_line(const string&)`, `dialog::send(const string&)`, `dialog::receive()`, `message::format(std::ostream&, bool)`.
     **/
     std::string submit(const message& msg);
 
+    /**
+    Aborting the current mail transaction by the `RSET` command, so the session can be used for another message.
+
+    @throw smtp_error Session reset failure.
+    @throw *          `parse_line(const string&)`, `dialog::send(const string&)`, `dialog::receive()`.
+    **/
+    void reset();
+
+    /**
+    Checking if the session is alive by the `NOOP` command.
+
+    @return True if the server replies positively, false if it does not or the connection is broken.
+    **/
+    bool noop();
+
+    /**
+    Submitting a message without blocking.
+
+    The operation runs on the connection context, which has to be run by the caller from a single thread. The object must outlive the
+    operation and must not be used by another operation until this one completes. The message is formatted by this call, before the
+    operation is initiated, so it does not have to outlive the call even if the completion token defers the operation.
+
+    Unlike `submit(const message&)`, the whole formatted message is kept in memory until the operation completes, since the formatting cannot
+    be suspended between the writes. The message is still sent in the bounded chunks, each one by its own write, so the timeout applies to a
+    chunk rather than to the whole message.
+
+    @param msg   Mail message to send.
+    @param token Completion token with the signature `void (std::exception_ptr, std::string)`, the string being the server's reply on accepting
+                 the message. The errors are the same as of `submit(const message&)`.
+    @return      Depending on the completion token.
+    **/
+    template<typename CompletionToken>
+    auto async_submit(const message& msg, CompletionToken&& token)
+    {
+        return boost::asio::async_initiate<CompletionToken, void (std::exception_ptr, std::string)>(
+            [this, submission = prepare_submission(msg)](auto handler)
+            {
+                initiate_submit(submission, make_async_callback<std::string>(std::move(handler), dlg_->io_context()->get_executor()));
+            }, token);
+    }
+
+    /**
+    Getting the recipients rejected by the server during the last submission.
+
+    @return Rejected recipients, in the order they are listed in the message.
+    **/
+    const std::vector<rejected_recipient_t>& rejected_recipients() const;
+
+    /**
+    Checking if the server advertises the command pipelining, as found by the last `EHLO` command.
+
+    @return True if it does, false if not.
+    **/
+    bool pipelining() const;
+
     /**
     Setting the source hostname.
 
@@ -148,13 +241,275 @@ protected:
     void auth_login(const std::string& username, const std::string& password);
 
     /**
-    Issuing `EHLO` and/or `HELO` commands.
+    Issuing `EHLO` and/or `HELO` commands, determining whether the server supports the command pipelining.
 
     @throw smtp_error Initial message rejection.
     @throw *          `parse_line(const string&)`, `dialog::send(const string&)`, `dialog::receive()`.
     **/
     void ehlo();
 
+    /**
+    Envelope command of a mail transaction.
+    **/
+    struct envelope_command_t
+    {
+        /**
+        Command to send.
+        **/
+        std::string command;
+
+        /**
+        Sender or recipient address of the command.
+        **/
+        std::string address;
+
+        /**
+        Error message used if the server rejects the command.
+        **/
+        std::string rejection;
+    };
+
+    /**
+    Creating the envelope commands of a message, i.e. the sender and all the recipients.
+
+    @param msg Message to send.
+    @return    Envelope commands in the order to be sent.
+    @throw *   `std::vector::at`.
+    **/
+    static std::vector<envelope_command_t> envelope(const message& msg);
+
+    /**
+    Stream buffer sending the message to the server in bounded chunks, escaping the leading dots of lines on the fly.
+    **/
+    class data_streambuf : public std::streambuf
+    {
+    public:
+
+        /**
+        Size of the buffer which triggers sending.
+        **/
+        static const std::string::size_type BUFFER_SIZE = 65536;
+
+        /**
+        Creating an empty buffer.
+
+        @param dlg Dialog to send the message over.
+        **/
+        explicit data_streambuf(std::shared_ptr<dialog> dlg);
+
+        data_streambuf(const data_streambuf&) = delete;
+
+        data_streambuf(data_streambuf&&) = delete;
+
+        void operator=(const data_streambuf&) = delete;
+
+        void operator=(data_streambuf&&) = delete;
+
+        /**
+        Sending the buffered characters, the CRLF and the end of message line by a single write.
+
+        @throw * `dialog::send(const std::vector<boost::asio::const_buffer>&)`.
+        **/
+        void finish();
+
+        /**
+        Appending the characters to a chunk with the leading dots of lines escaped, until the chunk reaches the size which triggers sending.
+
+        @param chars      Characters to append.
+        @param count      Number of characters.
+        @param chunk      Chunk to append to.
+        @param line_start Flag if the next character starts a line, updated by the appended characters.
+        @return           Number of the characters appended.
+        **/
+        static std::string::size_type stuff(const char* chars, std::string::size_type count, std::string& chunk, bool& line_start);
+
+    protected:
+
+        /**
+        Buffering a single character.
+
+        @param ch Character to buffer.
+        @return   The character.
+        @throw *  `dialog::send(const std::string&, bool)`.
+        **/
+        int_type overflow(int_type ch) override;
+
+        /**
+        Buffering the given characters.
+
+        @param chars Characters to buffer.
+        @param count Number of characters.
+        @return      Number of characters buffered.
+        @throw *     `dialog::send(const std::string&, bool)`.
+        **/
+        std::streamsize xsputn(const char* chars, std::streamsize count) override;
+
+        /**
+        Sending the buffered characters.
+
+        @return  Zero.
+        @throw * `dialog::send(const std::string&, bool)`.
+        **/
+        int sync() override;
+
+    private:
+
+        /**
+        Dialog to send the message over.
+        **/
+        std::shared_ptr<dialog> dlg_;
+
+        /**
+        Characters not sent yet.
+        **/
+        std::string buffer_;
+
+        /**
+        Flag if the next character starts a line.
+        **/
+        bool line_start_;
+    };
+
+    /**
+    Sending the envelope and the message.
+
+    The message is formatted directly to the connection, so the connection is closed if the formatting fails after the data is started.
+
+    @param commands   Envelope commands.
+    @param msg        Message to send.
+    @return           The server's reply on accepting the message.
+    @throw smtp_error See `submit(const message&)`.
+    @throw *          `parse_line(const string&)`, `dialog::send(const string&)`, `dialog::receive()`, `message::format(std::ostream&, bool)`.
+    **/
+    std::string transaction(const std::vector<envelope_command_t>& commands, const message& msg);
+
+    /**
+    Resetting the session after a rejected message, ignoring errors since the original rejection is the one to be reported.
+    **/
+    void reset_session();
+
+    /**
+    Joining the envelope commands and the data command into a single pipelined batch.
+
+    @param commands Envelope commands.
+    @return         Commands separated by CRLF, without the trailing one.
+    **/
+    static std::string pipeline(const std::vector<envelope_command_t>& commands);
+
+    /**
+    Checking the replies to the envelope commands, and storing the rejected recipients.
+
+    @param commands   Envelope commands.
+    @param replies    Tokens of the replies to the envelope commands, in the same order. If the sender is rejected, the replies to the
+                      recipients may be missing.
+    @throw smtp_error Mail sender rejection.
+    @throw smtp_error Rejection of the first recipient, if all of them are rejected.
+    **/
+    void check_envelope(const std::vector<envelope_command_t>& commands, const std::vector<std::tuple<int, bool, std::string>>& replies);
+
+    /**
+    Receiving a reply, possibly consisting of several lines.
+
+    @return Tokens of the last line of the reply.
+    @throw * `parse_line(const string&)`, `dialog::receive()`.
+    **/
+    std::tuple<int, bool, std::string> receive_reply();
+
+    /**
+    Envelope commands and formatted message of a non-blocking submission, or the error of making them.
+    **/
+    struct submission_t
+    {
+        /**
+        Envelope commands of the message.
+        **/
+        std::vector<envelope_command_t> commands;
+
+        /**
+        Message formatted with the leading dots not escaped yet, since they are escaped chunk by chunk when sending.
+        **/
+        std::string msg_str;
+
+        /**
+        Error of making the envelope or formatting the message, null pointer if there is none.
+        **/
+        std::exception_ptr error;
+    };
+
+    /**
+    Making the envelope commands and formatting the message, so the submission does not depend on the message any longer.
+
+    @param msg Message to send.
+    @return    Submission to initiate, with the error stored instead of thrown.
+    **/
+    static std::shared_ptr<submission_t> prepare_submission(const message& msg);
+
+    /**
+    Starting the non-blocking submission.
+
+    @param submission Prepared submission.
+    @param handler    Called with the error or the server's reply on accepting the message.
+    **/
+    void initiate_submit(std::shared_ptr<submission_t> submission, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Sending the envelope commands one by one, then the message itself, without blocking.
+
+    @param commands Envelope commands.
+    @param replies  Tokens of the replies received so far, the next command to send is the one following them.
+    @param msg_str  Formatted message.
+    @param handler  Called with the error or the server's reply on accepting the message.
+    **/
+    void async_envelope(std::shared_ptr<std::vector<envelope_command_t>> commands,
+        std::shared_ptr<std::vector<std::tuple<int, bool, std::string>>> replies, std::shared_ptr<std::string> msg_str, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Receiving the replies to the pipelined envelope and data commands without blocking, then sending the message itself.
+
+    @param commands Envelope commands.
+    @param replies  Tokens of the replies received so far.
+    @param msg_str  Formatted message.
+    @param handler  Called with the error or the server's reply on accepting the message.
+    **/
+    void async_pipelined_replies(std::shared_ptr<std::vector<envelope_command_t>> commands,
+        std::shared_ptr<std::vector<std::tuple<int, bool, std::string>>> replies, std::shared_ptr<std::string> msg_str,
+        std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Sending the message once the data command is accepted, without blocking.
+
+    @param msg_str Formatted message, sent in the escaped chunks of the same size as by `data_streambuf`.
+    @param handler Called with the error or the server's reply on accepting the message.
+    **/
+    void async_data(std::shared_ptr<std::string> msg_str, std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Sending the next chunk of the message without blocking, the last one together with the end of data marker.
+
+    @param msg_str    Formatted message.
+    @param chunk      Chunk reused for escaping the message.
+    @param offset     Offset of the message part not sent yet.
+    @param line_start Flag if the part not sent yet starts a line.
+    @param handler    Called with the error or the server's reply on accepting the message.
+    **/
+    void async_data_chunk(std::shared_ptr<std::string> msg_str, std::shared_ptr<std::string> chunk, std::string::size_type offset, bool line_start,
+        std::function<void (std::exception_ptr, std::string)> handler);
+
+    /**
+    Sending a command and receiving its reply without blocking.
+
+    @param command Command to send.
+    @param handler Called with the error or the tokens of the last reply line.
+    **/
+    void async_command(const std::string& command, std::function<void (std::exception_ptr, std::tuple<int, bool, std::string>)> handler);
+
+    /**
+    Receiving a reply, possibly consisting of several lines, without blocking.
+
+    @param handler Called with the error or the tokens of the last reply line.
+    **/
+    void async_receive_reply(std::function<void (std::exception_ptr, std::tuple<int, bool, std::string>)> handler);
+
     /**
     Reading the source hostname.
 
@@ -218,6 +573,16 @@ protected:
     Dialog to use for send/receive operations.
     **/
     std::shared_ptr<dialog> dlg_;
+
+    /**
+    Flag if the server advertises the command pipelining.
+    **/
+    bool pipelining_;
+
+    /**
+    Recipients rejected by the server during the last submission.
+    **/
+    std::vector<rejected_recipient_t> rejected_recipients_;
 };
 
 
@@ -247,9 +612,12 @@ public:
     @param hostname Hostname of the server.
     @param port     Port of the server.
     @param timeout  Network timeout after which I/O operations fail. If zero, then no timeout is set i.e. I/O operations are synchronous.
+    @param ios      Asio context to run the I/O on. If null, then the connection creates its own context. A shared context must not
+                    be run by `io_context::run()` while the blocking methods are called, see `dialog::dialog`.
     @throw *        `smtp::smtp(const string&, unsigned)`.
     **/
-    smtps(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    smtps(const std::string& hostname, unsigned port, std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+        std::shared_ptr<boost::asio::io_context> ios = nullptr);
 
     /**
     Sending the quit command and closing the connection.
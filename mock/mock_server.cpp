@@ -0,0 +1,624 @@
+/*
+
+mock_server.cpp
+---------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#endif
+#include "mock_server.hpp"
+
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::size_t;
+using std::min;
+using std::any_of;
+using std::stoul;
+using std::thread;
+using std::mutex;
+using std::lock_guard;
+using std::make_shared;
+using std::make_unique;
+using std::unique_ptr;
+using std::runtime_error;
+using std::atomic;
+using boost::asio::buffer;
+using boost::asio::streambuf;
+using boost::asio::transfer_at_least;
+using boost::asio::ip::tcp;
+using boost::asio::ip::address_v4;
+using boost::asio::ssl::context;
+using boost::algorithm::to_upper_copy;
+using boost::algorithm::replace_all_copy;
+using boost::algorithm::split;
+using boost::algorithm::is_any_of;
+
+
+namespace mailio
+{
+
+
+namespace
+{
+
+const string END_OF_LINE = "\r\n";
+
+
+/**
+Creating the TLS context with a self signed certificate for the localhost.
+
+@return TLS server context.
+@throw  runtime_error Creating the key or the certificate failure.
+**/
+unique_ptr<context> make_tls_context()
+{
+    unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> key(EVP_EC_gen("P-256"), EVP_PKEY_free);
+    unique_ptr<X509, decltype(&X509_free)> cert(X509_new(), X509_free);
+    if (key == nullptr || cert == nullptr)
+        throw runtime_error("Creating certificate failure.");
+
+    X509_set_version(cert.get(), 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert.get()), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert.get()), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert.get()), 24 * 60 * 60);
+    X509_set_pubkey(cert.get(), key.get());
+    X509_NAME* name = X509_get_subject_name(cert.get());
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert.get(), name);
+    if (X509_sign(cert.get(), key.get(), EVP_sha256()) == 0)
+        throw runtime_error("Creating certificate failure.");
+
+    auto ctx = make_unique<context>(context::tls_server);
+    if (SSL_CTX_use_certificate(ctx->native_handle(), cert.get()) != 1 || SSL_CTX_use_PrivateKey(ctx->native_handle(), key.get()) != 1)
+        throw runtime_error("Creating certificate failure.");
+    return ctx;
+}
+
+
+/**
+Receiving a line from the stream.
+
+@param stream Stream to read from.
+@param buf    Data received but not consumed yet.
+@return       Line without the CRLF.
+**/
+template<typename Stream>
+string read_line_from(Stream& stream, streambuf& buf)
+{
+    size_t line_len = boost::asio::read_until(stream, buf, END_OF_LINE);
+    string line(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + line_len - END_OF_LINE.length());
+    buf.consume(line_len);
+    return line;
+}
+
+
+/**
+Receiving the given number of bytes from the stream.
+
+@param stream   Stream to read from.
+@param buf      Data received but not consumed yet.
+@param bytes_no Number of bytes to receive.
+@return         Received bytes.
+**/
+template<typename Stream>
+string read_bytes_from(Stream& stream, streambuf& buf, size_t bytes_no)
+{
+    if (buf.size() < bytes_no)
+        boost::asio::read(stream, buf, transfer_at_least(bytes_no - buf.size()));
+    string bytes(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + bytes_no);
+    buf.consume(bytes_no);
+    return bytes;
+}
+
+
+/**
+Splitting off the first word of a line.
+
+@param line Line to split, the rest after the word and the space remains.
+@return     First word.
+**/
+string split_word(string& line)
+{
+    string::size_type pos = line.find(' ');
+    string word = line.substr(0, pos);
+    line = pos == string::npos ? "" : line.substr(pos + 1);
+    return word;
+}
+
+} // anonymous namespace
+
+
+mock_connection::mock_connection(tcp::socket socket, context* context) : socket_(std::move(socket))
+{
+    socket_.set_option(tcp::no_delay(true));
+    if (context != nullptr)
+    {
+        ssl_socket_ = make_unique<boost::asio::ssl::stream<tcp::socket&>>(socket_, *context);
+        ssl_socket_->handshake(boost::asio::ssl::stream_base::server);
+    }
+}
+
+
+string mock_connection::read_line()
+{
+    if (ssl_socket_ != nullptr)
+        return read_line_from(*ssl_socket_, buffer_);
+    return read_line_from(socket_, buffer_);
+}
+
+
+string mock_connection::read_bytes(size_t bytes_no)
+{
+    if (ssl_socket_ != nullptr)
+        return read_bytes_from(*ssl_socket_, buffer_, bytes_no);
+    return read_bytes_from(socket_, buffer_, bytes_no);
+}
+
+
+void mock_connection::write(const string& data)
+{
+    if (ssl_socket_ != nullptr)
+        boost::asio::write(*ssl_socket_, buffer(data));
+    else
+        boost::asio::write(socket_, buffer(data));
+}
+
+
+void mock_connection::write_line(const string& line)
+{
+    write(line + END_OF_LINE);
+}
+
+
+mock_server::mock_server(bool tls) : acceptor_(ios_, tcp::endpoint(address_v4::loopback(), 0)), stopped_(true)
+{
+    if (tls)
+        context_ = make_tls_context();
+}
+
+
+mock_server::~mock_server()
+{
+    stop();
+}
+
+
+unsigned mock_server::port() const
+{
+    return acceptor_.local_endpoint().port();
+}
+
+
+void mock_server::script(const string& command, const vector<string>& reply)
+{
+    lock_guard<mutex> lock(mutex_);
+    script_[to_upper_copy(command)] = reply;
+}
+
+
+vector<string> mock_server::commands() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return commands_;
+}
+
+
+void mock_server::start()
+{
+    stopped_ = false;
+    acceptor_thread_ = thread(&mock_server::accept_loop, this);
+}
+
+
+void mock_server::stop()
+{
+    if (stopped_.exchange(true))
+        return;
+
+    // the blocking accept is woken up by a connection which is dropped at once
+    try
+    {
+        boost::asio::io_context ios;
+        tcp::socket waker(ios);
+        waker.connect(tcp::endpoint(address_v4::loopback(), port()));
+    }
+    catch (const boost::system::system_error&)
+    {
+    }
+    acceptor_thread_.join();
+
+    for (auto& conn : connections_)
+    {
+        if (!*conn.closed)
+#ifdef _WIN32
+            ::shutdown(conn.handle, SD_BOTH);
+#else
+            ::shutdown(conn.handle, SHUT_RDWR);
+#endif
+        conn.thread.join();
+    }
+    connections_.clear();
+}
+
+
+bool mock_server::reply_scripted(mock_connection& conn, const string& command, const string& tag) const
+{
+    string reply;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto lines = script_.find(to_upper_copy(command));
+        if (lines == script_.end())
+            return false;
+        for (const auto& line : lines->second)
+            reply += replace_all_copy(line, "$TAG", tag) + END_OF_LINE;
+    }
+    conn.write(reply);
+    return true;
+}
+
+
+void mock_server::record(const string& line)
+{
+    lock_guard<mutex> lock(mutex_);
+    commands_.push_back(line);
+}
+
+
+void mock_server::accept_loop()
+{
+    while (!stopped_)
+    {
+        tcp::socket socket(ios_);
+        boost::system::error_code error;
+        acceptor_.accept(socket, error);
+        if (stopped_)
+            break;
+        if (error)
+            continue;
+
+        connections_.remove_if([](connection_t& conn)
+            {
+                if (!*conn.closed)
+                    return false;
+                conn.thread.join();
+                return true;
+            });
+
+        auto closed = make_shared<atomic<bool>>(false);
+        auto handle = socket.native_handle();
+        thread conn_thread([this, closed, socket = std::move(socket)]() mutable
+            {
+                try
+                {
+                    mock_connection conn(std::move(socket), context_.get());
+                    serve(conn);
+                }
+                catch (...)
+                {
+                }
+                *closed = true;
+            });
+        connections_.push_back(connection_t{std::move(conn_thread), handle, closed});
+    }
+}
+
+
+mock_smtp::mock_smtp(bool tls) : mock_server(tls), messages_received_(0)
+{
+    start();
+}
+
+
+mock_smtp::~mock_smtp()
+{
+    stop();
+}
+
+
+unsigned long mock_smtp::messages_received() const
+{
+    return messages_received_;
+}
+
+
+vector<string> mock_smtp::messages() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return messages_;
+}
+
+
+void mock_smtp::reject_recipient(const string& address)
+{
+    lock_guard<mutex> lock(mutex_);
+    rejected_recipients_.push_back(address);
+}
+
+
+void mock_smtp::serve(mock_connection& conn)
+{
+    auto is_rejected = [this](const string& args)
+    {
+        lock_guard<mutex> lock(mutex_);
+        return any_of(rejected_recipients_.begin(), rejected_recipients_.end(),
+            [&args](const string& address) { return args.find("<" + address + ">") != string::npos; });
+    };
+
+    conn.write_line("220 localhost mailio mock ESMTP");
+    while (true)
+    {
+        string line = conn.read_line();
+        record(line);
+        const string verb = to_upper_copy(split_word(line));
+        if (reply_scripted(conn, verb))
+            continue;
+
+        if (verb == "EHLO")
+            conn.write("250-localhost" + END_OF_LINE + "250-PIPELINING" + END_OF_LINE + "250 AUTH LOGIN" + END_OF_LINE);
+        else if (verb == "HELO")
+            conn.write_line("250 localhost");
+        else if (verb == "AUTH")
+        {
+            conn.write_line("334 VXNlcm5hbWU6");
+            conn.read_line();
+            conn.write_line("334 UGFzc3dvcmQ6");
+            conn.read_line();
+            conn.write_line("235 2.7.0 Authentication successful");
+        }
+        else if (verb == "RCPT" && is_rejected(line))
+            conn.write_line("550 5.1.1 Recipient rejected");
+        else if (verb == "MAIL" || verb == "RCPT" || verb == "RSET" || verb == "NOOP")
+            conn.write_line("250 2.0.0 OK");
+        else if (verb == "DATA")
+        {
+            conn.write_line("354 Go ahead");
+            string msg;
+            for (string data_line = conn.read_line(); data_line != "."; data_line = conn.read_line())
+                msg += (data_line.compare(0, 1, ".") == 0 ? data_line.substr(1) : data_line) + END_OF_LINE;
+            {
+                lock_guard<mutex> lock(mutex_);
+                messages_.push_back(msg);
+            }
+            messages_received_++;
+            conn.write_line("250 2.0.0 OK queued as " + to_string(messages_received_));
+        }
+        else if (verb == "QUIT")
+        {
+            conn.write_line("221 2.0.0 Bye");
+            return;
+        }
+        else
+            conn.write_line("502 5.5.2 Command not recognized");
+    }
+}
+
+
+mock_imap::mock_imap(bool tls, const vector<string>& messages) : mock_server(tls), messages_(messages)
+{
+    start();
+}
+
+
+mock_imap::~mock_imap()
+{
+    stop();
+}
+
+
+void mock_imap::serve(mock_connection& conn)
+{
+    conn.write_line("* OK mailio mock IMAP4rev1 ready");
+    while (true)
+    {
+        string args = conn.read_line();
+        record(args);
+        const string tag = split_word(args);
+        string verb = to_upper_copy(split_word(args));
+        bool is_uids = false;
+        if (verb == "UID")
+        {
+            is_uids = true;
+            verb = to_upper_copy(split_word(args));
+        }
+        if (reply_scripted(conn, verb, tag))
+            continue;
+
+        if (verb == "CAPABILITY")
+            conn.write("* CAPABILITY IMAP4rev1 LITERAL+" + END_OF_LINE + tag + " OK CAPABILITY completed" + END_OF_LINE);
+        else if (verb == "LOGIN")
+            conn.write_line(tag + " OK LOGIN completed");
+        else if (verb == "SELECT" || verb == "EXAMINE")
+            conn.write("* " + to_string(messages_.size()) + " EXISTS" + END_OF_LINE + "* 0 RECENT" + END_OF_LINE +
+                "* OK [UIDVALIDITY 1] UIDs valid" + END_OF_LINE + "* OK [UIDNEXT " + to_string(messages_.size() + 1) + "] Predicted next UID" +
+                END_OF_LINE + tag + " OK [" + (verb == "SELECT" ? "READ-WRITE" : "READ-ONLY") + "] " + verb + " completed" + END_OF_LINE);
+        else if (verb == "FETCH")
+            fetch(conn, tag, args, is_uids);
+        else if (verb == "SEARCH")
+        {
+            // the conditions are not evaluated, all the messages are found
+            string reply = "* SEARCH";
+            for (size_t msg_no = 1; msg_no <= messages_.size(); msg_no++)
+                reply += " " + to_string(msg_no);
+            conn.write(reply + END_OF_LINE + tag + " OK SEARCH completed" + END_OF_LINE);
+        }
+        else if (verb == "APPEND")
+        {
+            // the appended message is received but not stored, so the mailbox stays the same for the other connections
+            string::size_type lit_begin = args.rfind('{');
+            if (lit_begin == string::npos || args.back() != '}')
+            {
+                conn.write_line(tag + " BAD Missing literal");
+                continue;
+            }
+            const size_t msg_len = stoul(args.substr(lit_begin + 1, args.length() - lit_begin - 2));
+            conn.write_line("+ Ready for literal data");
+            conn.read_bytes(msg_len);
+            conn.read_line();
+            conn.write_line(tag + " OK APPEND completed");
+        }
+        else if (verb == "NOOP" || verb == "CLOSE")
+            conn.write_line(tag + " OK " + verb + " completed");
+        else if (verb == "LOGOUT")
+        {
+            conn.write("* BYE mailio mock logging out" + END_OF_LINE + tag + " OK LOGOUT completed" + END_OF_LINE);
+            return;
+        }
+        else
+            conn.write_line(tag + " BAD Command unknown");
+    }
+}
+
+
+void mock_imap::fetch(mock_connection& conn, const string& tag, const string& args, bool is_uids)
+{
+    string items = args;
+    const string set = split_word(items);
+    const string item = to_upper_copy(items);
+    if (item != "RFC822" && item != "RFC822.HEADER")
+    {
+        conn.write_line(tag + " BAD Fetch item not supported");
+        return;
+    }
+
+    // the message numbers and the UIDs are the same, so the set is parsed the same way for both
+    string reply;
+    for (auto msg_no : parse_sequence_set(set))
+    {
+        const string& msg = messages_[msg_no - 1];
+        const string literal = item == "RFC822" ? msg : msg.substr(0, min(msg.find("\r\n\r\n"), msg.length() - 4) + 4);
+        reply += "* " + to_string(msg_no) + " FETCH (" + (is_uids ? "UID " + to_string(msg_no) + " " : "") + item + " {" +
+            to_string(literal.length()) + "}" + END_OF_LINE + literal + ")" + END_OF_LINE;
+    }
+    conn.write(reply + tag + " OK FETCH completed" + END_OF_LINE);
+}
+
+
+vector<size_t> mock_imap::parse_sequence_set(const string& set) const
+{
+    const size_t last = messages_.size();
+    auto number = [last](const string& num) { return num == "*" ? last : static_cast<size_t>(stoul(num)); };
+
+    vector<size_t> numbers;
+    vector<string> ranges;
+    split(ranges, set, is_any_of(","));
+    for (const auto& range : ranges)
+    {
+        string::size_type colon = range.find(':');
+        size_t first = number(range.substr(0, colon));
+        size_t second = colon == string::npos ? first : number(range.substr(colon + 1));
+        if (first > second)
+            std::swap(first, second);
+        for (size_t msg_no = first; msg_no <= min(second, last); msg_no++)
+            if (msg_no > 0)
+                numbers.push_back(msg_no);
+    }
+    return numbers;
+}
+
+
+mock_pop3::mock_pop3(bool tls, const vector<string>& messages) : mock_server(tls), messages_(messages)
+{
+    start();
+}
+
+
+mock_pop3::~mock_pop3()
+{
+    stop();
+}
+
+
+void mock_pop3::serve(mock_connection& conn)
+{
+    conn.write_line("+OK mailio mock POP3 ready");
+    while (true)
+    {
+        string args = conn.read_line();
+        record(args);
+        const string verb = to_upper_copy(split_word(args));
+        if (reply_scripted(conn, verb))
+            continue;
+
+        if (verb == "USER" || verb == "PASS" || verb == "NOOP" || verb == "RSET")
+            conn.write_line("+OK");
+        else if (verb == "STAT")
+        {
+            size_t size = 0;
+            for (const auto& msg : messages_)
+                size += msg.length();
+            conn.write_line("+OK " + to_string(messages_.size()) + " " + to_string(size));
+        }
+        else if (verb == "LIST" && args.empty())
+        {
+            string reply = "+OK " + to_string(messages_.size()) + " messages" + END_OF_LINE;
+            for (size_t msg_no = 1; msg_no <= messages_.size(); msg_no++)
+                reply += to_string(msg_no) + " " + to_string(messages_[msg_no - 1].length()) + END_OF_LINE;
+            conn.write(reply + "." + END_OF_LINE);
+        }
+        else if (verb == "LIST" || verb == "RETR" || verb == "TOP" || verb == "DELE")
+        {
+            const size_t msg_no = stoul(split_word(args));
+            if (msg_no == 0 || msg_no > messages_.size())
+            {
+                conn.write_line("-ERR No such message");
+                continue;
+            }
+            const string& msg = messages_[msg_no - 1];
+            if (verb == "LIST")
+                conn.write_line("+OK " + to_string(msg_no) + " " + to_string(msg.length()));
+            else if (verb == "DELE")
+                conn.write_line("+OK Message deleted");
+            else
+            {
+                // the message lines starting with the dot are escaped by another dot
+                const string content = verb == "RETR" ? msg : msg.substr(0, min(msg.find("\r\n\r\n"), msg.length() - 4) + 4);
+                string reply = "+OK " + to_string(content.length()) + " octets" + END_OF_LINE;
+                reply.reserve(reply.length() + content.length() + content.length() / 64 + 5);
+                bool line_start = true;
+                for (char ch : content)
+                {
+                    if (line_start && ch == '.')
+                        reply += '.';
+                    reply += ch;
+                    line_start = ch == '\n';
+                }
+                if (!line_start)
+                    reply += END_OF_LINE;
+                conn.write(reply + "." + END_OF_LINE);
+            }
+        }
+        else if (verb == "QUIT")
+        {
+            conn.write_line("+OK Bye");
+            return;
+        }
+        else
+            conn.write_line("-ERR Command unknown");
+    }
+}
+
+
+} // namespace mailio
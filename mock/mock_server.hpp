@@ -0,0 +1,433 @@
+/*
+
+mock_server.hpp
+---------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/streambuf.hpp>
+
+
+namespace mailio
+{
+
+
+/**
+Connection accepted by a mock server, either plain or over TLS.
+**/
+class mock_connection
+{
+public:
+
+    /**
+    Taking over the accepted socket and making the TLS handshake if required.
+
+    @param socket  Accepted socket.
+    @param context TLS context, or null for the plain connection.
+    @throw *       `boost::asio::ssl::stream::handshake(handshake_type)`.
+    **/
+    mock_connection(boost::asio::ip::tcp::socket socket, boost::asio::ssl::context* context);
+
+    mock_connection(const mock_connection&) = delete;
+
+    mock_connection(mock_connection&&) = delete;
+
+    void operator=(const mock_connection&) = delete;
+
+    void operator=(mock_connection&&) = delete;
+
+    /**
+    Receiving a line.
+
+    @return Line without the CRLF.
+    @throw  boost::system::system_error Connection closed by the client.
+    **/
+    std::string read_line();
+
+    /**
+    Receiving the given number of bytes.
+
+    @param bytes_no Number of bytes to receive.
+    @return         Received bytes.
+    @throw          boost::system::system_error Connection closed by the client.
+    **/
+    std::string read_bytes(std::size_t bytes_no);
+
+    /**
+    Sending the given data as it is.
+
+    @param data Data to send.
+    @throw      boost::system::system_error Connection closed by the client.
+    **/
+    void write(const std::string& data);
+
+    /**
+    Sending a line followed by CRLF.
+
+    @param line Line to send.
+    @throw      boost::system::system_error Connection closed by the client.
+    **/
+    void write_line(const std::string& line);
+
+private:
+
+    /**
+    Plain socket.
+    **/
+    boost::asio::ip::tcp::socket socket_;
+
+    /**
+    TLS stream over the plain socket, if the connection is over TLS.
+    **/
+    std::unique_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket&>> ssl_socket_;
+
+    /**
+    Received data not consumed yet.
+    **/
+    boost::asio::streambuf buffer_;
+};
+
+
+/**
+Server on the loopback interface which speaks enough of a mail protocol to drive the clients, used to test and measure them without a real
+server.
+
+Each connection is served by its own thread. A derived server implements the protocol by the `serve(mock_connection&)` method, calls
+`start()` at the end of its constructor and `stop()` at the beginning of its destructor.
+
+The replies can be scripted per command, which overrides the default ones of the protocol. The received commands are recorded, so a test can
+check what the client sent.
+**/
+class mock_server
+{
+public:
+
+    /**
+    Binding to an ephemeral port on the loopback interface.
+
+    @param tls Flag if the connections are over TLS, with a self signed certificate made on the fly.
+    **/
+    explicit mock_server(bool tls);
+
+    /**
+    Stopping the server if not stopped yet.
+    **/
+    virtual ~mock_server();
+
+    mock_server(const mock_server&) = delete;
+
+    mock_server(mock_server&&) = delete;
+
+    void operator=(const mock_server&) = delete;
+
+    void operator=(mock_server&&) = delete;
+
+    /**
+    Getting the port the server listens on.
+
+    @return Port number.
+    **/
+    unsigned port() const;
+
+    /**
+    Scripting the reply to a command.
+
+    @param command Command verb, case insensitive.
+    @param reply   Lines to reply with instead of the default reply, `$TAG` in a line is replaced by the tag of the command.
+    **/
+    void script(const std::string& command, const std::vector<std::string>& reply);
+
+    /**
+    Getting the commands received so far over all the connections.
+
+    @return Command lines as sent by the client, without the CRLF.
+    **/
+    std::vector<std::string> commands() const;
+
+protected:
+
+    /**
+    Starting to accept the connections.
+    **/
+    void start();
+
+    /**
+    Stopping to accept the connections, closing the open ones and waiting for their threads.
+    **/
+    void stop();
+
+    /**
+    Serving a connection until the client quits.
+
+    @param conn Connection to serve.
+    @throw *    Any exception closes the connection.
+    **/
+    virtual void serve(mock_connection& conn) = 0;
+
+    /**
+    Replying to a command by its script, if there is one.
+
+    @param conn    Connection to reply to.
+    @param command Command verb.
+    @param tag     Tag of the command.
+    @return        True if the command is scripted, false if not.
+    **/
+    bool reply_scripted(mock_connection& conn, const std::string& command, const std::string& tag = "") const;
+
+    /**
+    Recording a received command.
+
+    @param line Command line without the CRLF.
+    **/
+    void record(const std::string& line);
+
+    /**
+    Accepting the connections until the server is stopped.
+    **/
+    void accept_loop();
+
+    /**
+    Context for the accepted sockets.
+    **/
+    boost::asio::io_context ios_;
+
+    /**
+    Listening socket.
+    **/
+    boost::asio::ip::tcp::acceptor acceptor_;
+
+    /**
+    TLS context with the self signed certificate, if the server uses TLS.
+    **/
+    std::unique_ptr<boost::asio::ssl::context> context_;
+
+    /**
+    Flag if the server is stopped.
+    **/
+    std::atomic<bool> stopped_;
+
+    /**
+    Thread accepting the connections.
+    **/
+    std::thread acceptor_thread_;
+
+    /**
+    Mutex guarding the script and the recorded commands.
+    **/
+    mutable std::mutex mutex_;
+
+    /**
+    Connection served by its own thread.
+    **/
+    struct connection_t
+    {
+        /**
+        Thread serving the connection.
+        **/
+        std::thread thread;
+
+        /**
+        Native handle of the socket, so the connection can be shut down when stopping.
+        **/
+        boost::asio::ip::tcp::socket::native_handle_type handle;
+
+        /**
+        Flag if the connection is closed, so its thread can be joined.
+        **/
+        std::shared_ptr<std::atomic<bool>> closed;
+    };
+
+    /**
+    Connections accepted so far, the closed ones are joined on the next accept.
+    **/
+    std::list<connection_t> connections_;
+
+    /**
+    Scripted replies per upper case command verb.
+    **/
+    std::map<std::string, std::vector<std::string>> script_;
+
+    /**
+    Received commands in the order of arrival.
+    **/
+    std::vector<std::string> commands_;
+};
+
+
+/**
+Mock SMTP server, accepting the login authentication and counting the received messages.
+**/
+class mock_smtp : public mock_server
+{
+public:
+
+    /**
+    Starting the server.
+
+    @param tls Flag if the connections are over TLS.
+    **/
+    explicit mock_smtp(bool tls);
+
+    /**
+    Stopping the server.
+    **/
+    ~mock_smtp();
+
+    /**
+    Getting the number of the received messages.
+
+    @return Number of messages.
+    **/
+    unsigned long messages_received() const;
+
+    /**
+    Getting the received messages.
+
+    @return Messages with the escaping dots removed, each line ended by CRLF.
+    **/
+    std::vector<std::string> messages() const;
+
+    /**
+    Rejecting a recipient by the permanent negative reply.
+
+    @param address Address of the recipient to reject.
+    **/
+    void reject_recipient(const std::string& address);
+
+protected:
+
+    /**
+    Serving the SMTP session.
+
+    @param conn Connection to serve.
+    **/
+    void serve(mock_connection& conn) override;
+
+    /**
+    Number of the received messages.
+    **/
+    std::atomic<unsigned long> messages_received_;
+
+    /**
+    Received messages, guarded by the mutex of the server.
+    **/
+    std::vector<std::string> messages_;
+
+    /**
+    Addresses of the rejected recipients, guarded by the mutex of the server.
+    **/
+    std::vector<std::string> rejected_recipients_;
+};
+
+
+/**
+Mock IMAP server with a single mailbox, supporting the login, selecting, fetching, searching and appending.
+**/
+class mock_imap : public mock_server
+{
+public:
+
+    /**
+    Starting the server.
+
+    @param tls      Flag if the connections are over TLS.
+    @param messages Messages of the mailbox, with CRLF line endings.
+    **/
+    mock_imap(bool tls, const std::vector<std::string>& messages);
+
+    /**
+    Stopping the server.
+    **/
+    ~mock_imap();
+
+protected:
+
+    /**
+    Serving the IMAP session.
+
+    @param conn Connection to serve.
+    **/
+    void serve(mock_connection& conn) override;
+
+    /**
+    Replying to a fetch of whole messages or their headers.
+
+    @param conn     Connection to reply to.
+    @param tag      Tag of the command.
+    @param args     Arguments of the command, the sequence set and the fetch item.
+    @param is_uids  Flag if the sequence set consists of UIDs.
+    **/
+    void fetch(mock_connection& conn, const std::string& tag, const std::string& args, bool is_uids);
+
+    /**
+    Parsing a sequence set into message numbers.
+
+    @param set Sequence set like `1:3,5,7:*`.
+    @return    Message numbers which exist in the mailbox.
+    **/
+    std::vector<std::size_t> parse_sequence_set(const std::string& set) const;
+
+    /**
+    Messages of the mailbox.
+    **/
+    std::vector<std::string> messages_;
+};
+
+
+/**
+Mock POP3 server with a single mailbox, supporting the login, statistics, listing and retrieving.
+**/
+class mock_pop3 : public mock_server
+{
+public:
+
+    /**
+    Starting the server.
+
+    @param tls      Flag if the connections are over TLS.
+    @param messages Messages of the mailbox, with CRLF line endings.
+    **/
+    mock_pop3(bool tls, const std::vector<std::string>& messages);
+
+    /**
+    Stopping the server.
+    **/
+    ~mock_pop3();
+
+protected:
+
+    /**
+    Serving the POP3 session.
+
+    @param conn Connection to serve.
+    **/
+    void serve(mock_connection& conn) override;
+
+    /**
+    Messages of the mailbox.
+    **/
+    std::vector<std::string> messages_;
+};
+
+
+} // namespace mailio
@@ -11,13 +11,20 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 */
 
 
-#include <string> 
+#include <algorithm>
+#include <array>
+#include <string>
+#include <utility>
 #include <boost/algorithm/string/trim.hpp>
 #include <mailio/base64.hpp>
 
 
+using std::array;
+using std::max;
 using std::string;
+using std::string_view;
 using std::vector;
+using std::move;
 using boost::trim_right;
 
 
@@ -28,6 +35,16 @@ namespace mailio
 const string base64::CHARSET = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 
+const array<int, 256> base64::DECODE_TABLE = []()
+{
+    array<int, 256> table;
+    table.fill(-1);
+    for (string::size_type i = 0; i < CHARSET.size(); i++)
+        table[static_cast<unsigned char>(CHARSET[i])] = static_cast<int>(i);
+    return table;
+}();
+
+
 base64::base64(codec::line_len_policy_t encoder_line_policy, codec::line_len_policy_t decoder_line_policy)
   : codec(encoder_line_policy, decoder_line_policy)
 {
@@ -37,42 +54,96 @@ base64::base64(codec::line_len_policy_t encoder_line_policy, codec::line_len_pol
 vector<string> base64::encode(const string& text, string::size_type reserved) const
 {
     vector<string> enc_text;
-    unsigned char group_8bit[3];
-    unsigned char group_6bit[4];
-    int count_3_chars = 0;
-    string line;
-    string::size_type line_len = 0;
+    const string::size_type line_len_max = string::size_type(line_policy_) - reserved - 2;
+    enc_text.reserve(text.length() / 3 * 4 / (line_len_max > 0 ? line_len_max : 1) + 2);
+    encoder_t encoder(*this, [&enc_text](const string& line) { enc_text.push_back(line); }, reserved);
+    encoder.feed(text);
+    encoder.finish();
+    return enc_text;
+}
+
+
+void base64::encode(const string& text, string& enc_text, string::size_type reserved) const
+{
+    // lines are wrapped after whole groups, the padding might start one more line
+    const string::size_type enc_len = (text.length() + 2) / 3 * 4;
+    const string::size_type line_chars = max<string::size_type>((string::size_type(line_policy_) - reserved - 2 + 3) / 4 * 4, 4);
+    enc_text.reserve(enc_text.length() + enc_len + (enc_len / line_chars + 2) * END_OF_LINE.length());
+
+    encoder_t encoder(*this, [&enc_text](const string& line) { enc_text.append(line).append(END_OF_LINE); }, reserved);
+    encoder.feed(text);
+    encoder.finish();
+}
+
+
+string base64::decode(const vector<string>& text) const
+{
+    string dec_text;
+    string::size_type text_len = 0;
+    for (const auto& line : text)
+        text_len += line.length();
+    dec_text.reserve(text_len / 4 * 3 + 3);
 
-    for (string::size_type cur_char = 0; cur_char < text.length(); cur_char++)
+    decoder_t decoder(*this, [&dec_text](const string& chunk) { dec_text += chunk; });
+    for (const auto& line : text)
+        decoder.feed(line);
+    decoder.finish();
+    return dec_text;
+}
+
+
+string base64::decode(const string& text) const
+{
+    vector<string> v;
+    v.push_back(text);
+    return decode(v);
+}
+
+
+bool base64::is_allowed(char ch) const
+{
+    return DECODE_TABLE[static_cast<unsigned char>(ch)] >= 0;
+}
+
+
+base64::encoder_t::encoder_t(const base64& codec, sink_t sink, string::size_type reserved)
+  : sink_(move(sink)), line_len_max_(string::size_type(codec.line_policy_) - reserved - 2)
+{
+    line_.reserve(line_len_max_ + 4);
+}
+
+
+void base64::encoder_t::feed(const string& chunk)
+{
+    string::size_type cur_char = 0;
+    // complete the group left over from the previous chunk
+    while (!group_.empty() && group_.length() < 3 && cur_char < chunk.length())
+        group_ += chunk[cur_char++];
+    if (group_.length() == 3)
     {
-        group_8bit[count_3_chars++] = text[cur_char];
-        if (count_3_chars == 3) 
-        {
-            group_6bit[0] = (group_8bit[0] & 0xfc) >> 2;
-            group_6bit[1] = ((group_8bit[0] & 0x03) << 4) + ((group_8bit[1] & 0xf0) >> 4);
-            group_6bit[2] = ((group_8bit[1] & 0x0f) << 2) + ((group_8bit[2] & 0xc0) >> 6);
-            group_6bit[3] = group_8bit[2] & 0x3f;
-
-            for(int i = 0; i < 4; i++)
-                line += CHARSET[group_6bit[i]];
-            count_3_chars = 0;
-            line_len += 4;
-        }
-        
-        if (line_len >= string::size_type(line_policy_) - reserved - 2)
-        {
-            enc_text.push_back(line);
-            line.clear();
-            line_len = 0;
-        }
+        encode_group(reinterpret_cast<const unsigned char*>(group_.data()));
+        group_.clear();
     }
 
+    const unsigned char* chars = reinterpret_cast<const unsigned char*>(chunk.data());
+    const string::size_type groups_end = cur_char + (chunk.length() - cur_char) / 3 * 3;
+    for (; cur_char < groups_end; cur_char += 3)
+        encode_group(chars + cur_char);
+    group_.append(chunk, cur_char, string::npos);
+}
+
+
+void base64::encoder_t::finish()
+{
     // encode remaining characters if any
 
+    int count_3_chars = static_cast<int>(group_.length());
     if (count_3_chars > 0)
     {
-        for (int i = count_3_chars; i < 3; i++)
-            group_8bit[i] = '\0';
+        unsigned char group_8bit[3] = {0, 0, 0};
+        unsigned char group_6bit[4];
+        for (int i = 0; i < count_3_chars; i++)
+            group_8bit[i] = static_cast<unsigned char>(group_[i]);
 
         group_6bit[0] = (group_8bit[0] & 0xfc) >> 2;
         group_6bit[1] = ((group_8bit[0] & 0x03) << 4) + ((group_8bit[1] & 0xf0) >> 4);
@@ -81,103 +152,105 @@ vector<string> base64::encode(const string& text, string::size_type reserved) co
 
         for (int i = 0; i < count_3_chars + 1; i++)
         {
-            if (line_len >= string::size_type(line_policy_) - reserved - 2)
+            if (line_.length() >= line_len_max_)
             {
-                enc_text.push_back(line);
-                line.clear();
-                line_len = 0;
+                sink_(line_);
+                line_.clear();
             }
-            line += CHARSET[group_6bit[i]];
-            line_len++;
+            line_ += CHARSET[group_6bit[i]];
         }
 
         while (count_3_chars++ < 3)
         {
-            if (line_len >= string::size_type(line_policy_) - reserved - 2)
+            if (line_.length() >= line_len_max_)
             {
-                enc_text.push_back(line);
-                line.clear();
-                line_len = 0;
-            }            
-            line += EQUAL_CHAR;
-            line_len++;
+                sink_(line_);
+                line_.clear();
+            }
+            line_ += EQUAL_CHAR;
         }
+        group_.clear();
     }
-    
-    if (!line.empty())
-        enc_text.push_back(line);
 
-    return enc_text;
+    if (!line_.empty())
+    {
+        sink_(line_);
+        line_.clear();
+    }
 }
 
 
-string base64::decode(const vector<string>& text) const
+/*
+Full groups are encoded by looking up the four six bit values directly, the line is checked after each group.
+*/
+void base64::encoder_t::encode_group(const unsigned char* chars)
 {
-    string dec_text;
-    unsigned char group_6bit[4];
-    unsigned char group_8bit[3];
-    int count_4_chars = 0;
+    const unsigned long group_24bit = (static_cast<unsigned long>(chars[0]) << 16) | (static_cast<unsigned long>(chars[1]) << 8) | chars[2];
+    line_ += CHARSET[(group_24bit >> 18) & 0x3f];
+    line_ += CHARSET[(group_24bit >> 12) & 0x3f];
+    line_ += CHARSET[(group_24bit >> 6) & 0x3f];
+    line_ += CHARSET[group_24bit & 0x3f];
+    if (line_.length() >= line_len_max_)
+    {
+        sink_(line_);
+        line_.clear();
+    }
+}
 
-    for (const auto& line : text)
+
+base64::decoder_t::decoder_t(const base64& codec, sink_t sink) : codec_(codec), sink_(move(sink))
+{
+}
+
+
+void base64::decoder_t::feed(string_view line)
+{
+    if (line.length() > string::size_type(codec_.decoder_line_policy_) - 2)
+        throw codec_error("Bad line policy.");
+
+    unsigned long group_24bit = 0;
+    int count_4_chars = 0;
+    for (string::size_type ch = 0; ch < line.length() && line[ch] != EQUAL_CHAR; ch++)
     {
-        if (line.length() > string::size_type(decoder_line_policy_) - 2)
-            throw codec_error("Bad line policy.");
+        const int value = DECODE_TABLE[static_cast<unsigned char>(line[ch])];
+        if (value < 0)
+            throw codec_error("Bad character `" + string(1, line[ch]) + "`.");
 
-        for (string::size_type ch = 0; ch < line.length() && line[ch] != EQUAL_CHAR; ch++)
-        {
-            if (!is_allowed(line[ch]))
-                throw codec_error("Bad character `" + string(1, line[ch]) + "`.");
-    
-            group_6bit[count_4_chars++] = line[ch];
-            if (count_4_chars == 4)
-            {
-                for (int i = 0; i < 4; i++)
-                    group_6bit[i] = static_cast<unsigned char>(CHARSET.find(group_6bit[i]));
-    
-                group_8bit[0] = (group_6bit[0] << 2) + ((group_6bit[1] & 0x30) >> 4);
-                group_8bit[1] = ((group_6bit[1] & 0xf) << 4) + ((group_6bit[2] & 0x3c) >> 2);
-                group_8bit[2] = ((group_6bit[2] & 0x3) << 6) + group_6bit[3];
-    
-                for (int i = 0; i < 3; i++)
-                    dec_text += group_8bit[i];
-                count_4_chars = 0;
-            }
-        }
-    
-        // decode remaining characters if any
-    
-        if (count_4_chars > 0) 
+        group_24bit = (group_24bit << 6) | static_cast<unsigned long>(value);
+        if (++count_4_chars == 4)
         {
-            for (int i = count_4_chars; i < 4; i++)
-                group_6bit[i] = '\0';
-    
-            for (int i = 0; i < 4; i++)
-                group_6bit[i] = static_cast<unsigned char>(CHARSET.find(group_6bit[i]));
-    
-            group_8bit[0] = (group_6bit[0] << 2) + ((group_6bit[1] & 0x30) >> 4);
-            group_8bit[1] = ((group_6bit[1] & 0xf) << 4) + ((group_6bit[2] & 0x3c) >> 2);
-            group_8bit[2] = ((group_6bit[2] & 0x3) << 6) + group_6bit[3];
-    
-            for (int i = 0; i < count_4_chars - 1; i++)
-                dec_text += group_8bit[i];
+            dec_text_ += static_cast<char>((group_24bit >> 16) & 0xff);
+            dec_text_ += static_cast<char>((group_24bit >> 8) & 0xff);
+            dec_text_ += static_cast<char>(group_24bit & 0xff);
+            group_24bit = 0;
+            count_4_chars = 0;
         }
     }
-    
-    return dec_text;
-}
 
+    // decode remaining characters if any, as the missing ones were zero
 
-string base64::decode(const string& text) const
-{
-    vector<string> v;
-    v.push_back(text);
-    return decode(v);
+    if (count_4_chars > 0)
+    {
+        group_24bit <<= 6 * (4 - count_4_chars);
+        for (int i = 0; i < count_4_chars - 1; i++)
+            dec_text_ += static_cast<char>((group_24bit >> (16 - 8 * i)) & 0xff);
+    }
+
+    if (dec_text_.length() >= DECODER_BUFFER_SIZE)
+    {
+        sink_(dec_text_);
+        dec_text_.clear();
+    }
 }
 
 
-bool base64::is_allowed(char ch) const
+void base64::decoder_t::finish()
 {
-    return (isalnum(ch) || ch == PLUS_CHAR || ch == SLASH_CHAR);
+    if (!dec_text_.empty())
+    {
+        sink_(dec_text_);
+        dec_text_.clear();
+    }
 }
 
 
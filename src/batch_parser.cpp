@@ -0,0 +1,267 @@
+/*
+
+batch_parser.cpp
+----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <mailio/mapped_text.hpp>
+#include <mailio/mbox.hpp>
+#include <mailio/message.hpp>
+#include <mailio/batch_parser.hpp>
+
+
+using std::string;
+using std::vector;
+using std::deque;
+using std::map;
+using std::pair;
+using std::make_pair;
+using std::move;
+using std::size_t;
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::thread;
+using std::exception_ptr;
+using std::current_exception;
+using std::rethrow_exception;
+using std::error_code;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+namespace filesystem = std::filesystem;
+
+
+namespace mailio
+{
+
+
+double batch_parser::batch_stat_t::bytes_per_second_per_worker() const
+{
+    const double seconds = duration<double>(elapsed).count();
+    if (seconds <= 0 || workers.empty())
+        return 0;
+    return static_cast<double>(bytes) / seconds / static_cast<double>(workers.size());
+}
+
+
+batch_parser::batch_parser(unsigned workers) : workers_(workers == 0 ? thread::hardware_concurrency() : workers)
+{
+    if (workers_ == 0)
+        workers_ = 1;
+}
+
+
+void batch_parser::prototype(const message& msg)
+{
+    prototype_ = msg;
+}
+
+
+unsigned batch_parser::workers() const
+{
+    return workers_;
+}
+
+
+batch_parser::batch_stat_t batch_parser::parse_mbox(const string& file_path, const message_handler_t& handler, delivery_t delivery)
+{
+    mbox archive(file_path);
+    vector<task_t> tasks;
+    mapped_text message_text;
+    while (archive.next(message_text))
+        tasks.push_back(task_t{tasks.size(), message_text, ""});
+    return parse(tasks, handler, delivery);
+}
+
+
+batch_parser::batch_stat_t batch_parser::parse_maildir(const string& dir_path, const message_handler_t& handler, delivery_t delivery)
+{
+    vector<task_t> tasks;
+    bool is_maildir = false;
+    try
+    {
+        for (auto subdir : {"cur", "new"})
+        {
+            const filesystem::path subdir_path = filesystem::path(dir_path) / subdir;
+            error_code dir_error;
+            if (!filesystem::is_directory(subdir_path, dir_error))
+                continue;
+            is_maildir = true;
+
+            vector<string> file_paths;
+            for (const auto& entry : filesystem::directory_iterator(subdir_path))
+                if (entry.is_regular_file())
+                    file_paths.push_back(entry.path().string());
+            std::sort(file_paths.begin(), file_paths.end());
+            for (auto& file_path : file_paths)
+                tasks.push_back(task_t{tasks.size(), mapped_text(), move(file_path)});
+        }
+    }
+    catch (filesystem::filesystem_error&)
+    {
+        throw batch_parser_error("Reading Maildir directory failed.");
+    }
+    if (!is_maildir)
+        throw batch_parser_error("Not a Maildir directory.");
+
+    return parse(tasks, handler, delivery);
+}
+
+
+batch_parser::batch_stat_t batch_parser::parse(vector<task_t>& tasks, const message_handler_t& handler, delivery_t delivery) const
+{
+    struct queue_t
+    {
+        mutex queue_mutex;
+        deque<task_t*> tasks;
+    };
+
+    const steady_clock::time_point start = steady_clock::now();
+    const size_t worker_count = std::max<size_t>(std::min<size_t>(workers_, tasks.size()), 1);
+    vector<queue_t> queues(worker_count);
+    // consecutive messages go to the same worker, so each worker reads its part of the mapping sequentially
+    for (size_t i = 0; i < tasks.size(); i++)
+        queues[i * worker_count / tasks.size()].tasks.push_back(&tasks[i]);
+
+    batch_stat_t stat;
+    stat.messages = tasks.size();
+    stat.workers.resize(worker_count);
+    atomic<size_t> failures{0};
+    atomic<bool> stopped{false};
+    mutex error_mutex;
+    exception_ptr handler_error;
+    mutex delivery_mutex;
+    size_t next_index = 0;
+    map<size_t, pair<message, exception_ptr>> pending;
+
+    // own tasks are taken from the front, stolen ones from the back of the other queues
+    auto take = [&queues, worker_count](size_t worker, task_t*& task, bool& stolen)
+    {
+        for (size_t i = 0; i < worker_count; i++)
+        {
+            queue_t& queue = queues[(worker + i) % worker_count];
+            lock_guard<mutex> lock(queue.queue_mutex);
+            if (queue.tasks.empty())
+                continue;
+            if (i == 0)
+            {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+            else
+            {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            }
+            stolen = i > 0;
+            return true;
+        }
+        return false;
+    };
+
+    // ordered messages wait until all the previous ones are delivered, and the handler is called by one worker at a time
+    auto deliver = [&](size_t index, message& msg, exception_ptr error)
+    {
+        if (delivery == delivery_t::UNORDERED)
+        {
+            handler(index, msg, error);
+            return;
+        }
+
+        lock_guard<mutex> lock(delivery_mutex);
+        pending.emplace(index, make_pair(move(msg), error));
+        for (auto it = pending.find(next_index); it != pending.end(); it = pending.find(++next_index))
+        {
+            handler(it->first, it->second.first, it->second.second);
+            pending.erase(it);
+        }
+    };
+
+    auto work = [&](size_t worker)
+    {
+        worker_stat_t& worker_stat = stat.workers[worker];
+        task_t* task = nullptr;
+        bool stolen = false;
+        while (!stopped && take(worker, task, stolen))
+        {
+            const steady_clock::time_point begin = steady_clock::now();
+            message msg(prototype_);
+            exception_ptr error;
+            try
+            {
+                const mapped_text text = task->file_path.empty() ? task->text : mapped_text(task->file_path);
+                worker_stat.bytes += text.text().length();
+                msg.parse(text);
+            }
+            catch (...)
+            {
+                error = current_exception();
+                failures++;
+            }
+
+            try
+            {
+                deliver(task->index, msg, error);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(error_mutex);
+                if (handler_error == nullptr)
+                    handler_error = current_exception();
+                stopped = true;
+            }
+
+            worker_stat.messages++;
+            if (stolen)
+                worker_stat.stolen++;
+            worker_stat.busy += steady_clock::now() - begin;
+        }
+    };
+
+    // the calling thread is the first worker
+    vector<thread> threads;
+    try
+    {
+        for (size_t worker = 1; worker < worker_count; worker++)
+            threads.emplace_back(work, worker);
+    }
+    catch (std::system_error&)
+    {
+        // the workers already started take over the messages
+    }
+    work(0);
+    for (auto& th : threads)
+        th.join();
+
+    if (handler_error != nullptr)
+        rethrow_exception(handler_error);
+
+    stat.failures = failures;
+    for (const auto& worker_stat : stat.workers)
+        stat.bytes += worker_stat.bytes;
+    stat.elapsed = steady_clock::now() - start;
+    return stat;
+}
+
+
+} // namespace mailio
@@ -12,12 +12,15 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 
 #include <string>
+#include <utility>
 #include <vector>
 #include <mailio/binary.hpp>
 
 
 using std::string;
+using std::string_view;
 using std::vector;
+using std::move;
 
 
 namespace mailio
@@ -33,7 +36,9 @@ binary::binary(codec::line_len_policy_t encoder_line_policy, codec::line_len_pol
 vector<string> binary::encode(const string& text) const
 {
     vector<string> enc_text;
-    enc_text.push_back(text);
+    encoder_t encoder(*this, [&enc_text](const string& chunk) { enc_text.push_back(chunk); });
+    encoder.feed(text);
+    encoder.finish();
     return enc_text;
 }
 
@@ -41,10 +46,44 @@ vector<string> binary::encode(const string& text) const
 string binary::decode(const vector<string>& text) const
 {
     string dec_text;
+    decoder_t decoder(*this, [&dec_text](const string& chunk) { dec_text += chunk; });
     for (const auto& line : text)
-        dec_text += line + END_OF_LINE;
+        decoder.feed(line);
+    decoder.finish();
     return dec_text;
 }
 
 
+binary::encoder_t::encoder_t(const binary&, sink_t sink) : sink_(move(sink))
+{
+}
+
+
+void binary::encoder_t::feed(const string& chunk)
+{
+    sink_(chunk);
+}
+
+
+void binary::encoder_t::finish()
+{
+}
+
+
+binary::decoder_t::decoder_t(const binary&, sink_t sink) : sink_(move(sink))
+{
+}
+
+
+void binary::decoder_t::feed(string_view line)
+{
+    sink_(string(line) + END_OF_LINE);
+}
+
+
+void binary::decoder_t::finish()
+{
+}
+
+
 } // namespace mailio
@@ -12,14 +12,15 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 
 #include <string>
+#include <utility>
 #include <vector>
-#include <boost/algorithm/string/trim.hpp>
 #include <mailio/bit7.hpp>
 
 
 using std::string;
+using std::string_view;
 using std::vector;
-using boost::trim_right;
+using std::move;
 
 
 namespace mailio
@@ -36,74 +37,119 @@ bit7::bit7(codec::line_len_policy_t encoder_line_policy, codec::line_len_policy_
 vector<string> bit7::encode(const string& text) const
 {
     vector<string> enc_text;
-    string line;
-    string::size_type line_len = 0;
-    for (auto ch = text.begin(); ch != text.end(); ch++)
+    encoder_t encoder(*this, [&enc_text](const string& line) { enc_text.push_back(line); });
+    encoder.feed(text);
+    encoder.finish();
+    return enc_text;
+}
+
+
+string bit7::decode(const vector<string>& text) const
+{
+    string dec_text;
+    decoder_t decoder(*this, [&dec_text](const string& chunk) { dec_text += chunk; });
+    for (const auto& line : text)
+        decoder.feed(line);
+    decoder.finish();
+    return dec_text;
+}
+
+
+/*
+For details see [rfc 2045, section 2.7].
+*/
+bool bit7::is_allowed(char ch) const
+{
+    if (strict_mode_)
+        return (ch > NIL_CHAR && ch <= TILDE_CHAR && ch != CR_CHAR && ch != LF_CHAR);
+    else
+        return (ch != NIL_CHAR && ch != CR_CHAR && ch != LF_CHAR);
+}
+
+
+bit7::encoder_t::encoder_t(const bit7& codec, sink_t sink) : codec_(codec), sink_(move(sink)), pending_cr_(false), empty_lines_(0)
+{
+}
+
+
+void bit7::encoder_t::feed(const string& chunk)
+{
+    auto ch = chunk.begin();
+    if (pending_cr_ && ch != chunk.end())
     {
-        if (is_allowed(*ch))
+        if (*ch != LF_CHAR)
+            throw codec_error("Bad character `" + string(1, CR_CHAR) + "`.");
+        pass_line(line_, empty_lines_, sink_);
+        line_.clear();
+        pending_cr_ = false;
+        ch++;
+    }
+
+    for (; ch != chunk.end(); ch++)
+    {
+        if (codec_.is_allowed(*ch))
+            line_ += *ch;
+        else if (*ch == CR_CHAR && (ch + 1) == chunk.end())
         {
-            line += *ch;
-            line_len++;
+            // the line feed is expected at the beginning of the next chunk
+            pending_cr_ = true;
+            return;
         }
-        else if (*ch == '\r' && (ch + 1) != text.end() && *(ch + 1) == '\n')
+        else if (*ch == CR_CHAR && *(ch + 1) == LF_CHAR)
         {
-            enc_text.push_back(line);
-            line.clear();
-            line_len = 0;
+            pass_line(line_, empty_lines_, sink_);
+            line_.clear();
             // skip both crlf characters
             ch++;
         }
         else
             throw codec_error("Bad character `" + string(1, *ch) + "`.");
-        
-        if (line_len == string::size_type(line_policy_))
+
+        if (line_.length() == string::size_type(codec_.line_policy_))
         {
-            enc_text.push_back(line);
-            line.clear();
-            line_len = 0;
-        }        
+            pass_line(line_, empty_lines_, sink_);
+            line_.clear();
+        }
     }
-    if (!line.empty())
-        enc_text.push_back(line);
-    while (!enc_text.empty() && enc_text.back().empty())
-        enc_text.pop_back();
-    
-    return enc_text;
 }
 
 
-string bit7::decode(const vector<string>& text) const
+void bit7::encoder_t::finish()
 {
-    string dec_text;
-    for (const auto& line : text)
+    if (pending_cr_)
+        throw codec_error("Bad character `" + string(1, CR_CHAR) + "`.");
+    if (!line_.empty())
     {
-        if (line.length() > string::size_type(decoder_line_policy_))
-            throw codec_error("Line policy overflow.");
-        
-        for (auto ch : line)
-        {
-            if (!is_allowed(ch))
-                throw codec_error("Bad character `" + string(1, ch) + "`.");
-
-            dec_text += ch;
-        }
-        dec_text += "\r\n";
+        pass_line(line_, empty_lines_, sink_);
+        line_.clear();
     }
-    trim_right(dec_text);
-    
-    return dec_text;    
+    empty_lines_ = 0;
 }
 
 
-/*
-For details see [rfc 2045, section 2.7].
-*/
-bool bit7::is_allowed(char ch) const
+bit7::decoder_t::decoder_t(const bit7& codec, sink_t sink) : codec_(codec), sink_(move(sink))
 {
-    if (strict_mode_)
-        return (ch > NIL_CHAR && ch <= TILDE_CHAR && ch != CR_CHAR && ch != LF_CHAR);
-    else
-        return (ch != NIL_CHAR && ch != CR_CHAR && ch != LF_CHAR);
+}
+
+
+void bit7::decoder_t::feed(string_view line)
+{
+    if (line.length() > string::size_type(codec_.decoder_line_policy_))
+        throw codec_error("Line policy overflow.");
+
+    for (auto ch : line)
+        if (!codec_.is_allowed(ch))
+            throw codec_error("Bad character `" + string(1, ch) + "`.");
+    dec_text_.append(line).append(END_OF_LINE);
+    if (dec_text_.length() >= DECODER_BUFFER_SIZE)
+        pass_trimmed(dec_text_, sink_);
+}
+
+
+void bit7::decoder_t::finish()
+{
+    pass_trimmed(dec_text_, sink_);
+    dec_text_.clear();
 }
 
 
@@ -12,11 +12,14 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 
 #include <algorithm>
+#include <cctype>
 #include <string>
 #include <mailio/codec.hpp>
 
 
 using std::string;
+using std::find_if;
+using std::isspace;
 
 
 namespace mailio
@@ -97,4 +100,32 @@ bool codec::strict_mode() const
 }
 
 
+void codec::pass_line(const string& line, string::size_type& empty_lines, const sink_t& sink)
+{
+    if (line.empty())
+    {
+        empty_lines++;
+        return;
+    }
+
+    for (; empty_lines > 0; empty_lines--)
+        sink(string());
+    sink(line);
+}
+
+
+void codec::pass_trimmed(string& dec_text, const sink_t& sink)
+{
+    auto last = find_if(dec_text.rbegin(), dec_text.rend(), [](char ch) { return !isspace(static_cast<unsigned char>(ch)); });
+    if (last == dec_text.rend())
+        return;
+
+    string::size_type text_len = dec_text.rend() - last;
+    string whitespace = dec_text.substr(text_len);
+    dec_text.resize(text_len);
+    sink(dec_text);
+    dec_text = whitespace;
+}
+
+
 } // namespace mailio
@@ -12,26 +12,41 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 #include <string>
 #include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <mailio/dialog.hpp>
 
 
 using std::string;
+using std::vector;
 using std::to_string;
 using std::move;
 using std::istream;
 using std::make_shared;
 using std::shared_ptr;
-using std::bind;
+using std::weak_ptr;
+using std::pair;
+using std::mutex;
+using std::lock_guard;
+using std::function;
+using std::exception_ptr;
+using std::make_exception_ptr;
 using std::chrono::milliseconds;
 using boost::asio::ip::tcp;
 using boost::asio::buffer;
+using boost::asio::const_buffer;
+using boost::asio::transfer_exactly;
+using boost::asio::buffer_copy;
+using boost::asio::post;
 using boost::asio::streambuf;
-using boost::asio::io_context;
 using boost::asio::deadline_timer;
 using boost::asio::ssl::context;
 using boost::system::system_error;
+using boost::system::error_code;
 using boost::algorithm::trim_if;
 using boost::algorithm::is_any_of;
 
@@ -40,18 +55,22 @@ namespace mailio
 {
 
 
-boost::asio::io_context dialog::ios_;
+/**
+Line terminator appended to the sent lines by the gathered writes.
+**/
+static const char END_OF_LINE[] = "\r\n";
 
 
-dialog::dialog(const string& hostname, unsigned port, milliseconds timeout) : std::enable_shared_from_this<dialog>(),
-    hostname_(hostname), port_(port), socket_(make_shared<tcp::socket>(ios_)), timer_(make_shared<deadline_timer>(ios_)),
-    timeout_(timeout), timer_expired_(false), strmbuf_(make_shared<streambuf>()), istrm_(make_shared<istream>(strmbuf_.get()))
+dialog::dialog(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) :
+    std::enable_shared_from_this<dialog>(), hostname_(hostname), port_(port), ios_(ios ? ios : make_shared<boost::asio::io_context>()),
+    socket_(make_shared<tcp::socket>(*ios_)), timer_(make_shared<deadline_timer>(*ios_)), timeout_(timeout), timer_expired_(false),
+    strmbuf_(make_shared<streambuf>()), istrm_(make_shared<istream>(strmbuf_.get()))
 {
 }
 
 
 dialog::dialog(const dialog& other) : std::enable_shared_from_this<dialog>(),
-    hostname_(move(other.hostname_)), port_(other.port_), socket_(other.socket_), timer_(other.timer_),
+    hostname_(move(other.hostname_)), port_(other.port_), ios_(other.ios_), socket_(other.socket_), timer_(other.timer_),
     timeout_(other.timeout_), timer_expired_(other.timer_expired_), strmbuf_(other.strmbuf_), istrm_(other.istrm_)
 {
 }
@@ -63,7 +82,7 @@ void dialog::connect()
     {
         if (timeout_.count() == 0)
         {
-            tcp::resolver res(ios_);
+            tcp::resolver res(*ios_);
             boost::asio::connect(*socket_, res.resolve(hostname_, to_string(port_)));
         }
         else
@@ -76,12 +95,21 @@ void dialog::connect()
 }
 
 
-void dialog::send(const string& line)
+void dialog::send(const string& line, bool raw)
+{
+    if (raw)
+        send(vector<const_buffer>{buffer(line)});
+    else
+        send(vector<const_buffer>{buffer(line), buffer(END_OF_LINE, 2)});
+}
+
+
+void dialog::send(const vector<const_buffer>& buffers)
 {
     if (timeout_.count() == 0)
-        send_sync(*socket_, line);
+        send_sync(*socket_, buffers);
     else
-        send_async(*socket_, line);
+        send_async(*socket_, buffers);
 }
 
 
@@ -95,13 +123,53 @@ string dialog::receive(bool raw)
 }
 
 
+shared_ptr<boost::asio::io_context> dialog::io_context() const
+{
+    return ios_;
+}
+
+
+void dialog::async_send(const string& line, function<void (exception_ptr)> handler)
+{
+    // the line is kept until the sending completes, the CRLF is gathered with it instead of appended
+    auto l = make_shared<string>(line);
+    async_send(vector<const_buffer>{buffer(*l), buffer(END_OF_LINE, 2)}, [l, handler = move(handler)](exception_ptr exc) { handler(exc); });
+}
+
+
+void dialog::async_send(const vector<const_buffer>& buffers, function<void (exception_ptr)> handler)
+{
+    async_write_buffers(*socket_, buffers, move(handler));
+}
+
+
+void dialog::async_receive(bool raw, function<void (exception_ptr, string)> handler)
+{
+    async_read_line(*socket_, raw, move(handler));
+}
+
+
+string dialog::receive_bytes(size_t bytes)
+{
+    if (timeout_.count() == 0)
+        return receive_bytes_sync(*socket_, bytes);
+    else
+        return receive_bytes_async(*socket_, bytes);
+}
+
+
+void dialog::async_receive_bytes(size_t bytes, function<void (exception_ptr, string)> handler)
+{
+    async_read_bytes(*socket_, bytes, move(handler));
+}
+
+
 template<typename Socket>
-void dialog::send_sync(Socket& socket, const string& line)
+void dialog::send_sync(Socket& socket, const vector<const_buffer>& buffers)
 {
     try
     {
-        string l = line + "\r\n";
-        write(socket, buffer(l, l.size()));
+        write(socket, buffers);
     }
     catch (system_error&)
     {
@@ -110,6 +178,22 @@ void dialog::send_sync(Socket& socket, const string& line)
 }
 
 
+template<typename Socket>
+string dialog::receive_bytes_sync(Socket& socket, size_t bytes)
+{
+    try
+    {
+        if (strmbuf_->size() < bytes)
+            read(socket, *strmbuf_, transfer_exactly(bytes - strmbuf_->size()));
+        return take_bytes(bytes);
+    }
+    catch (system_error&)
+    {
+        throw dialog_error("Network receiving error.");
+    }
+}
+
+
 template<typename Socket>
 string dialog::receive_sync(Socket& socket, bool raw)
 {
@@ -131,117 +215,321 @@ string dialog::receive_sync(Socket& socket, bool raw)
 
 void dialog::connect_async()
 {
-    tcp::resolver res(ios_);
+    tcp::resolver res(*ios_);
+    auto endpoints = res.resolve(hostname_, to_string(port_));
+    error_code error = run_with_timeout([this, &endpoints](auto handler)
+        {
+            async_connect(*socket_, endpoints, [handler](const error_code& ec, const tcp::endpoint&) { handler(ec); });
+        });
+    if (timer_expired_)
+        throw dialog_error("Server connecting timed out.");
+    if (error)
+        throw dialog_error("Server connecting failed.");
+}
+
+
+template<typename Socket>
+void dialog::send_async(Socket& socket, const vector<const_buffer>& buffers)
+{
+    error_code error = run_with_timeout([&socket, &buffers](auto handler)
+        {
+            async_write(socket, buffers, [handler](const error_code& ec, size_t) { handler(ec); });
+        });
+    if (timer_expired_)
+        throw dialog_error("Network sending timed out.");
+    if (error)
+        throw dialog_error("Network sending failed.");
+}
 
-    timer_->expires_at(boost::posix_time::pos_infin);
-    timer_->expires_from_now(boost::posix_time::milliseconds(timeout_.count()));
-    boost::system::error_code ignored_ec;
-    check_timeout();
 
-    bool has_connected{false}, connect_error{false};
-    async_connect(*socket_, res.resolve(hostname_, to_string(port_)),
-        [&has_connected, &connect_error](const boost::system::error_code& error, const boost::asio::ip::tcp::endpoint&)
+template<typename Socket>
+string dialog::receive_async(Socket& socket, bool raw)
+{
+    error_code error = run_with_timeout([this, &socket](auto handler)
         {
-            if (!error)
-                has_connected = true;
+            async_read_until(socket, *strmbuf_, "\n", [handler](const error_code& ec, size_t) { handler(ec); });
+        });
+    if (timer_expired_)
+        throw dialog_error("Network receiving timed out.");
+    if (error)
+        throw dialog_error("Network receiving failed.");
+
+    string line;
+    getline(*istrm_, line, '\n');
+    if (!raw)
+        trim_if(line, is_any_of("\r\n"));
+    return line;
+}
+
+
+template<typename Socket>
+void dialog::async_write_buffers(Socket& socket, const vector<const_buffer>& buffers, function<void (exception_ptr)> handler)
+{
+    auto self = shared_from_this();
+    auto completed = make_shared<bool>(false);
+    arm_timer(completed);
+    async_write(socket, buffers, [self, completed, handler](const error_code& error, size_t)
+        {
+            *completed = true;
+            self->timer_->cancel();
+            if (self->timer_expired_)
+                handler(make_exception_ptr(dialog_error("Network sending timed out.")));
+            else if (error)
+                handler(make_exception_ptr(dialog_error("Network sending failed.")));
             else
-                connect_error = true;
+                handler(nullptr);
         });
-    do
+}
+
+
+template<typename Socket>
+string dialog::receive_bytes_async(Socket& socket, size_t bytes)
+{
+    if (strmbuf_->size() < bytes)
     {
+        error_code error = run_with_timeout([this, &socket, bytes](auto handler)
+            {
+                async_read(socket, *strmbuf_, transfer_exactly(bytes - strmbuf_->size()), [handler](const error_code& ec, size_t) { handler(ec); });
+            });
         if (timer_expired_)
-            throw dialog_error("Server connecting timed out.");
-        if (connect_error)
-            throw dialog_error("Server connecting failed.");
-        ios_.run_one();
+            throw dialog_error("Network receiving timed out.");
+        if (error)
+            throw dialog_error("Network receiving failed.");
     }
-    while (!has_connected);
+    return take_bytes(bytes);
 }
 
 
 template<typename Socket>
-void dialog::send_async(Socket& socket, string line)
+void dialog::async_read_line(Socket& socket, bool raw, function<void (exception_ptr, string)> handler)
 {
-    timer_->expires_from_now(boost::posix_time::milliseconds(timeout_.count()));
-    string l = line + "\r\n";
-    bool has_written{false}, send_error{false};
-    async_write(socket, buffer(l, l.size()), [&has_written, &send_error](const boost::system::error_code& error, size_t)
+    auto self = shared_from_this();
+    auto completed = make_shared<bool>(false);
+    arm_timer(completed);
+    async_read_until(socket, *strmbuf_, "\n", [self, completed, raw, handler](const error_code& error, size_t)
         {
-            if (!error)
-                has_written = true;
-            else
-                send_error = true;
+            *completed = true;
+            self->timer_->cancel();
+            if (self->timer_expired_)
+            {
+                handler(make_exception_ptr(dialog_error("Network receiving timed out.")), string());
+                return;
+            }
+            if (error)
+            {
+                handler(make_exception_ptr(dialog_error("Network receiving failed.")), string());
+                return;
+            }
+
+            string line;
+            getline(*self->istrm_, line, '\n');
+            if (!raw)
+                trim_if(line, is_any_of("\r\n"));
+            handler(nullptr, move(line));
         });
-    do
+}
+
+
+template<typename Socket>
+void dialog::async_read_bytes(Socket& socket, size_t bytes, function<void (exception_ptr, string)> handler)
+{
+    auto self = shared_from_this();
+    if (strmbuf_->size() >= bytes)
     {
-        if (timer_expired_)
-            throw dialog_error("Network sending timed out.");
-        if (send_error)
-            throw dialog_error("Network sending failed.");
-        ios_.run_one();
+        post(*ios_, [self, bytes, handler]() { handler(nullptr, self->take_bytes(bytes)); });
+        return;
     }
-    while (!has_written);
+
+    auto completed = make_shared<bool>(false);
+    arm_timer(completed);
+    async_read(socket, *strmbuf_, transfer_exactly(bytes - strmbuf_->size()), [self, completed, bytes, handler](const error_code& error, size_t)
+        {
+            *completed = true;
+            self->timer_->cancel();
+            if (self->timer_expired_)
+                handler(make_exception_ptr(dialog_error("Network receiving timed out.")), string());
+            else if (error)
+                handler(make_exception_ptr(dialog_error("Network receiving failed.")), string());
+            else
+                handler(nullptr, self->take_bytes(bytes));
+        });
 }
 
 
-template<typename Socket>
-string dialog::receive_async(Socket& socket, bool raw)
+string dialog::take_bytes(size_t bytes)
+{
+    string data(bytes, '\0');
+    buffer_copy(buffer(&data[0], bytes), strmbuf_->data());
+    strmbuf_->consume(bytes);
+    return data;
+}
+
+
+void dialog::close()
+{
+    error_code ignored_ec;
+    socket_->close(ignored_ec);
+}
+
+
+void dialog::arm_timer(shared_ptr<bool> completed)
 {
+    if (timeout_.count() == 0)
+        return;
+
+    auto self = shared_from_this();
     timer_->expires_from_now(boost::posix_time::milliseconds(timeout_.count()));
-    bool has_read{false}, receive_error{false};
-    string line;
-    async_read_until(socket, *strmbuf_, "\n", [&has_read, &receive_error, this, &line, raw](const boost::system::error_code& error, size_t)
+    timer_->async_wait([self, completed](const error_code& error)
+        {
+            if (error == boost::asio::error::operation_aborted || *completed)
+                return;
+            error_code ignored_ec;
+            self->socket_->close(ignored_ec);
+            self->timer_expired_ = true;
+        });
+}
+
+
+template<typename Operation>
+error_code dialog::run_with_timeout(Operation&& operation)
+{
+    if (timer_expired_)
+        return boost::asio::error::timed_out;
+
+    if (ios_->stopped())
+        ios_->restart();
+
+    bool op_done{false}, timer_done{false};
+    error_code op_error;
+    timer_->expires_from_now(boost::posix_time::milliseconds(timeout_.count()));
+    timer_->async_wait([this, &op_done, &timer_done](const error_code& ec)
         {
-            if (!error)
+            if (ec != boost::asio::error::operation_aborted && !op_done)
             {
-                getline(*istrm_, line, '\n');
-                if (!raw)
-                    trim_if(line, is_any_of("\r\n"));
-                has_read = true;
+                error_code ignored_ec;
+                socket_->close(ignored_ec);
+                timer_expired_ = true;
             }
-            else
-                receive_error = true;
+            timer_done = true;
         });
-    do
+    operation([&op_done, &op_error](const error_code& ec)
+        {
+            op_error = ec;
+            op_done = true;
+        });
+
+    while (!op_done || !timer_done)
     {
-        if (timer_expired_)
-            throw dialog_error("Network receiving timed out.");
-        if (receive_error)
-            throw dialog_error("Network receiving failed.");
-        ios_.run_one();
+        if (op_done)
+            timer_->cancel();
+        if (ios_->run_one() == 0)
+            ios_->restart();
     }
-    while (!has_read);
+    // Running out of work stops the context, so it is restarted for the subsequent non-blocking operations.
+    if (ios_->stopped())
+        ios_->restart();
+    return op_error;
+}
 
-    return line;
+
+void ssl_session_cache::configure(context& ctx)
+{
+    // once configured, the context is only read, so it's safe for the handshakes running meanwhile
+    static mutex configure_mutex;
+    lock_guard<mutex> lock(configure_mutex);
+    SSL_CTX* native_ctx = ctx.native_handle();
+    if (SSL_CTX_sess_get_new_cb(native_ctx) == &ssl_session_cache::store)
+        return;
+    SSL_CTX_set_session_cache_mode(native_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native_ctx, &ssl_session_cache::store);
 }
 
 
-void dialog::check_timeout()
+void ssl_session_cache::attach(SSL* ssl, const string& hostname, unsigned port)
 {
-    if (timer_->expires_at() <= deadline_timer::traits_type::now())
+    string server = hostname + ":" + to_string(port);
     {
-        boost::system::error_code ignored_ec;
-        socket_->close(ignored_ec);
-        timer_->expires_at(boost::posix_time::pos_infin);
-        timer_expired_ = true;
+        lock_guard<mutex> lock(mutex_);
+        // a connection closed without the shutdown invalidates its session, so the connections get copies of the cached one
+        auto session = sessions_.find(server);
+        if (session != sessions_.end())
+        {
+            SSL_SESSION* copy = SSL_SESSION_dup(session->second.get());
+            if (copy != nullptr)
+            {
+                SSL_set_session(ssl, copy);
+                SSL_SESSION_free(copy);
+            }
+        }
     }
-    timer_->async_wait(bind(&dialog::check_timeout, shared_from_this()));
+    // the binding is released together with the connection
+    SSL_set_ex_data(ssl, binding_index(), new pair<weak_ptr<ssl_session_cache>, string>(weak_from_this(), server));
 }
 
 
-dialog_ssl::dialog_ssl(const string& hostname, unsigned port, milliseconds timeout, const ssl_options_t& options) :
-    dialog(hostname, port, timeout), ssl_(false), context_(make_shared<context>(options.method)),
+size_t ssl_session_cache::size() const
+{
+    lock_guard<mutex> lock(mutex_);
+    return sessions_.size();
+}
+
+
+void ssl_session_cache::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+    sessions_.clear();
+}
+
+
+int ssl_session_cache::store(SSL* ssl, SSL_SESSION* session)
+{
+    auto binding = static_cast<pair<weak_ptr<ssl_session_cache>, string>*>(SSL_get_ex_data(ssl, binding_index()));
+    if (binding == nullptr)
+        return 0;
+    shared_ptr<ssl_session_cache> cache = binding->first.lock();
+    if (cache == nullptr || SSL_SESSION_is_resumable(session) != 1)
+        return 0;
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (copy == nullptr)
+        return 0;
+
+    lock_guard<mutex> lock(cache->mutex_);
+    cache->sessions_[binding->second] = shared_ptr<SSL_SESSION>(copy, SSL_SESSION_free);
+    return 0;
+}
+
+
+int ssl_session_cache::binding_index()
+{
+    static const int index = CRYPTO_get_ex_new_index(CRYPTO_EX_INDEX_SSL, 0, nullptr, nullptr, nullptr,
+        [](void*, void* binding, CRYPTO_EX_DATA*, int, long, void*)
+        {
+            delete static_cast<pair<weak_ptr<ssl_session_cache>, string>*>(binding);
+        });
+    return index;
+}
+
+
+dialog_ssl::dialog_ssl(const string& hostname, unsigned port, milliseconds timeout, const ssl_options_t& options,
+    shared_ptr<boost::asio::io_context> ios) : dialog(hostname, port, timeout, ios), ssl_(false),
+    context_(options.context != nullptr ? options.context : make_shared<context>(options.method)),
     ssl_socket_(make_shared<boost::asio::ssl::stream<tcp::socket&>>(*socket_, *context_))
 {
 }
 
 
-dialog_ssl::dialog_ssl(const dialog& other, const ssl_options_t& options) : dialog(other), context_(make_shared<context>(options.method)),
+dialog_ssl::dialog_ssl(const dialog& other, const ssl_options_t& options) : dialog(other),
+    context_(options.context != nullptr ? options.context : make_shared<context>(options.method)),
     ssl_socket_(make_shared<boost::asio::ssl::stream<tcp::socket&>>(*socket_, *context_))
 {
     try
     {
         ssl_socket_->set_verify_mode(options.verify_mode);
+        if (options.session_cache != nullptr)
+        {
+            ssl_session_cache::configure(*context_);
+            options.session_cache->attach(ssl_socket_->native_handle(), hostname_, port_);
+        }
         ssl_socket_->handshake(boost::asio::ssl::stream_base::client);
         ssl_ = true;
     }
@@ -253,18 +541,63 @@ dialog_ssl::dialog_ssl(const dialog& other, const ssl_options_t& options) : dial
 }
 
 
-void dialog_ssl::send(const string& line)
+void dialog_ssl::send(const vector<const_buffer>& buffers)
 {
     if (!ssl_)
     {
-        dialog::send(line);
+        dialog::send(buffers);
         return;
     }
 
     if (timeout_.count() == 0)
-        send_sync(*ssl_socket_, line);
+        send_sync(*ssl_socket_, buffers);
+    else
+        send_async(*ssl_socket_, buffers);
+}
+
+
+void dialog_ssl::async_send(const vector<const_buffer>& buffers, function<void (exception_ptr)> handler)
+{
+    if (!ssl_)
+        dialog::async_send(buffers, move(handler));
+    else
+        async_write_buffers(*ssl_socket_, buffers, move(handler));
+}
+
+
+void dialog_ssl::async_receive(bool raw, function<void (exception_ptr, string)> handler)
+{
+    if (!ssl_)
+        dialog::async_receive(raw, move(handler));
+    else
+        async_read_line(*ssl_socket_, raw, move(handler));
+}
+
+
+bool dialog_ssl::session_resumed() const
+{
+    return ssl_ && SSL_session_reused(ssl_socket_->native_handle()) == 1;
+}
+
+
+string dialog_ssl::receive_bytes(size_t bytes)
+{
+    if (!ssl_)
+        return dialog::receive_bytes(bytes);
+
+    if (timeout_.count() == 0)
+        return receive_bytes_sync(*ssl_socket_, bytes);
+    else
+        return receive_bytes_async(*ssl_socket_, bytes);
+}
+
+
+void dialog_ssl::async_receive_bytes(size_t bytes, function<void (exception_ptr, string)> handler)
+{
+    if (!ssl_)
+        dialog::async_receive_bytes(bytes, move(handler));
     else
-        send_async(*ssl_socket_, line);
+        async_read_bytes(*ssl_socket_, bytes, move(handler));
 }
 
 
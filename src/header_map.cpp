@@ -0,0 +1,169 @@
+/*
+
+header_map.cpp
+--------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <mailio/header_map.hpp>
+
+
+using std::size_t;
+using std::string;
+using std::string_view;
+
+
+namespace mailio
+{
+
+
+auto header_map::begin() const -> const_iterator
+{
+    return entries_.begin();
+}
+
+
+auto header_map::end() const -> const_iterator
+{
+    return entries_.end();
+}
+
+
+size_t header_map::size() const
+{
+    return entries_.size();
+}
+
+
+bool header_map::empty() const
+{
+    return entries_.empty();
+}
+
+
+auto header_map::insert(const string& name, const string& value) -> const_iterator
+{
+    hashes_.push_back(hash_name(name));
+    entries_.emplace_back(name, value);
+    return entries_.end() - 1;
+}
+
+
+string& header_map::operator[](const string& name)
+{
+    const size_t name_hash = hash_name(name);
+    const size_t pos = find(name, name_hash, 0);
+    if (pos < entries_.size())
+        return entries_[pos].second;
+
+    hashes_.push_back(name_hash);
+    entries_.emplace_back(name, string());
+    return entries_.back().second;
+}
+
+
+auto header_map::find(string_view name) const -> const_iterator
+{
+    return entries_.begin() + find(name, hash_name(name), 0);
+}
+
+
+size_t header_map::count(string_view name) const
+{
+    const size_t name_hash = hash_name(name);
+    size_t found = 0;
+    for (size_t pos = find(name, name_hash, 0); pos < entries_.size(); pos = find(name, name_hash, pos + 1))
+        found++;
+    return found;
+}
+
+
+size_t header_map::erase(string_view name)
+{
+    const size_t name_hash = hash_name(name);
+    size_t kept = 0;
+    for (size_t pos = 0; pos < entries_.size(); pos++)
+        if (hashes_[pos] != name_hash || !equal_names(entries_[pos].first, name))
+        {
+            if (kept != pos)
+            {
+                entries_[kept] = std::move(entries_[pos]);
+                hashes_[kept] = hashes_[pos];
+            }
+            kept++;
+        }
+    const size_t erased = entries_.size() - kept;
+    entries_.resize(kept);
+    hashes_.resize(kept);
+    return erased;
+}
+
+
+auto header_map::erase(const_iterator pos) -> const_iterator
+{
+    hashes_.erase(hashes_.begin() + (pos - entries_.begin()));
+    return entries_.erase(pos);
+}
+
+
+void header_map::clear()
+{
+    entries_.clear();
+    hashes_.clear();
+}
+
+
+/*
+FNV-1a hash of the name with the ASCII letters folded to the lower case, since the header and attribute names are ASCII.
+*/
+size_t header_map::hash_name(string_view name)
+{
+    size_t name_hash = static_cast<size_t>(14695981039346656037ULL);
+    for (auto ch : name)
+    {
+        if (ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+        name_hash ^= static_cast<unsigned char>(ch);
+        name_hash *= static_cast<size_t>(1099511628211ULL);
+    }
+    return name_hash;
+}
+
+
+bool header_map::equal_names(string_view lhs, string_view rhs)
+{
+    if (lhs.length() != rhs.length())
+        return false;
+    for (string_view::size_type i = 0; i < lhs.length(); i++)
+    {
+        char lhs_ch = lhs[i], rhs_ch = rhs[i];
+        if (lhs_ch >= 'A' && lhs_ch <= 'Z')
+            lhs_ch += 'a' - 'A';
+        if (rhs_ch >= 'A' && rhs_ch <= 'Z')
+            rhs_ch += 'a' - 'A';
+        if (lhs_ch != rhs_ch)
+            return false;
+    }
+    return true;
+}
+
+
+size_t header_map::find(string_view name, size_t name_hash, size_t pos) const
+{
+    for (; pos < entries_.size(); pos++)
+        if (hashes_[pos] == name_hash && equal_names(entries_[pos].first, name))
+            return pos;
+    return entries_.size();
+}
+
+
+} // namespace mailio
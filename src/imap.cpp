@@ -12,10 +12,12 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 
 #include <algorithm>
+#include <charconv>
 #include <locale>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/compare.hpp>
@@ -27,7 +29,11 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <mailio/imap.hpp>
 
 
+using std::exception_ptr;
 using std::find_if;
+using std::from_chars;
+using std::function;
+using std::get;
 using std::invalid_argument;
 using std::list;
 using std::make_optional;
@@ -38,15 +44,24 @@ using std::move;
 using std::out_of_range;
 using std::pair;
 using std::shared_ptr;
-using std::stoul;
 using std::string;
+using std::string_view;
 using std::stringstream;
 using std::to_string;
 using std::tuple;
 using std::vector;
 using std::chrono::milliseconds;
+using boost::local_time::local_date_time;
+using boost::local_time::posix_time_zone;
+using boost::local_time::time_zone_ptr;
+using boost::posix_time::hours;
+using boost::posix_time::minutes;
+using boost::posix_time::seconds;
+using boost::asio::post;
 using boost::system::system_error;
 using boost::iequals;
+using boost::istarts_with;
+using boost::to_lower_copy;
 using boost::regex;
 using boost::regex_match;
 using boost::smatch;
@@ -194,9 +209,9 @@ string imap::tag_result_response_t::to_string() const
 }
 
 
-imap::imap(const string& hostname, unsigned port, milliseconds timeout) :
-    dlg_(make_shared<dialog>(hostname, port, timeout)), tag_(0), optional_part_state_(false), atom_state_(atom_state_t::NONE),
-    parenthesis_list_counter_(0), literal_state_(string_literal_state_t::NONE), literal_bytes_read_(0), eols_no_(2)
+imap::imap(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) :
+    dlg_(make_shared<dialog>(hostname, port, timeout, ios)), tag_(0), optional_part_state_(false), atom_state_(atom_state_t::NONE),
+    literal_state_(string_literal_state_t::NONE), literal_bytes_read_(0), literal_token_(NO_TOKEN), eols_no_(2)
 {
     dlg_->connect();
 }
@@ -233,107 +248,10 @@ auto imap::select(const list<string>& folder_name, bool /*read_only*/) -> mailbo
 
 auto imap::select(const string& mailbox, bool read_only) -> mailbox_stat_t
 {
-    string cmd;
-    if (read_only)
-        cmd = format("EXAMINE " + to_astring(mailbox));
-    else
-        cmd = format("SELECT " + to_astring(mailbox));
-    dlg_->send(cmd);
-
-    mailbox_stat_t stat;
-    bool exists_found = false;
-    bool recent_found = false;
-    bool has_more = true;
-
-    try
-    {
-        while (has_more)
-        {
-            reset_response_parser();
-            string line = dlg_->receive();
-            tag_result_response_t parsed_line = parse_tag_result(line);
-            parse_response(parsed_line.response);
-
-            if (parsed_line.tag == UNTAGGED_RESPONSE)
-            {
-                const auto result = parsed_line.result;
-                if (result.has_value() && result.value() == tag_result_response_t::OK)
-                {
-                    if (optional_part_.size() != 2)
-                        continue;
-
-                    auto key = optional_part_.front();
-                    optional_part_.pop_front();
-                    if (key->token_type == response_token_t::token_type_t::ATOM)
-                    {
-                        auto value = optional_part_.front();
-                        if (iequals(key->atom, "UNSEEN"))
-                        {
-                            if (value->token_type != response_token_t::token_type_t::ATOM)
-                                throw imap_error("Parsing failure.");
-                            stat.messages_first_unseen = stoul(value->atom);
-                        }
-                        else if (iequals(key->atom, "UIDNEXT"))
-                        {
-                            if (value->token_type != response_token_t::token_type_t::ATOM)
-                                throw imap_error("Parsing failure.");
-                            stat.uid_next = stoul(value->atom);
-                        }
-                        else if (iequals(key->atom, "UIDVALIDITY"))
-                        {
-                            if (value->token_type != response_token_t::token_type_t::ATOM)
-                                throw imap_error("Parsing failure.");
-                            stat.uid_validity = stoul(value->atom);
-                        }
-                    }
-                }
-                else
-                {
-                    if (mandatory_part_.size() == 2 && mandatory_part_.front()->token_type == response_token_t::token_type_t::ATOM)
-                    {
-                        auto value = mandatory_part_.front();
-                        mandatory_part_.pop_front();
-                        auto key = mandatory_part_.front();
-                        mandatory_part_.pop_front();
-                        if (iequals(key->atom, "EXISTS"))
-                        {
-                            stat.messages_no = stoul(value->atom);
-                            exists_found = true;
-                        }
-                        else if (iequals(key->atom, "RECENT"))
-                        {
-                            stat.messages_recent = stoul(value->atom);
-                            recent_found = true;
-                        }
-                    }
-                }
-            }
-            else if (parsed_line.tag == to_string(tag_))
-            {
-                if (!parsed_line.result.has_value() || parsed_line.result.value() != tag_result_response_t::OK)
-                    throw imap_error("Select or examine mailbox failure.");
-
-                has_more = false;
-            }
-            else
-                throw imap_error("Parsing failure.");
-        }
-    }
-    catch (const invalid_argument&)
-    {
-        throw imap_error("Parsing failure.");
-    }
-    catch (const out_of_range&)
-    {
-        throw imap_error("Parsing failure.");
-    }
-
-    // The EXISTS and RECENT are required, the others may be missing in earlier protocol versions.
-    if (!exists_found || !recent_found)
-        throw imap_error("Parsing failure.");
-
-    reset_response_parser();
-    return stat;
+    auto stat = make_shared<mailbox_stat_t>();
+    dlg_->send(select_command(mailbox, read_only));
+    receive_response(select_processor(stat));
+    return *stat;
 }
 
 
@@ -354,130 +272,51 @@ void imap::fetch(unsigned long message_no, message& msg, bool is_uid, bool heade
 }
 
 
-// Fetching literal is the only place where line is ended with LF only, instead of CRLF. Thus, `receive(true)` and counting EOLs is performed.
 void imap::fetch(const list<messages_range_t>& messages_range, map<unsigned long, message>& found_messages, bool is_uids, bool header_only,
     codec::line_len_policy_t line_policy)
 {
-    if (messages_range.empty())
-        throw imap_error("Empty messages range.");
-
-    const string RFC822_TOKEN = string("RFC822") + (header_only ? ".HEADER" : "");
-    const string message_ids = messages_range_list_to_string(messages_range);
-
-    string cmd;
-    if (is_uids)
-        cmd.append("UID ");
-    cmd.append("FETCH " + message_ids + TOKEN_SEPARATOR_STR + RFC822_TOKEN);
-    dlg_->send(format(cmd));
+    map<unsigned long, message> fetched;
+    fetch(messages_range, [&fetched](unsigned long msg_no, message msg) { fetched.emplace(msg_no, move(msg)); }, is_uids, header_only,
+        line_policy);
+    for (auto& msg : fetched)
+        found_messages.emplace(msg.first, move(msg.second));
+}
 
-    // Stores messages as string literals for parsing after the OK response.
-    map<unsigned long, string> msg_str;
-    bool has_more = true;
-    try
-    {
-        while (has_more)
-        {
-            reset_response_parser();
-            string line = dlg_->receive();
-            tag_result_response_t parsed_line = parse_tag_result(line);
 
-            if (parsed_line.tag == UNTAGGED_RESPONSE)
-            {
-                parse_response(parsed_line.response);
+void imap::fetch(const list<messages_range_t>& messages_range, function<void (unsigned long, message)> message_handler, bool is_uids,
+    bool header_only, codec::line_len_policy_t line_policy)
+{
+    dlg_->send(fetch_command(messages_range, is_uids, header_only));
+    receive_response(fetch_processor(is_uids, header_only, line_policy, move(message_handler)));
+}
 
-                if (mandatory_part_.front()->token_type != response_token_t::token_type_t::ATOM)
-                    throw imap_error("Fetching message failure.");
-                unsigned long msg_no = stoul(mandatory_part_.front()->atom);
-                mandatory_part_.pop_front();
-                if (msg_no == 0)
-                    throw imap_error("Fetching message failure.");
 
-                if (!iequals(mandatory_part_.front()->atom, "FETCH"))
-                    throw imap_error("Fetching message failure.");
+void imap::fetch_info(const list<messages_range_t>& messages_range, unsigned int items, map<unsigned long, message_info_t>& infos, bool is_uids)
+{
+    dlg_->send(fetch_info_command(messages_range, items, is_uids));
+    receive_response(fetch_info_processor(is_uids, [&infos](unsigned long msg_no, message_info_t info)
+        {
+            infos[msg_no] = move(info);
+        }));
+}
 
-                unsigned long uid = 0;
-                shared_ptr<response_token_t> literal_token = nullptr;
-                for (auto part : mandatory_part_)
-                    if (part->token_type == response_token_t::token_type_t::LIST)
-                        for (auto token = part->parenthesized_list.begin(); token != part->parenthesized_list.end(); token++)
-                            if ((*token)->token_type == response_token_t::token_type_t::ATOM)
-                            {
-                                if (iequals((*token)->atom, "UID"))
-                                {
-                                    token++;
-                                    if (token == part->parenthesized_list.end())
-                                        throw imap_error("Parsing failure.");
-                                    uid = stoul((*token)->atom);
-                                }
-                                else if (iequals((*token)->atom, RFC822_TOKEN))
-                                {
-                                    token++;
-                                    if (token == part->parenthesized_list.end() || (*token)->token_type != response_token_t::token_type_t::LITERAL)
-                                        throw imap_error("Parsing failure.");
-                                    literal_token = *token;
-                                    break;
-                                }
-                            }
 
-                if (literal_token != nullptr)
-                {
-                    // Loop to read string literal.
-                    while (literal_state_ == string_literal_state_t::READING)
-                    {
-                        string line = dlg_->receive(true);
-                        if (!line.empty())
-                            trim_eol(line);
-                        parse_response(line);
-                    }
-                    // Closing parenthesis not yet read.
-                    if (literal_state_ == string_literal_state_t::DONE && parenthesis_list_counter_ > 0)
-                    {
-                        string line = dlg_->receive(true);
-                        if (!line.empty())
-                            trim_eol(line);
-                        parse_response(line);
-                    }
-                    msg_str.emplace(is_uids ? uid : msg_no, move(literal_token->literal));
+void imap::fetch_section(unsigned long message_no, const string& section, string& content, bool is_uid, unsigned long offset,
+    unsigned long length)
+{
+    auto fetched = make_shared<string>();
+    dlg_->send(fetch_section_command(message_no, section, is_uid, offset, length));
+    receive_response(fetch_section_processor(fetched));
+    content = move(*fetched);
+}
 
-                    // If no UID was found, but we asked for them, it's an error.
-                    if (is_uids && uid == 0)
-                    {
-                        throw imap_error("Parsing failure.");
-                    }
-                }
-                else
-                    throw imap_error("Parsing failure.");
-            }
-            else if (parsed_line.tag == to_string(tag_))
-            {
-                if (parsed_line.result.value() == tag_result_response_t::OK)
-                {
-                    has_more = false;
-                    for (const auto& ms : msg_str)
-                    {
-                        message msg;
-                        msg.line_policy(line_policy, line_policy);
-                        msg.parse(ms.second);
-                        found_messages.emplace(ms.first, move(msg));
-                    }
-                }
-                else
-                    throw imap_error("Fetching message failure.");
-            }
-            else
-                throw imap_error("Parsing failure.");
-        }
-    }
-    catch (const invalid_argument&)
-    {
-        throw imap_error("Parsing failure.");
-    }
-    catch (const out_of_range&)
-    {
-        throw imap_error("Parsing failure.");
-    }
 
-    reset_response_parser();
+void imap::fetch_part(unsigned long message_no, const body_structure_t& part, mime& part_mime, bool is_uid, unsigned long offset,
+    unsigned long length)
+{
+    string content;
+    fetch_section(message_no, part.section, content, is_uid, offset, length);
+    decode_part(part, content, length > 0 && content.length() >= length, part_mime);
 }
 
 
@@ -549,49 +388,46 @@ auto imap::statistics(const string& mailbox, unsigned int info) -> mailbox_stat_
             if (parsed_line.tag == UNTAGGED_RESPONSE)
             {
                 parse_response(parsed_line.response);
-                if (!iequals(mandatory_part_.front()->atom, "STATUS"))
+                if (!iequals(token_atom(mandatory_part_.first), "STATUS"))
                     throw imap_error("Getting statistics failure.");
-                mandatory_part_.pop_front();
 
                 bool mess_found = false, recent_found = false;
-                for (auto it = mandatory_part_.begin(); it != mandatory_part_.end(); it++)
-                    if ((*it)->token_type == response_token_t::token_type_t::LIST && (*it)->parenthesized_list.size() >= 2)
+                for (auto it = tokens_[mandatory_part_.first].next; it != NO_TOKEN; it = tokens_[it].next)
+                    if (tokens_[it].token_type == response_token_t::token_type_t::LIST && tokens_[it].parenthesized_list.size >= 2)
                     {
                         bool key_found = false;
-                        string key;
-                        auto mp = *it;
-                        for(auto il = mp->parenthesized_list.begin(); il != mp->parenthesized_list.end(); ++il)
+                        string_view key;
+                        for (auto il = tokens_[it].parenthesized_list.first; il != NO_TOKEN; il = tokens_[il].next)
                         {
-                            const string& value = (*il)->atom;
                             if (key_found)
                             {
                                 if (iequals(key, "MESSAGES"))
                                 {
-                                    stat.messages_no = stoul(value);
+                                    stat.messages_no = token_number(il);
                                     mess_found = true;
                                 }
                                 else if (iequals(key, "RECENT"))
                                 {
-                                    stat.messages_recent = stoul(value);
+                                    stat.messages_recent = token_number(il);
                                     recent_found = true;
                                 }
                                 else if (iequals(key, "UNSEEN"))
                                 {
-                                    stat.messages_unseen = stoul(value);
+                                    stat.messages_unseen = token_number(il);
                                 }
                                 else if (iequals(key, "UIDNEXT"))
                                 {
-                                    stat.uid_next = stoul(value);
+                                    stat.uid_next = token_number(il);
                                 }
                                 else if (iequals(key, "UIDVALIDITY"))
                                 {
-                                    stat.uid_validity = stoul(value);
+                                    stat.uid_validity = token_number(il);
                                 }
                                 key_found = false;
                             }
                             else
                             {
-                                key = value;
+                                key = token_atom(il);
                                 key_found = true;
                             }
                         }
@@ -669,49 +505,38 @@ void imap::remove(unsigned long message_no, bool is_uid)
             {
                 parse_response(parsed_line.response);
 
-                if (mandatory_part_.empty())
+                if (mandatory_part_.size < 3)
                     throw imap_error("Parsing failure.");
-                auto msg_no_token = mandatory_part_.front();
-                mandatory_part_.pop_front();
+                auto msg_no_token = mandatory_part_.first;
 
-                if (mandatory_part_.empty())
-                    throw imap_error("Parsing failure.");
-                auto fetch_token = mandatory_part_.front();
-                if (!iequals(fetch_token->atom, "FETCH"))
+                auto fetch_token = tokens_[msg_no_token].next;
+                if (!iequals(token_atom(fetch_token), "FETCH"))
                     throw imap_error("Parsing failure.");
-                mandatory_part_.pop_front();
 
                 // Check the list with flags.
 
-                if (mandatory_part_.empty())
-                    throw imap_error("Parsing failure.");
-                auto flags_token_list = mandatory_part_.front();
-                if (flags_token_list->token_type != response_token_t::token_type_t::LIST)
+                auto flags_token_list = tokens_[fetch_token].next;
+                if (tokens_[flags_token_list].token_type != response_token_t::token_type_t::LIST)
                     throw imap_error("Parsing failure.");
 
-                std::shared_ptr<response_token_t> uid_token = nullptr;
-                auto uid_token_it = flags_token_list->parenthesized_list.begin();
-                do
-                    if (iequals((*uid_token_it)->atom, "UID"))
+                auto uid_token = NO_TOKEN;
+                for (auto token = tokens_[flags_token_list].parenthesized_list.first; token != NO_TOKEN; token = tokens_[token].next)
+                    if (iequals(token_atom(token), "UID"))
                     {
-                        uid_token_it++;
-                        if (uid_token_it == flags_token_list->parenthesized_list.end())
+                        uid_token = tokens_[token].next;
+                        if (uid_token == NO_TOKEN)
                             throw imap_error("Parsing failure.");
-                        uid_token = *uid_token_it;
                         break;
                     }
-                    else
-                        uid_token_it++;
-                while (uid_token_it != flags_token_list->parenthesized_list.end());
 
                 if (is_uid)
                 {
-                    if (uid_token == nullptr)
+                    if (uid_token == NO_TOKEN)
                         throw imap_error("Parsing failure.");
                     msg_no_token = uid_token;
                 }
 
-                if (msg_no_token->token_type != response_token_t::token_type_t::ATOM || stoul(msg_no_token->atom) != message_no)
+                if (tokens_[msg_no_token].token_type != response_token_t::token_type_t::ATOM || token_number(msg_no_token) != message_no)
                     throw imap_error("Deleting message failure.");
 
                 continue;
@@ -751,14 +576,7 @@ void imap::remove(unsigned long message_no, bool is_uid)
 
 void imap::search(const list<imap::search_condition_t>& conditions, list<unsigned long>& results, bool want_uids)
 {
-    string cond_str;
-    std::size_t elem = 0;
-    for (const auto& c : conditions)
-        if (elem++ < conditions.size() - 1)
-            cond_str += c.imap_string + TOKEN_SEPARATOR_STR;
-        else
-            cond_str += c.imap_string;
-    search(cond_str, results, want_uids);
+    search(search_conditions_to_string(conditions), results, want_uids);
 }
 
 
@@ -803,20 +621,17 @@ auto imap::list_folders(const string& folder_name) -> mailbox_folder_t
             parse_response(parsed_line.response);
             if (parsed_line.tag == UNTAGGED_RESPONSE)
             {
-                auto token = mandatory_part_.front();
-                mandatory_part_.pop_front();
-                if (!iequals(token->atom, "LIST"))
+                if (!iequals(token_atom(mandatory_part_.first), "LIST"))
                     throw imap_error("Listing folders failure.");
 
-                if (mandatory_part_.size() < 3)
+                if (mandatory_part_.size < 4)
                     throw imap_error("Parsing failure.");
-                auto found_folder = mandatory_part_.begin();
-                found_folder++; found_folder++;
-                if (found_folder != mandatory_part_.end() && (*found_folder)->token_type == response_token_t::token_type_t::ATOM)
+                auto found_folder = tokens_[tokens_[tokens_[mandatory_part_.first].next].next].next;
+                if (tokens_[found_folder].token_type == response_token_t::token_type_t::ATOM)
                 {
                     vector<string> folders_hierarchy;
                     // TODO: May `delim` contain more than one character?
-                    split(folders_hierarchy, (*found_folder)->atom, is_any_of(delim));
+                    split(folders_hierarchy, token_atom(found_folder), is_any_of(delim));
                     map<string, mailbox_folder_t>* mbox = &mailboxes.folders;
                     for (auto f : folders_hierarchy)
                     {
@@ -906,6 +721,33 @@ bool imap::rename_folder(const list<string>& old_name, const list<string>& new_n
 }
 
 
+bool imap::noop()
+{
+    try
+    {
+        dlg_->send(format("NOOP"));
+        while (true)
+        {
+            string line = dlg_->receive();
+            tag_result_response_t parsed_line = parse_tag_result(line);
+            // The untagged responses carry the mailbox updates which are not of interest here.
+            if (parsed_line.tag == to_string(tag_))
+                return parsed_line.result.has_value() && parsed_line.result.value() == tag_result_response_t::OK;
+            if (parsed_line.tag != UNTAGGED_RESPONSE)
+                return false;
+        }
+    }
+    catch (const dialog_error&)
+    {
+        return false;
+    }
+    catch (const imap_error&)
+    {
+        return false;
+    }
+}
+
+
 string imap::connect()
 {
     // read greetings message
@@ -947,64 +789,859 @@ void imap::auth_login(const string& username, const string& password)
 
 void imap::search(const string& conditions, list<unsigned long>& results, bool want_uids)
 {
+    auto found = make_shared<list<unsigned long>>();
+    dlg_->send(search_command(conditions, want_uids));
+    receive_response(search_processor(found));
+    results.splice(results.end(), *found);
+}
+
+
+string imap::select_command(const string& mailbox, bool read_only)
+{
+    if (read_only)
+        return format("EXAMINE " + to_astring(mailbox));
+    return format("SELECT " + to_astring(mailbox));
+}
+
+
+auto imap::select_processor(shared_ptr<mailbox_stat_t> stat) -> response_processor_t
+{
+    return [this, stat, exists_found = false, recent_found = false](string& line) mutable
+    {
+        reset_response_parser();
+        trim_if(line, is_any_of("\r\n"));
+        tag_result_response_t parsed_line = parse_tag_result(line);
+        parse_response(parsed_line.response);
+
+        if (parsed_line.tag == UNTAGGED_RESPONSE)
+        {
+            const auto result = parsed_line.result;
+            if (result.has_value() && result.value() == tag_result_response_t::OK)
+            {
+                if (optional_part_.size != 2)
+                    return false;
+
+                auto key = optional_part_.first;
+                if (tokens_[key].token_type == response_token_t::token_type_t::ATOM)
+                {
+                    auto value = optional_part_.last;
+                    if (iequals(token_atom(key), "UNSEEN"))
+                        stat->messages_first_unseen = token_number(value);
+                    else if (iequals(token_atom(key), "UIDNEXT"))
+                        stat->uid_next = token_number(value);
+                    else if (iequals(token_atom(key), "UIDVALIDITY"))
+                        stat->uid_validity = token_number(value);
+                }
+            }
+            else
+            {
+                if (mandatory_part_.size == 2 && tokens_[mandatory_part_.first].token_type == response_token_t::token_type_t::ATOM)
+                {
+                    auto value = mandatory_part_.first;
+                    auto key = mandatory_part_.last;
+                    if (iequals(token_atom(key), "EXISTS"))
+                    {
+                        stat->messages_no = token_number(value);
+                        exists_found = true;
+                    }
+                    else if (iequals(token_atom(key), "RECENT"))
+                    {
+                        stat->messages_recent = token_number(value);
+                        recent_found = true;
+                    }
+                }
+            }
+            return false;
+        }
+        else if (parsed_line.tag == to_string(tag_))
+        {
+            if (!parsed_line.result.has_value() || parsed_line.result.value() != tag_result_response_t::OK)
+                throw imap_error("Select or examine mailbox failure.");
+
+            // The EXISTS and RECENT are required, the others may be missing in earlier protocol versions.
+            if (!exists_found || !recent_found)
+                throw imap_error("Parsing failure.");
+            return true;
+        }
+        else
+            throw imap_error("Parsing failure.");
+    };
+}
+
+
+string imap::fetch_command(const list<messages_range_t>& messages_range, bool is_uids, bool header_only)
+{
+    if (messages_range.empty())
+        throw imap_error("Empty messages range.");
+
     string cmd;
-    if (want_uids)
+    if (is_uids)
         cmd.append("UID ");
-    cmd.append("SEARCH " + conditions);
-    dlg_->send(format(cmd));
+    cmd.append("FETCH " + messages_range_list_to_string(messages_range) + TOKEN_SEPARATOR_STR + "RFC822" + (header_only ? ".HEADER" : ""));
+    return format(cmd);
+}
 
-    bool has_more = true;
-    try
+
+// Fetching literal is the only place where line is ended with LF only, instead of CRLF. Thus, literal lines are kept raw and EOLs are counted.
+auto imap::fetch_processor(bool is_uids, bool header_only, codec::line_len_policy_t line_policy,
+    function<void (unsigned long, message)> message_handler) -> response_processor_t
+{
+    enum class fetch_state_t {RESPONSE, LITERAL, CLOSING};
+
+    const string RFC822_TOKEN = string("RFC822") + (header_only ? ".HEADER" : "");
+    return [this, is_uids, line_policy, message_handler, RFC822_TOKEN, state = fetch_state_t::RESPONSE, msg_no = 0UL, uid = 0UL,
+        literal_token = NO_TOKEN](string& line) mutable
     {
-        while (has_more)
+        if (state != fetch_state_t::RESPONSE)
+        {
+            if (!line.empty())
+                trim_eol(line);
+            parse_response(line);
+        }
+        else
         {
             reset_response_parser();
-            string line = dlg_->receive();
+            trim_if(line, is_any_of("\r\n"));
             tag_result_response_t parsed_line = parse_tag_result(line);
+
             if (parsed_line.tag == UNTAGGED_RESPONSE)
             {
                 parse_response(parsed_line.response);
 
-                auto search_token = mandatory_part_.front();
-                // ignore other responses, although not sure whether this is by the rfc or not
-                if (search_token->token_type == response_token_t::token_type_t::ATOM && !iequals(search_token->atom, "SEARCH"))
-                    continue;
-                mandatory_part_.pop_front();
+                if (mandatory_part_.first == NO_TOKEN || tokens_[mandatory_part_.first].token_type != response_token_t::token_type_t::ATOM)
+                    throw imap_error("Fetching message failure.");
+                msg_no = token_number(mandatory_part_.first);
+                if (msg_no == 0)
+                    throw imap_error("Fetching message failure.");
 
-                for (auto it = mandatory_part_.begin(); it != mandatory_part_.end(); it++)
-                    if ((*it)->token_type == response_token_t::token_type_t::ATOM)
-                    {
-                        const unsigned long idx = stoul((*it)->atom);
-                        if (idx == 0)
-                            throw imap_error("Parsing failure.");
-                        results.push_back(idx);
-                    }
+                if (!iequals(token_atom(tokens_[mandatory_part_.first].next), "FETCH"))
+                    throw imap_error("Fetching message failure.");
+
+                uid = 0;
+                literal_token = NO_TOKEN;
+                for (auto part = mandatory_part_.first; part != NO_TOKEN; part = tokens_[part].next)
+                    if (tokens_[part].token_type == response_token_t::token_type_t::LIST)
+                        for (auto token = tokens_[part].parenthesized_list.first; token != NO_TOKEN; token = tokens_[token].next)
+                            if (tokens_[token].token_type == response_token_t::token_type_t::ATOM)
+                            {
+                                if (iequals(token_atom(token), "UID"))
+                                {
+                                    token = tokens_[token].next;
+                                    if (token == NO_TOKEN)
+                                        throw imap_error("Parsing failure.");
+                                    uid = token_number(token);
+                                }
+                                else if (iequals(token_atom(token), RFC822_TOKEN))
+                                {
+                                    token = tokens_[token].next;
+                                    if (token == NO_TOKEN || tokens_[token].token_type != response_token_t::token_type_t::LITERAL)
+                                        throw imap_error("Parsing failure.");
+                                    literal_token = token;
+                                    break;
+                                }
+                            }
+
+                if (literal_token == NO_TOKEN)
+                    throw imap_error("Parsing failure.");
+                state = fetch_state_t::LITERAL;
             }
             else if (parsed_line.tag == to_string(tag_))
             {
                 if (parsed_line.result.value() != tag_result_response_t::OK)
-                    throw imap_error("Search mailbox failure.");
-
-                has_more = false;
+                    throw imap_error("Fetching message failure.");
+                return true;
             }
             else
-            {
                 throw imap_error("Parsing failure.");
-            }
         }
-    }
-    catch (const invalid_argument&)
-    {
-        throw imap_error("Parsing failure.");
-    }
-    catch (const out_of_range&)
+
+        // Keep reading the string literal.
+        if (state == fetch_state_t::LITERAL && literal_state_ == string_literal_state_t::READING)
+            return false;
+        // Closing parenthesis not yet read.
+        if (state == fetch_state_t::LITERAL && literal_state_ == string_literal_state_t::DONE && !open_lists_.empty())
+        {
+            state = fetch_state_t::CLOSING;
+            return false;
+        }
+
+        // If no UID was found, but we asked for them, it's an error.
+        if (is_uids && uid == 0)
+            throw imap_error("Parsing failure.");
+        // The message is parsed and handed over at once, and its literal is released before the handler is called.
+        message msg;
+        msg.line_policy(line_policy, line_policy);
+        {
+            string literal = move(token_literal(literal_token));
+            literal_token = NO_TOKEN;
+            msg.parse(literal);
+        }
+        state = fetch_state_t::RESPONSE;
+        message_handler(is_uids ? uid : msg_no, move(msg));
+        return false;
+    };
+}
+
+
+string imap::fetch_info_command(const list<messages_range_t>& messages_range, unsigned int items, bool is_uids)
+{
+    if (messages_range.empty())
+        throw imap_error("Empty messages range.");
+
+    string cmd;
+    if (is_uids)
+        cmd.append("UID ");
+    cmd.append("FETCH " + messages_range_list_to_string(messages_range) + TOKEN_SEPARATOR_STR + LIST_BEGIN + "UID");
+    if (items & message_info_t::FLAGS)
+        cmd.append(" FLAGS");
+    if (items & message_info_t::ENVELOPE)
+        cmd.append(" ENVELOPE");
+    if (items & message_info_t::BODY_STRUCTURE)
+        cmd.append(" BODYSTRUCTURE");
+    if (items & message_info_t::SIZE)
+        cmd.append(" RFC822.SIZE");
+    if (items & message_info_t::INTERNAL_DATE)
+        cmd.append(" INTERNALDATE");
+    cmd += LIST_END;
+    return format(cmd);
+}
+
+
+/*
+A response spans over several lines if it contains a string literal, for instance a subject of the envelope, so it's parsed line by line until
+its list is closed. The other untagged responses, like EXISTS or the FETCH without UID sent while fetching, are ignored.
+*/
+auto imap::fetch_info_processor(bool is_uids, function<void (unsigned long, message_info_t)> info_handler) -> response_processor_t
+{
+    return [this, is_uids, info_handler, continued = false](string& line) mutable
+    {
+        if (continued)
+        {
+            if (!line.empty())
+                trim_eol(line);
+            parse_response(line);
+        }
+        else
+        {
+            reset_response_parser();
+            trim_if(line, is_any_of("\r\n"));
+            tag_result_response_t parsed_line = parse_tag_result(line);
+            if (parsed_line.tag == to_string(tag_))
+            {
+                if (!parsed_line.result.has_value() || parsed_line.result.value() != tag_result_response_t::OK)
+                    throw imap_error("Fetching message failure.");
+                return true;
+            }
+            else if (parsed_line.tag != UNTAGGED_RESPONSE)
+                throw imap_error("Parsing failure.");
+            parse_response(parsed_line.response);
+        }
+
+        continued = literal_state_ == string_literal_state_t::READING || !open_lists_.empty();
+        if (continued || mandatory_part_.size < 3 || !iequals(token_atom(tokens_[mandatory_part_.first].next), "FETCH"))
+            return false;
+
+        const unsigned long msg_no = token_number(mandatory_part_.first);
+        auto items_list = tokens_[tokens_[mandatory_part_.first].next].next;
+        if (tokens_[items_list].token_type != response_token_t::token_type_t::LIST)
+            throw imap_error("Parsing failure.");
+
+        message_info_t info;
+        for (auto item = tokens_[items_list].parenthesized_list.first; item != NO_TOKEN; item = tokens_[item].next)
+        {
+            const string_view item_name = token_atom(item);
+            item = tokens_[item].next;
+            if (item == NO_TOKEN)
+                throw imap_error("Parsing failure.");
+
+            if (iequals(item_name, "UID"))
+                info.uid = token_number(item);
+            else if (iequals(item_name, "FLAGS"))
+            {
+                if (tokens_[item].token_type != response_token_t::token_type_t::LIST)
+                    throw imap_error("Parsing failure.");
+                for (auto flag = tokens_[item].parenthesized_list.first; flag != NO_TOKEN; flag = tokens_[flag].next)
+                    info.flags.push_back(string(token_atom(flag)));
+            }
+            else if (iequals(item_name, "RFC822.SIZE"))
+                info.size = token_number(item);
+            else if (iequals(item_name, "INTERNALDATE"))
+                info.internal_date = parse_internal_date(token_atom(item));
+            else if (iequals(item_name, "ENVELOPE"))
+                parse_envelope(item, info.envelope);
+            else if (iequals(item_name, "BODYSTRUCTURE") || iequals(item_name, "BODY"))
+                parse_body_structure(item, info.body_structure, "");
+        }
+
+        // the UID is always fetched, so a response without it is an unsolicited one like a flags update
+        if (info.uid == 0)
+            return false;
+        const unsigned long info_no = is_uids ? info.uid : msg_no;
+        info_handler(info_no, move(info));
+        return false;
+    };
+}
+
+
+string imap::fetch_section_command(unsigned long message_no, const string& section, bool is_uid, unsigned long offset, unsigned long length)
+{
+    string cmd;
+    if (is_uid)
+        cmd.append("UID ");
+    cmd.append("FETCH " + to_string(message_no) + TOKEN_SEPARATOR_STR + "BODY.PEEK" + OPTIONAL_BEGIN + section + OPTIONAL_END);
+    if (length > 0)
+        cmd.append("<" + to_string(offset) + "." + to_string(length) + ">");
+    return format(cmd);
+}
+
+
+/*
+The section is received as a literal, or as a quoted string or `NIL` if it's empty. Its item name is like `BODY[1.2]<0>`, since the offset of
+a partial content is repeated by the server.
+*/
+auto imap::fetch_section_processor(shared_ptr<string> content) -> response_processor_t
+{
+    return [this, content, continued = false](string& line) mutable
+    {
+        if (continued)
+        {
+            if (!line.empty())
+                trim_eol(line);
+            parse_response(line);
+        }
+        else
+        {
+            reset_response_parser();
+            trim_if(line, is_any_of("\r\n"));
+            tag_result_response_t parsed_line = parse_tag_result(line);
+            if (parsed_line.tag == to_string(tag_))
+            {
+                if (!parsed_line.result.has_value() || parsed_line.result.value() != tag_result_response_t::OK)
+                    throw imap_error("Fetching message failure.");
+                return true;
+            }
+            else if (parsed_line.tag != UNTAGGED_RESPONSE)
+                throw imap_error("Parsing failure.");
+            parse_response(parsed_line.response);
+        }
+
+        continued = literal_state_ == string_literal_state_t::READING || !open_lists_.empty();
+        if (continued || mandatory_part_.size < 3 || !iequals(token_atom(tokens_[mandatory_part_.first].next), "FETCH"))
+            return false;
+
+        auto items_list = tokens_[tokens_[mandatory_part_.first].next].next;
+        if (tokens_[items_list].token_type != response_token_t::token_type_t::LIST)
+            throw imap_error("Parsing failure.");
+        for (auto item = tokens_[items_list].parenthesized_list.first; item != NO_TOKEN; item = tokens_[item].next)
+        {
+            const bool is_section = istarts_with(token_atom(item), "BODY[");
+            item = tokens_[item].next;
+            if (item == NO_TOKEN)
+                throw imap_error("Parsing failure.");
+            if (!is_section)
+                continue;
+            if (tokens_[item].token_type == response_token_t::token_type_t::LITERAL)
+                *content = move(token_literal(item));
+            else
+                *content = token_string(item);
+        }
+        return false;
+    };
+}
+
+
+void imap::decode_part(const body_structure_t& part, string& content, bool partial, mime& part_mime)
+{
+    // the last line is cut, since it could end in the middle of an encoded character
+    if (partial)
+    {
+        string::size_type line_end = content.rfind(codec::LF_CHAR);
+        content.erase(line_end == string::npos ? 0 : line_end + 1);
+    }
+    content.insert(0, format_part_header(part));
+
+    mime fetched;
+    fetched.line_policy(part_mime.line_policy(), part_mime.decoder_line_policy());
+    fetched.strict_mode(part_mime.strict_mode());
+    fetched.strict_codec_mode(part_mime.strict_codec_mode());
+    fetched.parse(content);
+    part_mime = move(fetched);
+}
+
+
+string imap::format_part_header(const body_structure_t& part)
+{
+    auto format_parameters = [](const header_map& parameters)
+    {
+        string params;
+        for (const auto& parameter : parameters)
+            params += "; " + parameter.first + "=" + QUOTED_STRING_SEPARATOR + parameter.second + QUOTED_STRING_SEPARATOR;
+        return params;
+    };
+
+    string header = "Content-Type: " + part.media_type + "/" + part.media_subtype + format_parameters(part.parameters) + codec::END_OF_LINE;
+    if (!part.encoding.empty())
+        header += "Content-Transfer-Encoding: " + part.encoding + codec::END_OF_LINE;
+    if (!part.disposition.empty())
+        header += "Content-Disposition: " + part.disposition + format_parameters(part.disposition_parameters) + codec::END_OF_LINE;
+    return header + codec::END_OF_LINE;
+}
+
+
+void imap::parse_envelope(std::size_t token, envelope_t& envelope)
+{
+    if (tokens_[token].token_type != response_token_t::token_type_t::LIST || tokens_[token].parenthesized_list.size < 10)
+        throw imap_error("Parsing failure.");
+
+    auto field = tokens_[token].parenthesized_list.first;
+    auto next_field = [this, &field]()
+    {
+        auto current = field;
+        field = tokens_[field].next;
+        return current;
+    };
+
+    envelope.date = token_string(next_field());
+    q_codec qc(codec::line_len_policy_t::VERYLARGE, codec::line_len_policy_t::VERYLARGE);
+    auto subject = qc.check_decode(token_string(next_field()));
+    envelope.subject = string_t(get<0>(subject), get<1>(subject));
+    envelope.from = parse_address_list(next_field());
+    envelope.sender = parse_address_list(next_field());
+    envelope.reply_to = parse_address_list(next_field());
+    envelope.to = parse_address_list(next_field());
+    envelope.cc = parse_address_list(next_field());
+    envelope.bcc = parse_address_list(next_field());
+    envelope.in_reply_to = token_string(next_field());
+    envelope.message_id = token_string(next_field());
+}
+
+
+mailboxes imap::parse_address_list(std::size_t token)
+{
+    mailboxes address_list;
+    if (tokens_[token].token_type != response_token_t::token_type_t::LIST)
+        return address_list;
+
+    q_codec qc(codec::line_len_policy_t::VERYLARGE, codec::line_len_policy_t::VERYLARGE);
+    bool in_group = false;
+    for (auto address = tokens_[token].parenthesized_list.first; address != NO_TOKEN; address = tokens_[address].next)
+    {
+        if (tokens_[address].token_type != response_token_t::token_type_t::LIST || tokens_[address].parenthesized_list.size != 4)
+            throw imap_error("Parsing failure.");
+
+        // the fields are the name, the source route, the mailbox and the host
+        auto name_token = tokens_[address].parenthesized_list.first;
+        auto mailbox_token = tokens_[tokens_[name_token].next].next;
+        const string mailbox = token_string(mailbox_token);
+        const string host = token_string(tokens_[mailbox_token].next);
+        if (host.empty())
+        {
+            in_group = !mailbox.empty();
+            if (in_group)
+                address_list.groups.push_back(mail_group(mailbox, {}));
+            continue;
+        }
+
+        auto name = qc.check_decode(token_string(name_token));
+        mail_address mail(string_t(get<0>(name), get<1>(name)), mailbox + codec::MONKEY_CHAR + host);
+        if (in_group)
+            address_list.groups.back().add(mail);
+        else
+            address_list.addresses.push_back(mail);
+    }
+    return address_list;
+}
+
+
+/*
+By RFC 3501 section 6.4.5, the parts of a multipart body are numbered from one, and the parts of a nested multipart are numbered with the prefix
+of its own number. The body of an attached message is numbered the same way, except that a non-multipart body of an attached message gets the
+suffix `.1`, and so does a non-multipart body of the message itself, numbered just `1`.
+*/
+void imap::parse_body_structure(std::size_t token, body_structure_t& body, const string& section)
+{
+    if (tokens_[token].token_type != response_token_t::token_type_t::LIST || tokens_[token].parenthesized_list.size < 2)
+        throw imap_error("Parsing failure.");
+
+    auto field = tokens_[token].parenthesized_list.first;
+    auto next_field = [this, &field]()
+    {
+        auto current = field;
+        if (field != NO_TOKEN)
+            field = tokens_[field].next;
+        return current;
+    };
+
+    if (tokens_[field].token_type == response_token_t::token_type_t::LIST)
+    {
+        body.section = section.empty() ? "TEXT" : section;
+        body.media_type = "multipart";
+        for (unsigned long part_no = 1; field != NO_TOKEN && tokens_[field].token_type == response_token_t::token_type_t::LIST; part_no++)
+        {
+            body.parts.emplace_back();
+            parse_body_structure(next_field(), body.parts.back(), section.empty() ? to_string(part_no) : section + "." + to_string(part_no));
+        }
+        body.media_subtype = to_lower_copy(token_string(next_field()));
+        parse_body_parameters(next_field(), body.parameters);
+    }
+    else
+    {
+        body.section = section.empty() ? "1" : section;
+        body.media_type = to_lower_copy(token_string(next_field()));
+        body.media_subtype = to_lower_copy(token_string(next_field()));
+        parse_body_parameters(next_field(), body.parameters);
+        body.id = token_string(next_field());
+        body.description = token_string(next_field());
+        body.encoding = to_lower_copy(token_string(next_field()));
+        body.size = token_number(next_field());
+
+        if (body.media_type == "message" && body.media_subtype == "rfc822")
+        {
+            // the envelope of the attached message is skipped
+            next_field();
+            auto attached_body = next_field();
+            if (attached_body == NO_TOKEN || tokens_[attached_body].token_type != response_token_t::token_type_t::LIST ||
+                tokens_[attached_body].parenthesized_list.first == NO_TOKEN)
+                throw imap_error("Parsing failure.");
+            const bool is_multipart = tokens_[tokens_[attached_body].parenthesized_list.first].token_type ==
+                response_token_t::token_type_t::LIST;
+            body.parts.emplace_back();
+            parse_body_structure(attached_body, body.parts.back(), is_multipart ? body.section : body.section + ".1");
+            // the parts of the attached message are numbered from the message, but its multipart body is fetched by its text
+            if (is_multipart)
+                body.parts.back().section = body.section + ".TEXT";
+            body.lines = token_number(next_field());
+        }
+        else if (body.media_type == "text")
+            body.lines = token_number(next_field());
+
+        // the MD5 extension is skipped
+        next_field();
+    }
+
+    auto disposition = next_field();
+    if (disposition != NO_TOKEN && tokens_[disposition].token_type == response_token_t::token_type_t::LIST)
+    {
+        auto disposition_type = tokens_[disposition].parenthesized_list.first;
+        if (disposition_type != NO_TOKEN)
+        {
+            body.disposition = to_lower_copy(token_string(disposition_type));
+            parse_body_parameters(tokens_[disposition_type].next, body.disposition_parameters);
+        }
+    }
+}
+
+
+void imap::parse_body_parameters(std::size_t token, header_map& parameters)
+{
+    if (token == NO_TOKEN || tokens_[token].token_type != response_token_t::token_type_t::LIST)
+        return;
+
+    for (auto name = tokens_[token].parenthesized_list.first; name != NO_TOKEN && tokens_[name].next != NO_TOKEN;
+        name = tokens_[tokens_[name].next].next)
+        parameters.insert(token_string(name), token_string(tokens_[name].next));
+}
+
+
+local_date_time imap::parse_internal_date(string_view date_str)
+{
+    const string_view MONTHS[] = {"jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"};
+
+    // the day is padded by a space or not padded at all
+    while (!date_str.empty() && date_str.front() == TOKEN_SEPARATOR_CHAR)
+        date_str.remove_prefix(1);
+    string_view::size_type pos = 0;
+    auto read_number = [&date_str, &pos](string_view::size_type digits, int& number)
+    {
+        auto [end, error] = from_chars(date_str.data() + pos, date_str.data() + std::min(pos + digits, date_str.length()), number);
+        if (error != std::errc() || end == date_str.data() + pos)
+            return false;
+        pos = end - date_str.data();
+        return true;
+    };
+    auto skip = [&date_str, &pos](char ch)
+    {
+        if (pos >= date_str.length() || date_str[pos] != ch)
+            return false;
+        pos++;
+        return true;
+    };
+
+    int day = 0, year = 0, hour = 0, minute = 0, second = 0, zone_hours = 0, zone_minutes = 0;
+    std::size_t month = 0;
+    if (!read_number(2, day) || !skip('-') || pos + 3 > date_str.length())
+        throw imap_error("Parsing failure.");
+    while (month < 12 && !iequals(date_str.substr(pos, 3), MONTHS[month]))
+        month++;
+    pos += 3;
+    if (month == 12 || !skip('-') || !read_number(4, year) || !skip(TOKEN_SEPARATOR_CHAR) || !read_number(2, hour) || !skip(':') ||
+        !read_number(2, minute) || !skip(':') || !read_number(2, second) || !skip(TOKEN_SEPARATOR_CHAR) || pos + 5 != date_str.length() ||
+        (date_str[pos] != '+' && date_str[pos] != '-'))
+        throw imap_error("Parsing failure.");
+    const string zone = string(date_str.substr(pos, 3)) + codec::COLON_CHAR + string(date_str.substr(pos + 3, 2));
+    pos++;
+    if (!read_number(2, zone_hours) || !read_number(2, zone_minutes) || pos != date_str.length())
+        throw imap_error("Parsing failure.");
+
+    try
+    {
+        time_zone_ptr tz(new posix_time_zone(zone));
+        return local_date_time(boost::gregorian::date(year, static_cast<unsigned short>(month + 1), day),
+            hours(hour) + minutes(minute) + seconds(second), tz, local_date_time::EXCEPTION_ON_ERROR);
+    }
+    catch (const std::out_of_range&)
+    {
+        throw imap_error("Parsing failure.");
+    }
+    catch (const boost::local_time::time_label_invalid&)
     {
         throw imap_error("Parsing failure.");
     }
+}
+
+
+string imap::search_command(const string& conditions, bool want_uids)
+{
+    string cmd;
+    if (want_uids)
+        cmd.append("UID ");
+    cmd.append("SEARCH " + conditions);
+    return format(cmd);
+}
+
+
+string imap::search_conditions_to_string(const list<search_condition_t>& conditions)
+{
+    string cond_str;
+    std::size_t elem = 0;
+    for (const auto& c : conditions)
+        if (elem++ < conditions.size() - 1)
+            cond_str += c.imap_string + TOKEN_SEPARATOR_STR;
+        else
+            cond_str += c.imap_string;
+    return cond_str;
+}
+
+
+auto imap::search_processor(shared_ptr<list<unsigned long>> results) -> response_processor_t
+{
+    return [this, results](string& line)
+    {
+        reset_response_parser();
+        trim_if(line, is_any_of("\r\n"));
+        tag_result_response_t parsed_line = parse_tag_result(line);
+        if (parsed_line.tag == UNTAGGED_RESPONSE)
+        {
+            parse_response(parsed_line.response);
+
+            auto search_token = mandatory_part_.first;
+            if (search_token == NO_TOKEN)
+                throw imap_error("Parsing failure.");
+            // ignore other responses, although not sure whether this is by the rfc or not
+            if (tokens_[search_token].token_type == response_token_t::token_type_t::ATOM && !iequals(token_atom(search_token), "SEARCH"))
+                return false;
+
+            for (auto it = tokens_[search_token].next; it != NO_TOKEN; it = tokens_[it].next)
+                if (tokens_[it].token_type == response_token_t::token_type_t::ATOM)
+                {
+                    const unsigned long idx = token_number(it);
+                    if (idx == 0)
+                        throw imap_error("Parsing failure.");
+                    results->push_back(idx);
+                }
+            return false;
+        }
+        else if (parsed_line.tag == to_string(tag_))
+        {
+            if (parsed_line.result.value() != tag_result_response_t::OK)
+                throw imap_error("Search mailbox failure.");
+            return true;
+        }
+        else
+            throw imap_error("Parsing failure.");
+    };
+}
+
+
+void imap::receive_response(response_processor_t processor)
+{
+    while (true)
+    {
+        string line = dlg_->receive(true);
+        if (process_line(processor, line))
+            break;
+        // the rest of a string literal is received at once, since its size is known
+        if (literal_state_ == string_literal_state_t::READING)
+            complete_literal(dlg_->receive_bytes(literal_remaining()));
+    }
     reset_response_parser();
 }
 
 
+bool imap::process_line(response_processor_t& processor, string& line)
+{
+    try
+    {
+        return processor(line);
+    }
+    catch (const invalid_argument&)
+    {
+        throw imap_error("Parsing failure.");
+    }
+    catch (const out_of_range&)
+    {
+        throw imap_error("Parsing failure.");
+    }
+}
+
+
+void imap::initiate_command(const string& command, response_processor_t processor, function<void (exception_ptr)> handler)
+{
+    auto proc = make_shared<response_processor_t>(move(processor));
+    dlg_->async_send(command, [this, proc, handler](exception_ptr exc)
+        {
+            if (exc)
+                handler(exc);
+            else
+                async_receive_response(proc, handler);
+        });
+}
+
+
+void imap::async_receive_response(shared_ptr<response_processor_t> processor, function<void (exception_ptr)> handler)
+{
+    dlg_->async_receive(true, [this, processor, handler](exception_ptr exc, string line)
+        {
+            bool completed = true;
+            if (!exc)
+            {
+                try
+                {
+                    completed = process_line(*processor, line);
+                }
+                catch (...)
+                {
+                    exc = std::current_exception();
+                }
+            }
+
+            if (completed)
+            {
+                reset_response_parser();
+                handler(exc);
+            }
+            else if (literal_state_ == string_literal_state_t::READING)
+            {
+                dlg_->async_receive_bytes(literal_remaining(), [this, processor, handler](exception_ptr exc, string octets)
+                    {
+                        if (exc)
+                        {
+                            reset_response_parser();
+                            handler(exc);
+                            return;
+                        }
+                        complete_literal(octets);
+                        async_receive_response(processor, handler);
+                    });
+            }
+            else
+                async_receive_response(processor, handler);
+        });
+}
+
+
+void imap::initiate_select(const string& mailbox, bool read_only, function<void (exception_ptr, mailbox_stat_t)> handler)
+{
+    auto stat = make_shared<mailbox_stat_t>();
+    initiate_command(select_command(mailbox, read_only), select_processor(stat), [stat, handler](exception_ptr exc)
+        {
+            handler(exc, exc ? mailbox_stat_t() : *stat);
+        });
+}
+
+
+void imap::initiate_fetch(const list<messages_range_t>& messages_range, bool is_uids, bool header_only, codec::line_len_policy_t line_policy,
+    function<void (exception_ptr, map<unsigned long, message>)> handler)
+{
+    string cmd;
+    try
+    {
+        cmd = fetch_command(messages_range, is_uids, header_only);
+    }
+    catch (...)
+    {
+        post(*dlg_->io_context(), [exc = std::current_exception(), handler]() { handler(exc, map<unsigned long, message>()); });
+        return;
+    }
+
+    auto fetched = make_shared<map<unsigned long, message>>();
+    auto message_handler = [fetched](unsigned long msg_no, message msg) { fetched->emplace(msg_no, move(msg)); };
+    initiate_command(cmd, fetch_processor(is_uids, header_only, line_policy, message_handler), [fetched, handler](exception_ptr exc)
+        {
+            handler(exc, exc ? map<unsigned long, message>() : move(*fetched));
+        });
+}
+
+
+void imap::initiate_fetch_info(const list<messages_range_t>& messages_range, unsigned int items, bool is_uids,
+    function<void (exception_ptr, map<unsigned long, message_info_t>)> handler)
+{
+    string cmd;
+    try
+    {
+        cmd = fetch_info_command(messages_range, items, is_uids);
+    }
+    catch (...)
+    {
+        post(*dlg_->io_context(), [exc = std::current_exception(), handler]() { handler(exc, map<unsigned long, message_info_t>()); });
+        return;
+    }
+
+    auto fetched = make_shared<map<unsigned long, message_info_t>>();
+    auto info_handler = [fetched](unsigned long msg_no, message_info_t info) { (*fetched)[msg_no] = move(info); };
+    initiate_command(cmd, fetch_info_processor(is_uids, info_handler), [fetched, handler](exception_ptr exc)
+        {
+            handler(exc, exc ? map<unsigned long, message_info_t>() : move(*fetched));
+        });
+}
+
+
+void imap::initiate_fetch_part(unsigned long message_no, const body_structure_t& part, bool is_uid, unsigned long offset, unsigned long length,
+    codec::line_len_policy_t line_policy, function<void (exception_ptr, mime)> handler)
+{
+    auto fetched = make_shared<string>();
+    initiate_command(fetch_section_command(message_no, part.section, is_uid, offset, length), fetch_section_processor(fetched),
+        [fetched, part, length, line_policy, handler](exception_ptr exc)
+        {
+            mime part_mime;
+            part_mime.line_policy(line_policy, line_policy);
+            if (!exc)
+            {
+                try
+                {
+                    decode_part(part, *fetched, length > 0 && fetched->length() >= length, part_mime);
+                }
+                catch (...)
+                {
+                    exc = std::current_exception();
+                    part_mime = mime();
+                }
+            }
+            handler(exc, move(part_mime));
+        });
+}
+
+
+void imap::initiate_search(const string& conditions, bool want_uids, function<void (exception_ptr, list<unsigned long>)> handler)
+{
+    auto found = make_shared<list<unsigned long>>();
+    initiate_command(search_command(conditions, want_uids), search_processor(found), [found, handler](exception_ptr exc)
+        {
+            handler(exc, exc ? list<unsigned long>() : move(*found));
+        });
+}
+
+
 string imap::folder_delimiter()
 {
     try
@@ -1020,16 +1657,15 @@ string imap::folder_delimiter()
                 if (parsed_line.tag == UNTAGGED_RESPONSE && folder_delimiter_.empty())
                 {
                     parse_response(parsed_line.response);
-                    if (!iequals(mandatory_part_.front()->atom, "LIST"))
+                    if (!iequals(token_atom(mandatory_part_.first), "LIST"))
                         throw imap_error("Determining folder delimiter failure.");
-                    mandatory_part_.pop_front();
 
-                    if (mandatory_part_.size() < 3)
+                    if (mandatory_part_.size < 4)
                         throw imap_error("Determining folder delimiter failure.");
-                    auto it = mandatory_part_.begin();
-                    if ((*(++it))->token_type != response_token_t::token_type_t::ATOM)
+                    auto it = tokens_[tokens_[mandatory_part_.first].next].next;
+                    if (tokens_[it].token_type != response_token_t::token_type_t::ATOM)
                         throw imap_error("Determining folder delimiter failure.");
-                    folder_delimiter_ = trim_copy_if((*it)->atom, [](char c ){ return c == QUOTED_STRING_SEPARATOR_CHAR; });
+                    folder_delimiter_ = trim_copy_if(string(token_atom(it)), [](char c ){ return c == QUOTED_STRING_SEPARATOR_CHAR; });
                     reset_response_parser();
                 }
                 else if (parsed_line.tag == to_string(tag_))
@@ -1088,26 +1724,23 @@ atoms, string literal and parenthesized lists). The grammar can be parsed in one
 parenthesized list:
 1. if a square bracket is reached, then an optional part is found, so parse its content as usual
 2. if a brace is read, then string literal size is found, so read a number and then literal itself
-3. if a parenthesis is found, then a list is being read, so increase the parenthesis counter and proceed
+3. if a parenthesis is found, then a list is being read, so push it to the open lists and proceed
 4. for a regular char check the state and determine if an atom or string size/literal is read
 
 Token of the grammar is defined by `response_token_t` and stores one of the three types. Since parenthesized list is recursively defined, it keeps
-sequence of tokens. When a character is read, it belongs to the last token of the sequence of tokens at the given parenthesis depth. The last token
-of the response expression is found by getting the last token of the token sequence at the given depth (in terms of parenthesis count).
+sequence of tokens. The tokens are appended to the arena, and linked by indexes to the sequence of the innermost open list, or to the optional or
+mandatory part if no list is open. The response is appended to the response text, so an atom is kept as its position and length within the text.
+Since a new token is always the last one of the arena, the current token is the last one as well.
 */
-void imap::parse_response(const string& response)
+void imap::parse_response(string_view response)
 {
-    list<shared_ptr<imap::response_token_t>>* token_list;
-
     if (literal_state_ == string_literal_state_t::READING)
     {
-        token_list = optional_part_state_ ? find_last_token_list(optional_part_) : find_last_token_list(mandatory_part_);
-        if (token_list->back()->token_type == response_token_t::token_type_t::LITERAL && literal_bytes_read_ > token_list->back()->literal.size())
-            throw imap_error("Parser failure.");
-        unsigned long literal_size = stoul(token_list->back()->literal_size);
+        string& literal = literals_[tokens_[literal_token_].pos];
+        const string::size_type literal_size = tokens_[literal_token_].length;
         if (literal_bytes_read_ + response.size() < literal_size)
         {
-            token_list->back()->literal += response + codec::END_OF_LINE;
+            literal.append(response).append(codec::END_OF_LINE);
             literal_bytes_read_ += response.size() + eols_no_;
             if (literal_bytes_read_ == literal_size)
                 literal_state_ = string_literal_state_t::DONE;
@@ -1115,24 +1748,39 @@ void imap::parse_response(const string& response)
         }
         else
         {
-            string::size_type resp_len = response.size();
-            token_list->back()->literal += response.substr(0, literal_size - literal_bytes_read_);
-            literal_bytes_read_ += literal_size - literal_bytes_read_;
+            const string::size_type literal_rest = literal_size - literal_bytes_read_;
+            literal.append(response.substr(0, literal_rest));
+            literal_bytes_read_ = literal_size;
             literal_state_ = string_literal_state_t::DONE;
-            parse_response(response.substr(resp_len - (literal_size - literal_bytes_read_) - 1));
+            parse_response(response.substr(literal_rest));
             return;
         }
     }
 
-    shared_ptr<response_token_t> cur_token;
-    for (auto ch : response)
+    const string::size_type text_pos = response_text_.size();
+    response_text_.append(response);
+    for (string_view::size_type i = 0; i < response.size(); i++)
     {
+        const char ch = response[i];
+        if (atom_state_ == atom_state_t::SECTION)
+        {
+            tokens_.back().length++;
+            if (ch == OPTIONAL_END)
+                atom_state_ = atom_state_t::PLAIN;
+            continue;
+        }
+
         switch (ch)
         {
             case OPTIONAL_BEGIN:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
+                else if (atom_state_ == atom_state_t::PLAIN)
+                {
+                    tokens_.back().length++;
+                    atom_state_ = atom_state_t::SECTION;
+                }
                 else
                 {
                     if (optional_part_state_)
@@ -1146,7 +1794,7 @@ void imap::parse_response(const string& response)
             case OPTIONAL_END:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
                 else
                 {
                     if (!optional_part_state_)
@@ -1161,14 +1809,10 @@ void imap::parse_response(const string& response)
             case LIST_BEGIN:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
                 else
                 {
-                    cur_token = make_shared<response_token_t>();
-                    cur_token->token_type = response_token_t::token_type_t::LIST;
-                    token_list = optional_part_state_ ? find_last_token_list(optional_part_) : find_last_token_list(mandatory_part_);
-                    token_list->push_back(cur_token);
-                    parenthesis_list_counter_++;
+                    open_lists_.push_back(add_token(response_token_t::token_type_t::LIST, 0));
                     atom_state_ = atom_state_t::NONE;
                 }
             }
@@ -1177,13 +1821,13 @@ void imap::parse_response(const string& response)
             case LIST_END:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
                 else
                 {
-                    if (parenthesis_list_counter_ == 0)
+                    if (open_lists_.empty())
                         throw imap_error("Parser failure.");
 
-                    parenthesis_list_counter_--;
+                    open_lists_.pop_back();
                     atom_state_ = atom_state_t::NONE;
                 }
             }
@@ -1192,16 +1836,16 @@ void imap::parse_response(const string& response)
             case STRING_LITERAL_BEGIN:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
                 else
                 {
                     if (literal_state_ == string_literal_state_t::SIZE)
                         throw imap_error("Parser failure.");
 
-                    cur_token = make_shared<response_token_t>();
-                    cur_token->token_type = response_token_t::token_type_t::LITERAL;
-                    token_list = optional_part_state_ ? find_last_token_list(optional_part_) : find_last_token_list(mandatory_part_);
-                    token_list->push_back(cur_token);
+                    literal_token_ = add_token(response_token_t::token_type_t::LITERAL, literals_.size());
+                    literals_.emplace_back();
+                    // the octets are counted per literal, since a response can contain several of them
+                    literal_bytes_read_ = 0;
                     literal_state_ = string_literal_state_t::SIZE;
                     atom_state_ = atom_state_t::NONE;
                 }
@@ -1211,7 +1855,7 @@ void imap::parse_response(const string& response)
             case STRING_LITERAL_END:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
                 else
                 {
                     if (literal_state_ == string_literal_state_t::NONE)
@@ -1225,15 +1869,9 @@ void imap::parse_response(const string& response)
             case TOKEN_SEPARATOR_CHAR:
             {
                 if (atom_state_ == atom_state_t::QUOTED)
-                    cur_token->atom +=ch;
+                    tokens_.back().length++;
                 else
-                {
-                    if (cur_token != nullptr)
-                    {
-                        trim(cur_token->atom);
-                        atom_state_ = atom_state_t::NONE;
-                    }
-                }
+                    atom_state_ = atom_state_t::NONE;
             }
             break;
 
@@ -1241,14 +1879,13 @@ void imap::parse_response(const string& response)
             {
                 if (atom_state_ == atom_state_t::NONE)
                 {
-                    cur_token = make_shared<response_token_t>();
-                    cur_token->token_type = response_token_t::token_type_t::ATOM;
-                    token_list = optional_part_state_ ? find_last_token_list(optional_part_) : find_last_token_list(mandatory_part_);
-                    token_list->push_back(cur_token);
+                    tokens_[add_token(response_token_t::token_type_t::ATOM, text_pos + i + 1)].quoted = true;
                     atom_state_ = atom_state_t::QUOTED;
                 }
                 else if (atom_state_ == atom_state_t::QUOTED)
                     atom_state_ = atom_state_t::NONE;
+                else
+                    tokens_.back().length++;
             }
             break;
 
@@ -1259,7 +1896,10 @@ void imap::parse_response(const string& response)
                     if (!isdigit(ch))
                         throw imap_error("Parser failure.");
 
-                    cur_token->literal_size += ch;
+                    string::size_type& literal_size = tokens_.back().length;
+                    if (literal_size > (string::npos - (ch - '0')) / 10)
+                        throw imap_error("Parser failure.");
+                    literal_size = literal_size * 10 + (ch - '0');
                 }
                 else if (literal_state_ == string_literal_state_t::WAITING)
                 {
@@ -1270,13 +1910,10 @@ void imap::parse_response(const string& response)
                 {
                     if (atom_state_ == atom_state_t::NONE)
                     {
-                        cur_token = make_shared<response_token_t>();
-                        cur_token->token_type = response_token_t::token_type_t::ATOM;
-                        token_list = optional_part_state_ ? find_last_token_list(optional_part_) : find_last_token_list(mandatory_part_);
-                        token_list->push_back(cur_token);
+                        add_token(response_token_t::token_type_t::ATOM, text_pos + i);
                         atom_state_ = atom_state_t::PLAIN;
                     }
-                    cur_token->atom += ch;
+                    tokens_.back().length++;
                 }
             }
         }
@@ -1285,19 +1922,92 @@ void imap::parse_response(const string& response)
         literal_state_ = string_literal_state_t::READING;
 }
 
+
+std::size_t imap::literal_remaining()
+{
+    return tokens_[literal_token_].length - literal_bytes_read_;
+}
+
+
+void imap::complete_literal(const string& octets)
+{
+    literals_[tokens_[literal_token_].pos] += octets;
+    literal_bytes_read_ += octets.size();
+    literal_state_ = string_literal_state_t::DONE;
+}
+
+
 void imap::reset_response_parser()
 {
-    optional_part_.clear();
-    mandatory_part_.clear();
+    // the containers are cleared but keep their capacity, so the next responses reuse it
+    tokens_.clear();
+    response_text_.clear();
+    literals_.clear();
+    optional_part_ = token_list_t();
+    mandatory_part_ = token_list_t();
     optional_part_state_ = false;
     atom_state_ = atom_state_t::NONE;
-    parenthesis_list_counter_ = 0;
+    open_lists_.clear();
     literal_state_ = string_literal_state_t::NONE;
     literal_bytes_read_ = 0;
+    literal_token_ = NO_TOKEN;
     eols_no_ = 2;
 }
 
 
+std::size_t imap::add_token(response_token_t::token_type_t token_type, string::size_type pos)
+{
+    const std::size_t token = tokens_.size();
+    tokens_.emplace_back(token_type, pos);
+    token_list_t& token_list = open_lists_.empty() ? (optional_part_state_ ? optional_part_ : mandatory_part_) :
+        tokens_[open_lists_.back()].parenthesized_list;
+    if (token_list.last == NO_TOKEN)
+        token_list.first = token;
+    else
+        tokens_[token_list.last].next = token;
+    token_list.last = token;
+    token_list.size++;
+    return token;
+}
+
+
+string_view imap::token_atom(std::size_t token) const
+{
+    if (token == NO_TOKEN || tokens_[token].token_type != response_token_t::token_type_t::ATOM)
+        return string_view();
+    return string_view(response_text_).substr(tokens_[token].pos, tokens_[token].length);
+}
+
+
+unsigned long imap::token_number(std::size_t token) const
+{
+    const string_view atom = token_atom(token);
+    unsigned long number = 0;
+    auto [end, error] = from_chars(atom.data(), atom.data() + atom.size(), number);
+    if (atom.empty() || error != std::errc() || end != atom.data() + atom.size())
+        throw imap_error("Parsing failure.");
+    return number;
+}
+
+
+string& imap::token_literal(std::size_t token)
+{
+    return literals_[tokens_[token].pos];
+}
+
+
+string imap::token_string(std::size_t token)
+{
+    if (token == NO_TOKEN)
+        return string();
+    if (tokens_[token].token_type == response_token_t::token_type_t::LITERAL)
+        return token_literal(token);
+    const string_view atom = token_atom(token);
+    if (!tokens_[token].quoted && iequals(atom, "NIL"))
+        return string();
+    return string(atom);
+}
+
 string imap::format(const string& command)
 {
     return to_string(++tag_) + TOKEN_SEPARATOR_STR + command;
@@ -1340,21 +2050,8 @@ string imap::imap_date_to_string(const boost::gregorian::date& gregorian_date)
 }
 
 
-
-list<shared_ptr<imap::response_token_t>>* imap::find_last_token_list(list<shared_ptr<response_token_t>>& token_list)
-{
-    list<shared_ptr<response_token_t>>* list_ptr = &token_list;
-    unsigned int depth = 1;
-    while (!list_ptr->empty() && list_ptr->back()->token_type == response_token_t::token_type_t::LIST && depth <= parenthesis_list_counter_)
-    {
-        list_ptr = &(list_ptr->back()->parenthesized_list);
-        depth++;
-    }
-    return list_ptr;
-}
-
-
-imaps::imaps(const string& hostname, unsigned port, milliseconds timeout) : imap(hostname, port, timeout)
+imaps::imaps(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) :
+    imap(hostname, port, timeout, ios)
 {
     ssl_options_ =
         {
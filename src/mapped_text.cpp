@@ -0,0 +1,81 @@
+/*
+
+mapped_text.cpp
+---------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <filesystem>
+#include <memory>
+#include <system_error>
+#include <string>
+#include <string_view>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <mailio/mapped_text.hpp>
+
+
+using std::string;
+using std::string_view;
+using std::make_shared;
+using std::error_code;
+using std::filesystem::file_size;
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::interprocess_exception;
+using boost::interprocess::read_only;
+
+
+namespace mailio
+{
+
+
+mapped_text::mapped_text(const string& file_path)
+{
+    // an empty file cannot be mapped, so it remains an empty text
+    error_code size_error;
+    if (file_size(file_path, size_error) == 0 && !size_error)
+        return;
+
+    try
+    {
+        file_mapping mapping(file_path.c_str(), read_only);
+        auto region = make_shared<const mapped_region>(mapping, read_only);
+        text_ = string_view(static_cast<const char*>(region->get_address()), region->get_size());
+        region_ = region;
+    }
+    catch (interprocess_exception&)
+    {
+        throw mapped_text_error("Mapping file `" + file_path + "` failed.");
+    }
+}
+
+
+string_view mapped_text::text() const
+{
+    return text_;
+}
+
+
+mapped_text mapped_text::substr(string_view::size_type pos, string_view::size_type count) const
+{
+    mapped_text part;
+    part.region_ = region_;
+    part.text_ = text_.substr(pos, count);
+    return part;
+}
+
+
+bool mapped_text::empty() const
+{
+    return text_.empty();
+}
+
+
+} // namespace mailio
@@ -0,0 +1,83 @@
+/*
+
+mbox.cpp
+--------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <string>
+#include <string_view>
+#include <mailio/codec.hpp>
+#include <mailio/mapped_text.hpp>
+#include <mailio/message.hpp>
+#include <mailio/mbox.hpp>
+
+
+using std::string;
+using std::string_view;
+
+
+namespace mailio
+{
+
+
+const string mbox::FROM_LINE{"From "};
+
+
+mbox::mbox(const string& file_path) : text_(file_path), pos_(0)
+{
+}
+
+
+mbox::mbox(const mapped_text& archive_text) : text_(archive_text), pos_(0)
+{
+}
+
+
+bool mbox::next(mapped_text& message_text)
+{
+    const string_view text = text_.text();
+    while (pos_ < text.length())
+    {
+        string_view::size_type msg_begin = pos_;
+        if (text.compare(pos_, FROM_LINE.length(), FROM_LINE) == 0)
+        {
+            string_view::size_type line_end = text.find(codec::LF_CHAR, pos_);
+            msg_begin = line_end == string_view::npos ? text.length() : line_end + 1;
+        }
+
+        // the separator is recognized only at the beginning of a line
+        string_view::size_type msg_end = text.find(FROM_LINE, msg_begin);
+        while (msg_end != string_view::npos && (msg_end == 0 || text[msg_end - 1] != codec::LF_CHAR))
+            msg_end = text.find(FROM_LINE, msg_end + 1);
+        if (msg_end == string_view::npos)
+            msg_end = text.length();
+
+        pos_ = msg_end;
+        if (msg_begin < msg_end)
+        {
+            message_text = text_.substr(msg_begin, msg_end - msg_begin);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool mbox::next(message& msg)
+{
+    mapped_text message_text;
+    if (!next(message_text))
+        return false;
+    msg.parse(message_text);
+    return true;
+}
+
+
+} // namespace mailio
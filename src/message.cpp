@@ -11,10 +11,11 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 */
 
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <list>
-#include <map>
 #include <stdexcept>
 #include <utility>
 #include <locale>
@@ -25,7 +26,6 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
-#include <boost/regex.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <mailio/codec.hpp>
 #include <mailio/base64.hpp>
@@ -38,14 +38,13 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 
 
 using std::string;
+using std::string_view;
 #if defined(__cpp_char8_t)
 using std::u8string;
 #endif
 using std::vector;
 using std::list;
-using std::multimap;
 using std::pair;
-using std::make_pair;
 using std::locale;
 using std::ios_base;
 using std::istream;
@@ -56,19 +55,18 @@ using std::make_shared;
 using std::tuple;
 using std::size_t;
 using std::get;
+using std::all_of;
 using boost::trim_copy;
 using boost::trim;
-using boost::iequals;
 using boost::split;
-using boost::regex;
-using boost::regex_match;
-using boost::smatch;
-using boost::sregex_iterator;
 using boost::local_time::local_date_time;
 using boost::local_time::local_time_input_facet;
 using boost::local_time::not_a_date_time;
 using boost::posix_time::second_clock;
 using boost::posix_time::ptime;
+using boost::posix_time::hours;
+using boost::posix_time::minutes;
+using boost::posix_time::seconds;
 using boost::local_time::time_zone_ptr;
 using boost::local_time::posix_time_zone;
 using boost::local_time::local_time_facet;
@@ -77,8 +75,6 @@ using boost::local_time::local_time_facet;
 namespace mailio
 {
 
-const string message::ATEXT{"!#$%&'*+-./=?^_`{|}~"};
-const string message::DTEXT{"!#$%&'*+-.@/=?^_`{|}~"}; // atext with monkey
 const string message::FROM_HEADER{"From"};
 const string message::SENDER_HEADER{"Sender"};
 const string message::REPLY_TO_HEADER{"Reply-To"};
@@ -101,11 +97,19 @@ message::message() : mime(), date_time_(second_clock::universal_time(), time_zon
 
 void message::format(string& message_str, bool dot_escape) const
 {
-    message_str += format_header();
+    string_streambuf message_buf(message_str);
+    ostream message_strm(&message_buf);
+    format(message_strm, dot_escape);
+}
+
+
+void message::format(ostream& message_strm, bool dot_escape) const
+{
+    message_strm << format_header();
 
     if (!parts_.empty())
     {
-        if (!content_.empty())
+        if (!decoded_content().empty())
         {
             mime content_part;
             content_part.content(content_);
@@ -117,22 +121,22 @@ void message::format(string& message_str, bool dot_escape) const
             content_part.strict_mode(strict_mode_);
             content_part.strict_codec_mode(strict_codec_mode_);
             content_part.header_codec(header_codec_);
-            string cps;
-            content_part.format(cps, dot_escape);
-            message_str += BOUNDARY_DELIMITER + boundary_ + codec::END_OF_LINE + cps + codec::END_OF_LINE;
+            message_strm << BOUNDARY_DELIMITER << boundary_ << codec::END_OF_LINE;
+            content_part.format(message_strm, dot_escape);
+            message_strm << codec::END_OF_LINE;
         }
 
         // recursively format mime parts
         for (const auto& p: parts_)
         {
-            string p_str;
-            p.format(p_str, dot_escape);
-            message_str += BOUNDARY_DELIMITER + boundary_ + codec::END_OF_LINE + p_str + codec::END_OF_LINE;
+            message_strm << BOUNDARY_DELIMITER << boundary_ << codec::END_OF_LINE;
+            p.format(message_strm, dot_escape);
+            message_strm << codec::END_OF_LINE;
         }
-        message_str += BOUNDARY_DELIMITER + boundary_ + BOUNDARY_DELIMITER + codec::END_OF_LINE;
+        message_strm << BOUNDARY_DELIMITER << boundary_ << BOUNDARY_DELIMITER << codec::END_OF_LINE;
     }
     else
-        message_str += format_content(dot_escape);
+        format_content(message_strm, dot_escape);
 }
 
 
@@ -164,9 +168,18 @@ void message::parse(const u8string& message_str, bool dot_escape)
 #endif
 
 
+void message::parse(const mapped_text& message_text, bool dot_escape)
+{
+    mime::parse(message_text, dot_escape);
+
+    if (from_.addresses.size() == 0)
+        throw message_error("No author address.");
+}
+
+
 bool message::empty() const
 {
-    return content_.empty();
+    return decoded_content().empty();
 }
 
 
@@ -322,10 +335,7 @@ string message::disposition_notification_to_string() const
 
 void message::message_id(string id)
 {
-    const regex r(strict_mode_ ? MESSAGE_ID_REGEX : MESSAGE_ID_REGEX_NS);
-    smatch m;
-
-    if (regex_match(id, m, r))
+    if (is_message_id(id, strict_mode_))
         message_id_ = id;
     else
         throw message_error("Invalid message ID.");
@@ -340,9 +350,7 @@ string message::message_id() const
 
 void message::add_in_reply_to(const string& in_reply)
 {
-    const regex r(MESSAGE_ID_REGEX);
-    smatch m;
-    if (!regex_match(in_reply, m, r))
+    if (!is_message_id(in_reply, true))
         throw message_error("Invalid In Reply To ID.");
     in_reply_to_.push_back(in_reply);
 }
@@ -356,9 +364,7 @@ vector<string> message::in_reply_to() const
 
 void message::add_references(const string& reference_id)
 {
-    const regex r(MESSAGE_ID_REGEX);
-    smatch m;
-    if (!regex_match(reference_id, m, r))
+    if (!is_message_id(reference_id, true))
         throw message_error("Invalid Reference ID.");
     references_.push_back(reference_id);
 }
@@ -455,7 +461,7 @@ void message::attach(const list<tuple<istream&, string, content_type_t>>& attach
         boundary_ = make_boundary();
 
     // the content goes to the first mime part, and then it's deleted
-    if (!content_.empty())
+    if (!decoded_content().empty())
     {
         if (content_type_.type == media_type_t::NONE)
             content_type_ = content_type_t(media_type_t::TEXT, "plain");
@@ -527,12 +533,11 @@ void message::attachment(size_t index, ostream& att_strm, string& att_name) cons
 
 void message::add_header(const string& name, const string& value)
 {
-    smatch m;
-    if (!regex_match(name, m, mime::HEADER_NAME_REGEX))
+    if (!is_header_name(name))
         throw message_error("Format failure of the header name `" + name + "`.");
-    if (!regex_match(value, m, mime::HEADER_VALUE_REGEX))
+    if (!is_header_value(value))
         throw message_error("Format failure of the header value `" + value + "`.");
-    headers_.insert(make_pair(name, value));
+    headers_.insert(name, value);
 }
 
 
@@ -542,7 +547,7 @@ void message::remove_header(const std::string& name)
 }
 
 
-multimap<string, string> message::headers() const
+header_map message::headers() const
 {
     return headers_;
 }
@@ -627,60 +632,60 @@ void message::parse_header_line(const string& header_line)
     string header_name, header_value;
     parse_header_name_value(header_line, header_name, header_value);
 
-    if (iequals(header_name, FROM_HEADER))
+    if (header_map::equal_names(header_name, FROM_HEADER))
     {
         from_ = parse_address_list(header_value);
         if (from_.addresses.empty())
             throw message_error("Empty author header.");
     }
-    else if (iequals(header_name, SENDER_HEADER))
+    else if (header_map::equal_names(header_name, SENDER_HEADER))
     {
         mailboxes mbx = parse_address_list(header_value);
         if (!mbx.addresses.empty())
             sender_ = mbx.addresses[0];
     }
-    else if (iequals(header_name, REPLY_TO_HEADER))
+    else if (header_map::equal_names(header_name, REPLY_TO_HEADER))
     {
         mailboxes mbx = parse_address_list(header_value);
         if (!mbx.addresses.empty())
             reply_address_ = mbx.addresses[0];
     }
-    else if (iequals(header_name, TO_HEADER))
+    else if (header_map::equal_names(header_name, TO_HEADER))
     {
         recipients_ = parse_address_list(header_value);
     }
-    else if (iequals(header_name, CC_HEADER))
+    else if (header_map::equal_names(header_name, CC_HEADER))
     {
         cc_recipients_ = parse_address_list(header_value);
     }
-    else if (iequals(header_name, DISPOSITION_NOTIFICATION_HEADER))
+    else if (header_map::equal_names(header_name, DISPOSITION_NOTIFICATION_HEADER))
     {
         mailboxes mbx = parse_address_list(header_value);
         if (!mbx.addresses.empty())
             disposition_notification_ = mbx.addresses[0];
     }
-    else if (iequals(header_name, MESSAGE_ID_HEADER))
+    else if (header_map::equal_names(header_name, MESSAGE_ID_HEADER))
     {
         auto ids = parse_many_ids(header_value);
         if (!ids.empty())
             message_id_ = ids[0];
     }
-    else if (iequals(header_name, IN_REPLY_TO_HEADER))
+    else if (header_map::equal_names(header_name, IN_REPLY_TO_HEADER))
         in_reply_to_ = parse_many_ids(header_value);
-    else if (iequals(header_name, REFERENCES_HEADER))
+    else if (header_map::equal_names(header_name, REFERENCES_HEADER))
         references_ = parse_many_ids(header_value);
-    else if (iequals(header_name, SUBJECT_HEADER))
+    else if (header_map::equal_names(header_name, SUBJECT_HEADER))
         std::tie(subject_.buffer, subject_.charset) = parse_subject(header_value);
-    else if (iequals(header_name, DATE_HEADER))
+    else if (header_map::equal_names(header_name, DATE_HEADER))
         date_time_ = parse_date(trim_copy(header_value));
-    else if (iequals(header_name, MIME_VERSION_HEADER))
+    else if (header_map::equal_names(header_name, MIME_VERSION_HEADER))
         version_ = trim_copy(header_value);
     else
     {
-        if (!iequals(header_name, CONTENT_TYPE_HEADER) && !iequals(header_name, CONTENT_TRANSFER_ENCODING_HEADER) &&
-            !iequals(header_name, CONTENT_DISPOSITION_HEADER))
+        if (!header_map::equal_names(header_name, CONTENT_TYPE_HEADER) && !header_map::equal_names(header_name, CONTENT_TRANSFER_ENCODING_HEADER) &&
+            !header_map::equal_names(header_name, CONTENT_DISPOSITION_HEADER))
         {
-            headers_.insert(make_pair(header_name, header_value));
+            headers_.insert(header_name, header_value);
         }
     }
 }
@@ -688,8 +693,6 @@ void message::parse_header_line(const string& header_line)
 
 string message::format_address_list(const mailboxes& mailbox_list) const
 {
-    const regex ATEXT_REGEX{R"([a-zA-Z0-9\!#\$%&'\*\+\-\./=\?\^\_`\{\|\}\~]*)"};
-    smatch m;
     string mailbox_str;
 
     for (auto ma = mailbox_list.addresses.begin(); ma != mailbox_list.addresses.end(); ma++)
@@ -708,7 +711,7 @@ string message::format_address_list(const mailboxes& mailbox_list) const
 
     for (auto mg = mailbox_list.groups.begin(); mg != mailbox_list.groups.end(); mg++)
     {
-        if (!regex_match(mg->name, m, ATEXT_REGEX))
+        if (!all_of(mg->name.begin(), mg->name.end(), is_atext))
             throw message_error("Formatting failure of address list, bad group name `" + mg->name + "`.");
 
         mailbox_str += mg->name + MAILGROUP_NAME_SEPARATOR + codec::SPACE_CHAR;
@@ -734,13 +737,12 @@ string message::format_address(const string_t& name, const string& address) cons
     if (name.buffer.empty() && address.empty())
         return "";
 
-    // TODO: no need for regex, simple string comparaison can be used
-    const regex QTEXT_REGEX{R"([a-zA-Z0-9\ \t\!#\$%&'\(\)\*\+\,\-\.@/\:;<=>\?\[\]\^\_`\{\|\}\~]*)"};
-    const regex DTEXT_REGEX{R"([a-zA-Z0-9\!#\$%&'\*\+\-\.\@/=\?\^\_`\{\|\}\~]*)"};
+    auto is_name_char = [](char ch) { return is_alnum(ch) || ch == codec::SPACE_CHAR || ch == '\t'; };
+    auto is_qtext = [](char ch) { return is_alnum(ch) || (ch != codec::NIL_CHAR && QTEXT.find(ch) != string::npos); };
+    auto is_dtext = [](char ch) { return is_alnum(ch) || (ch != codec::NIL_CHAR && DTEXT.find(ch) != string::npos); };
 
     string name_formatted;
     string addr;
-    smatch m;
 
     // The charset has precedence over the header codec. Only for the non-ascii characters, consider the header encoding.
 
@@ -748,9 +750,9 @@ string message::format_address(const string_t& name, const string& address) cons
     {
         // Check the name format.
 
-        if (regex_match(name.buffer, m, regex(R"([A-Za-z0-9\ \t]*)")))
+        if (all_of(name.buffer.begin(), name.buffer.end(), is_name_char))
             name_formatted = name.buffer;
-        else if (regex_match(name.buffer, m, QTEXT_REGEX))
+        else if (all_of(name.buffer.begin(), name.buffer.end(), is_qtext))
             name_formatted = codec::QUOTE_CHAR + name.buffer + codec::QUOTE_CHAR;
         else
             throw message_error("Formatting failure of name `" + name.buffer + "`.");
@@ -781,7 +783,7 @@ string message::format_address(const string_t& name, const string& address) cons
         }
         else
         {
-            if (regex_match(address, m, DTEXT_REGEX))
+            if (all_of(address.begin(), address.end(), is_dtext))
                 addr = ADDRESS_BEGIN_CHAR + address + ADDRESS_END_CHAR;
             else
                 throw message_error("Formatting failure of address `" + address + "`.");
@@ -884,7 +886,7 @@ mailboxes message::parse_address_list(const string& address_list)
             {
                 if (isspace(*ch))
                     ;
-                else if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                else if (is_atext(*ch) || codec::is_8bit_char(*ch))
                 {
                     token += *ch;
                     state = state_t::NAMEADDRGRP;
@@ -925,7 +927,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::NAMEADDRGRP:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                if (is_atext(*ch) || codec::is_8bit_char(*ch))
                     token += *ch;
                 else if (*ch == codec::MONKEY_CHAR)
                 {
@@ -1008,7 +1010,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::NAME:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || isspace(*ch) || codec::is_8bit_char(*ch))
+                if (is_atext(*ch) || isspace(*ch) || codec::is_8bit_char(*ch))
                     token += *ch;
                 else if (*ch == codec::QUOTE_CHAR && !strict_mode_)
                     state = state_t::QNAMEADDRBEG;
@@ -1032,7 +1034,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::ADDR:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                if (is_atext(*ch) || codec::is_8bit_char(*ch))
                     token += *ch;
                 else if (*ch == codec::MONKEY_CHAR)
                 {
@@ -1131,7 +1133,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::QNAMEADDRBEG:
             {
-                if (isalpha(*ch) || isdigit(*ch) || isspace(*ch) || QTEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                if (is_alnum(*ch) || isspace(*ch) || QTEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
                     token += *ch;
                 // backslash is invisible, see [rfc 5322, section 3.2.4]
                 else if (*ch == codec::BACKSLASH_CHAR)
@@ -1176,7 +1178,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::ADDRBRBEG:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                if (is_atext(*ch) || codec::is_8bit_char(*ch))
                     token += *ch;
                 else if (*ch == codec::MONKEY_CHAR)
                 {
@@ -1266,7 +1268,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::GROUPBEG:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                if (is_atext(*ch) || codec::is_8bit_char(*ch))
                 {
                     token += *ch;
                     state = state_t::BEGIN;
@@ -1298,7 +1300,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::GROUPEND:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || codec::is_8bit_char(*ch))
+                if (is_atext(*ch) || codec::is_8bit_char(*ch))
                 {
                     token += *ch;
                     state = state_t::BEGIN;
@@ -1323,7 +1325,7 @@ mailboxes message::parse_address_list(const string& address_list)
 
             case state_t::COMMBEG:
             {
-                if (isalpha(*ch) || isdigit(*ch) || ATEXT.find(*ch) != string::npos || isspace(*ch))
+                if (is_atext(*ch) || isspace(*ch))
                     ;
                 else if (*ch == codec::RIGHT_PARENTHESIS_CHAR)
                     state = state_t::COMMEND;
@@ -1359,26 +1361,77 @@ See [rfc 5322, section 3.3, page 14-16].
 */
 local_date_time message::parse_date(const string& date_str) const
 {
-    try
+    // date format to be parsed is like "Thu, 17 Jul 2014 10:31:49 +0200 (CET)", the text after the zone is ignored
+    const string_view WEEKDAYS[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+    const string_view MONTHS[] = {"jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"};
+    string::size_type pos = 0;
+
+    auto skip_blanks = [&date_str, &pos](bool required)
     {
-        // date format to be parsed is like "Thu, 17 Jul 2014 10:31:49 +0200 (CET)"
-        regex r(R"(([A-Za-z]{3}[\ \t]*,)[\ \t]+(\d{1,2}[\ \t]+[A-Za-z]{3}[\ \t]+\d{4})[\ \t]+(\d{2}:\d{2}:\d{2}[\ \t]+(\+|\-)\d{4}).*)");
-        smatch m;
-        if (regex_match(date_str, m, r))
+        const string::size_type begin = pos;
+        while (pos < date_str.length() && (date_str[pos] == codec::SPACE_CHAR || date_str[pos] == '\t'))
+            pos++;
+        return !required || pos > begin;
+    };
+
+    auto skip_char = [&date_str, &pos](char ch)
+    {
+        if (pos >= date_str.length() || date_str[pos] != ch)
+            return false;
+        pos++;
+        return true;
+    };
+
+    auto read_number = [&date_str, &pos](string::size_type min_digits, string::size_type max_digits, int& number)
+    {
+        const string::size_type begin = pos;
+        number = 0;
+        while (pos < date_str.length() && pos - begin < max_digits && date_str[pos] >= '0' && date_str[pos] <= '9')
+            number = number * 10 + date_str[pos++] - '0';
+        return pos - begin >= min_digits;
+    };
+
+    // reading three letters as a name, the index is past the end of the names if the name is unknown
+    auto read_name = [&date_str, &pos](const string_view* names, size_t names_no, size_t& index)
+    {
+        const size_t NAME_LEN = 3;
+        if (pos + NAME_LEN > date_str.length())
+            return false;
+        char name[NAME_LEN];
+        for (size_t i = 0; i < NAME_LEN; i++)
         {
-            // TODO: regex manipulation to be replaced with time facet format?
-
-            // if day has single digit, then prepend it with zero
-            string dttz = m[1].str() + " " + (m[2].str()[1] == ' ' ? "0" : "") + m[2].str() + " " + m[3].str().substr(0, 12) + ":" + m[3].str().substr(12);
-            stringstream ss(dttz);
-            local_time_input_facet* facet = new local_time_input_facet("%a %d %b %Y %H:%M:%S %ZP");
-            ss.exceptions(std::ios_base::failbit);
-            ss.imbue(locale(ss.getloc(), facet));
-            local_date_time ldt(not_a_date_time);
-            ss >> ldt;
-            return ldt;
+            const char ch = date_str[pos + i];
+            if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')))
+                return false;
+            name[i] = static_cast<char>(ch | 0x20);
         }
+        pos += NAME_LEN;
+        for (index = 0; index < names_no && names[index] != string_view(name, NAME_LEN); index++)
+            ;
+        return true;
+    };
+
+    size_t weekday = 0, month = 0;
+    int day = 0, year = 0, hour = 0, minute = 0, second = 0, zone = 0;
+    const bool matched = read_name(WEEKDAYS, 7, weekday) && skip_blanks(false) && skip_char(codec::COMMA_CHAR) && skip_blanks(true) &&
+        read_number(1, 2, day) && skip_blanks(true) && read_name(MONTHS, 12, month) && skip_blanks(true) && read_number(4, 4, year) &&
+        skip_blanks(true) && read_number(2, 2, hour) && skip_char(codec::COLON_CHAR) && read_number(2, 2, minute) &&
+        skip_char(codec::COLON_CHAR) && read_number(2, 2, second) && skip_blanks(true) &&
+        (skip_char(codec::PLUS_CHAR) || skip_char(codec::MINUS_CHAR)) && read_number(4, 4, zone);
+    if (!matched)
         return local_date_time(not_a_date_time);
+
+    try
+    {
+        if (weekday >= 7 || month >= 12)
+            throw message_error("Parsing failure of date.");
+
+        // the time out of range is carried over to the date, and the zone is given in the posix format like "+02:00"
+        const ptime local_time(boost::gregorian::date(year, static_cast<unsigned short>(month + 1), day), hours(hour) + minutes(minute) +
+            seconds(second));
+        const string::size_type zone_pos = pos - 5;
+        time_zone_ptr tz(new posix_time_zone(date_str.substr(zone_pos, 3) + codec::COLON_CHAR + date_str.substr(zone_pos + 3, 2)));
+        return local_date_time(local_time.date(), local_time.time_of_day(), tz, local_date_time::EXCEPTION_ON_ERROR);
     }
     catch (...)
     {
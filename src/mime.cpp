@@ -11,7 +11,13 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 */
 
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <fstream>
 #include <sstream>
 #include <map>
@@ -19,6 +25,7 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <random>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
 #include <mailio/base64.hpp>
 #include <mailio/quoted_printable.hpp>
 #include <mailio/bit7.hpp>
@@ -26,32 +33,34 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <mailio/binary.hpp>
 #include <mailio/q_codec.hpp>
 #include <mailio/mime.hpp>
+#include <mailio/mapped_text.hpp>
 
 
 using std::string;
+using std::string_view;
+using std::shared_ptr;
+using std::make_shared;
 #if defined(__cpp_char8_t)
 using std::u8string;
 #endif
 using std::ifstream;
 using std::stringstream;
+using std::streamsize;
+using std::ostream;
 using std::pair;
-using std::multimap;
 using std::vector;
 using std::map;
 using std::get;
-using boost::trim_left_if;
-using boost::trim_right_if;
-using boost::regex;
-using boost::regex_match;
-using boost::smatch;
-using boost::match_flag_type;
-using boost::match_results;
+using std::mutex;
+using std::lock_guard;
+using std::atomic_load;
+using std::atomic_store;
+using std::uintptr_t;
 using boost::to_lower_copy;
 using boost::trim_copy;
 using boost::trim;
 using boost::trim_right;
 using boost::iequals;
-using boost::algorithm::is_any_of;
 
 
 namespace mailio
@@ -61,13 +70,26 @@ namespace mailio
 const string mime::CONTENT_ID_HEADER{"Content-ID"};
 const string mime::ADDRESS_BEGIN_STR(1, ADDRESS_BEGIN_CHAR);
 const string mime::ADDRESS_END_STR(1, ADDRESS_END_CHAR);
-const string mime::MESSAGE_ID_REGEX = "([a-zA-Z0-9\\!#\\$%&'\\*\\+\\-\\./=\\?\\^\\_`\\{\\|\\}\\~]+)"
-    "\\@([a-zA-Z0-9\\!#\\$%&'\\*\\+\\-\\./=\\?\\^\\_`\\{\\|\\}\\~]+)";
-const string mime::MESSAGE_ID_REGEX_NS = "([a-zA-Z0-9\\!#\\$%&'\\*\\+\\-\\./=\\?\\^\\_`\\{\\|\\}\\~\\@\\\\ \\t<\\>]*)";
 const string mime::content_type_t::ATTR_CHARSET{"charset"};
 const string mime::content_type_t::ATTR_BOUNDARY{"boundary"};
 
 
+/**
+Getting the mutex guarding the lazy decoding of the given part.
+
+The mutexes are shared by the parts in stripes, since a part is copyable and cannot own one. The neighbouring parts of a message fall into
+different stripes, so they are decoded in parallel.
+
+@param part Part to decode.
+@return     Mutex of the part.
+**/
+static mutex& decoding_mutex(const mime* part)
+{
+    static mutex stripes[16];
+    return stripes[reinterpret_cast<uintptr_t>(part) / sizeof(mime) % 16];
+}
+
+
 mime::content_type_t::content_type_t() : type(media_type_t::NONE)
 {
 }
@@ -110,16 +132,15 @@ const string mime::ATTRIBUTES_SEPARATOR_STR{"; "};
 const string mime::ATTRIBUTE_NAME{"name"};
 const string mime::ATTRIBUTE_FILENAME{"filename"};
 const string mime::BOUNDARY_DELIMITER(2, '-');
+const string mime::ATEXT{"!#$%&'*+-./=?^_`{|}~"};
+const string mime::DTEXT{"!#$%&'*+-.@/=?^_`{|}~"}; // atext with monkey
 const string mime::QTEXT{"\t !#$%&'()*+,-.@/:;<=>?[]^_`{|}~"};
-// exluded double quote and backslash characters from the header name
-const regex mime::HEADER_NAME_REGEX{R"(([a-zA-Z0-9\!#\$%&'\(\)\*\+\-\./;\<=\>\?@\[\\\]\^\_`\{\|\}\~]+))"};
-const regex mime::HEADER_VALUE_REGEX{R"(([a-zA-Z0-9\ \t\!\"#\$%&'\(\)\*\+\,\-\./:;\<=\>\?@\[\\\]\^\_`\{\|\}\~]+))"};
 const string mime::CONTENT_ATTR_ALPHABET{"!#$%&*+-.^_`|~"};
 const string mime::CONTENT_HEADER_VALUE_ALPHABET{"!#$%&*+-./^_`|~"};
 
 
 mime::mime() : version_("1.0"), line_policy_(codec::line_len_policy_t::RECOMMENDED),
-    decoder_line_policy_(codec::line_len_policy_t::RECOMMENDED), strict_mode_(false), strict_codec_mode_(false),
+    decoder_line_policy_(codec::line_len_policy_t::RECOMMENDED), strict_mode_(false), strict_codec_mode_(false), lazy_decoding_(false),
     header_codec_(header_codec_t::UTF8), content_type_(media_type_t::NONE, ""), encoding_(content_transfer_encoding_t::NONE),
     disposition_(content_disposition_t::NONE), parsing_header_(true), mime_status_(mime_parsing_status_t::NONE)
 {
@@ -127,26 +148,33 @@ mime::mime() : version_("1.0"), line_policy_(codec::line_len_policy_t::RECOMMEND
 
 
 void mime::format(string& mime_str, bool dot_escape) const
+{
+    string_streambuf mime_buf(mime_str);
+    ostream mime_strm(&mime_buf);
+    format(mime_strm, dot_escape);
+}
+
+
+void mime::format(ostream& mime_strm, bool dot_escape) const
 {
     if (!boundary_.empty() && content_type_.type != media_type_t::MULTIPART)
         throw mime_error("Formatting failure, non multipart message with boundary.");
 
-    mime_str += format_header() + codec::END_OF_LINE;
-    string content = format_content(dot_escape);
-    mime_str += content;
+    mime_strm << format_header() << codec::END_OF_LINE;
+    bool has_content = format_content(mime_strm, dot_escape);
 
     if (!parts_.empty())
     {
-        if (!content.empty())
-            mime_str += codec::END_OF_LINE;
+        if (has_content)
+            mime_strm << codec::END_OF_LINE;
         // recursively format mime parts
         for (auto& p : parts_)
         {
-            string p_str;
-            p.format(p_str, dot_escape);
-            mime_str += BOUNDARY_DELIMITER + boundary_ + codec::END_OF_LINE + p_str + codec::END_OF_LINE;
+            mime_strm << BOUNDARY_DELIMITER << boundary_ << codec::END_OF_LINE;
+            p.format(mime_strm, dot_escape);
+            mime_strm << codec::END_OF_LINE;
         }
-        mime_str += BOUNDARY_DELIMITER + boundary_ + BOUNDARY_DELIMITER + codec::END_OF_LINE;
+        mime_strm << BOUNDARY_DELIMITER << boundary_ << BOUNDARY_DELIMITER << codec::END_OF_LINE;
     }
 }
 
@@ -162,24 +190,20 @@ void mime::format(u8string& mime_str, bool dot_escape) const
 
 void mime::parse(const string& mime_string, bool dot_escape)
 {
-    string::size_type line_begin = 0;
-    string::size_type line_end = mime_string.find(codec::END_OF_LINE, line_begin);
-    string line;
-    while (line_end != string::npos)
+    // for the lazy decoding the bodies refer to a copy of the string, shared by all the parts
+    if (lazy_decoding_)
     {
-        line = mime_string.substr(line_begin, line_end - line_begin);
-        parse_by_line(line, dot_escape);
-        if (line_end != string::npos)
-        {
-            line_end += codec::END_OF_LINE.length();
-            line_begin = line_end;
-        }
-        line_end = mime_string.find(codec::END_OF_LINE, line_begin);
+        const shared_ptr<const string> raw_text = make_shared<const string>(mime_string);
+        parse_text(*raw_text, raw_text, dot_escape, false);
     }
-    line = mime_string.substr(line_begin);
-    if (!line.empty())
-        parse_by_line(line, dot_escape);
-    parse_by_line(codec::END_OF_LINE, dot_escape);
+    else
+        parse_text(mime_string, nullptr, dot_escape, false);
+}
+
+
+void mime::parse(const mapped_text& mime_text, bool dot_escape)
+{
+    parse_text(mime_text.text_, mime_text.region_, dot_escape, true);
 }
 
 
@@ -191,6 +215,29 @@ void mime::parse(const u8string& mime_string, bool dot_escape)
 #endif
 
 
+void mime::parse_text(string_view text, const shared_ptr<const void>& raw_text, bool dot_escape, bool bare_lf)
+{
+    // the text is kept only if the bodies are left to decode on access
+    const shared_ptr<const void> kept_text = lazy_decoding_ ? raw_text : nullptr;
+    const string_view end_of_line = bare_lf ? string_view("\n") : string_view(codec::END_OF_LINE);
+    vector<part_lines_t> parts{part_lines_t{this, {}, {}}};
+    string_view::size_type line_begin = 0;
+    string_view::size_type line_end = text.find(end_of_line, line_begin);
+    while (line_end != string_view::npos)
+    {
+        string_view line = text.substr(line_begin, line_end - line_begin);
+        if (bare_lf && !line.empty() && line.back() == codec::CR_CHAR)
+            line.remove_suffix(1);
+        parse_line(parts, 0, line, dot_escape, kept_text);
+        line_begin = line_end + end_of_line.length();
+        line_end = text.find(end_of_line, line_begin);
+    }
+    if (line_begin < text.length())
+        parse_line(parts, 0, text.substr(line_begin), dot_escape, kept_text);
+    end_part(parts, 0, kept_text);
+}
+
+
 mime& mime::parse_by_line(const string& line, bool dot_escape)
 {
     if (line.length() > string::size_type(decoder_line_policy_))
@@ -200,7 +247,7 @@ mime& mime::parse_by_line(const string& line, bool dot_escape)
     if (parsing_header_ && line.empty())
     {
         parsing_header_ = false;
-        parse_header();
+        parse_header(vector<string_view>(parsed_headers_.begin(), parsed_headers_.end()));
     }
     else
     {
@@ -211,7 +258,7 @@ mime& mime::parse_by_line(const string& line, bool dot_escape)
             // end of message reached, decode the body
             if (line == codec::END_OF_LINE)
             {
-                parse_content();
+                parse_content(vector<string_view>(parsed_body_.begin(), parsed_body_.end()));
                 mime_status_ = mime_parsing_status_t::END;
             }
             // parsing the body
@@ -282,10 +329,7 @@ mime::content_type_t mime::content_type() const
 
 void mime::content_id(string id)
 {
-    const regex r(strict_mode_ ? MESSAGE_ID_REGEX : MESSAGE_ID_REGEX_NS);
-    smatch m;
-
-    if (regex_match(id, m, r))
+    if (is_message_id(id, strict_mode_))
         content_id_ = id;
     else
         throw mime_error("Invalid content ID.");
@@ -349,20 +393,22 @@ string mime::boundary() const
 void mime::content(const string& content_str)
 {
     content_ = content_str;
+    raw_text_.reset();
+    raw_body_.clear();
 }
 
 
 #if defined(__cpp_char8_t)
 void mime::content(const u8string& content_str)
 {
-    content_ = string(reinterpret_cast<const char*>(content_str.c_str()));
+    content(string(reinterpret_cast<const char*>(content_str.c_str())));
 }
 #endif
 
 
 string mime::content() const
 {
-    return content_;
+    return decoded_content();
 }
 
 
@@ -421,6 +467,18 @@ bool mime::strict_codec_mode() const
 }
 
 
+void mime::lazy_decoding(bool mode)
+{
+    lazy_decoding_ = mode;
+}
+
+
+bool mime::lazy_decoding() const
+{
+    return lazy_decoding_;
+}
+
+
 void mime::header_codec(header_codec_t hdr_codec)
 {
     header_codec_ = hdr_codec;
@@ -433,6 +491,62 @@ mime::header_codec_t mime::header_codec() const
 }
 
 
+bool mime::is_alnum(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9');
+}
+
+
+bool mime::is_atext(char ch)
+{
+    return is_alnum(ch) || (ch != codec::NIL_CHAR && ATEXT.find(ch) != string::npos);
+}
+
+
+bool mime::is_header_name(string_view name)
+{
+    if (name.empty())
+        return false;
+    for (auto ch : name)
+        if (ch < '!' || ch > '~' || ch == codec::COLON_CHAR || ch == codec::COMMA_CHAR || ch == codec::QUOTE_CHAR)
+            return false;
+    return true;
+}
+
+
+bool mime::is_header_value(string_view value)
+{
+    if (value.empty())
+        return false;
+    for (auto ch : value)
+        if ((ch < codec::SPACE_CHAR || ch > '~') && ch != '\t')
+            return false;
+    return true;
+}
+
+
+bool mime::is_message_id(string_view id, bool strict_mode)
+{
+    if (!strict_mode)
+    {
+        const string_view ID_CHARS_NS{"@\\ \t<>"};
+        for (auto ch : id)
+            if (!is_atext(ch) && ID_CHARS_NS.find(ch) == string_view::npos)
+                return false;
+        return true;
+    }
+
+    // the monkey is not atext, so the first one must separate two non-empty atext parts
+    const string_view::size_type monkey_pos = id.find(codec::MONKEY_CHAR);
+    if (monkey_pos == string_view::npos || monkey_pos == 0 || monkey_pos == id.length() - 1)
+        return false;
+    for (string_view::size_type i = 0; i < id.length(); i++)
+        if (i != monkey_pos && !is_atext(id[i]))
+            return false;
+    return true;
+}
+
+
 string mime::format_many_ids(const vector<string>& ids)
 {
     string ids_str;
@@ -457,22 +571,25 @@ vector<string> mime::parse_many_ids(const string& ids) const
     if (!strict_mode_)
         return vector<string>{ids};
 
+    // the ids in the angle brackets are searched for, so the text between them is skipped
     vector<string> idv;
-    auto start = ids.cbegin();
-    auto end = ids.cend();
-    match_flag_type flags = boost::match_default | boost::match_not_null;
-    match_results<string::const_iterator> tokens;
     bool all_tokens_parsed = false;
-    const string ANGLED_MESSAGE_ID_REGEX = codec::LESS_THAN_STR + MESSAGE_ID_REGEX + codec::GREATER_THAN_STR;
-    const regex rgx(ANGLED_MESSAGE_ID_REGEX);
-    while (regex_search(start, end, tokens, rgx, flags))
+    string::size_type id_begin = ids.find(codec::LESS_THAN_CHAR);
+    while (id_begin != string::npos)
     {
-        string id = tokens[0];
-        trim_left_if(id, is_any_of(codec::LESS_THAN_STR));
-        trim_right_if(id, is_any_of(codec::GREATER_THAN_STR));
-        idv.push_back(id);
-        start = tokens[0].second;
-        all_tokens_parsed = (start == end);
+        string::size_type id_end = ids.find(codec::GREATER_THAN_CHAR, id_begin + 1);
+        if (id_end == string::npos)
+            break;
+
+        const string_view id = string_view(ids).substr(id_begin + 1, id_end - id_begin - 1);
+        if (is_message_id(id, true))
+        {
+            idv.emplace_back(id);
+            all_tokens_parsed = (id_end + 1 == ids.length());
+            id_begin = ids.find(codec::LESS_THAN_CHAR, id_end + 1);
+        }
+        else
+            id_begin = ids.find(codec::LESS_THAN_CHAR, id_begin + 1);
     }
 
     if (!all_tokens_parsed)
@@ -482,6 +599,27 @@ vector<string> mime::parse_many_ids(const string& ids) const
 }
 
 
+mime::string_streambuf::string_streambuf(string& text) : text_(text)
+{
+}
+
+
+auto mime::string_streambuf::overflow(int_type ch) -> int_type
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+    text_ += traits_type::to_char_type(ch);
+    return ch;
+}
+
+
+streamsize mime::string_streambuf::xsputn(const char* chars, streamsize count)
+{
+    text_.append(chars, static_cast<string::size_type>(count));
+    return count;
+}
+
+
 string mime::format_header() const
 {
     return format_content_type() + format_transfer_encoding() + format_content_disposition() + format_content_id();
@@ -490,14 +628,43 @@ string mime::format_header() const
 
 string mime::format_content(bool dot_escape) const
 {
-    vector<string> content_lines;
+    string content;
+    string_streambuf content_buf(content);
+    ostream content_strm(&content_buf);
+    format_content(content_strm, dot_escape);
+    return content;
+}
+
+
+bool mime::format_content(ostream& content_strm, bool dot_escape) const
+{
+    bool has_content = false;
+    string buffer;
+    buffer.reserve(CONTENT_BUFFER_SIZE + string::size_type(line_policy_) + 1);
+    codec::sink_t write_line = [&content_strm, dot_escape, &has_content, &buffer](const string& line)
+    {
+        has_content = true;
+        if (dot_escape && line[0] == codec::DOT_CHAR)
+            buffer += codec::DOT_CHAR;
+        buffer.append(line).append(codec::END_OF_LINE);
+        if (buffer.length() >= CONTENT_BUFFER_SIZE)
+        {
+            content_strm.write(buffer.data(), buffer.length());
+            buffer.clear();
+        }
+    };
+
+    // encoded lines are collected into the buffer and written by blocks, so the encoded content is never held as a whole
+    const string& content = decoded_content();
     switch (encoding_)
     {
         case content_transfer_encoding_t::BASE_64:
         {
             base64 b(line_policy_, decoder_line_policy_);
             b.strict_mode(strict_codec_mode_);
-            content_lines = b.encode(content_);
+            base64::encoder_t encoder(b, write_line);
+            encoder.feed(content);
+            encoder.finish();
             break;
         }
 
@@ -505,7 +672,9 @@ string mime::format_content(bool dot_escape) const
         {
             quoted_printable qp(line_policy_, decoder_line_policy_);
             qp.strict_mode(strict_codec_mode_);
-            content_lines = qp.encode(content_);
+            quoted_printable::encoder_t encoder(qp, write_line);
+            encoder.feed(content);
+            encoder.finish();
             break;
         }
 
@@ -514,7 +683,9 @@ string mime::format_content(bool dot_escape) const
         {
             bit8 b8(line_policy_, decoder_line_policy_);
             b8.strict_mode(strict_codec_mode_);
-            content_lines = b8.encode(content_);
+            bit8::encoder_t encoder(b8, write_line);
+            encoder.feed(content);
+            encoder.finish();
             break;
         }
 
@@ -524,7 +695,9 @@ string mime::format_content(bool dot_escape) const
         {
             bit7 b7(line_policy_, decoder_line_policy_);
             b7.strict_mode(strict_codec_mode_);
-            content_lines = b7.encode(content_);
+            bit7::encoder_t encoder(b7, write_line);
+            encoder.feed(content);
+            encoder.finish();
             break;
         }
 
@@ -533,21 +706,16 @@ string mime::format_content(bool dot_escape) const
             // TODO: probably bug when `\0` is part of the content
             binary b(line_policy_, decoder_line_policy_);
             b.strict_mode(strict_codec_mode_);
-            content_lines = b.encode(content_);
+            binary::encoder_t encoder(b, write_line);
+            encoder.feed(content);
+            encoder.finish();
             break;
         }
 
         // default encoding is seven bit, so no `default` clause
     }
-
-    string content;
-    for (const auto& s : content_lines)
-        if (dot_escape && s[0] == codec::DOT_CHAR)
-            content += string(1, codec::DOT_CHAR) + s + codec::END_OF_LINE;
-        else
-            content += s + codec::END_OF_LINE;
-
-    return content;
+    content_strm.write(buffer.data(), buffer.length());
+    return has_content;
 }
 
 
@@ -672,13 +840,92 @@ string mime::format_mime_name(const string& name) const
 }
 
 
-void mime::parse_header()
+void mime::parse_line(vector<part_lines_t>& parts, vector<part_lines_t>::size_type level, string_view line, bool dot_escape,
+    const shared_ptr<const void>& raw_text)
+{
+    mime& part = *parts[level].part;
+    if (line.length() > string_view::size_type(part.decoder_line_policy_))
+        throw mime_error("Line policy overflow in a header.");
+
+    // mark end of header and parse it
+    if (part.parsing_header_)
+    {
+        if (line.empty())
+        {
+            part.parsing_header_ = false;
+            part.parse_header(parts[level].header);
+        }
+        else
+            parts[level].header.push_back(line);
+        return;
+    }
+
+    // the boundary is compared in place, so no string is made for each line
+    const string& boundary = part.boundary_;
+    const string_view::size_type delimiter_len = BOUNDARY_DELIMITER.length() + boundary.length();
+    const bool is_delimiter = !boundary.empty() && line.length() >= delimiter_len &&
+        line.compare(0, BOUNDARY_DELIMITER.length(), BOUNDARY_DELIMITER) == 0 &&
+        line.compare(BOUNDARY_DELIMITER.length(), boundary.length(), boundary) == 0;
+
+    // mime part sequence begins, the current part (if exists) is ended and another part is created
+    if (is_delimiter && line.length() == delimiter_len)
+    {
+        part.mime_status_ = mime_parsing_status_t::BEGIN;
+        if (parts.size() > level + 1)
+            end_part(parts, level + 1, raw_text);
+        mime m;
+        m.line_policy(part.line_policy_, part.decoder_line_policy_);
+        m.strict_codec_mode(part.strict_codec_mode_);
+        m.lazy_decoding(part.lazy_decoding_);
+        part.parts_.push_back(m);
+        parts.push_back(part_lines_t{&part.parts_.back(), {}, {}});
+    }
+    // mime part sequence ends, so the last mime part is ended
+    else if (is_delimiter && line.length() == delimiter_len + BOUNDARY_DELIMITER.length() &&
+        line.compare(delimiter_len, BOUNDARY_DELIMITER.length(), BOUNDARY_DELIMITER) == 0)
+    {
+        part.mime_status_ = mime_parsing_status_t::END;
+        if (parts.size() > level + 1)
+            end_part(parts, level + 1, raw_text);
+    }
+    // parser entered mime body
+    else if (part.mime_status_ == mime_parsing_status_t::BEGIN)
+        parse_line(parts, level + 1, line, dot_escape, raw_text);
+    else
+    {
+        if (dot_escape && !line.empty() && line[0] == codec::DOT_CHAR)
+            line.remove_prefix(1);
+        parts[level].body.push_back(line);
+    }
+}
+
+
+void mime::end_part(vector<part_lines_t>& parts, vector<part_lines_t>::size_type level, const shared_ptr<const void>& raw_text)
+{
+    mime& part = *parts[level].part;
+    if (!part.parsing_header_)
+    {
+        if (raw_text == nullptr)
+            part.parse_content(parts[level].body);
+        else
+        {
+            part.content_.clear();
+            part.raw_text_ = raw_text;
+            part.raw_body_ = std::move(parts[level].body);
+        }
+        part.mime_status_ = mime_parsing_status_t::END;
+    }
+    parts.erase(parts.begin() + level, parts.end());
+}
+
+
+void mime::parse_header(const vector<string_view>& header_lines)
 {
     string line;
-    for (const auto& hdr : parsed_headers_)
+    for (const auto& hdr : header_lines)
     {
         if (isspace(hdr[0]))
-            line += trim_copy(hdr);
+            line += trim_copy(string(hdr));
         else
         {
             if (!line.empty())
@@ -694,17 +941,43 @@ void mime::parse_header()
 }
 
 
-void mime::parse_content()
+void mime::parse_content(const vector<string_view>& body_lines)
 {
-    strip_body();
+    content_ = decode_content(body_lines);
+    raw_text_.reset();
+    raw_body_.clear();
+}
+
 
+string mime::decode_content(const vector<string_view>& body_lines) const
+{
+    auto body_end = body_lines.end();
+    while (body_end != body_lines.begin() && (body_end - 1)->empty())
+        body_end--;
+    string::size_type body_len = 0;
+    for (auto line = body_lines.begin(); line != body_end; line++)
+        body_len += line->length() + codec::END_OF_LINE.length();
+
+    // the lines are decoded straight from the views, so the decoded content is the only copy made
+    auto decode = [&body_lines, body_end](const auto& decoder_codec, string::size_type reserved)
+    {
+        string dec_text;
+        dec_text.reserve(reserved);
+        typename std::decay_t<decltype(decoder_codec)>::decoder_t decoder(decoder_codec, [&dec_text](const string& chunk) { dec_text += chunk; });
+        for (auto line = body_lines.begin(); line != body_end; line++)
+            decoder.feed(*line);
+        decoder.finish();
+        return dec_text;
+    };
+
+    string dec_content;
     switch (encoding_)
     {
         case content_transfer_encoding_t::BASE_64:
         {
             base64 b64(line_policy_, decoder_line_policy_);
             b64.strict_mode(strict_codec_mode_);
-            content_ = b64.decode(parsed_body_);
+            dec_content = decode(b64, body_len / 4 * 3 + 3);
             break;
         }
 
@@ -712,7 +985,7 @@ void mime::parse_content()
         {
             quoted_printable qp(line_policy_, decoder_line_policy_);
             qp.strict_mode(strict_codec_mode_);
-            content_ = qp.decode(parsed_body_);
+            dec_content = decode(qp, body_len);
             break;
         }
 
@@ -720,7 +993,7 @@ void mime::parse_content()
         {
             bit8 b8(line_policy_, decoder_line_policy_);
             b8.strict_mode(strict_codec_mode_);
-            content_ = b8.decode(parsed_body_);
+            dec_content = decode(b8, body_len);
             break;
         }
 
@@ -729,7 +1002,7 @@ void mime::parse_content()
         {
             bit7 b7(line_policy_, decoder_line_policy_);
             b7.strict_mode(strict_codec_mode_);
-            content_ = b7.decode(parsed_body_);
+            dec_content = decode(b7, body_len);
             break;
         }
 
@@ -737,12 +1010,33 @@ void mime::parse_content()
         {
             binary b(line_policy_, decoder_line_policy_);
             b.strict_mode(strict_codec_mode_);
-            content_ = b.decode(parsed_body_);
+            dec_content = decode(b, body_len);
             break;
         }
 
         // default encoding is seven bit, so no `default` clause
     }
+    return dec_content;
+}
+
+
+/*
+The owner of the parsed text is released only after the content is decoded, so the threads which see it released read the decoded content. The
+ones which see it kept check it again under the lock, so only the first of them decodes.
+*/
+const string& mime::decoded_content() const
+{
+    if (atomic_load(&raw_text_) != nullptr)
+    {
+        lock_guard<mutex> lock(decoding_mutex(this));
+        if (raw_text_ != nullptr)
+        {
+            content_ = decode_content(raw_body_);
+            raw_body_.clear();
+            atomic_store(&raw_text_, shared_ptr<const void>());
+        }
+    }
+    return content_;
 }
 
 
@@ -760,7 +1054,7 @@ void mime::parse_header_line(const string& header_line)
     string header_name, header_value;
     parse_header_name_value(header_line, header_name, header_value);
 
-    if (iequals(header_name, CONTENT_TYPE_HEADER))
+    if (header_map::equal_names(header_name, CONTENT_TYPE_HEADER))
     {
         media_type_t media_type;
         string media_subtype;
@@ -783,12 +1077,12 @@ void mime::parse_header_line(const string& header_line)
             name_ = get<0>(qc.check_decode(name_it->second));
         }
     }
-    else if (iequals(header_name, CONTENT_TRANSFER_ENCODING_HEADER))
+    else if (header_map::equal_names(header_name, CONTENT_TRANSFER_ENCODING_HEADER))
     {
         attributes_t attributes;
         parse_content_transfer_encoding(header_value, encoding_, attributes);
     }
-    else if (iequals(header_name, CONTENT_DISPOSITION_HEADER))
+    else if (header_map::equal_names(header_name, CONTENT_DISPOSITION_HEADER))
     {
         attributes_t attributes;
         parse_content_disposition(header_value, disposition_, attributes);
@@ -801,7 +1095,7 @@ void mime::parse_header_line(const string& header_line)
             name_ = get<0>(qc.check_decode(filename_it->second));
         }
     }
-    else if (iequals(header_name, CONTENT_ID_HEADER))
+    else if (header_map::equal_names(header_name, CONTENT_ID_HEADER))
     {
         auto ids = parse_many_ids(header_value);
         if (!ids.empty())
@@ -823,8 +1117,7 @@ void mime::parse_header_name_value(const string& header_line, string& header_nam
 
     if (header_name.empty())
         throw mime_error("Parsing failure, header name or value empty: " + header_line);
-    smatch m;
-    if (!regex_match(header_name, m, HEADER_NAME_REGEX))
+    if (!is_header_name(header_name))
         throw mime_error("Format failure of the header name `" + header_name + "`.");
 
     if (header_value.empty())
@@ -839,7 +1132,7 @@ void mime::parse_header_name_value(const string& header_line, string& header_nam
         }
     }
 
-    if (!codec::is_utf8_string(header_value) && !regex_match(header_value, m, HEADER_VALUE_REGEX))
+    if (!codec::is_utf8_string(header_value) && !is_header_value(header_value))
         throw mime_error("Format failure of the header value `" + header_value + "`.");
 }
 
@@ -1211,14 +1504,4 @@ mime::media_type_t mime::mime_type_as_enum(const string& media_type_val) const
     return media_type;
 }
 
-
-void mime::strip_body()
-{
-    while (!parsed_body_.empty())
-        if (parsed_body_.back().empty())
-            parsed_body_.pop_back();
-        else
-            break;
-}
-
 } // namespace mailio
@@ -38,6 +38,9 @@ using std::tuple;
 using std::make_tuple;
 using std::move;
 using std::make_shared;
+using std::function;
+using std::exception_ptr;
+using std::shared_ptr;
 using std::chrono::milliseconds;
 using boost::algorithm::trim;
 using boost::iequals;
@@ -47,7 +50,7 @@ namespace mailio
 {
 
 
-pop3::pop3(const string& hostname, unsigned port, milliseconds timeout) : dlg_(make_shared<dialog>(hostname, port, timeout))
+pop3::pop3(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) : dlg_(make_shared<dialog>(hostname, port, timeout, ios))
 {
     dlg_->connect();
 }
@@ -231,56 +234,13 @@ auto pop3::statistics() -> mailbox_stat_t
 
 void pop3::fetch(unsigned long message_no, message& msg, bool header_only)
 {
-    string line;
-    if (header_only)
-    {
-        dlg_->send("TOP " + to_string(message_no) + " 0");
-        line = dlg_->receive();
-        tuple<string, string> stat_msg = parse_status(line);
-        if (iequals(std::get<0>(stat_msg), "-ERR"))
-            return;
-    }
-    else
-    {
-        dlg_->send("RETR " + to_string(message_no));
-        line = dlg_->receive();
-        tuple<string, string> stat_msg = parse_status(line);
-        if (iequals(std::get<0>(stat_msg), "-ERR"))
-            throw pop3_error("Fetching message failure.");
-    }
+    dlg_->send(fetch_command(message_no, header_only));
+    if (!fetch_status(dlg_->receive(), header_only))
+        return;
 
-    // end of message is marked with crlf+dot+crlf sequence
-    // empty_line marks the last empty line, so it could be used to detect end of message when dot is reached
     bool empty_line = false;
-    while (true)
-    {
-        line = dlg_->receive();
-        // reading line by line ensures that crlf are the last characters read; so, reaching single dot in the line means that it's end of message
-        if (line == codec::END_OF_MESSAGE)
-        {
-            // if header only, then mark the header end with the empty line
-            if (header_only)
-                msg.parse_by_line("");
-            msg.parse_by_line(codec::END_OF_LINE);
-            break;
-        }
-        else if (line.empty())
-        {
-            // ensure that sequence of empty lines are all included in the message; otherwise, mark that an empty line is reached
-            if (empty_line)
-                msg.parse_by_line("");
-            else
-                empty_line = true;
-        }
-        else
-        {
-            // regular line with the content; if empty line was before this one, ensure that it is included
-            if (empty_line)
-                msg.parse_by_line("");
-            msg.parse_by_line(line, true);
-            empty_line = false;
-        }
-    }
+    while (!parse_message_line(dlg_->receive(), msg, header_only, empty_line))
+        ;
 }
 
 
@@ -324,6 +284,125 @@ void pop3::auth_login(const string& username, const string& password)
 }
 
 
+string pop3::fetch_command(unsigned long message_no, bool header_only)
+{
+    if (header_only)
+        return "TOP " + to_string(message_no) + " 0";
+    return "RETR " + to_string(message_no);
+}
+
+
+bool pop3::fetch_status(const string& line, bool header_only)
+{
+    tuple<string, string> stat_msg = parse_status(line);
+    if (iequals(std::get<0>(stat_msg), "-ERR"))
+    {
+        if (header_only)
+            return false;
+        throw pop3_error("Fetching message failure.");
+    }
+    return true;
+}
+
+
+// end of message is marked with crlf+dot+crlf sequence
+// empty_line marks the last empty line, so it could be used to detect end of message when dot is reached
+bool pop3::parse_message_line(const string& line, message& msg, bool header_only, bool& empty_line)
+{
+    // reading line by line ensures that crlf are the last characters read; so, reaching single dot in the line means that it's end of message
+    if (line == codec::END_OF_MESSAGE)
+    {
+        // if header only, then mark the header end with the empty line
+        if (header_only)
+            msg.parse_by_line("");
+        msg.parse_by_line(codec::END_OF_LINE);
+        return true;
+    }
+    else if (line.empty())
+    {
+        // ensure that sequence of empty lines are all included in the message; otherwise, mark that an empty line is reached
+        if (empty_line)
+            msg.parse_by_line("");
+        else
+            empty_line = true;
+    }
+    else
+    {
+        // regular line with the content; if empty line was before this one, ensure that it is included
+        if (empty_line)
+            msg.parse_by_line("");
+        msg.parse_by_line(line, true);
+        empty_line = false;
+    }
+    return false;
+}
+
+
+void pop3::initiate_fetch(unsigned long message_no, bool header_only, codec::line_len_policy_t line_policy,
+    function<void (exception_ptr, message)> handler)
+{
+    dlg_->async_send(fetch_command(message_no, header_only), [this, header_only, line_policy, handler](exception_ptr exc)
+        {
+            if (exc)
+            {
+                handler(exc, message());
+                return;
+            }
+
+            dlg_->async_receive(false, [this, header_only, line_policy, handler](exception_ptr exc, string line)
+                {
+                    bool has_message = false;
+                    if (!exc)
+                    {
+                        try
+                        {
+                            has_message = fetch_status(line, header_only);
+                        }
+                        catch (...)
+                        {
+                            exc = std::current_exception();
+                        }
+                    }
+                    if (exc || !has_message)
+                    {
+                        handler(exc, message());
+                        return;
+                    }
+
+                    auto msg = make_shared<message>();
+                    msg->line_policy(line_policy, line_policy);
+                    async_receive_message(msg, header_only, make_shared<bool>(false), handler);
+                });
+        });
+}
+
+
+void pop3::async_receive_message(shared_ptr<message> msg, bool header_only, shared_ptr<bool> empty_line,
+    function<void (exception_ptr, message)> handler)
+{
+    dlg_->async_receive(false, [this, msg, header_only, empty_line, handler](exception_ptr exc, string line)
+        {
+            bool completed = true;
+            if (!exc)
+            {
+                try
+                {
+                    completed = parse_message_line(line, *msg, header_only, *empty_line);
+                }
+                catch (...)
+                {
+                    exc = std::current_exception();
+                }
+            }
+
+            if (!completed)
+                async_receive_message(msg, header_only, empty_line, handler);
+            else
+                handler(exc, exc ? message() : move(*msg));
+        });
+}
+
+
 tuple<string, string> pop3::parse_status(const string& line)
 {
     string::size_type pos = line.find(TOKEN_SEPARATOR_CHAR);
@@ -337,7 +416,8 @@ tuple<string, string> pop3::parse_status(const string& line)
 }
 
 
-pop3s::pop3s(const string& hostname, unsigned port, milliseconds timeout) : pop3(hostname, port, timeout)
+pop3s::pop3s(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) :
+    pop3(hostname, port, timeout, ios)
 {
     ssl_options_ =
         {
@@ -11,23 +11,49 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 */
 
 
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <string>
 #include <vector>
 #include <stdexcept>
-#include <boost/algorithm/string/trim.hpp>
+#include <utility>
 #include <mailio/quoted_printable.hpp>
 
 
 using std::string;
+using std::string_view;
+using std::max;
+using std::min;
+using std::array;
+using std::isxdigit;
 using std::vector;
 using std::runtime_error;
-using boost::trim_right;
+using std::move;
 
 
 namespace mailio
 {
 
 
+const array<bool, 256> quoted_printable::ENCODER_PLAIN_CHARS = []()
+{
+    array<bool, 256> table;
+    for (int ch = 0; ch < 256; ch++)
+        table[ch] = ch >= SPACE_CHAR && ch <= TILDE_CHAR && ch != EQUAL_CHAR && ch != QUESTION_MARK_CHAR;
+    return table;
+}();
+
+
+const array<bool, 256> quoted_printable::DECODER_PLAIN_CHARS = []()
+{
+    array<bool, 256> table;
+    for (int ch = 0; ch < 256; ch++)
+        table[ch] = ((ch >= SPACE_CHAR && ch <= TILDE_CHAR) || ch == '\t') && ch != EQUAL_CHAR && ch != UNDERSCORE_CHAR;
+    return table;
+}();
+
+
 quoted_printable::quoted_printable(codec::line_len_policy_t encoder_line_policy, codec::line_len_policy_t decoder_line_policy)
   : codec(encoder_line_policy, decoder_line_policy), q_codec_mode_(false)
 {
@@ -37,229 +63,322 @@ quoted_printable::quoted_printable(codec::line_len_policy_t encoder_line_policy,
 vector<string> quoted_printable::encode(const string& text, string::size_type reserved) const
 {
     vector<string> enc_text;
-    string line;
-    string::size_type line_len = 0;
-    for (auto ch = text.begin(); ch != text.end(); ch++)
+    encoder_t encoder(*this, [&enc_text](const string& line) { enc_text.push_back(line); }, reserved);
+    encoder.feed(text);
+    encoder.finish();
+    return enc_text;
+}
+
+
+void quoted_printable::encode(const string& text, string& enc_text, string::size_type reserved) const
+{
+    // each escaped character takes three characters, and each soft break at most three more; the question marks are counted as escaped
+    // even when they are not, which only overestimates
+    string::size_type enc_len = 0;
+    for (auto ch : text)
+        enc_len += ENCODER_PLAIN_CHARS[static_cast<unsigned char>(ch)] || ch == CR_CHAR || ch == LF_CHAR ? 1 : 3;
+    const string::size_type line_chars = max<string::size_type>(string::size_type(line_policy_) - reserved - 5, 1);
+    enc_text.reserve(enc_text.length() + enc_len + (enc_len / line_chars + 1) * 3);
+
+    encoder_t encoder(*this, [&enc_text](const string& line) { enc_text.append(line).append(END_OF_LINE); }, reserved);
+    encoder.feed(text);
+    encoder.finish();
+}
+
+
+string quoted_printable::decode(const vector<string>& text) const
+{
+    string dec_text;
+    decoder_t decoder(*this, [&dec_text](const string& chunk) { dec_text += chunk; });
+    for (const auto& line : text)
+        decoder.feed(line);
+    decoder.finish();
+    return dec_text;
+}
+
+
+void quoted_printable::q_codec_mode(bool mode)
+{
+    q_codec_mode_ = mode;
+}
+
+
+bool quoted_printable::is_allowed(char ch) const
+{
+    return ((ch >= SPACE_CHAR && ch <= TILDE_CHAR) || ch == '\t');
+}
+
+
+quoted_printable::encoder_t::encoder_t(const quoted_printable& codec, sink_t sink, string::size_type reserved)
+  : codec_(codec), sink_(move(sink)), reserved_(reserved), line_len_(0), pending_cr_(false), empty_lines_(0)
+{
+}
+
+
+void quoted_printable::encoder_t::feed(const string& chunk)
+{
+    const string::size_type line_len_max = string::size_type(codec_.line_policy_) - reserved_ - 4;
+    auto ch = chunk.begin();
+    if (pending_cr_ && ch != chunk.end())
+    {
+        if (*ch != LF_CHAR)
+            throw codec_error("Bad CRLF sequence.");
+        pass_line();
+        pending_cr_ = false;
+        ch++;
+    }
+
+    for (; ch != chunk.end(); ch++)
+    {
+        if (*ch == CR_CHAR)
+        {
+            if (codec_.q_codec_mode_)
+                throw codec_error("Bad character `" + string(1, *ch) + "`.");
+
+            // the line feed is expected at the beginning of the next chunk
+            if (ch + 1 == chunk.end())
+            {
+                pending_cr_ = true;
+                return;
+            }
+            if (*(ch + 1) != LF_CHAR)
+                throw codec_error("Bad CRLF sequence.");
+            pass_line();
+            // two characters have to be skipped
+            ch++;
+        }
+        else if (!codec_.q_codec_mode_ && ENCODER_PLAIN_CHARS[static_cast<unsigned char>(*ch)] && line_len_ < line_len_max)
+        {
+            // copy the run of plain characters at once, up to the length where a soft break might be needed
+            auto run_end = ch + 1;
+            const auto room_end = ch + min<string::size_type>(line_len_max - line_len_, chunk.end() - ch);
+            while (run_end != room_end && ENCODER_PLAIN_CHARS[static_cast<unsigned char>(*run_end)])
+                run_end++;
+            line_.append(ch, run_end);
+            line_len_ += run_end - ch;
+            ch = run_end - 1;
+        }
+        else
+            encode_char(*ch);
+    }
+}
+
+
+void quoted_printable::encoder_t::finish()
+{
+    if (pending_cr_)
+        throw codec_error("Bad CRLF sequence.");
+    if (!line_.empty())
+        pass_line();
+    empty_lines_ = 0;
+}
+
+
+void quoted_printable::encoder_t::encode_char(char ch)
+{
+    const string::size_type policy = string::size_type(codec_.line_policy_) - reserved_;
+    const bool q_codec_mode = codec_.q_codec_mode_;
+
+    if (ch > SPACE_CHAR && ch <= TILDE_CHAR && ch != EQUAL_CHAR && ch != QUESTION_MARK_CHAR)
     {
-        if (*ch > SPACE_CHAR && *ch <= TILDE_CHAR && *ch != EQUAL_CHAR && *ch != QUESTION_MARK_CHAR)
+        // add soft break when not q encoding
+        if (line_len_ >= policy - 3)
         {
-            // add soft break when not q encoding
-            if (line_len >= string::size_type(line_policy_) - reserved - 3)
+            if (q_codec_mode)
             {
-                if (q_codec_mode_)
-                {
-                    line += *ch;
-                    enc_text.push_back(line);
-                    line.clear();
-                    line_len = 0;
-                }
-                else
-                {
-                    line += EQUAL_CHAR;
-                    enc_text.push_back(line);
-                    line.clear();
-                    line_len = 0;
-                    line += *ch;
-                    line_len++;
-                }
+                line_ += ch;
+                pass_line();
             }
             else
             {
-                line += *ch;
-                line_len++;
+                line_ += EQUAL_CHAR;
+                pass_line();
+                line_ += ch;
+                line_len_++;
             }
         }
-        else if (*ch == SPACE_CHAR)
+        else
         {
-            // add soft break after the current space character if not q encoding
-            if (line_len >= string::size_type(line_policy_) - reserved - 4)
-            {
-                if (q_codec_mode_)
-                {
-                    line += UNDERSCORE_CHAR;
-                    line_len++;
-                }
-                else
-                {
-                    line += SPACE_CHAR;
-                    line += EQUAL_CHAR;
-                    enc_text.push_back(line);
-                    line.clear();
-                    line_len = 0;
-                }
-            }
-            // add soft break before the current space character if not q encoding
-            else if (line_len >= string::size_type(line_policy_) - reserved - 3)
+            line_ += ch;
+            line_len_++;
+        }
+    }
+    else if (ch == SPACE_CHAR)
+    {
+        // add soft break after the current space character if not q encoding
+        if (line_len_ >= policy - 4)
+        {
+            if (q_codec_mode)
             {
-                if (q_codec_mode_)
-                {
-                    line += UNDERSCORE_CHAR;
-                    line_len++;
-                }
-                else
-                {
-                    line += EQUAL_CHAR;
-                    enc_text.push_back(line);
-                    line.clear();
-                    line += SPACE_CHAR;
-                    line_len = 1;
-                }
+                line_ += UNDERSCORE_CHAR;
+                line_len_++;
             }
             else
             {
-                if (q_codec_mode_)
-                    line += UNDERSCORE_CHAR;
-                else
-                    line += SPACE_CHAR;
-                line_len++;
+                line_ += SPACE_CHAR;
+                line_ += EQUAL_CHAR;
+                pass_line();
             }
         }
-        else if (*ch == QUESTION_MARK_CHAR)
+        // add soft break before the current space character if not q encoding
+        else if (line_len_ >= policy - 3)
         {
-            if (line_len >= string::size_type(line_policy_) - reserved - 2)
+            if (q_codec_mode)
             {
-                if (q_codec_mode_)
-                {
-                    enc_text.push_back(line);
-                    line.clear();
-                    line += "=3F";
-                    line_len = 3;
-                }
-                else
-                {
-                    line += *ch;
-                    line_len++;
-                }
+                line_ += UNDERSCORE_CHAR;
+                line_len_++;
             }
             else
             {
-                if (q_codec_mode_)
-                {
-                    line += "=3F";
-                    line_len += 3;
-                }
-                else
-                {
-                    line += *ch;
-                    line_len++;
-                }
-
+                line_ += EQUAL_CHAR;
+                pass_line();
+                line_ += SPACE_CHAR;
+                line_len_ = 1;
             }
         }
-        else if (*ch == CR_CHAR)
+        else
         {
-            if (q_codec_mode_)
-                throw codec_error("Bad character `" + string(1, *ch) + "`.");
-
-            if (ch + 1 == text.end() || (ch + 1 != text.end() && *(ch + 1) != LF_CHAR))
-                throw codec_error("Bad CRLF sequence.");
-            enc_text.push_back(line);
-            line.clear();
-            line_len = 0;
-            // two characters have to be skipped
-            ch++;
+            if (q_codec_mode)
+                line_ += UNDERSCORE_CHAR;
+            else
+                line_ += SPACE_CHAR;
+            line_len_++;
         }
-        else
+    }
+    else if (ch == QUESTION_MARK_CHAR)
+    {
+        if (line_len_ >= policy - 2)
         {
-            // add soft break before the current character
-            if (line_len >= string::size_type(line_policy_) - reserved - 5 && !q_codec_mode_)
+            if (q_codec_mode)
+            {
+                pass_line();
+                line_ += "=3F";
+                line_len_ = 3;
+            }
+            else
             {
-                line += EQUAL_CHAR;
-                enc_text.push_back(line);
-                line.clear();
-                line += EQUAL_CHAR;
-                line += HEX_DIGITS[((*ch >> 4) & 0x0F)];
-                line += HEX_DIGITS[(*ch & 0x0F)];
-                line_len = 3;
+                line_ += ch;
+                line_len_++;
             }
-            else if (line_len >= string::size_type(line_policy_) - reserved - 2 && q_codec_mode_)
+        }
+        else
+        {
+            if (q_codec_mode)
             {
-                enc_text.push_back(line);
-                line.clear();
-                line += EQUAL_CHAR;
-                line += HEX_DIGITS[((*ch >> 4) & 0x0F)];
-                line += HEX_DIGITS[(*ch & 0x0F)];
-                line_len = 3;
+                line_ += "=3F";
+                line_len_ += 3;
             }
             else
             {
-                line += EQUAL_CHAR;
-                line += HEX_DIGITS[((*ch >> 4) & 0x0F)];
-                line += HEX_DIGITS[(*ch & 0x0F)];
-                line_len += 3;
+                line_ += ch;
+                line_len_++;
             }
         }
     }
-    if (!line.empty())
-        enc_text.push_back(line);
-    while (!enc_text.empty() && enc_text.back().empty())
-        enc_text.pop_back();
-    
-    return enc_text;
+    else
+    {
+        // add soft break before the current character
+        if (line_len_ >= policy - 5 && !q_codec_mode)
+        {
+            line_ += EQUAL_CHAR;
+            pass_line();
+            line_ += EQUAL_CHAR;
+            line_ += HEX_DIGITS[((ch >> 4) & 0x0F)];
+            line_ += HEX_DIGITS[(ch & 0x0F)];
+            line_len_ = 3;
+        }
+        else if (line_len_ >= policy - 2 && q_codec_mode)
+        {
+            pass_line();
+            line_ += EQUAL_CHAR;
+            line_ += HEX_DIGITS[((ch >> 4) & 0x0F)];
+            line_ += HEX_DIGITS[(ch & 0x0F)];
+            line_len_ = 3;
+        }
+        else
+        {
+            line_ += EQUAL_CHAR;
+            line_ += HEX_DIGITS[((ch >> 4) & 0x0F)];
+            line_ += HEX_DIGITS[(ch & 0x0F)];
+            line_len_ += 3;
+        }
+    }
 }
 
 
-string quoted_printable::decode(const vector<string>& text) const
+void quoted_printable::encoder_t::pass_line()
 {
-    string dec_text;
-    for (const auto& line : text)
+    codec::pass_line(line_, empty_lines_, sink_);
+    line_.clear();
+    line_len_ = 0;
+}
+
+
+quoted_printable::decoder_t::decoder_t(const quoted_printable& codec, sink_t sink) : codec_(codec), sink_(move(sink))
+{
+}
+
+
+void quoted_printable::decoder_t::feed(string_view line)
+{
+    if (line.length() > string::size_type(codec_.decoder_line_policy_) - 2)
+        throw codec_error("Bad line policy.");
+
+    bool soft_break = false;
+    for (string::size_type ch = 0; ch < line.length(); ch++)
     {
-        if (line.length() > string::size_type(decoder_line_policy_) - 2)
-            throw codec_error("Bad line policy.");
+        if (!codec_.is_allowed(line[ch]))
+            throw codec_error("Bad character `" + string(1, line[ch]) + "`.");
 
-        bool soft_break = false;
-        for (string::const_iterator ch = line.begin(); ch != line.end(); ch++)
+        if (line[ch] == EQUAL_CHAR)
         {
-            if (!is_allowed(*ch))
-                throw codec_error("Bad character `" + string(1, *ch) + "`.");
-
-            if (*ch == EQUAL_CHAR)
+            if (ch + 1 == line.length() && !codec_.q_codec_mode_)
             {
-                if ((ch + 1) == line.end() && !q_codec_mode_)
-                {
-                    soft_break = true;
-                    continue;
-                }
-
-                // Avoid exception: Convert to uppercase.
-                char next_char = toupper(*(ch + 1));
-                char next_next_char = toupper(*(ch + 2));
-                if (!is_allowed(next_char) || !is_allowed(next_next_char))
-                    throw codec_error("Bad character.");
-
-                if (HEX_DIGITS.find(next_char) == string::npos || HEX_DIGITS.find(next_next_char) == string::npos)
-                    throw codec_error("Bad hexadecimal digit.");
-                int nc_val = hex_digit_to_int(next_char);
-                int nnc_val = hex_digit_to_int(next_next_char);
-                dec_text += ((nc_val << 4) + nnc_val);
-                ch += 2;
+                soft_break = true;
+                continue;
             }
+
+            // Avoid exception: Convert to uppercase.
+            char next_char = ch + 1 < line.length() ? toupper(line[ch + 1]) : NIL_CHAR;
+            char next_next_char = ch + 2 < line.length() ? toupper(line[ch + 2]) : NIL_CHAR;
+            if (!codec_.is_allowed(next_char) || !codec_.is_allowed(next_next_char))
+                throw codec_error("Bad character.");
+
+            if (!isxdigit(static_cast<unsigned char>(next_char)) || !isxdigit(static_cast<unsigned char>(next_next_char)))
+                throw codec_error("Bad hexadecimal digit.");
+            int nc_val = hex_digit_to_int(next_char);
+            int nnc_val = hex_digit_to_int(next_next_char);
+            dec_text_ += ((nc_val << 4) + nnc_val);
+            ch += 2;
+        }
+        else if (DECODER_PLAIN_CHARS[static_cast<unsigned char>(line[ch])])
+        {
+            // copy the run of plain characters at once
+            string::size_type run_end = ch + 1;
+            while (run_end < line.length() && DECODER_PLAIN_CHARS[static_cast<unsigned char>(line[run_end])])
+                run_end++;
+            dec_text_.append(line, ch, run_end - ch);
+            ch = run_end - 1;
+        }
+        else
+        {
+            if (codec_.q_codec_mode_ && line[ch] == UNDERSCORE_CHAR)
+                dec_text_ += SPACE_CHAR;
             else
-            {
-                if (q_codec_mode_ && *ch == UNDERSCORE_CHAR)
-                    dec_text += SPACE_CHAR;
-                else
-                    dec_text += *ch;
-            }
+                dec_text_ += line[ch];
         }
-        if (!soft_break && !q_codec_mode_)
-            dec_text += END_OF_LINE;
     }
-    trim_right(dec_text);
-    
-    return dec_text;
+    if (!soft_break && !codec_.q_codec_mode_)
+        dec_text_ += END_OF_LINE;
+    if (dec_text_.length() >= DECODER_BUFFER_SIZE)
+        pass_trimmed(dec_text_, sink_);
 }
 
 
-void quoted_printable::q_codec_mode(bool mode)
-{
-    q_codec_mode_ = mode;
-}
-
-
-bool quoted_printable::is_allowed(char ch) const
+void quoted_printable::decoder_t::finish()
 {
-    return ((ch >= SPACE_CHAR && ch <= TILDE_CHAR) || ch == '\t');
+    pass_trimmed(dec_text_, sink_);
+    dec_text_.clear();
 }
 
 
@@ -0,0 +1,290 @@
+/*
+
+session_pool.cpp
+----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <mailio/session_pool.hpp>
+
+
+using std::string;
+using std::list;
+using std::unique_ptr;
+using std::make_unique;
+using std::move;
+using std::tie;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::cv_status;
+using std::size_t;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+
+namespace mailio
+{
+
+
+template<typename Session>
+bool session_pool<Session>::session_params_t::operator<(const session_params_t& other) const
+{
+    return tie(hostname, port, username, password, method, ssl_options.method, ssl_options.verify_mode, ssl_options.context,
+        ssl_options.session_cache) < tie(other.hostname, other.port, other.username, other.password, other.method, other.ssl_options.method,
+        other.ssl_options.verify_mode, other.ssl_options.context, other.ssl_options.session_cache);
+}
+
+
+template<typename Session>
+session_pool<Session>::lease_t::lease_t(session_pool* pool, const session_params_t& params, unique_ptr<Session> session) :
+    pool_(pool), params_(params), session_(move(session)), valid_(true)
+{
+}
+
+
+template<typename Session>
+session_pool<Session>::lease_t::lease_t(lease_t&& other) noexcept :
+    pool_(other.pool_), params_(move(other.params_)), session_(move(other.session_)), valid_(other.valid_)
+{
+    other.pool_ = nullptr;
+}
+
+
+template<typename Session>
+session_pool<Session>::lease_t::~lease_t()
+{
+    if (pool_ != nullptr && session_ != nullptr)
+        pool_->release(params_, move(session_), valid_);
+}
+
+
+template<typename Session>
+Session& session_pool<Session>::lease_t::operator*() const
+{
+    return *session_;
+}
+
+
+template<typename Session>
+Session* session_pool<Session>::lease_t::operator->() const
+{
+    return session_.get();
+}
+
+
+template<typename Session>
+void session_pool<Session>::lease_t::invalidate()
+{
+    valid_ = false;
+}
+
+
+template<typename Session>
+session_pool<Session>::session_pool(size_t max_sessions, milliseconds idle_timeout, milliseconds timeout, milliseconds wait_timeout) :
+    max_sessions_(max_sessions), idle_timeout_(idle_timeout), timeout_(timeout), wait_timeout_(wait_timeout)
+{
+    if (max_sessions_ == 0)
+        throw pool_error("Zero sessions not allowed.");
+}
+
+
+template<typename Session>
+session_pool<Session>::~session_pool()
+{
+    // sessions close the connections in their destructors
+    idle_.clear();
+}
+
+
+template<typename Session>
+typename session_pool<Session>::lease_t session_pool<Session>::lease(const session_params_t& params)
+{
+    const server_t server(params.hostname, params.port);
+    const auto deadline = steady_clock::now() + wait_timeout_;
+    list<unique_ptr<Session>> closed;
+    unique_lock<mutex> lock(mutex_);
+    collect_expired(closed);
+
+    while (true)
+    {
+        if (!closed.empty())
+        {
+            lock.unlock();
+            closed.clear();
+            lock.lock();
+            released_.notify_all();
+        }
+
+        auto idle_it = idle_.find(params);
+        if (idle_it != idle_.end())
+        {
+            unique_ptr<Session> session = move(idle_it->second.back().first);
+            idle_it->second.pop_back();
+            if (idle_it->second.empty())
+                idle_.erase(idle_it);
+
+            // the session stays counted as open while being checked
+            lock.unlock();
+            bool alive = session->noop();
+            lock.lock();
+            if (alive)
+            {
+                stat_.hits++;
+                return lease_t(this, params, move(session));
+            }
+            stat_.failed_checks++;
+            forget(server, closed, move(session));
+            continue;
+        }
+
+        if (open_[server] < max_sessions_)
+        {
+            open_[server]++;
+            stat_.misses++;
+            lock.unlock();
+            try
+            {
+                return lease_t(this, params, create(params));
+            }
+            catch (...)
+            {
+                lock_guard<mutex> guard(mutex_);
+                open_[server]--;
+                released_.notify_all();
+                throw;
+            }
+        }
+
+        // make a room by closing the least recently used idle session of the same server but with other parameters
+        auto victim = idle_.end();
+        for (auto it = idle_.begin(); it != idle_.end(); it++)
+            if (it->first.hostname == params.hostname && it->first.port == params.port &&
+                (victim == idle_.end() || it->second.front().second < victim->second.front().second))
+                victim = it;
+        if (victim != idle_.end())
+        {
+            stat_.evictions++;
+            forget(server, closed, move(victim->second.front().first));
+            victim->second.pop_front();
+            if (victim->second.empty())
+                idle_.erase(victim);
+            continue;
+        }
+
+        if (wait_timeout_.count() == 0)
+            released_.wait(lock);
+        else if (released_.wait_until(lock, deadline) == cv_status::timeout)
+            throw pool_error("Session pool exhausted.");
+    }
+}
+
+
+template<typename Session>
+size_t session_pool<Session>::evict_idle()
+{
+    list<unique_ptr<Session>> expired;
+    {
+        lock_guard<mutex> guard(mutex_);
+        collect_expired(expired);
+    }
+    size_t expired_no = expired.size();
+    expired.clear();
+    released_.notify_all();
+    return expired_no;
+}
+
+
+template<typename Session>
+typename session_pool<Session>::pool_stat_t session_pool<Session>::statistics() const
+{
+    lock_guard<mutex> guard(mutex_);
+    return stat_;
+}
+
+
+template<typename Session>
+size_t session_pool<Session>::idle_sessions() const
+{
+    lock_guard<mutex> guard(mutex_);
+    size_t idle_no = 0;
+    for (const auto& sessions : idle_)
+        idle_no += sessions.second.size();
+    return idle_no;
+}
+
+
+template<typename Session>
+void session_pool<Session>::release(const session_params_t& params, unique_ptr<Session> session, bool valid)
+{
+    {
+        lock_guard<mutex> guard(mutex_);
+        if (valid)
+            idle_[params].emplace_back(move(session), steady_clock::now());
+        else
+            open_[server_t(params.hostname, params.port)]--;
+    }
+    // an invalidated session is closed outside of the lock
+    session.reset();
+    released_.notify_all();
+}
+
+
+template<typename Session>
+unique_ptr<Session> session_pool<Session>::create(const session_params_t& params) const
+{
+    auto session = make_unique<Session>(params.hostname, params.port, timeout_);
+    session->ssl_options(params.ssl_options);
+    session->authenticate(params.username, params.password, params.method);
+    return session;
+}
+
+
+template<typename Session>
+void session_pool<Session>::collect_expired(list<unique_ptr<Session>>& expired)
+{
+    const auto now = steady_clock::now();
+    for (auto it = idle_.begin(); it != idle_.end();)
+    {
+        const server_t server(it->first.hostname, it->first.port);
+        // the least recently used sessions are at the front
+        while (!it->second.empty() && now - it->second.front().second >= idle_timeout_)
+        {
+            stat_.evictions++;
+            forget(server, expired, move(it->second.front().first));
+            it->second.pop_front();
+        }
+        if (it->second.empty())
+            it = idle_.erase(it);
+        else
+            it++;
+    }
+}
+
+
+template<typename Session>
+void session_pool<Session>::forget(const server_t& server, list<unique_ptr<Session>>& closed, unique_ptr<Session> session)
+{
+    open_[server]--;
+    closed.push_back(move(session));
+}
+
+
+template class session_pool<smtps>;
+template class session_pool<imaps>;
+
+
+} // namespace mailio
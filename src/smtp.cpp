@@ -16,6 +16,7 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <stdexcept>
 #include <tuple>
 #include <algorithm>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/asio/ip/host_name.hpp>
 #include <mailio/base64.hpp>
 #include <mailio/smtp.hpp>
@@ -25,24 +26,35 @@ using std::ostream;
 using std::istream;
 using std::vector;
 using std::string;
+using std::ios_base;
+using std::streamsize;
 using std::to_string;
 using std::tuple;
 using std::stoi;
 using std::move;
 using std::make_shared;
+using std::function;
+using std::exception_ptr;
+using std::make_exception_ptr;
+using std::shared_ptr;
 using std::runtime_error;
 using std::out_of_range;
 using std::invalid_argument;
 using std::chrono::milliseconds;
+using boost::asio::post;
+using boost::asio::buffer;
+using boost::asio::const_buffer;
 using boost::asio::ip::host_name;
 using boost::system::system_error;
+using boost::iequals;
 
 
 namespace mailio
 {
 
 
-smtp::smtp(const string& hostname, unsigned port, milliseconds timeout) : dlg_(make_shared<dialog>(hostname, port, timeout))
+smtp::smtp(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) :
+    dlg_(make_shared<dialog>(hostname, port, timeout, ios)), pipelining_(false)
 {
     src_host_ = read_hostname();
     dlg_->connect();
@@ -79,86 +91,188 @@ string smtp::authenticate(const string& username, const string& password, auth_m
 
 string smtp::submit(const message& msg)
 {
-    if (!msg.sender().address.empty())
-        dlg_->send("MAIL FROM: " + message::ADDRESS_BEGIN_STR + msg.sender().address + message::ADDRESS_END_STR);
-    else
-        dlg_->send("MAIL FROM: " + message::ADDRESS_BEGIN_STR + msg.from().addresses.at(0).address + message::ADDRESS_END_STR);
-    string line = dlg_->receive();
-    tuple<int, bool, string> tokens = parse_line(line);
-    if (std::get<1>(tokens) && !positive_completion(std::get<0>(tokens)))
-        throw smtp_error("Mail sender rejection.");
-
-    for (const auto& rcpt : msg.recipients().addresses)
+    rejected_recipients_.clear();
+    vector<envelope_command_t> commands = envelope(msg);
+    try
     {
-        dlg_->send("RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.address + message::ADDRESS_END_STR);
-        line = dlg_->receive();
-        tokens = parse_line(line);
-        if (!positive_completion(std::get<0>(tokens)))
-            throw smtp_error("Mail recipient rejection.");
+        return transaction(commands, msg);
     }
-
-    for (const auto& rcpt : msg.recipients().groups)
+    catch (const smtp_error&)
     {
-        dlg_->send("RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.name + message::ADDRESS_END_STR);
-        line = dlg_->receive();
-        tokens = parse_line(line);
-        if (!positive_completion(std::get<0>(tokens)))
-            throw smtp_error("Mail group recipient rejection.");
+        // The message is rejected, so the session is reset to be ready for the next one.
+        reset_session();
+        throw;
     }
+}
+
+
+void smtp::reset()
+{
+    dlg_->send("RSET");
+    tuple<int, bool, string> tokens = receive_reply();
+    if (!positive_completion(std::get<0>(tokens)))
+        throw smtp_error("Session reset failure.");
+}
 
-    for (const auto& rcpt : msg.cc_recipients().addresses)
+
+bool smtp::noop()
+{
+    try
     {
-        dlg_->send("RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.address + message::ADDRESS_END_STR);
-        line = dlg_->receive();
-        tokens = parse_line(line);
-        if (!positive_completion(std::get<0>(tokens)))
-            throw smtp_error("Mail cc recipient rejection.");
+        dlg_->send("NOOP");
+        tuple<int, bool, string> tokens = receive_reply();
+        return positive_completion(std::get<0>(tokens));
     }
-
-    for (const auto& rcpt : msg.cc_recipients().groups)
+    catch (const dialog_error&)
     {
-        dlg_->send("RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.name + message::ADDRESS_END_STR);
-        line = dlg_->receive();
-        tokens = parse_line(line);
-        if (!positive_completion(std::get<0>(tokens)))
-            throw smtp_error("Mail group cc recipient rejection.");
+        return false;
     }
-
-    for (const auto& rcpt : msg.bcc_recipients().addresses)
+    catch (const smtp_error&)
     {
-        dlg_->send("RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.address + message::ADDRESS_END_STR);
-        line = dlg_->receive();
-        tokens = parse_line(line);
-        if (!positive_completion(std::get<0>(tokens)))
-            throw smtp_error("Mail bcc recipient rejection.");
+        return false;
     }
+}
+
 
-    for (const auto& rcpt : msg.bcc_recipients().groups)
+string smtp::transaction(const vector<envelope_command_t>& commands, const message& msg)
+{
+    tuple<int, bool, string> tokens;
+    if (pipelining_)
     {
-        dlg_->send("RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.name + message::ADDRESS_END_STR);
-        line = dlg_->receive();
-        tokens = parse_line(line);
-        if (!positive_completion(std::get<0>(tokens)))
-            throw smtp_error("Mail group bcc recipient rejection.");
+        dlg_->send(pipeline(commands));
+        vector<tuple<int, bool, string>> replies;
+        for (vector<envelope_command_t>::size_type i = 0; i < commands.size(); i++)
+            replies.push_back(receive_reply());
+        tokens = receive_reply();
+        try
+        {
+            check_envelope(commands, replies);
+        }
+        catch (const smtp_error&)
+        {
+            // The server should reject the data, but if it has not then the transaction is closed with no content.
+            if (positive_intermediate(std::get<0>(tokens)))
+            {
+                dlg_->send(codec::END_OF_MESSAGE);
+                receive_reply();
+            }
+            throw;
+        }
+    }
+    else
+    {
+        vector<tuple<int, bool, string>> replies;
+        for (const auto& cmd : commands)
+        {
+            dlg_->send(cmd.command);
+            replies.push_back(receive_reply());
+            // the recipients are not sent if the sender is rejected
+            if (!positive_completion(std::get<0>(replies.front())))
+                break;
+        }
+        check_envelope(commands, replies);
+        dlg_->send("DATA");
+        tokens = receive_reply();
     }
-
-    dlg_->send("DATA");
-    line = dlg_->receive();
-    tokens = parse_line(line);
     if (!positive_intermediate(std::get<0>(tokens)))
         throw smtp_error("Mail message rejection.");
 
-    string msg_str;
-    msg.format(msg_str, true);
-    dlg_->send(msg_str + codec::END_OF_LINE + codec::END_OF_MESSAGE);
-    line = dlg_->receive();
-    tokens = parse_line(line);
+    try
+    {
+        data_streambuf data_buf(dlg_);
+        ostream data_strm(&data_buf);
+        data_strm.exceptions(ios_base::badbit);
+        msg.format(data_strm, false);
+        data_buf.finish();
+    }
+    catch (...)
+    {
+        // The server is in the middle of the data, so the session cannot be reset and is closed instead.
+        dlg_->close();
+        throw;
+    }
+    tokens = receive_reply();
     if (!positive_completion(std::get<0>(tokens)))
         throw smtp_error("Mail message rejection.");
     return std::get<2>(tokens);
 }
 
 
+smtp::data_streambuf::data_streambuf(shared_ptr<dialog> dlg) : dlg_(dlg), line_start_(true)
+{
+    // a character may be preceded by the escaping dot
+    buffer_.reserve(BUFFER_SIZE + 2);
+}
+
+
+auto smtp::data_streambuf::overflow(int_type ch) -> int_type
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof()))
+        return traits_type::not_eof(ch);
+    char c = traits_type::to_char_type(ch);
+    xsputn(&c, 1);
+    return ch;
+}
+
+
+streamsize smtp::data_streambuf::xsputn(const char* chars, streamsize count)
+{
+    streamsize appended = 0;
+    while (appended < count)
+    {
+        appended += static_cast<streamsize>(stuff(chars + appended, static_cast<string::size_type>(count - appended), buffer_, line_start_));
+        if (buffer_.size() >= BUFFER_SIZE)
+            sync();
+    }
+    return count;
+}
+
+
+string::size_type smtp::data_streambuf::stuff(const char* chars, string::size_type count, string& chunk, bool& line_start)
+{
+    string::size_type i = 0;
+    for (; i < count && chunk.size() < BUFFER_SIZE; i++)
+    {
+        if (line_start && chars[i] == codec::DOT_CHAR)
+            chunk += codec::DOT_CHAR;
+        chunk += chars[i];
+        line_start = chars[i] == codec::LF_CHAR;
+    }
+    return i;
+}
+
+
+void smtp::data_streambuf::finish()
+{
+    dlg_->send(vector<const_buffer>{buffer(buffer_), buffer(codec::END_OF_LINE), buffer(codec::END_OF_MESSAGE), buffer(codec::END_OF_LINE)});
+    buffer_.clear();
+    line_start_ = true;
+}
+
+
+int smtp::data_streambuf::sync()
+{
+    if (!buffer_.empty())
+    {
+        dlg_->send(buffer_, true);
+        buffer_.clear();
+    }
+    return 0;
+}
+
+
+auto smtp::rejected_recipients() const -> const vector<rejected_recipient_t>&
+{
+    return rejected_recipients_;
+}
+
+
+bool smtp::pipelining() const
+{
+    return pipelining_;
+}
+
+
 void smtp::source_hostname(const string& src_host)
 {
     src_host_ = src_host;
@@ -219,17 +333,22 @@ void smtp::auth_login(const string& username, const string& password)
 
 void smtp::ehlo()
 {
+    pipelining_ = false;
     dlg_->send("EHLO " + src_host_);
     string line = dlg_->receive();
     tuple<int, bool, string> tokens = parse_line(line);
+    // The first line is the greeting, the rest are the supported extensions.
     while (!std::get<1>(tokens))
     {
         line = dlg_->receive();
         tokens = parse_line(line);
+        if (positive_completion(std::get<0>(tokens)) && iequals(std::get<2>(tokens).substr(0, std::get<2>(tokens).find(' ')), "PIPELINING"))
+            pipelining_ = true;
     }
 
     if (!positive_completion(std::get<0>(tokens)))
     {
+        pipelining_ = false;
         dlg_->send("HELO " + src_host_);
 
         line = dlg_->receive();
@@ -245,6 +364,310 @@ void smtp::ehlo()
 }
 
 
+auto smtp::envelope(const message& msg) -> vector<envelope_command_t>
+{
+    vector<envelope_command_t> commands;
+    const string sender = msg.sender().address.empty() ? msg.from().addresses.at(0).address : msg.sender().address;
+    commands.push_back({"MAIL FROM: " + message::ADDRESS_BEGIN_STR + sender + message::ADDRESS_END_STR, sender, "Mail sender rejection."});
+
+    auto add_recipients = [&commands](const mailboxes& rcpts, const string& address_rejection, const string& group_rejection)
+    {
+        for (const auto& rcpt : rcpts.addresses)
+            commands.push_back({"RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.address + message::ADDRESS_END_STR, rcpt.address, address_rejection});
+        for (const auto& rcpt : rcpts.groups)
+            commands.push_back({"RCPT TO: " + message::ADDRESS_BEGIN_STR + rcpt.name + message::ADDRESS_END_STR, rcpt.name, group_rejection});
+    };
+    add_recipients(msg.recipients(), "Mail recipient rejection.", "Mail group recipient rejection.");
+    add_recipients(msg.cc_recipients(), "Mail cc recipient rejection.", "Mail group cc recipient rejection.");
+    add_recipients(msg.bcc_recipients(), "Mail bcc recipient rejection.", "Mail group bcc recipient rejection.");
+    return commands;
+}
+
+
+string smtp::pipeline(const vector<envelope_command_t>& commands)
+{
+    string batch;
+    for (const auto& cmd : commands)
+        batch += cmd.command + codec::END_OF_LINE;
+    batch += "DATA";
+    return batch;
+}
+
+
+void smtp::check_envelope(const vector<envelope_command_t>& commands, const vector<tuple<int, bool, string>>& replies)
+{
+    if (!positive_completion(std::get<0>(replies.at(0))))
+        throw smtp_error(commands.at(0).rejection);
+
+    for (vector<envelope_command_t>::size_type i = 1; i < commands.size(); i++)
+        if (!positive_completion(std::get<0>(replies.at(i))))
+            rejected_recipients_.push_back({commands[i].address, std::get<0>(replies[i]), std::get<2>(replies[i])});
+
+    // The message is sent if at least one recipient is accepted, otherwise the first rejection is reported.
+    if (commands.size() > 1 && rejected_recipients_.size() == commands.size() - 1)
+        throw smtp_error(commands[1].rejection);
+}
+
+
+void smtp::reset_session()
+{
+    try
+    {
+        reset();
+    }
+    catch (const dialog_error&)
+    {
+    }
+    catch (const smtp_error&)
+    {
+    }
+}
+
+
+tuple<int, bool, string> smtp::receive_reply()
+{
+    tuple<int, bool, string> tokens = parse_line(dlg_->receive());
+    while (!std::get<1>(tokens))
+        tokens = parse_line(dlg_->receive());
+    return tokens;
+}
+
+
+shared_ptr<smtp::submission_t> smtp::prepare_submission(const message& msg)
+{
+    auto submission = make_shared<submission_t>();
+    try
+    {
+        submission->commands = envelope(msg);
+        msg.format(submission->msg_str, false);
+    }
+    catch (...)
+    {
+        submission->error = std::current_exception();
+    }
+    return submission;
+}
+
+
+void smtp::initiate_submit(shared_ptr<submission_t> submission, function<void (exception_ptr, string)> handler)
+{
+    rejected_recipients_.clear();
+    if (submission->error)
+    {
+        post(*dlg_->io_context(), [exc = submission->error, handler]() { handler(exc, string()); });
+        return;
+    }
+    // the commands and the message share the ownership of the submission
+    shared_ptr<vector<envelope_command_t>> commands(submission, &submission->commands);
+    shared_ptr<string> msg_str(submission, &submission->msg_str);
+
+    handler = [this, handler](exception_ptr exc, string reply)
+    {
+        try
+        {
+            if (exc)
+                std::rethrow_exception(exc);
+        }
+        catch (const smtp_error&)
+        {
+            // The message is rejected, so the session is reset to be ready for the next one.
+            async_command("RSET", [exc, handler](exception_ptr, tuple<int, bool, string>)
+                {
+                    handler(exc, string());
+                });
+            return;
+        }
+        catch (...)
+        {
+        }
+        handler(exc, reply);
+    };
+
+    if (!pipelining_)
+    {
+        async_envelope(commands, make_shared<vector<tuple<int, bool, string>>>(), msg_str, handler);
+        return;
+    }
+
+    dlg_->async_send(pipeline(*commands), [this, commands, msg_str, handler](exception_ptr exc)
+        {
+            if (exc)
+                handler(exc, string());
+            else
+                async_pipelined_replies(commands, make_shared<vector<tuple<int, bool, string>>>(), msg_str, handler);
+        });
+}
+
+
+void smtp::async_envelope(shared_ptr<vector<envelope_command_t>> commands, shared_ptr<vector<tuple<int, bool, string>>> replies,
+    shared_ptr<string> msg_str, function<void (exception_ptr, string)> handler)
+{
+    // the recipients are not sent if the sender is rejected
+    if (replies->size() < commands->size() && (replies->empty() || positive_completion(std::get<0>(replies->front()))))
+    {
+        async_command(commands->at(replies->size()).command, [this, commands, replies, msg_str, handler](exception_ptr exc,
+            tuple<int, bool, string> tokens)
+            {
+                if (exc)
+                {
+                    handler(exc, string());
+                    return;
+                }
+                replies->push_back(tokens);
+                async_envelope(commands, replies, msg_str, handler);
+            });
+        return;
+    }
+
+    try
+    {
+        check_envelope(*commands, *replies);
+    }
+    catch (const smtp_error&)
+    {
+        handler(std::current_exception(), string());
+        return;
+    }
+    async_command("DATA", [this, msg_str, handler](exception_ptr exc, tuple<int, bool, string> tokens)
+        {
+            if (!exc && !positive_intermediate(std::get<0>(tokens)))
+                exc = make_exception_ptr(smtp_error("Mail message rejection."));
+            if (exc)
+                handler(exc, string());
+            else
+                async_data(msg_str, handler);
+        });
+}
+
+
+void smtp::async_pipelined_replies(shared_ptr<vector<envelope_command_t>> commands, shared_ptr<vector<tuple<int, bool, string>>> replies,
+    shared_ptr<string> msg_str, function<void (exception_ptr, string)> handler)
+{
+    async_receive_reply([this, commands, replies, msg_str, handler](exception_ptr exc, tuple<int, bool, string> tokens)
+        {
+            if (exc)
+            {
+                handler(exc, string());
+                return;
+            }
+            if (replies->size() < commands->size())
+            {
+                replies->push_back(tokens);
+                async_pipelined_replies(commands, replies, msg_str, handler);
+                return;
+            }
+
+            // The last reply is the one to the data command.
+            try
+            {
+                check_envelope(*commands, *replies);
+            }
+            catch (const smtp_error&)
+            {
+                exc = std::current_exception();
+            }
+            if (exc && positive_intermediate(std::get<0>(tokens)))
+            {
+                // The server should reject the data, but if it has not then the transaction is closed with no content.
+                async_command(codec::END_OF_MESSAGE, [exc, handler](exception_ptr, tuple<int, bool, string>)
+                    {
+                        handler(exc, string());
+                    });
+                return;
+            }
+
+            if (!exc && !positive_intermediate(std::get<0>(tokens)))
+                exc = make_exception_ptr(smtp_error("Mail message rejection."));
+            if (exc)
+                handler(exc, string());
+            else
+                async_data(msg_str, handler);
+        });
+}
+
+
+void smtp::async_data(shared_ptr<string> msg_str, function<void (exception_ptr, string)> handler)
+{
+    auto chunk = make_shared<string>();
+    // a character may be preceded by the escaping dot
+    chunk->reserve(data_streambuf::BUFFER_SIZE + 2);
+    async_data_chunk(msg_str, chunk, 0, true, handler);
+}
+
+
+void smtp::async_data_chunk(shared_ptr<string> msg_str, shared_ptr<string> chunk, string::size_type offset, bool line_start,
+    function<void (exception_ptr, string)> handler)
+{
+    // the message and the chunk are kept by the completion handler until the sending completes
+    chunk->clear();
+    offset += data_streambuf::stuff(msg_str->data() + offset, msg_str->size() - offset, *chunk, line_start);
+    if (offset < msg_str->size())
+    {
+        dlg_->async_send(vector<const_buffer>{buffer(*chunk)}, [this, msg_str, chunk, offset, line_start, handler](exception_ptr exc)
+            {
+                if (exc)
+                    handler(exc, string());
+                else
+                    async_data_chunk(msg_str, chunk, offset, line_start, handler);
+            });
+        return;
+    }
+
+    vector<const_buffer> buffers{buffer(*chunk), buffer(codec::END_OF_LINE), buffer(codec::END_OF_MESSAGE), buffer(codec::END_OF_LINE)};
+    dlg_->async_send(buffers, [this, msg_str, chunk, handler](exception_ptr exc)
+        {
+            if (exc)
+            {
+                handler(exc, string());
+                return;
+            }
+            async_receive_reply([handler](exception_ptr exc, tuple<int, bool, string> tokens)
+                {
+                    if (!exc && !positive_completion(std::get<0>(tokens)))
+                        exc = make_exception_ptr(smtp_error("Mail message rejection."));
+                    handler(exc, exc ? string() : std::get<2>(tokens));
+                });
+        });
+}
+
+
+void smtp::async_command(const string& command, function<void (exception_ptr, tuple<int, bool, string>)> handler)
+{
+    dlg_->async_send(command, [this, handler](exception_ptr exc)
+        {
+            if (exc)
+                handler(exc, tuple<int, bool, string>());
+            else
+                async_receive_reply(handler);
+        });
+}
+
+
+void smtp::async_receive_reply(function<void (exception_ptr, tuple<int, bool, string>)> handler)
+{
+    dlg_->async_receive(false, [this, handler](exception_ptr exc, string line)
+        {
+            tuple<int, bool, string> tokens;
+            if (!exc)
+            {
+                try
+                {
+                    tokens = parse_line(line);
+                }
+                catch (...)
+                {
+                    exc = std::current_exception();
+                }
+            }
+
+            if (!exc && !std::get<1>(tokens))
+                async_receive_reply(handler);
+            else
+                handler(exc, tokens);
+        });
+}
+
+
 string smtp::read_hostname()
 {
     try
@@ -299,7 +722,8 @@ inline bool smtp::permanent_negative(int status)
 }
 
 
-smtps::smtps(const string& hostname, unsigned port, milliseconds timeout) : smtp(hostname, port, timeout)
+smtps::smtps(const string& hostname, unsigned port, milliseconds timeout, shared_ptr<boost::asio::io_context> ios) :
+    smtp(hostname, port, timeout, ios)
 {
     ssl_options_ =
         {
@@ -19,10 +19,24 @@ copy at http://www.freebsd.org/copyright/freebsd-license.html.
 #include <utility>
 #include <list>
 #include <tuple>
+#include <vector>
+#include <filesystem>
+#include <exception>
+#include <atomic>
+#include <thread>
 #include <boost/test/unit_test.hpp>
+#include <boost/algorithm/string/join.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <mailio/mailboxes.hpp>
 #include <mailio/message.hpp>
+#include <mailio/mapped_text.hpp>
+#include <mailio/mbox.hpp>
+#include <mailio/batch_parser.hpp>
+#include <mailio/base64.hpp>
+#include <mailio/binary.hpp>
+#include <mailio/bit7.hpp>
+#include <mailio/bit8.hpp>
+#include <mailio/quoted_printable.hpp>
 
 
 using std::string;
@@ -44,6 +58,16 @@ using mailio::message;
 using mailio::mime_error;
 using mailio::message_error;
 using mailio::codec_error;
+using mailio::mapped_text;
+using mailio::mapped_text_error;
+using mailio::mbox;
+using mailio::batch_parser;
+using mailio::batch_parser_error;
+using mailio::base64;
+using mailio::binary;
+using mailio::bit7;
+using mailio::bit8;
+using mailio::quoted_printable;
 
 
 #ifdef __cpp_char8_t
@@ -53,6 +77,53 @@ using mailio::codec_error;
 #endif
 
 
+/**
+Chunk sizes which split the text at every position relative to the CRLF, the Base64 groups and the line policy.
+**/
+const std::vector<string::size_type> CHUNK_SIZES{1, 2, 3, 4, 5, 7, 13, 76, 77, 78, 1000};
+
+
+/**
+Encoding the text by feeding it to the codec encoder in chunks of the given size.
+
+@param cdc        Codec to encode with.
+@param text       Text to encode.
+@param chunk_size Size of the chunks.
+@return           Encoded lines.
+**/
+template<typename Codec>
+std::vector<string> encode_by_chunks(const Codec& cdc, const string& text, string::size_type chunk_size)
+{
+    std::vector<string> lines;
+    typename Codec::encoder_t encoder(cdc, [&lines](const string& line) { lines.push_back(line); });
+    for (string::size_type pos = 0; pos < text.length(); pos += chunk_size)
+        encoder.feed(text.substr(pos, chunk_size));
+    encoder.finish();
+    return lines;
+}
+
+
+/**
+Decoding the lines by the codec decoder, collecting the blocks passed to the sink.
+
+@param cdc    Codec to decode with.
+@param lines  Lines to decode.
+@param blocks Number of blocks passed to the sink.
+@return       Decoded text.
+**/
+template<typename Codec>
+string decode_by_lines(const Codec& cdc, const std::vector<string>& lines, std::size_t& blocks)
+{
+    string text;
+    blocks = 0;
+    typename Codec::decoder_t decoder(cdc, [&text, &blocks](const string& block) { text += block; blocks++; });
+    for (const auto& line : lines)
+        decoder.feed(line);
+    decoder.finish();
+    return text;
+}
+
+
 /**
 Verifying setters and getters for sender/reply/recipient addresses, message date, subject, content type, transfer encoding and short ASCII content.
 
@@ -163,8 +234,8 @@ BOOST_AUTO_TEST_CASE(format_other_headers)
     string msg_str;
     msg.format(msg_str);
 
-    BOOST_CHECK(msg_str == "Content-Language: en-US\r\n"
-        "User-Agent: mailio\r\n"
+    BOOST_CHECK(msg_str == "User-Agent: mailio\r\n"
+        "Content-Language: en-US\r\n"
         "From: mailio <adresa@mailio.dev>\r\n"
         "To: mailio <adresa@mailio.dev>\r\n"
         "Date: Fri, 17 Jan 2014 05:39:22 -0730\r\n"
@@ -2437,6 +2508,33 @@ BOOST_AUTO_TEST_CASE(parse_simple)
 }
 
 
+/**
+Parsing dates with the single digit day, the blanks of various lengths and the trailing comment, and the invalid dates.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(parse_date)
+{
+    auto parse_date = [](const string& date_str)
+    {
+        message msg;
+        msg.parse("From: mailio <adresa@mailio.dev>\r\nDate: " + date_str + "\r\n\r\nHello, World!\r\n");
+        return msg.date_time();
+    };
+
+    time_zone_ptr tz(new posix_time_zone("-07:30"));
+    local_date_time ldt(time_from_string("2014-01-17 13:09:22"), tz);
+    BOOST_CHECK(parse_date("Fri, 17 Jan 2014 05:39:22 -0730") == ldt);
+    BOOST_CHECK(parse_date("fri ,\t17  JAN 2014 05:39:22  -0730 (PST)") == ldt);
+    ldt = local_date_time(time_from_string("2014-01-07 13:09:22"), tz);
+    BOOST_CHECK(parse_date("Tue, 7 Jan 2014 05:39:22 -0730") == ldt);
+    BOOST_CHECK(parse_date("17 Jan 2014 05:39:22 -0730").is_not_a_date_time());
+    BOOST_CHECK_THROW(parse_date("Xyz, 17 Jan 2014 05:39:22 -0730"), message_error);
+    BOOST_CHECK_THROW(parse_date("Fri, 31 Feb 2014 05:39:22 -0730"), message_error);
+}
+
+
 /**
 Parsing custom headers.
 
@@ -2462,6 +2560,40 @@ BOOST_AUTO_TEST_CASE(parse_custom_header)
 }
 
 
+/**
+Parsing custom headers of the same name written in different cases, and the content type attributes in upper case.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(parse_custom_header_case)
+{
+    message msg;
+    msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+    string msg_str = "From: mail io <adre.sa@mailio.dev>\r\n"
+        "To: mailio <adre.sa@mailio.dev>\r\n"
+        "Subject: parse custom header case\r\n"
+        "X-Label: first\r\n"
+        "Date: Thu, 11 Feb 2016 22:56:22 +0000\r\n"
+        "User-Agent: mailio\r\n"
+        "x-label: second\r\n"
+        "Content-Type: text/plain; CHARSET=UTF-8\r\n"
+        "\r\n"
+        "Hello, world!\r\n";
+    msg.parse(msg_str);
+
+    auto headers = msg.headers();
+    BOOST_CHECK(headers.size() == 3 && headers.count("X-LABEL") == 2);
+    BOOST_CHECK(headers.find("x-Label")->second == "first");
+    BOOST_CHECK(headers.begin()->first == "X-Label" && (headers.end() - 1)->first == "x-label");
+    BOOST_CHECK(msg.content_type().charset == "utf-8");
+
+    msg.remove_header("X-LABEL");
+    headers = msg.headers();
+    BOOST_CHECK(headers.size() == 1 && headers.find("X-Label") == headers.end());
+}
+
+
 /**
 Parsing a header with a non-allowed character in it's name.
 
@@ -4187,6 +4319,266 @@ BOOST_AUTO_TEST_CASE(parse_multipart_content)
 }
 
 
+/**
+Parsing multipart message with the lazy decoding, so the contents are decoded on access.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(parse_multipart_lazy)
+{
+    message msg;
+    msg.line_policy(codec::line_len_policy_t::MANDATORY, codec::line_len_policy_t::MANDATORY);
+    msg.lazy_decoding(true);
+    string msg_str = "From: mailio <adresa@mailio.dev>\r\n"
+        "To: mailio <adresa@mailio.dev>\r\n"
+        "Date: Fri, 17 Jan 2014 05:39:22 -0730\r\n"
+        "MIME-Version: 1.0\r\n"
+        "Content-Type: multipart/related; boundary=\"my_bound\"\r\n"
+        "Subject: parse multipart lazy\r\n"
+        "\r\n"
+        "--my_bound\r\n"
+        "Content-Type: text/html\r\n"
+        "Content-Transfer-Encoding: Base64\r\n"
+        "\r\n"
+        "PGh0bWw+PGhlYWQ+PC9oZWFkPjxib2R5PjxoMT5IZWxsbywgV29ybGQhPC9oMT48L2JvZHk+PC9o\r\n"
+        "dG1sPg==\r\n"
+        "\r\n"
+        "--my_bound\r\n"
+        "Content-Type: text/plain; charset=utf-8\r\n"
+        "Content-Transfer-Encoding: Quoted-Printable\r\n"
+        "\r\n"
+        "=D0=97=D0=B4=D1=80=D0=B0=D0=B2=D0=BE, =D0=A1=D0=B2=D0=B5=D1=82=D0=B5!\r\n"
+        "\r\n"
+        "--my_bound--\r\n";
+    msg.parse(msg_str);
+    msg_str.clear();
+
+    BOOST_CHECK(msg.subject() == "parse multipart lazy" && msg.boundary() == "my_bound" && msg.parts().size() == 2 &&
+        msg.parts().at(0).lazy_decoding() && msg.parts().at(1).lazy_decoding());
+    BOOST_CHECK(msg.parts().at(0).content_transfer_encoding() == mime::content_transfer_encoding_t::BASE_64 &&
+        msg.parts().at(0).content() == "<html><head></head><body><h1>Hello, World!</h1></body></html>");
+    BOOST_CHECK(msg.parts().at(1).content_transfer_encoding() == mime::content_transfer_encoding_t::QUOTED_PRINTABLE &&
+        msg.parts().at(1).content() == "Здраво, Свете!");
+}
+
+
+/**
+Parsing a message with the bad Base64 content and the lazy decoding, so the failure is reported on access.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(parse_lazy_bad_content)
+{
+    message msg;
+    msg.lazy_decoding(true);
+    string msg_str = "From: mailio <adresa@mailio.dev>\r\n"
+        "To: mailio <adresa@mailio.dev>\r\n"
+        "Subject: parse lazy bad content\r\n"
+        "Content-Transfer-Encoding: Base64\r\n"
+        "\r\n"
+        "PGh0bWw+PGhlYWQ+PC9oZWFkPjxib2R5PjxoMT5I?ZWxsbywgV29ybGQhPC9oMT48L2JvZHk+PC9o\r\n";
+    msg.parse(msg_str);
+
+    BOOST_CHECK(msg.subject() == "parse lazy bad content");
+    BOOST_CHECK_THROW(msg.content(), codec_error);
+}
+
+
+/**
+Reading the content of a message parsed with the lazy decoding by several threads at once, so it is decoded once under the lock.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(parse_lazy_concurrent)
+{
+    message msg;
+    msg.lazy_decoding(true);
+    const string text(100000, 'x');
+    const std::vector<string> lines = base64(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED).encode(text);
+    msg.parse("From: mailio <adresa@mailio.dev>\r\n"
+        "Subject: parse lazy concurrent\r\n"
+        "Content-Transfer-Encoding: Base64\r\n"
+        "\r\n" + boost::algorithm::join(lines, "\r\n") + "\r\n");
+    const message& shared_msg = msg;
+
+    std::atomic<bool> started(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 4; reader++)
+        readers.emplace_back([&shared_msg, &text, &started, &failures]()
+            {
+                while (!started)
+                    std::this_thread::yield();
+                if (shared_msg.content() != text)
+                    failures++;
+            });
+    started = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    BOOST_CHECK(failures == 0);
+}
+
+
+/**
+Parsing a message from a mapped file with LF line endings and the lazy decoding, so the content is decoded from the mapping.
+
+@pre  None.
+@post Created file `mapped.eml`.
+**/
+BOOST_AUTO_TEST_CASE(parse_mapped)
+{
+    {
+        ofstream ofs("mapped.eml", std::ios::binary);
+        ofs << "From: mailio <adresa@mailio.dev>\n"
+            "To: mailio <adresa@mailio.dev>\n"
+            "Subject: parse mapped\n"
+            "Content-Type: text/plain; charset=utf-8\n"
+            "Content-Transfer-Encoding: Quoted-Printable\n"
+            "\n"
+            "=D0=97=D0=B4=D1=80=D0=B0=D0=B2=D0=BE, =D0=A1=D0=B2=D0=B5=D1=82=D0=B5!\r\n"
+            "Hello, World!\n";
+    }
+
+    message msg;
+    msg.lazy_decoding(true);
+    msg.parse(mapped_text("mapped.eml"));
+
+    BOOST_CHECK(msg.subject() == "parse mapped" && msg.content_transfer_encoding() == mime::content_transfer_encoding_t::QUOTED_PRINTABLE);
+    BOOST_CHECK(msg.content() == "Здраво, Свете!\r\nHello, World!");
+    BOOST_CHECK_THROW(mapped_text("no_such_file.eml"), mapped_text_error);
+}
+
+
+/**
+Iterating the messages of a mapped mbox archive.
+
+@pre  None.
+@post Created file `mapped.mbox`.
+**/
+BOOST_AUTO_TEST_CASE(parse_mbox)
+{
+    {
+        ofstream ofs("mapped.mbox", std::ios::binary);
+        ofs << "From adresa@mailio.dev Fri Jan 17 05:39:22 2014\n"
+            "From: mailio <adresa@mailio.dev>\n"
+            "Subject: first\n"
+            "\n"
+            "Hello, World!\n"
+            ">From the first message.\n"
+            "\n"
+            "From adresa@mailio.dev Fri Jan 17 05:40:22 2014\n"
+            "From: mailio <adresa@mailio.dev>\n"
+            "Subject: second\n"
+            "Content-Transfer-Encoding: Base64\n"
+            "\n"
+            "SGVsbG8sIFdvcmxkIQ==\n"
+            "\n";
+    }
+
+    mbox archive("mapped.mbox");
+    message msg1;
+    BOOST_CHECK(archive.next(msg1));
+    BOOST_CHECK(msg1.subject() == "first" && msg1.content() == "Hello, World!\r\n>From the first message.");
+    message msg2;
+    msg2.lazy_decoding(true);
+    BOOST_CHECK(archive.next(msg2));
+    BOOST_CHECK(msg2.subject() == "second" && msg2.content() == "Hello, World!");
+    message msg3;
+    BOOST_CHECK(!archive.next(msg3));
+
+    mapped_text empty_text;
+    BOOST_CHECK(!mbox(empty_text).next(msg3));
+}
+
+
+/**
+Parsing the messages of an mbox archive in parallel, delivered in order and out of order.
+
+@pre  None.
+@post Created file `batch.mbox`.
+**/
+BOOST_AUTO_TEST_CASE(parse_batch_mbox)
+{
+    const std::size_t MESSAGES = 100;
+    {
+        ofstream ofs("batch.mbox", std::ios::binary);
+        for (std::size_t i = 0; i < MESSAGES; i++)
+        {
+            ofs << "From adresa@mailio.dev Fri Jan 17 05:39:22 2014\n";
+            if (i % 10 != 9)
+                ofs << "From: mailio <adresa@mailio.dev>\n";
+            ofs << "Subject: message " << i << "\n\nHello, World!\n\n";
+        }
+    }
+
+    message prototype;
+    prototype.lazy_decoding(true);
+    batch_parser parser(4);
+    parser.prototype(prototype);
+
+    std::vector<std::size_t> indexes;
+    std::size_t failures = 0;
+    auto ordered_stat = parser.parse_mbox("batch.mbox", [&](std::size_t index, message& msg, std::exception_ptr error)
+        {
+            indexes.push_back(index);
+            if (error != nullptr)
+                failures++;
+            else if (msg.subject() != "message " + std::to_string(index) || msg.content() != "Hello, World!")
+                failures += MESSAGES;
+        });
+    BOOST_CHECK(ordered_stat.messages == MESSAGES && ordered_stat.failures == MESSAGES / 10 && failures == MESSAGES / 10);
+    BOOST_CHECK(ordered_stat.workers.size() == 4);
+    bool in_order = indexes.size() == MESSAGES;
+    for (std::size_t i = 0; in_order && i < MESSAGES; i++)
+        in_order = indexes[i] == i;
+    BOOST_CHECK(in_order);
+
+    std::atomic<std::size_t> delivered{0};
+    auto unordered_stat = parser.parse_mbox("batch.mbox", [&delivered](std::size_t, message&, std::exception_ptr)
+        {
+            delivered++;
+        }, batch_parser::delivery_t::UNORDERED);
+    BOOST_CHECK(delivered == MESSAGES && unordered_stat.bytes == ordered_stat.bytes);
+
+    BOOST_CHECK_THROW(parser.parse_mbox("batch.mbox", [](std::size_t, message&, std::exception_ptr)
+        {
+            throw std::runtime_error("stop");
+        }), std::runtime_error);
+}
+
+
+/**
+Parsing the messages of a Maildir directory in parallel.
+
+@pre  None.
+@post Created directory `batch_maildir`.
+**/
+BOOST_AUTO_TEST_CASE(parse_batch_maildir)
+{
+    std::filesystem::remove_all("batch_maildir");
+    std::filesystem::create_directories("batch_maildir/cur");
+    std::filesystem::create_directories("batch_maildir/new");
+    for (int i = 0; i < 3; i++)
+    {
+        ofstream ofs((i < 2 ? "batch_maildir/cur/" : "batch_maildir/new/") + std::to_string(i), std::ios::binary);
+        ofs << "From: mailio <adresa@mailio.dev>\r\nSubject: message " << i << "\r\n\r\nHello, World!\r\n";
+    }
+
+    batch_parser parser(2);
+    std::vector<string> subjects;
+    auto stat = parser.parse_maildir("batch_maildir", [&subjects](std::size_t, message& msg, std::exception_ptr)
+        {
+            subjects.push_back(msg.subject());
+        });
+    BOOST_CHECK(stat.messages == 3 && stat.failures == 0 && subjects == std::vector<string>({"message 0", "message 1", "message 2"}));
+    BOOST_CHECK_THROW(parser.parse_maildir("batch_maildir/cur", [](std::size_t, message&, std::exception_ptr) {}), batch_parser_error);
+}
+
+
 /**
 Parsing attachments of a message.
 
@@ -5205,3 +5597,117 @@ BOOST_AUTO_TEST_CASE(object_copying)
         BOOST_CHECK(msg1_str == msg3_str);
     }
 }
+
+
+/**
+Encoding the same text in chunks of different sizes by the streaming encoders, and comparing the lines to the ones of the whole text.
+
+The text has the CRLF split among the chunks, empty lines, trailing whitespace and lines longer than the policy.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(encode_by_chunks_all_codecs)
+{
+    const string ascii_text = "first line\r\n\r\n\r\ntrailing spaces   \r\n" + string(200, 'a') + "=" + string(150, 'b') + "\r\n.dot\r\n\r\n\r\nlast";
+    const string text = ascii_text + "\r\n\xC3\xA9\xC3\xA8 " + string(100, '\xC3') + "\r\n\r\n";
+    const auto policy = codec::line_len_policy_t::RECOMMENDED;
+
+    bit7 b7(policy, policy);
+    bit8 b8(policy, policy);
+    binary bin(policy, policy);
+    quoted_printable qp(policy, policy);
+    base64 b64(policy, policy);
+    const auto b7_lines = b7.encode(ascii_text);
+    const auto b8_lines = b8.encode(text);
+    const auto bin_lines = bin.encode(text);
+    const auto qp_lines = qp.encode(text);
+    const auto b64_lines = b64.encode(text);
+    for (auto chunk_size : CHUNK_SIZES)
+    {
+        BOOST_TEST_CONTEXT("chunk size " << chunk_size)
+        {
+            BOOST_CHECK(encode_by_chunks(b7, ascii_text, chunk_size) == b7_lines);
+            BOOST_CHECK(encode_by_chunks(b8, text, chunk_size) == b8_lines);
+            // the binary text is not split into lines, so the chunks are passed unchanged
+            BOOST_CHECK(boost::algorithm::join(encode_by_chunks(bin, text, chunk_size), "") == boost::algorithm::join(bin_lines, ""));
+            BOOST_CHECK(encode_by_chunks(qp, text, chunk_size) == qp_lines);
+            BOOST_CHECK(encode_by_chunks(b64, text, chunk_size) == b64_lines);
+        }
+    }
+
+    // the soft breaks of the long line fall on the chunk boundaries of the sizes around the line policy
+    BOOST_CHECK(qp_lines.size() > 8 && qp_lines[4].back() == '=');
+    BOOST_CHECK(qp.decode(qp_lines) == text.substr(0, text.find_last_not_of("\r\n") + 1));
+    BOOST_CHECK(b64.decode(b64_lines) == text);
+}
+
+
+/**
+Decoding a text larger than the decoder buffer of 64KiB, so the decoded text is passed to the sink in several blocks.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(decode_by_blocks_base64_qp)
+{
+    string text;
+    for (unsigned i = 0; text.length() < 200000; i++)
+        text += "line " + std::to_string(i) + string(i % 7, ' ') + "\r\n" + string(i % 3 == 0 ? 1 : 0, '\xC3');
+    text += "end";
+
+    base64 b64(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    std::size_t blocks = 0;
+    BOOST_CHECK(decode_by_lines(b64, b64.encode(text), blocks) == text);
+    BOOST_CHECK(blocks > 1 && blocks < 10);
+
+    // the whitespace before a block boundary is kept for the next block, and only the trailing one is dropped at the end
+    quoted_printable qp(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+    BOOST_CHECK(decode_by_lines(qp, qp.encode(text), blocks) == text);
+    BOOST_CHECK(blocks > 1 && blocks < 10);
+    BOOST_CHECK(decode_by_lines(qp, qp.encode(text + "  \r\n\r\n"), blocks) == text);
+}
+
+
+/**
+Encoding to a string by Base64 and quoted printable codecs, with the reserved characters and in the Q codec mode, and comparing it to the
+encoded lines joined by CRLF.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(encode_to_string_base64_qp)
+{
+    const string text = "Hello, World? a=b\r\n" + string(150, 'x') + "\xC3\xA9 \r\n\r\nend";
+    auto join_lines = [](const std::vector<string>& lines)
+    {
+        string joined = "prefix";
+        for (const auto& line : lines)
+            joined += line + codec::END_OF_LINE;
+        return joined;
+    };
+
+    for (string::size_type reserved : {0, 20})
+    {
+        BOOST_TEST_CONTEXT("reserved " << reserved)
+        {
+            base64 b64(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+            string b64_text = "prefix";
+            b64.encode(text, b64_text, reserved);
+            BOOST_CHECK(b64_text == join_lines(b64.encode(text, reserved)));
+
+            quoted_printable qp(codec::line_len_policy_t::RECOMMENDED, codec::line_len_policy_t::RECOMMENDED);
+            string qp_text = "prefix";
+            qp.encode(text, qp_text, reserved);
+            BOOST_CHECK(qp_text == join_lines(qp.encode(text, reserved)));
+
+            // the Q codec encodes a header, so the text is without line endings
+            const string header_text = "Hello, World? a=b \xC3\xA9" + string(150, 'x');
+            qp.q_codec_mode(true);
+            string q_text = "prefix";
+            qp.encode(header_text, q_text, reserved);
+            BOOST_CHECK(q_text == join_lines(qp.encode(header_text, reserved)));
+            BOOST_CHECK(q_text.find("=3F") != string::npos);
+        }
+    }
+}
@@ -0,0 +1,904 @@
+/*
+
+test_protocol.cpp
+-----------------
+
+Copyright (C) 2016, Tomislav Karastojkovic (http://www.alepho.com).
+
+Distributed under the FreeBSD license, see the accompanying file LICENSE or
+copy at http://www.freebsd.org/copyright/freebsd-license.html.
+
+*/
+
+
+#define BOOST_TEST_MODULE protocol_test
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <list>
+#include <map>
+#include <string>
+#include <thread>
+#include <boost/asio/use_future.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <mailio/mime.hpp>
+#include <mailio/message.hpp>
+#include <mailio/smtp.hpp>
+#include <mailio/pop3.hpp>
+#include <mailio/imap.hpp>
+#include <mailio/session_pool.hpp>
+#include "mock_server.hpp"
+
+
+using std::exception_ptr;
+using std::future;
+using std::list;
+using std::make_shared;
+using std::make_unique;
+using std::map;
+using std::string;
+using std::to_string;
+using std::vector;
+using std::count_if;
+using std::chrono::milliseconds;
+using std::thread;
+using std::this_thread::sleep_for;
+using boost::asio::use_future;
+using boost::posix_time::hours;
+using boost::posix_time::time_from_string;
+using mailio::mime;
+using mailio::message;
+using mailio::mail_address;
+using mailio::smtp;
+using mailio::smtp_error;
+using mailio::pop3;
+using mailio::pop3_error;
+using mailio::codec;
+using mailio::imap;
+using mailio::imaps;
+using mailio::imap_error;
+using mailio::dialog_ssl;
+using mailio::session_pool;
+using mailio::pool_error;
+using mailio::mock_smtp;
+using mailio::mock_pop3;
+using mailio::mock_imap;
+
+
+typedef session_pool<imaps> imaps_pool;
+
+
+/**
+Body structure of a message with a text part, an attachment and an attached message whose body is multipart, with the extension data.
+**/
+const string BODY_STRUCTURE = "BODYSTRUCTURE ("
+    "(\"TEXT\" \"PLAIN\" (\"CHARSET\" \"US-ASCII\") NIL NIL \"7BIT\" 1152 23)"
+    "(\"APPLICATION\" \"OCTET-STREAM\" (\"NAME\" \"cc.diff\") \"<960723163407.20117h@cac.washington.edu>\" \"Compiler diff\" \"BASE64\" 4554)"
+    "(\"MESSAGE\" \"RFC822\" NIL NIL NIL \"7BIT\" 342 (NIL \"inner\" NIL NIL NIL NIL NIL NIL NIL NIL) "
+    "((\"TEXT\" \"PLAIN\" NIL NIL NIL \"7BIT\" 10 1)"
+    "(\"APPLICATION\" \"PDF\" (\"NAME\" \"a.pdf\") NIL NIL \"BASE64\" 100 NIL (\"ATTACHMENT\" (\"FILENAME\" \"a.pdf\")) NIL) \"MIXED\" (\"BOUNDARY\" \"in\") NIL NIL) 10) "
+    "\"MIXED\" (\"BOUNDARY\" \"xyz\") NIL NIL)";
+
+
+/**
+Making the reply to a fetch of a section, with the content as a literal.
+
+@param section Section item like `BODY[1]` or `BODY[1]<0>`.
+@param content Content of the section.
+@return        Reply lines to script.
+**/
+vector<string> section_reply(const string& section, const string& content)
+{
+    return {"* 1 FETCH (UID 7 " + section + " {" + to_string(content.length()) + "}", content + ")", "$TAG OK FETCH completed"};
+}
+
+
+/**
+Making a message whose lines start with a dot, long enough to be sent in several chunks of the data buffer.
+
+The lines are of different lengths, so the chunk boundaries fall on various places of the lines, including their starts.
+
+@param body Lines of the message body joined by CRLF.
+@return     Message to send.
+**/
+message dotted_message(string& body)
+{
+    body.clear();
+    for (int i = 0; i < 40000; i++)
+        body += "." + string(i % 7, 'a') + "\r\n";
+    body += ".";
+    message msg;
+    msg.from(mail_address("mailio", "adresa@mailio.dev"));
+    msg.add_recipient(mail_address("mailio", "adresa@mailio.dev"));
+    msg.subject("Dots");
+    msg.content(body);
+    return msg;
+}
+
+
+/**
+Making a message to two recipients.
+
+@return Message to send.
+**/
+message two_recipients_message()
+{
+    message msg;
+    msg.from(mail_address("mailio", "adresa@mailio.dev"));
+    msg.add_recipient(mail_address("first", "first@mailio.dev"));
+    msg.add_recipient(mail_address("second", "second@mailio.dev"));
+    msg.subject("Recipients");
+    msg.content("Hello, World!");
+    return msg;
+}
+
+
+/**
+Making the mock SMTP server advertise the command pipelining or not.
+
+@param srv        Server to script.
+@param pipelining Flag if the server advertises the command pipelining.
+**/
+void script_pipelining(mock_smtp& srv, bool pipelining)
+{
+    if (!pipelining)
+        srv.script("EHLO", {"250-localhost\r\n250 AUTH LOGIN"});
+}
+
+
+/**
+Counting the received SMTP commands of the given verb.
+
+@param srv  Server which received the commands.
+@param verb Command verb.
+@return     Number of the commands.
+**/
+long count_smtp_commands(const mock_smtp& srv, const string& verb)
+{
+    const auto commands = srv.commands();
+    return count_if(commands.begin(), commands.end(), [&verb](const string& command) { return command.compare(0, verb.length(), verb) == 0; });
+}
+
+
+/**
+Making the parameters of a session to the mock server.
+
+@param srv      Mock server to connect to.
+@param username Username to authenticate.
+@return         Session parameters.
+**/
+imaps_pool::session_params_t pool_params(const mock_imap& srv, const string& username = "mailio")
+{
+    return {"127.0.0.1", srv.port(), username, "mailiopass", imaps::auth_method_t::LOGIN,
+        dialog_ssl::ssl_options_t{boost::asio::ssl::context::sslv23, boost::asio::ssl::verify_none}};
+}
+
+
+/**
+Counting the received commands with the given verb.
+
+@param srv  Mock server which received the commands.
+@param verb Command verb.
+@return     Number of the commands.
+**/
+long count_commands(const mock_imap& srv, const string& verb)
+{
+    const auto commands = srv.commands();
+    return count_if(commands.begin(), commands.end(), [&verb](const string& command) { return command.find(" " + verb) != string::npos; });
+}
+
+
+/**
+Opening a connection to the mock server and selecting its mailbox.
+
+@param conn Connection to the mock server.
+**/
+void select_inbox(imap& conn)
+{
+    conn.authenticate("mailio", "mailiopass", imap::auth_method_t::LOGIN);
+    conn.select("INBOX");
+}
+
+
+/**
+Fetching the body structure of nested multipart parts, and numbering their sections.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_info_body_structure)
+{
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 1 FETCH (UID 7 " + BODY_STRUCTURE + ")", "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port());
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(1, 1)}, imap::message_info_t::BODY_STRUCTURE, infos);
+
+    BOOST_REQUIRE(infos.size() == 1 && infos.count(1) == 1);
+    const imap::body_structure_t& body = infos[1].body_structure;
+    BOOST_CHECK(infos[1].uid == 7);
+    BOOST_CHECK(body.section == "TEXT" && body.media_type == "multipart" && body.media_subtype == "mixed" && body.size == 0);
+    BOOST_CHECK(body.parameters.find("boundary")->second == "xyz");
+    BOOST_REQUIRE(body.parts.size() == 3);
+
+    const imap::body_structure_t& text = body.parts[0];
+    BOOST_CHECK(text.section == "1" && text.media_type == "text" && text.media_subtype == "plain" && text.encoding == "7bit");
+    BOOST_CHECK(text.parameters.find("charset")->second == "US-ASCII");
+    BOOST_CHECK(text.id.empty() && text.description.empty() && text.disposition.empty());
+    BOOST_CHECK(text.size == 1152 && text.lines == 23);
+
+    const imap::body_structure_t& diff = body.parts[1];
+    BOOST_CHECK(diff.section == "2" && diff.media_type == "application" && diff.media_subtype == "octet-stream" && diff.encoding == "base64");
+    BOOST_CHECK(diff.id == "<960723163407.20117h@cac.washington.edu>" && diff.description == "Compiler diff");
+    BOOST_CHECK(diff.size == 4554 && diff.lines == 0);
+
+    const imap::body_structure_t& attached = body.parts[2];
+    BOOST_CHECK(attached.section == "3" && attached.media_type == "message" && attached.media_subtype == "rfc822");
+    BOOST_CHECK(attached.parameters.empty() && attached.size == 342 && attached.lines == 10);
+    BOOST_REQUIRE(attached.parts.size() == 1);
+    const imap::body_structure_t& inner = attached.parts[0];
+    BOOST_CHECK(inner.section == "3.TEXT" && inner.media_type == "multipart" && inner.media_subtype == "mixed");
+    BOOST_CHECK(inner.parameters.find("boundary")->second == "in");
+    BOOST_REQUIRE(inner.parts.size() == 2);
+    BOOST_CHECK(inner.parts[0].section == "3.1" && inner.parts[0].media_type == "text" && inner.parts[0].parameters.empty());
+    BOOST_CHECK(inner.parts[0].size == 10 && inner.parts[0].lines == 1);
+    BOOST_CHECK(inner.parts[1].section == "3.2" && inner.parts[1].media_subtype == "pdf" && inner.parts[1].disposition == "attachment");
+    BOOST_CHECK(inner.parts[1].disposition_parameters.find("filename")->second == "a.pdf");
+}
+
+
+/**
+Fetching the envelope with an address group and the NIL fields, a literal subject, the flags, the size and the internal date.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_info_envelope)
+{
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 2 FETCH (UID 9 FLAGS (\\Seen \\Answered) RFC822.SIZE 4286 INTERNALDATE \"17-Jul-1996 02:44:25 -0700\" "
+        "ENVELOPE (\"Wed, 17 Jul 1996 02:23:25 -0700 (PDT)\" {16}",
+        "IMAP4rev1 WG mtg ((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) ((\"Terry Gray\" NIL \"gray\" \"cac.washington.edu\")) NIL "
+        "((NIL NIL \"team\" NIL)(NIL NIL \"a\" \"b.com\")(NIL NIL NIL NIL)(\"Bob\" NIL \"bob\" \"c.com\")) NIL NIL NIL "
+        "\"<B27397-0100000@cac.washington.edu>\"))",
+        "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port());
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(2, 2)}, imap::message_info_t::ENVELOPE | imap::message_info_t::FLAGS | imap::message_info_t::SIZE |
+        imap::message_info_t::INTERNAL_DATE, infos);
+
+    BOOST_REQUIRE(infos.size() == 1 && infos.count(2) == 1);
+    const imap::message_info_t& info = infos[2];
+    BOOST_CHECK(info.uid == 9 && info.size == 4286);
+    BOOST_CHECK(info.flags == list<string>({"\\Seen", "\\Answered"}));
+    BOOST_CHECK(info.internal_date.utc_time() == time_from_string("1996-07-17 09:44:25"));
+    BOOST_CHECK(info.internal_date.zone()->base_utc_offset() == hours(-7));
+
+    const imap::envelope_t& env = info.envelope;
+    BOOST_CHECK(env.date == "Wed, 17 Jul 1996 02:23:25 -0700 (PDT)");
+    BOOST_CHECK(env.subject.buffer == "IMAP4rev1 WG mtg");
+    BOOST_REQUIRE(env.from.addresses.size() == 1 && env.sender.addresses.size() == 1);
+    BOOST_CHECK(env.from.addresses[0].name.buffer == "Terry Gray" && env.from.addresses[0].address == "gray@cac.washington.edu");
+    BOOST_CHECK(env.reply_to.addresses.empty() && env.reply_to.groups.empty());
+    BOOST_REQUIRE(env.to.groups.size() == 1 && env.to.addresses.size() == 1);
+    BOOST_CHECK(env.to.groups[0].name == "team");
+    BOOST_REQUIRE(env.to.groups[0].members.size() == 1);
+    BOOST_CHECK(env.to.groups[0].members[0].name.buffer.empty() && env.to.groups[0].members[0].address == "a@b.com");
+    BOOST_CHECK(env.to.addresses[0].name.buffer == "Bob" && env.to.addresses[0].address == "bob@c.com");
+    BOOST_CHECK(env.cc.addresses.empty() && env.bcc.addresses.empty());
+    BOOST_CHECK(env.in_reply_to.empty() && env.message_id == "<B27397-0100000@cac.washington.edu>");
+}
+
+
+/**
+Fetching the envelope with two literals in the same response, the second one shorter than the first.
+
+The network timeout makes the test fail instead of waiting forever, if the second literal is not read as it should.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_info_two_literals)
+{
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 1 FETCH (UID 7 ENVELOPE (NIL {16}",
+        "IMAP4rev1 WG mtg (({3}",
+        "Bob NIL \"bob\" \"c.com\")) NIL NIL NIL NIL NIL NIL NIL))",
+        "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port(), milliseconds(2000));
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(1, 1)}, imap::message_info_t::ENVELOPE, infos);
+
+    BOOST_REQUIRE(infos.count(1) == 1);
+    const imap::envelope_t& env = infos[1].envelope;
+    BOOST_CHECK(env.subject.buffer == "IMAP4rev1 WG mtg");
+    BOOST_REQUIRE(env.from.addresses.size() == 1);
+    BOOST_CHECK(env.from.addresses[0].name.buffer == "Bob" && env.from.addresses[0].address == "bob@c.com");
+}
+
+
+/**
+Fetching the envelopes and the body structures of two messages, with the strings sent as literals of various sizes, including the empty ones.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_info_literals)
+{
+    auto literal = [](const string& text) { return "{" + to_string(text.length()) + "}\r\n" + text; };
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 1 FETCH (UID 7 ENVELOPE (" + literal("Wed, 17 Jul 1996 02:23:25 -0700") + " " + literal("IMAP4rev1 WG mtg") + " ((" +
+        literal("Terry Gray") + " NIL \"gray\" \"cac.washington.edu\")) NIL NIL ((NIL NIL " + literal("team") + " NIL)(" + literal("") +
+        " NIL \"a\" \"b.com\")(NIL NIL NIL NIL)) NIL NIL NIL " + literal("<B27397@cac.washington.edu>") + ") BODYSTRUCTURE (\"TEXT\" \"PLAIN\" "
+        "(\"CHARSET\" " + literal("UTF-8") + " \"NAME\" " + literal("weekly report.txt") + ") NIL " + literal("") + " \"7BIT\" 10 1))",
+        "* 2 FETCH (UID 8 ENVELOPE (NIL " + literal("x") + " NIL NIL NIL NIL NIL NIL NIL NIL) BODYSTRUCTURE (\"TEXT\" \"PLAIN\" NIL NIL NIL "
+        "\"7BIT\" 0 0))",
+        "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port(), milliseconds(2000));
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(7, 8)}, imap::message_info_t::ENVELOPE | imap::message_info_t::BODY_STRUCTURE, infos, true);
+
+    BOOST_REQUIRE(infos.size() == 2 && infos.count(7) == 1 && infos.count(8) == 1);
+    const imap::envelope_t& env = infos[7].envelope;
+    BOOST_CHECK(env.date == "Wed, 17 Jul 1996 02:23:25 -0700" && env.subject.buffer == "IMAP4rev1 WG mtg");
+    BOOST_REQUIRE(env.from.addresses.size() == 1);
+    BOOST_CHECK(env.from.addresses[0].name.buffer == "Terry Gray" && env.from.addresses[0].address == "gray@cac.washington.edu");
+    BOOST_REQUIRE(env.to.groups.size() == 1 && env.to.groups[0].members.size() == 1);
+    BOOST_CHECK(env.to.groups[0].name == "team");
+    BOOST_CHECK(env.to.groups[0].members[0].name.buffer.empty() && env.to.groups[0].members[0].address == "a@b.com");
+    BOOST_CHECK(env.message_id == "<B27397@cac.washington.edu>");
+    const imap::body_structure_t& body = infos[7].body_structure;
+    BOOST_CHECK(body.parameters.find("charset")->second == "UTF-8" && body.parameters.find("name")->second == "weekly report.txt");
+    BOOST_CHECK(body.description.empty() && body.encoding == "7bit" && body.size == 10 && body.lines == 1);
+
+    BOOST_CHECK(infos[8].envelope.subject.buffer == "x" && infos[8].envelope.from.addresses.empty());
+    BOOST_CHECK(infos[8].body_structure.media_type == "text" && infos[8].body_structure.size == 0);
+}
+
+
+/**
+Ignoring the unsolicited fetch responses without UID while fetching by UIDs, like the flags updated by another session.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_info_unsolicited)
+{
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 3 FETCH (FLAGS (\\Seen))", "* 1 FETCH (UID 7 RFC822.SIZE 100)", "* 4 EXISTS", "* 2 FETCH (FLAGS (\\Deleted) UID 8 RFC822.SIZE 200)",
+        "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port());
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(7, 8)}, imap::message_info_t::SIZE, infos, true);
+
+    BOOST_REQUIRE(infos.size() == 2 && infos.count(7) == 1 && infos.count(8) == 1);
+    BOOST_CHECK(infos[7].size == 100 && infos[8].size == 200);
+    BOOST_CHECK(infos[8].flags == list<string>({"\\Deleted"}));
+}
+
+
+/**
+Fetching the multipart body of the message and of the attached message by their text sections, and a part of the attached message by its
+number.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_part_sections)
+{
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 1 FETCH (UID 7 " + BODY_STRUCTURE + ")", "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port());
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(1, 1)}, imap::message_info_t::BODY_STRUCTURE, infos);
+    const imap::body_structure_t& body = infos[1].body_structure;
+
+    srv.script("FETCH", section_reply("BODY[TEXT]", "--xyz\r\nContent-Type: text/plain\r\n\r\nHello\r\n--xyz\r\n"
+        "Content-Type: application/octet-stream\r\nContent-Transfer-Encoding: base64\r\n\r\nSGVsbG8gd29ybGQh\r\n--xyz--\r\n"));
+    mime text;
+    conn.fetch_part(1, body, text);
+    BOOST_CHECK(srv.commands().back().find(" FETCH 1 BODY.PEEK[TEXT]") != string::npos);
+    BOOST_REQUIRE(text.parts().size() == 2);
+    BOOST_CHECK(text.parts()[0].content() == "Hello");
+    BOOST_CHECK(text.parts()[1].content() == "Hello world!");
+
+    srv.script("FETCH", section_reply("BODY[3.TEXT]", "--in\r\nContent-Type: text/plain\r\n\r\nInner\r\n--in--\r\n"));
+    mime inner;
+    conn.fetch_part(1, body.parts[2].parts[0], inner);
+    BOOST_CHECK(srv.commands().back().find(" FETCH 1 BODY.PEEK[3.TEXT]") != string::npos);
+    BOOST_REQUIRE(inner.parts().size() == 1);
+    BOOST_CHECK(inner.parts()[0].content() == "Inner");
+
+    srv.script("FETCH", section_reply("BODY[3.2]", "SGVsbG8gd29ybGQh\r\n"));
+    mime pdf;
+    conn.fetch_part(7, body.parts[2].parts[0].parts[1], pdf, true);
+    BOOST_CHECK(srv.commands().back().find(" UID FETCH 7 BODY.PEEK[3.2]") != string::npos);
+    BOOST_CHECK(pdf.content_type().type == mime::media_type_t::APPLICATION && pdf.content_type().subtype == "pdf");
+    BOOST_CHECK(pdf.content_disposition() == mime::content_disposition_t::ATTACHMENT);
+    BOOST_CHECK(pdf.content() == "Hello world!");
+}
+
+
+/**
+Fetching the beginning of the parts, which is cut to the last complete line before decoding, unless the whole part fits.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(fetch_part_partial)
+{
+    mock_imap srv(false, {});
+    srv.script("FETCH", {"* 1 FETCH (UID 7 " + BODY_STRUCTURE + ")", "$TAG OK FETCH completed"});
+    imap conn("127.0.0.1", srv.port());
+    select_inbox(conn);
+    map<unsigned long, imap::message_info_t> infos;
+    conn.fetch_info({imap::messages_range_t(1, 1)}, imap::message_info_t::BODY_STRUCTURE, infos);
+    const imap::body_structure_t& body = infos[1].body_structure;
+
+    srv.script("FETCH", section_reply("BODY[1]<0>", "first line\r\nsecond line\r\nthi"));
+    mime text;
+    conn.fetch_part(1, body.parts[0], text, false, 0, 28);
+    BOOST_CHECK(srv.commands().back().find(" FETCH 1 BODY.PEEK[1]<0.28>") != string::npos);
+    BOOST_CHECK(text.content() == "first line\r\nsecond line");
+
+    srv.script("FETCH", section_reply("BODY[2]<0>", "SGVsbG8gd29y\r\nbGQh"));
+    mime diff;
+    conn.fetch_part(1, body.parts[1], diff, false, 0, 18);
+    BOOST_CHECK(srv.commands().back().find(" FETCH 1 BODY.PEEK[2]<0.18>") != string::npos);
+    BOOST_CHECK(diff.content() == "Hello wor");
+
+    srv.script("FETCH", section_reply("BODY[2]<0>", "SGVsbG8gd29y\r\nbGQh"));
+    mime whole;
+    conn.fetch_part(1, body.parts[1], whole, false, 0, 100);
+    BOOST_CHECK(whole.content() == "Hello world!");
+}
+
+
+/**
+Reusing an idle session after checking it by `NOOP`, and replacing it by a new one if the check fails.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(pool_reuse_checked)
+{
+    mock_imap srv(true, {});
+    imaps_pool pool(2, milliseconds(60000));
+    {
+        auto session = pool.lease(pool_params(srv));
+        session->select("INBOX");
+        BOOST_CHECK(pool.idle_sessions() == 0);
+    }
+    BOOST_CHECK(pool.idle_sessions() == 1);
+    BOOST_CHECK(count_commands(srv, "NOOP") == 0);
+
+    {
+        auto session = pool.lease(pool_params(srv));
+        BOOST_CHECK(count_commands(srv, "NOOP") == 1 && count_commands(srv, "LOGIN") == 1);
+        BOOST_CHECK(pool.idle_sessions() == 0);
+    }
+    auto stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 1 && stat.misses == 1 && stat.failed_checks == 0 && stat.evictions == 0);
+    BOOST_CHECK(pool.idle_sessions() == 1);
+
+    srv.script("NOOP", {"$TAG NO Session expired"});
+    {
+        auto session = pool.lease(pool_params(srv));
+        BOOST_CHECK(count_commands(srv, "NOOP") == 2 && count_commands(srv, "LOGIN") == 2);
+    }
+    stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 1 && stat.misses == 2 && stat.failed_checks == 1 && stat.evictions == 0);
+    BOOST_CHECK(pool.idle_sessions() == 1);
+}
+
+
+/**
+Limiting the sessions open towards a server, with the wait for a returned session running out, and closing an invalidated session.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(pool_server_cap)
+{
+    mock_imap srv(true, {});
+    imaps_pool pool(2, milliseconds(60000), milliseconds(0), milliseconds(100));
+    {
+        auto first = pool.lease(pool_params(srv));
+        auto second = pool.lease(pool_params(srv));
+        BOOST_CHECK_THROW(pool.lease(pool_params(srv)), pool_error);
+        second.invalidate();
+    }
+    auto stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 0 && stat.misses == 2 && stat.failed_checks == 0 && stat.evictions == 0);
+    BOOST_CHECK(pool.idle_sessions() == 1);
+
+    {
+        // the invalidated session made a room for a new one
+        auto first = pool.lease(pool_params(srv));
+        auto second = pool.lease(pool_params(srv));
+    }
+    stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 1 && stat.misses == 3 && stat.failed_checks == 0 && stat.evictions == 0);
+    BOOST_CHECK(pool.idle_sessions() == 2);
+}
+
+
+/**
+Closing the least recently used idle session with other parameters to make a room for a new session towards the same server.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(pool_evict_other_params)
+{
+    mock_imap srv(true, {});
+    imaps_pool pool(2, milliseconds(60000));
+    {
+        auto first = pool.lease(pool_params(srv, "first"));
+    }
+    {
+        auto second = pool.lease(pool_params(srv, "second"));
+    }
+    BOOST_CHECK(pool.idle_sessions() == 2);
+
+    {
+        auto third = pool.lease(pool_params(srv, "third"));
+        BOOST_CHECK(pool.idle_sessions() == 1);
+    }
+    auto stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 0 && stat.misses == 3 && stat.failed_checks == 0 && stat.evictions == 1);
+    BOOST_CHECK(pool.idle_sessions() == 2);
+
+    // the first session is evicted, so the second one is still idle
+    {
+        auto second = pool.lease(pool_params(srv, "second"));
+    }
+    stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 1 && stat.misses == 3 && stat.failed_checks == 0 && stat.evictions == 1);
+    BOOST_CHECK(pool.idle_sessions() == 2);
+}
+
+
+/**
+Closing the sessions idle longer than the idle timeout, either explicitly or when leasing.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(pool_idle_timeout)
+{
+    mock_imap srv(true, {});
+    imaps_pool pool(2, milliseconds(50));
+    {
+        auto first = pool.lease(pool_params(srv));
+        auto second = pool.lease(pool_params(srv));
+    }
+    BOOST_CHECK(pool.idle_sessions() == 2);
+    sleep_for(milliseconds(100));
+    BOOST_CHECK(pool.evict_idle() == 2);
+    auto stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 0 && stat.misses == 2 && stat.failed_checks == 0 && stat.evictions == 2);
+    BOOST_CHECK(pool.idle_sessions() == 0);
+
+    {
+        auto session = pool.lease(pool_params(srv));
+    }
+    sleep_for(milliseconds(100));
+    {
+        auto session = pool.lease(pool_params(srv));
+    }
+    stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 0 && stat.misses == 4 && stat.failed_checks == 0 && stat.evictions == 3);
+    BOOST_CHECK(pool.idle_sessions() == 1);
+}
+
+
+/**
+Keeping the number of open sessions when creating a session fails, so the failed ones do not exhaust the pool.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(pool_create_failure)
+{
+    mock_imap srv(true, {});
+    imaps_pool pool(1, milliseconds(60000), milliseconds(0), milliseconds(100));
+    srv.script("LOGIN", {"$TAG NO Authentication failed"});
+    BOOST_CHECK_THROW(pool.lease(pool_params(srv)), imap_error);
+    BOOST_CHECK_THROW(pool.lease(pool_params(srv)), imap_error);
+    auto stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 0 && stat.misses == 2 && stat.failed_checks == 0 && stat.evictions == 0);
+    BOOST_CHECK(pool.idle_sessions() == 0);
+
+    srv.script("LOGIN", {"$TAG OK LOGIN completed"});
+    {
+        auto session = pool.lease(pool_params(srv));
+    }
+    stat = pool.statistics();
+    BOOST_CHECK(stat.hits == 0 && stat.misses == 3 && stat.failed_checks == 0 && stat.evictions == 0);
+    BOOST_CHECK(pool.idle_sessions() == 1);
+}
+
+
+/**
+Escaping the leading dots of the lines across the chunks of the data buffer, both by the blocking and the asynchronous submission.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(submit_dot_stuffing)
+{
+    mock_smtp srv(false);
+    auto ios = make_shared<boost::asio::io_context>();
+    smtp conn("127.0.0.1", srv.port(), milliseconds(5000), ios);
+    conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+    string body;
+    message msg = dotted_message(body);
+    // the data buffer is of 64 KiB
+    BOOST_CHECK(body.length() > 3 * 65536);
+
+    conn.submit(msg);
+    string reply;
+    bool failed = true;
+    conn.async_submit(msg, [&reply, &failed](exception_ptr exc, string async_reply)
+        {
+            failed = bool(exc);
+            reply = async_reply;
+        });
+    ios->restart();
+    ios->run();
+    BOOST_CHECK(!failed && reply == "2.0.0 OK queued as 2");
+
+    vector<string> messages = srv.messages();
+    BOOST_REQUIRE(messages.size() == 2);
+    for (const auto& received : messages)
+        BOOST_CHECK(received.find("\r\n\r\n" + body + "\r\n") != string::npos);
+}
+
+
+/**
+Sending the message to the accepted recipients and storing the rejected one, with and without the command pipelining.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(submit_rejected_recipient)
+{
+    for (bool pipelining : {true, false})
+    {
+        mock_smtp srv(false);
+        script_pipelining(srv, pipelining);
+        srv.reject_recipient("first@mailio.dev");
+        auto ios = make_shared<boost::asio::io_context>();
+        smtp conn("127.0.0.1", srv.port(), milliseconds(5000), ios);
+        conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+        BOOST_CHECK(conn.pipelining() == pipelining);
+        message msg = two_recipients_message();
+
+        BOOST_CHECK(conn.submit(msg) == "2.0.0 OK queued as 1");
+        BOOST_REQUIRE(conn.rejected_recipients().size() == 1);
+        BOOST_CHECK(conn.rejected_recipients()[0].address == "first@mailio.dev" && conn.rejected_recipients()[0].status == 550 &&
+            conn.rejected_recipients()[0].reply == "5.1.1 Recipient rejected");
+
+        string reply;
+        bool failed = true;
+        conn.async_submit(msg, [&reply, &failed](exception_ptr exc, string async_reply)
+            {
+                failed = bool(exc);
+                reply = async_reply;
+            });
+        ios->restart();
+        ios->run();
+        BOOST_CHECK(!failed && reply == "2.0.0 OK queued as 2");
+        BOOST_REQUIRE(conn.rejected_recipients().size() == 1);
+        BOOST_CHECK(conn.rejected_recipients()[0].address == "first@mailio.dev");
+        BOOST_CHECK(count_smtp_commands(srv, "RCPT") == 4 && count_smtp_commands(srv, "RSET") == 0);
+    }
+}
+
+
+/**
+Aborting the submission if the sender is rejected, without sending the recipients unless they are pipelined.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(submit_rejected_sender)
+{
+    for (bool pipelining : {true, false})
+    {
+        mock_smtp srv(false);
+        script_pipelining(srv, pipelining);
+        srv.script("MAIL", {"550 5.7.1 Sender rejected"});
+        srv.script("DATA", {"554 5.5.1 No valid recipients"});
+        smtp conn("127.0.0.1", srv.port(), milliseconds(5000));
+        conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+
+        BOOST_CHECK_THROW(conn.submit(two_recipients_message()), smtp_error);
+        BOOST_CHECK(conn.rejected_recipients().empty());
+        BOOST_CHECK(count_smtp_commands(srv, "RCPT") == (pipelining ? 2 : 0) && count_smtp_commands(srv, "DATA") == (pipelining ? 1 : 0));
+        BOOST_CHECK(count_smtp_commands(srv, "RSET") == 1 && srv.messages_received() == 0);
+    }
+}
+
+
+/**
+Aborting the submission if all the recipients are rejected, and closing the data with no content if the server accepts it anyway.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(submit_rejected_all_recipients)
+{
+    for (bool pipelining : {true, false})
+    {
+        mock_smtp srv(false);
+        script_pipelining(srv, pipelining);
+        srv.reject_recipient("first@mailio.dev");
+        srv.reject_recipient("second@mailio.dev");
+        smtp conn("127.0.0.1", srv.port(), milliseconds(5000));
+        conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+
+        BOOST_CHECK_THROW(conn.submit(two_recipients_message()), smtp_error);
+        BOOST_CHECK(conn.rejected_recipients().size() == 2);
+        BOOST_CHECK(count_smtp_commands(srv, "RSET") == 1);
+        // the pipelined data is accepted by the mock server, so it gets the empty message
+        vector<string> messages = srv.messages();
+        BOOST_CHECK(messages.size() == (pipelining ? 1 : 0) && count_smtp_commands(srv, "DATA") == (pipelining ? 1 : 0));
+        if (pipelining)
+            BOOST_CHECK(messages.size() == 1 && messages[0].empty());
+    }
+}
+
+
+/**
+Resetting the session after a rejected submission, so the next message is sent over the same connection.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(submit_after_rejection)
+{
+    mock_smtp srv(false);
+    // without the pipelining, the mock server does not get the data of the rejected message
+    script_pipelining(srv, false);
+    smtp conn("127.0.0.1", srv.port(), milliseconds(5000));
+    conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+    message msg = two_recipients_message();
+
+    srv.script("MAIL", {"550 5.7.1 Sender rejected"});
+    BOOST_CHECK_THROW(conn.submit(msg), smtp_error);
+    BOOST_CHECK(count_smtp_commands(srv, "RSET") == 1 && srv.messages_received() == 0);
+
+    srv.script("MAIL", {"250 2.1.0 OK"});
+    BOOST_CHECK(conn.submit(msg) == "2.0.0 OK queued as 1");
+    BOOST_CHECK(count_smtp_commands(srv, "MAIL") == 2 && count_smtp_commands(srv, "RSET") == 1 && srv.messages_received() == 1);
+
+    conn.reset();
+    BOOST_CHECK(count_smtp_commands(srv, "RSET") == 2);
+    srv.script("RSET", {"421 4.3.0 Service not available"});
+    BOOST_CHECK_THROW(conn.reset(), smtp_error);
+}
+
+
+/**
+Checking the session by the no operation command, which fails on the negative reply and on the closed connection.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(noop_closed_connection)
+{
+    auto srv = make_unique<mock_smtp>(false);
+    smtp conn("127.0.0.1", srv->port(), milliseconds(5000));
+    conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+    BOOST_CHECK(conn.noop());
+    srv->script("NOOP", {"421 4.3.0 Service not available"});
+    BOOST_CHECK(!conn.noop());
+
+    srv.reset();
+    BOOST_CHECK(!conn.noop());
+}
+
+
+/**
+Selecting and searching a mailbox without blocking, the search being started by the completion handler of the selection.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(async_imap_callback)
+{
+    mock_imap srv(false, {"Subject: first\r\n\r\nHello\r\n", "Subject: second\r\n\r\nWorld\r\n"});
+    auto ios = make_shared<boost::asio::io_context>();
+    imap conn("127.0.0.1", srv.port(), milliseconds(5000), ios);
+    conn.authenticate("mailio", "mailiopass", imap::auth_method_t::LOGIN);
+
+    unsigned long messages_no = 0;
+    list<unsigned long> found;
+    bool failed = true;
+    conn.async_select("INBOX", false, [&conn, &messages_no, &found, &failed](exception_ptr exc, imap::mailbox_stat_t stat)
+        {
+            if (exc)
+                return;
+            messages_no = stat.messages_no;
+            conn.async_search({imap::search_condition_t(imap::search_condition_t::ALL)}, false,
+                [&found, &failed](exception_ptr exc, list<unsigned long> msg_nos)
+                {
+                    failed = bool(exc);
+                    found = msg_nos;
+                });
+        });
+    ios->restart();
+    ios->run();
+    BOOST_CHECK(!failed && messages_no == 2);
+    BOOST_CHECK(found == list<unsigned long>({1, 2}));
+    BOOST_CHECK(count_commands(srv, "SELECT") == 1 && count_commands(srv, "SEARCH") == 1);
+}
+
+
+/**
+Fetching a message without blocking by the future, with the error thrown by the future.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(async_pop3_future)
+{
+    mock_pop3 srv(false, {"Subject: first\r\n\r\nHello\r\n", "Subject: second\r\n\r\nWorld\r\n"});
+    auto ios = make_shared<boost::asio::io_context>();
+    pop3 conn("127.0.0.1", srv.port(), milliseconds(5000), ios);
+    conn.authenticate("mailio", "mailiopass", pop3::auth_method_t::LOGIN);
+
+    future<message> fetched = conn.async_fetch(2, false, codec::line_len_policy_t::RECOMMENDED, use_future);
+    // the context is run by a single thread while the future is waited on
+    ios->restart();
+    thread runner([ios]() { ios->run(); });
+    message msg = fetched.get();
+    runner.join();
+    BOOST_CHECK(msg.subject() == "second");
+
+    fetched = conn.async_fetch(3, false, codec::line_len_policy_t::RECOMMENDED, use_future);
+    ios->restart();
+    runner = thread([ios]() { ios->run(); });
+    BOOST_CHECK_THROW(fetched.get(), pop3_error);
+    runner.join();
+}
+
+
+/**
+Submitting messages without blocking by the future, the second one being rejected.
+
+@pre  None.
+@post None.
+**/
+BOOST_AUTO_TEST_CASE(async_smtp_future)
+{
+    mock_smtp srv(false);
+    auto ios = make_shared<boost::asio::io_context>();
+    smtp conn("127.0.0.1", srv.port(), milliseconds(5000), ios);
+    conn.authenticate("mailio", "secret", smtp::auth_method_t::LOGIN);
+    message msg = two_recipients_message();
+
+    future<string> reply = conn.async_submit(msg, use_future);
+    ios->restart();
+    thread runner([ios]() { ios->run(); });
+    BOOST_CHECK(reply.get() == "2.0.0 OK queued as 1");
+    runner.join();
+
+    srv.script("DATA", {"554 5.5.1 No valid recipients"});
+    reply = conn.async_submit(msg, use_future);
+    ios->restart();
+    runner = thread([ios]() { ios->run(); });
+    BOOST_CHECK_THROW(reply.get(), smtp_error);
+    runner.join();
+    BOOST_CHECK(count_smtp_commands(srv, "RSET") == 1 && srv.messages_received() == 1);
+}